@@ -125,7 +125,12 @@ INSTANTIATE_TEST_CASE_P(
     Integration, Correctness,
     testing::Combine(testing::Values(true, false),
                      testing::Values(DataStructure::Raw, DataStructure::Gcs,
-                                     DataStructure::BloomFilter)),
+                                     DataStructure::BloomFilter,
+                                     DataStructure::BlockedBloomFilter,
+                                     DataStructure::BinaryFuseFilter,
+                                     DataStructure::EliasFano,
+                                     DataStructure::RansSet,
+                                     DataStructure::RawFingerprints)),
     [](const testing::TestParamInfo<Correctness::ParamType> &info) {
       bool reveal_intersection = std::get<0>(info.param);
       DataStructure ds = std::get<1>(info.param);
@@ -140,6 +145,21 @@ INSTANTIATE_TEST_CASE_P(
         case DataStructure::BloomFilter:
           ds_name = "bloomfilter";
           break;
+        case DataStructure::BlockedBloomFilter:
+          ds_name = "blockedbloomfilter";
+          break;
+        case DataStructure::BinaryFuseFilter:
+          ds_name = "binaryfusefilter";
+          break;
+        case DataStructure::EliasFano:
+          ds_name = "eliasfano";
+          break;
+        case DataStructure::RansSet:
+          ds_name = "ransset";
+          break;
+        case DataStructure::RawFingerprints:
+          ds_name = "rawfingerprints";
+          break;
         default: {
           throw std::logic_error("Bad enum variant");
         }
@@ -0,0 +1,87 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_BATCH_CIPHER_H_
+#define PRIVATE_SET_INTERSECTION_CPP_BATCH_CIPHER_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// How a `BatchCipher` encodes the points of ciphertexts.
+enum class EcPointEncoding {
+  // SEC1 compressed points of 33 bytes.
+  kCompressed,
+  // The 32-byte big-endian x-coordinate alone. A point and its negation have
+  // the same x-coordinate and so do their multiples, so ciphertexts are still
+  // commutative; decoding just skips recovering the sign of y.
+  kXOnly,
+};
+
+// Returns the encoding of `BatchCipher` for `point_encoding`, which must be
+// valid.
+inline EcPointEncoding CipherEncoding(psi_proto::PointEncoding point_encoding) {
+  return point_encoding == psi_proto::POINT_ENCODING_X_ONLY
+             ? EcPointEncoding::kXOnly
+             : EcPointEncoding::kCompressed;
+}
+
+// Commutative encryption of whole batches of elements, on the curve and with
+// the hash of a cipher suite (see `cipher_suite.h`). Implementations are never
+// modified after creation and can be shared by any number of threads.
+class BatchCipher {
+ public:
+  virtual ~BatchCipher() = default;
+
+  // Returns `H(x)^k` for each element `x` of `plaintexts`, where `k` is the
+  // key and `H` the suite's hash to the curve, in the same order and in
+  // `encoding`.
+  virtual StatusOr<std::vector<std::string>> EncryptBatch(
+      absl::Span<const std::string> plaintexts,
+      EcPointEncoding encoding) const = 0;
+
+  // Returns `c^k` for each encrypted element `c` of `ciphertexts`, which are
+  // read and written in `encoding`.
+  //
+  // Returns INVALID_ARGUMENT if any element is not a point of the curve in
+  // `encoding`.
+  virtual StatusOr<std::vector<std::string>> ReEncryptBatch(
+      absl::Span<const std::string> ciphertexts,
+      EcPointEncoding encoding) const = 0;
+
+  // Returns `c^(1/k)` for each encrypted element `c` of `ciphertexts`, which
+  // are read and written in `encoding`.
+  //
+  // Returns INVALID_ARGUMENT if any element is not a point of the curve in
+  // `encoding`.
+  virtual StatusOr<std::vector<std::string>> DecryptBatch(
+      absl::Span<const std::string> ciphertexts,
+      EcPointEncoding encoding) const = 0;
+
+  // Returns the private key the cipher was created with.
+  virtual std::string GetPrivateKeyBytes() const = 0;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_BATCH_CIPHER_H_
@@ -0,0 +1,62 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/cipher_suite.h"
+
+#include "absl/status/status.h"
+#include "private_set_intersection/cpp/crypto/p256_batch_cipher.h"
+#include "private_set_intersection/cpp/crypto/sm2_batch_cipher.h"
+
+namespace private_set_intersection {
+
+/**
+ * @brief Creates a batch cipher of a suite with a new key
+ *
+ * @param cipher_suite The curve and hash of the cipher
+ * @return StatusOr<std::unique_ptr<BatchCipher>>
+ */
+StatusOr<std::unique_ptr<BatchCipher>> CreateBatchCipherWithNewKey(
+    psi_proto::CipherSuite cipher_suite) {
+  switch (cipher_suite) {
+    case psi_proto::CIPHER_SUITE_SM2_SM3:
+      return Sm2BatchCipher::CreateWithNewKey();
+    case psi_proto::CIPHER_SUITE_P256_SHA256:
+      return P256BatchCipher::CreateWithNewKey();
+    default:
+      return absl::InvalidArgumentError("Unknown `cipher_suite`");
+  }
+}
+
+/**
+ * @brief Creates a batch cipher of a suite from a key
+ *
+ * @param cipher_suite The curve and hash of the cipher
+ * @param key_bytes The big-endian private key
+ * @return StatusOr<std::unique_ptr<BatchCipher>>
+ */
+StatusOr<std::unique_ptr<BatchCipher>> CreateBatchCipherFromKey(
+    psi_proto::CipherSuite cipher_suite, absl::string_view key_bytes) {
+  switch (cipher_suite) {
+    case psi_proto::CIPHER_SUITE_SM2_SM3:
+      return Sm2BatchCipher::CreateFromKey(key_bytes);
+    case psi_proto::CIPHER_SUITE_P256_SHA256:
+      return P256BatchCipher::CreateFromKey(key_bytes);
+    default:
+      return absl::InvalidArgumentError("Unknown `cipher_suite`");
+  }
+}
+
+}  // namespace private_set_intersection
@@ -0,0 +1,50 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_CIPHER_SUITE_H_
+#define PRIVATE_SET_INTERSECTION_CPP_CIPHER_SUITE_H_
+
+#include <memory>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// Creates a batch cipher of `cipher_suite` with a fresh key:
+// `Sm2BatchCipher` for CIPHER_SUITE_SM2_SM3 and `P256BatchCipher` for
+// CIPHER_SUITE_P256_SHA256.
+//
+// Returns INVALID_ARGUMENT if `cipher_suite` is unknown, or INTERNAL if any
+// OpenSSL crypto operations fail.
+StatusOr<std::unique_ptr<BatchCipher>> CreateBatchCipherWithNewKey(
+    psi_proto::CipherSuite cipher_suite);
+
+// Creates a batch cipher of `cipher_suite` with the big-endian private key
+// `key_bytes`.
+//
+// Returns INVALID_ARGUMENT if `cipher_suite` is unknown or the key is not in
+// [1, n) for the order n of the suite's curve.
+StatusOr<std::unique_ptr<BatchCipher>> CreateBatchCipherFromKey(
+    psi_proto::CipherSuite cipher_suite, absl::string_view key_bytes);
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_CIPHER_SUITE_H_
@@ -0,0 +1,81 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "private_set_intersection/cpp/crypto/cipher_suite.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+constexpr EcPointEncoding kCompressed = EcPointEncoding::kCompressed;
+
+TEST(CipherSuiteTest, TestRoundTripOfEachSuite) {
+  const std::vector<std::string> plaintexts = {"a", "b", "c"};
+  for (auto cipher_suite : {psi_proto::CIPHER_SUITE_SM2_SM3,
+                            psi_proto::CIPHER_SUITE_P256_SHA256}) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto cipher,
+                             CreateBatchCipherWithNewKey(cipher_suite));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto from_key,
+        CreateBatchCipherFromKey(cipher_suite, cipher->GetPrivateKeyBytes()));
+    PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                             cipher->EncryptBatch(plaintexts, kCompressed));
+    PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                             from_key->EncryptBatch(plaintexts, kCompressed));
+    EXPECT_EQ(encrypted, expected);
+    PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted,
+                             cipher->ReEncryptBatch(encrypted, kCompressed));
+    PSI_ASSERT_OK_AND_ASSIGN(auto decrypted,
+                             cipher->DecryptBatch(reencrypted, kCompressed));
+    EXPECT_EQ(decrypted, encrypted);
+  }
+}
+
+TEST(CipherSuiteTest, TestSuitesDiffer) {
+  // The same key encrypts to different points on the two curves.
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto sm2, CreateBatchCipherWithNewKey(psi_proto::CIPHER_SUITE_SM2_SM3));
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto p256, CreateBatchCipherFromKey(psi_proto::CIPHER_SUITE_P256_SHA256,
+                                          sm2->GetPrivateKeyBytes()));
+  PSI_ASSERT_OK_AND_ASSIGN(auto sm2_encrypted,
+                           sm2->EncryptBatch({"a"}, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto p256_encrypted,
+                           p256->EncryptBatch({"a"}, kCompressed));
+  EXPECT_NE(sm2_encrypted, p256_encrypted);
+}
+
+TEST(CipherSuiteTest, TestUnknownSuite) {
+  for (const auto unknown : {psi_proto::CIPHER_SUITE_UNSPECIFIED,
+                             static_cast<psi_proto::CipherSuite>(7)}) {
+    EXPECT_EQ(CreateBatchCipherWithNewKey(unknown).status().code(),
+              absl::StatusCode::kInvalidArgument);
+    EXPECT_EQ(CreateBatchCipherFromKey(unknown, std::string(32, '\x01'))
+                  .status()
+                  .code(),
+              absl::StatusCode::kInvalidArgument);
+  }
+}
+
+}  // namespace
+}  // namespace private_set_intersection
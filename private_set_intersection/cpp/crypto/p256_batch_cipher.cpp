@@ -0,0 +1,188 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/p256_batch_cipher.h"
+
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "openssl/obj_mac.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+using ::private_join_and_compute::ECCommutativeCipher;
+
+// Size of an x-coordinate of P-256.
+constexpr size_t kXOnlySize = 32;
+
+// Returns `point`, which is in `encoding`, as a SEC1 compressed point. Either
+// point with an x-coordinate will do, since only the x-coordinates of their
+// multiples are kept.
+StatusOr<std::string> ToCompressed(const std::string& point,
+                                   EcPointEncoding encoding) {
+  if (encoding == EcPointEncoding::kCompressed) {
+    return point;
+  }
+  if (point.size() != kXOnlySize) {
+    return absl::InvalidArgumentError(
+        "P256BatchCipher: x-coordinate has the wrong size");
+  }
+  return std::string(1, '\x02') + point;
+}
+
+// Converts the SEC1 compressed `point` into `encoding` in place.
+void FromCompressed(EcPointEncoding encoding, std::string* point) {
+  if (encoding == EcPointEncoding::kXOnly) {
+    point->erase(0, 1);
+  }
+}
+
+}  // namespace
+
+/**
+ * @brief Construct a new P256 Batch Cipher:: P256 Batch Cipher object
+ *
+ * @param key_bytes The private key as it was passed in
+ */
+P256BatchCipher::P256BatchCipher(std::string key_bytes)
+    : key_bytes_(std::move(key_bytes)) {}
+
+/**
+ * @brief Creates a cipher with a fresh key
+ *
+ * @return StatusOr<std::unique_ptr<P256BatchCipher>>
+ */
+StatusOr<std::unique_ptr<P256BatchCipher>>
+P256BatchCipher::CreateWithNewKey() {
+  auto ec_cipher = ECCommutativeCipher::CreateWithNewKey(
+      NID_X9_62_prime256v1, ECCommutativeCipher::HashType::SHA256);
+  if (!ec_cipher.ok()) {
+    return ec_cipher.status();
+  }
+  return absl::WrapUnique(
+      new P256BatchCipher((*ec_cipher)->GetPrivateKeyBytes()));
+}
+
+/**
+ * @brief Creates a cipher from a key, checking that it is in range
+ *
+ * @param key_bytes The big-endian private key
+ * @return StatusOr<std::unique_ptr<P256BatchCipher>>
+ */
+StatusOr<std::unique_ptr<P256BatchCipher>> P256BatchCipher::CreateFromKey(
+    absl::string_view key_bytes) {
+  if (key_bytes.size() > 32) {
+    return absl::InvalidArgumentError("P256BatchCipher: key is too long");
+  }
+  auto cipher = absl::WrapUnique(new P256BatchCipher(std::string(key_bytes)));
+  auto ec_cipher = cipher->CreateEcCipher();
+  if (!ec_cipher.ok()) {
+    return ec_cipher.status();
+  }
+  return cipher;
+}
+
+/**
+ * @brief Creates an EC cipher with the key for the calling thread
+ *
+ * @return StatusOr<std::unique_ptr<ECCommutativeCipher>>
+ */
+StatusOr<std::unique_ptr<ECCommutativeCipher>>
+P256BatchCipher::CreateEcCipher() const {
+  return ECCommutativeCipher::CreateFromKey(
+      NID_X9_62_prime256v1, key_bytes_, ECCommutativeCipher::HashType::SHA256);
+}
+
+/**
+ * @brief Hashes each plaintext to the curve and encrypts it with the key
+ *
+ * @param plaintexts The elements to encrypt
+ * @param encoding How to encode the ciphertexts
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> P256BatchCipher::EncryptBatch(
+    absl::Span<const std::string> plaintexts,
+    EcPointEncoding encoding) const {
+  ASSIGN_OR_RETURN(auto ec_cipher, CreateEcCipher());
+  std::vector<std::string> result(plaintexts.size());
+  for (size_t i = 0; i < plaintexts.size(); i++) {
+    ASSIGN_OR_RETURN(result[i], ec_cipher->Encrypt(plaintexts[i]));
+    FromCompressed(encoding, &result[i]);
+  }
+  return result;
+}
+
+/**
+ * @brief Encrypts each ciphertext again with the key
+ *
+ * @param ciphertexts The encoded points to re-encrypt
+ * @param encoding How the points are encoded
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> P256BatchCipher::ReEncryptBatch(
+    absl::Span<const std::string> ciphertexts,
+    EcPointEncoding encoding) const {
+  return MultiplyBatch(ciphertexts, encoding, /*inverse=*/false);
+}
+
+/**
+ * @brief Removes one layer of encryption with the key from each ciphertext
+ *
+ * @param ciphertexts The encoded points to decrypt
+ * @param encoding How the points are encoded
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> P256BatchCipher::DecryptBatch(
+    absl::Span<const std::string> ciphertexts,
+    EcPointEncoding encoding) const {
+  return MultiplyBatch(ciphertexts, encoding, /*inverse=*/true);
+}
+
+/**
+ * @brief Multiplies each encoded point by the key or its inverse
+ *
+ * @param ciphertexts The encoded points
+ * @param encoding How the points are encoded
+ * @param inverse Whether to decrypt rather than re-encrypt
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> P256BatchCipher::MultiplyBatch(
+    absl::Span<const std::string> ciphertexts, EcPointEncoding encoding,
+    bool inverse) const {
+  ASSIGN_OR_RETURN(auto ec_cipher, CreateEcCipher());
+  std::vector<std::string> result(ciphertexts.size());
+  for (size_t i = 0; i < ciphertexts.size(); i++) {
+    ASSIGN_OR_RETURN(std::string point,
+                     ToCompressed(ciphertexts[i], encoding));
+    ASSIGN_OR_RETURN(result[i], inverse ? ec_cipher->Decrypt(point)
+                                        : ec_cipher->ReEncrypt(point));
+    FromCompressed(encoding, &result[i]);
+  }
+  return result;
+}
+
+/**
+ * @brief Get the private key of the cipher
+ *
+ * @return The big-endian private key
+ */
+std::string P256BatchCipher::GetPrivateKeyBytes() const { return key_bytes_; }
+
+}  // namespace private_set_intersection
@@ -0,0 +1,90 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_P256_BATCH_CIPHER_H_
+#define PRIVATE_SET_INTERSECTION_CPP_P256_BATCH_CIPHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// Commutative encryption over NIST P-256, hashing elements to the curve with
+// SHA-256. Every element goes through `ECCommutativeCipher`, whose P-256
+// arithmetic and SHA-256 are BoringSSL's assembly implementations, so the
+// ciphertexts are byte-for-byte those of `ECCommutativeCipher` with the same
+// key.
+//
+// An `ECCommutativeCipher` keeps scratch space for its arithmetic and must not
+// be shared between threads. This cipher only holds the key and creates one
+// for each call, which costs far less than a batch of point multiplications.
+class P256BatchCipher : public BatchCipher {
+ public:
+  P256BatchCipher() = delete;
+
+  // Creates a cipher with a fresh key.
+  //
+  // Returns INTERNAL if any OpenSSL crypto operations fail.
+  static StatusOr<std::unique_ptr<P256BatchCipher>> CreateWithNewKey();
+
+  // Creates a cipher with the big-endian private key `key_bytes`.
+  //
+  // Returns INVALID_ARGUMENT if the key is not in [1, n).
+  static StatusOr<std::unique_ptr<P256BatchCipher>> CreateFromKey(
+      absl::string_view key_bytes);
+
+  StatusOr<std::vector<std::string>> EncryptBatch(
+      absl::Span<const std::string> plaintexts,
+      EcPointEncoding encoding) const override;
+
+  StatusOr<std::vector<std::string>> ReEncryptBatch(
+      absl::Span<const std::string> ciphertexts,
+      EcPointEncoding encoding) const override;
+
+  StatusOr<std::vector<std::string>> DecryptBatch(
+      absl::Span<const std::string> ciphertexts,
+      EcPointEncoding encoding) const override;
+
+  std::string GetPrivateKeyBytes() const override;
+
+ private:
+  explicit P256BatchCipher(std::string key_bytes);
+
+  // Returns an `ECCommutativeCipher` with the key, for use by a single call.
+  StatusOr<std::unique_ptr<::private_join_and_compute::ECCommutativeCipher>>
+  CreateEcCipher() const;
+
+  // Re-encrypts each of `ciphertexts`, which are read and written in
+  // `encoding`, with the key, or decrypts them if `inverse` is true.
+  StatusOr<std::vector<std::string>> MultiplyBatch(
+      absl::Span<const std::string> ciphertexts, EcPointEncoding encoding,
+      bool inverse) const;
+
+  std::string key_bytes_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_P256_BATCH_CIPHER_H_
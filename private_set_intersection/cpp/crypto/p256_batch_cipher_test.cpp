@@ -0,0 +1,139 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "private_set_intersection/cpp/crypto/p256_batch_cipher.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "openssl/obj_mac.h"
+#include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+
+namespace private_set_intersection {
+namespace {
+
+using ::private_join_and_compute::ECCommutativeCipher;
+
+constexpr EcPointEncoding kCompressed = EcPointEncoding::kCompressed;
+constexpr EcPointEncoding kXOnly = EcPointEncoding::kXOnly;
+
+class P256BatchCipherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    PSI_ASSERT_OK_AND_ASSIGN(cipher_, P256BatchCipher::CreateWithNewKey());
+    PSI_ASSERT_OK_AND_ASSIGN(
+        reference_, ECCommutativeCipher::CreateFromKey(
+                        NID_X9_62_prime256v1, cipher_->GetPrivateKeyBytes(),
+                        ECCommutativeCipher::HashType::SHA256));
+    for (int i = 0; i < 100; i++) {
+      plaintexts_.push_back(absl::StrCat("Element ", i));
+    }
+  }
+
+  std::unique_ptr<P256BatchCipher> cipher_;
+  std::unique_ptr<ECCommutativeCipher> reference_;
+  std::vector<std::string> plaintexts_;
+};
+
+TEST_F(P256BatchCipherTest, TestMatchesElementwiseCipher) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  ASSERT_EQ(encrypted.size(), plaintexts_.size());
+  for (size_t i = 0; i < plaintexts_.size(); i++) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                             reference_->Encrypt(plaintexts_[i]));
+    EXPECT_EQ(encrypted[i], expected);
+  }
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted,
+                           cipher_->ReEncryptBatch(encrypted, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto decrypted,
+                           cipher_->DecryptBatch(reencrypted, kCompressed));
+  for (size_t i = 0; i < encrypted.size(); i++) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                             reference_->ReEncrypt(encrypted[i]));
+    EXPECT_EQ(reencrypted[i], expected);
+  }
+  EXPECT_EQ(decrypted, encrypted);
+}
+
+TEST_F(P256BatchCipherTest, TestXOnlyMatchesCompressed) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto compressed,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch(plaintexts_, kXOnly));
+  ASSERT_EQ(encrypted.size(), compressed.size());
+  for (size_t i = 0; i < encrypted.size(); i++) {
+    EXPECT_EQ(encrypted[i], compressed[i].substr(1));
+  }
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted_compressed,
+                           cipher_->ReEncryptBatch(compressed, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted,
+                           cipher_->ReEncryptBatch(encrypted, kXOnly));
+  for (size_t i = 0; i < encrypted.size(); i++) {
+    EXPECT_EQ(reencrypted[i], reencrypted_compressed[i].substr(1));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto decrypted,
+                           cipher_->DecryptBatch(reencrypted, kXOnly));
+  EXPECT_EQ(decrypted, encrypted);
+
+  // Compressed points are not x-coordinates.
+  EXPECT_EQ(cipher_->ReEncryptBatch(compressed, kXOnly).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(P256BatchCipherTest, TestEmptyBatch) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch({}, kCompressed));
+  EXPECT_TRUE(encrypted.empty());
+}
+
+TEST_F(P256BatchCipherTest, TestInvalidPoint) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  encrypted[7] = "not a point";
+  auto result = cipher_->ReEncryptBatch(encrypted, kCompressed);
+  EXPECT_EQ(result.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(P256BatchCipherTest, TestCreateFromKey) {
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto from_key,
+      P256BatchCipher::CreateFromKey(cipher_->GetPrivateKeyBytes()));
+  EXPECT_EQ(from_key->GetPrivateKeyBytes(), cipher_->GetPrivateKeyBytes());
+  PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           from_key->EncryptBatch(plaintexts_, kCompressed));
+  EXPECT_EQ(encrypted, expected);
+
+  EXPECT_EQ(P256BatchCipher::CreateFromKey(std::string(33, '\x01'))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(P256BatchCipher::CreateFromKey(std::string(32, '\0'))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
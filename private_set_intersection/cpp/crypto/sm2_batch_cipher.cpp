@@ -0,0 +1,257 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_batch_cipher.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "openssl/rand.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+// Number of points normalized together. Larger batches amortize the field
+// inversion further but hold more intermediate points in memory.
+constexpr size_t kNormalizeBatchSize = 1024;
+
+// The parts of a cipher that do not depend on its key. Creating the hasher
+// checks it against BoringSSL on a few probe messages, which costs far more
+// than the rest of a cipher.
+struct SharedCurve {
+  Sm2Group group;
+  std::unique_ptr<Sm2HashToCurve> hash_to_curve;
+};
+
+// Returns the curve shared by all ciphers, building it on the first call. It
+// is never freed, so that ciphers alive during static destruction can still
+// use it.
+StatusOr<const SharedCurve*> GetSharedCurve() {
+  static const auto* const curve =
+      new StatusOr<const SharedCurve*>([]() -> StatusOr<const SharedCurve*> {
+        auto curve = absl::make_unique<SharedCurve>();
+        auto hash_to_curve = Sm2HashToCurve::Create(
+            curve->group, Sm2BatchCipher::kHashToCurveDst);
+        if (!hash_to_curve.ok()) {
+          return hash_to_curve.status();
+        }
+        curve->hash_to_curve = std::move(*hash_to_curve);
+        return curve.release();
+      }());
+  return *curve;
+}
+
+}  // namespace
+
+/**
+ * @brief Construct a new Sm2 Batch Cipher:: Sm2 Batch Cipher object
+ *
+ * @param group The shared SM2 group
+ * @param hash_to_curve The shared hasher for plaintexts
+ * @param key_bytes The private key as it was passed in
+ * @param key The recoded private key
+ * @param inverse_key The recoded inverse of the private key modulo the order
+ */
+Sm2BatchCipher::Sm2BatchCipher(const Sm2Group& group,
+                               const Sm2HashToCurve& hash_to_curve,
+                               std::string key_bytes, const RecodedScalar& key,
+                               const RecodedScalar& inverse_key)
+    : group_(group),
+      hash_to_curve_(hash_to_curve),
+      key_bytes_(std::move(key_bytes)),
+      key_(key),
+      inverse_key_(inverse_key) {}
+
+/**
+ * @brief Draws random 256-bit keys until one is in [1, n). SM2's n is just
+ * below 2^256, so a draw is rejected with probability about 2^-32.
+ *
+ * @return StatusOr<std::unique_ptr<Sm2BatchCipher>>
+ */
+StatusOr<std::unique_ptr<Sm2BatchCipher>> Sm2BatchCipher::CreateWithNewKey() {
+  StatusOr<const SharedCurve*> curve = GetSharedCurve();
+  if (!curve.ok()) {
+    return curve.status();
+  }
+  const MontgomeryField& scalars = (*curve)->group.scalar_field();
+  uint8_t key_bytes[32];
+  U256 key;
+  do {
+    if (RAND_bytes(key_bytes, sizeof(key_bytes)) != 1) {
+      return absl::InternalError("Sm2BatchCipher: RAND_bytes failed");
+    }
+    key = U256FromBytes(key_bytes);
+  } while (MontgomeryField::IsZeroMask(key) ||
+           !U256LessThanMask(key, scalars.modulus()));
+  return CreateFromKey(absl::string_view(
+      reinterpret_cast<const char*>(key_bytes), sizeof(key_bytes)));
+}
+
+/**
+ * @brief Creates a cipher with the key of an SM2 cipher
+ *
+ * @param ec_cipher The SM2 cipher holding the key
+ * @return StatusOr<std::unique_ptr<Sm2BatchCipher>>
+ */
+StatusOr<std::unique_ptr<Sm2BatchCipher>> Sm2BatchCipher::Create(
+    std::unique_ptr<::private_join_and_compute::ECCommutativeCipher>
+        ec_cipher) {
+  return CreateFromKey(ec_cipher->GetPrivateKeyBytes());
+}
+
+/**
+ * @brief Recodes a key and its inverse, borrowing the shared group and hasher
+ *
+ * @param key_bytes The big-endian private key
+ * @return StatusOr<std::unique_ptr<Sm2BatchCipher>>
+ */
+StatusOr<std::unique_ptr<Sm2BatchCipher>> Sm2BatchCipher::CreateFromKey(
+    absl::string_view key_bytes) {
+  if (key_bytes.size() > 32) {
+    return absl::InvalidArgumentError("Sm2BatchCipher: key is too long");
+  }
+  uint8_t padded[32] = {};
+  std::copy(key_bytes.begin(), key_bytes.end(),
+            padded + (32 - key_bytes.size()));
+  const U256 key = U256FromBytes(padded);
+
+  StatusOr<const SharedCurve*> curve = GetSharedCurve();
+  if (!curve.ok()) {
+    return curve.status();
+  }
+  const Sm2Group& group = (*curve)->group;
+  const MontgomeryField& scalars = group.scalar_field();
+  if (MontgomeryField::IsZeroMask(key) ||
+      !U256LessThanMask(key, scalars.modulus())) {
+    return absl::InvalidArgumentError("Sm2BatchCipher: key is out of range");
+  }
+  const U256 inverse_key = scalars.ToInt(scalars.Inv(scalars.FromInt(key)));
+
+  return absl::WrapUnique(new Sm2BatchCipher(
+      group, *(*curve)->hash_to_curve, std::string(key_bytes),
+      group.Recode(key), group.Recode(inverse_key)));
+}
+
+/**
+ * @brief Hashes each plaintext to the curve and encrypts it with the key
+ *
+ * @param plaintexts The elements to encrypt
+ * @param encoding How to encode the ciphertexts
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> Sm2BatchCipher::EncryptBatch(
+    absl::Span<const std::string> plaintexts,
+    EcPointEncoding encoding) const {
+  std::vector<std::string> result(plaintexts.size());
+  std::vector<JacobianPoint> points;
+  for (size_t begin = 0; begin < plaintexts.size();
+       begin += kNormalizeBatchSize) {
+    const auto batch = plaintexts.subspan(begin, kNormalizeBatchSize);
+    points.resize(batch.size());
+    hash_to_curve_.HashBatch(batch, absl::MakeSpan(points));
+    MultiplyAndEncode(absl::MakeSpan(points), key_, encoding, &result[begin]);
+  }
+  return result;
+}
+
+/**
+ * @brief Re-encrypts each ciphertext with the key
+ *
+ * @param ciphertexts The encoded points to re-encrypt
+ * @param encoding How the ciphertexts are encoded
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> Sm2BatchCipher::ReEncryptBatch(
+    absl::Span<const std::string> ciphertexts,
+    EcPointEncoding encoding) const {
+  return MultiplyBatch(ciphertexts, key_, encoding);
+}
+
+/**
+ * @brief Removes the key's layer of encryption from each ciphertext
+ *
+ * @param ciphertexts The encoded points to decrypt
+ * @param encoding How the ciphertexts are encoded
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> Sm2BatchCipher::DecryptBatch(
+    absl::Span<const std::string> ciphertexts,
+    EcPointEncoding encoding) const {
+  return MultiplyBatch(ciphertexts, inverse_key_, encoding);
+}
+
+std::string Sm2BatchCipher::GetPrivateKeyBytes() const {
+  return key_bytes_;
+}
+
+/**
+ * @brief Decodes, multiplies and re-encodes points a batch at a time
+ *
+ * @param points The encoded points
+ * @param scalar The recoded scalar to multiply by
+ * @param encoding How the points are encoded
+ * @return StatusOr<std::vector<std::string>>
+ */
+StatusOr<std::vector<std::string>> Sm2BatchCipher::MultiplyBatch(
+    absl::Span<const std::string> points, const RecodedScalar& scalar,
+    EcPointEncoding encoding) const {
+  std::vector<std::string> result(points.size());
+  std::vector<JacobianPoint> decoded;
+  decoded.reserve(std::min(points.size(), kNormalizeBatchSize));
+  for (size_t begin = 0; begin < points.size(); begin += kNormalizeBatchSize) {
+    const size_t end = std::min(begin + kNormalizeBatchSize, points.size());
+    decoded.clear();
+    for (size_t i = begin; i < end; i++) {
+      ASSIGN_OR_RETURN(JacobianPoint point,
+                       encoding == EcPointEncoding::kXOnly
+                           ? group_.DecodeXOnly(points[i])
+                           : group_.Decode(points[i]));
+      decoded.push_back(point);
+    }
+    MultiplyAndEncode(absl::MakeSpan(decoded), scalar, encoding,
+                      &result[begin]);
+  }
+  return result;
+}
+
+/**
+ * @brief Multiplies points, keeping the products in Jacobian coordinates
+ * until the whole batch can be normalized at once
+ *
+ * @param points The points to multiply, overwritten with the products
+ * @param scalar The recoded scalar to multiply by
+ * @param encoding How to encode the products
+ * @param out Receives the encoded products
+ */
+void Sm2BatchCipher::MultiplyAndEncode(absl::Span<JacobianPoint> points,
+                                       const RecodedScalar& scalar,
+                                       EcPointEncoding encoding,
+                                       std::string* out) const {
+  group_.MultiplyBatch(scalar, points);
+  std::vector<AffinePoint> affine(points.size());
+  group_.BatchNormalize(points, absl::MakeSpan(affine));
+  for (size_t i = 0; i < points.size(); i++) {
+    out[i] = encoding == EcPointEncoding::kXOnly
+                 ? group_.EncodeXOnly(affine[i])
+                 : group_.Encode(affine[i]);
+  }
+}
+
+}  // namespace private_set_intersection
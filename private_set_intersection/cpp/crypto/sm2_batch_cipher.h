@@ -0,0 +1,130 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM2_BATCH_CIPHER_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM2_BATCH_CIPHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
+#include "private_set_intersection/cpp/crypto/sm2_group.h"
+#include "private_set_intersection/cpp/crypto/sm2_hash_to_curve.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// Commutative encryption over SM2 for whole batches of elements. Elements are
+// hashed to the curve with SM3-SSWU (see `Sm2HashToCurve`) under
+// `kHashToCurveDst`. With compressed points, re-encryption and decryption are
+// byte-for-byte what `ECCommutativeCipher` produces with the same key, but the
+// key is recoded only once, and every batch of results is converted to affine
+// coordinates with a single field inversion instead of one per element.
+//
+// The group and the hasher do not depend on the key. They are built once per
+// process, when the first cipher is created, and shared by all ciphers, so
+// creating a cipher only costs recoding its key and inverting it. A cipher is
+// never modified after creation and can be shared by any number of threads.
+class Sm2BatchCipher : public BatchCipher {
+ public:
+  // Domain separation tag for hashing elements to the curve.
+  static constexpr char kHashToCurveDst[] =
+      "PSI-GM-V01-CS01-with-SM2_XMD:SM3_SSWU_RO_";
+
+  Sm2BatchCipher() = delete;
+
+  // Creates a cipher with a fresh key, drawn uniformly from [1, n).
+  //
+  // Returns INTERNAL if no random bytes can be drawn or the shared hasher to
+  // the curve cannot be built.
+  static StatusOr<std::unique_ptr<Sm2BatchCipher>> CreateWithNewKey();
+
+  // Creates a cipher with the key of `ec_cipher`, which must be an SM2
+  // cipher. `ec_cipher` is not needed afterwards.
+  //
+  // Returns INVALID_ARGUMENT if the key of `ec_cipher` is out of range.
+  static StatusOr<std::unique_ptr<Sm2BatchCipher>> Create(
+      std::unique_ptr<::private_join_and_compute::ECCommutativeCipher>
+          ec_cipher);
+
+  // Creates a cipher with the big-endian private key `key_bytes`.
+  //
+  // Returns INVALID_ARGUMENT if the key is longer than 32 bytes or not in
+  // [1, n), or INTERNAL if the shared hasher to the curve cannot be built.
+  static StatusOr<std::unique_ptr<Sm2BatchCipher>> CreateFromKey(
+      absl::string_view key_bytes);
+
+  // Returns `H(x)^k` for each element `x` of `plaintexts`, where `k` is the
+  // key and `H` is SM3-SSWU, in the same order and in `encoding`.
+  StatusOr<std::vector<std::string>> EncryptBatch(
+      absl::Span<const std::string> plaintexts,
+      EcPointEncoding encoding) const override;
+
+  // Returns `c^k` for each encrypted element `c` of `ciphertexts`, which are
+  // read and written in `encoding`.
+  //
+  // Returns INVALID_ARGUMENT if any element is not an SM2 point in
+  // `encoding`.
+  StatusOr<std::vector<std::string>> ReEncryptBatch(
+      absl::Span<const std::string> ciphertexts,
+      EcPointEncoding encoding) const override;
+
+  // Returns `c^(1/k)` for each encrypted element `c` of `ciphertexts`, which
+  // are read and written in `encoding`.
+  //
+  // Returns INVALID_ARGUMENT if any element is not an SM2 point in
+  // `encoding`.
+  StatusOr<std::vector<std::string>> DecryptBatch(
+      absl::Span<const std::string> ciphertexts,
+      EcPointEncoding encoding) const override;
+
+  // Returns the private key the cipher was created with.
+  std::string GetPrivateKeyBytes() const override;
+
+ private:
+  Sm2BatchCipher(const Sm2Group& group, const Sm2HashToCurve& hash_to_curve,
+                 std::string key_bytes, const RecodedScalar& key,
+                 const RecodedScalar& inverse_key);
+
+  // Multiplies each point of `points`, encoded in `encoding`, by `scalar`.
+  StatusOr<std::vector<std::string>> MultiplyBatch(
+      absl::Span<const std::string> points, const RecodedScalar& scalar,
+      EcPointEncoding encoding) const;
+
+  // Multiplies each of `points` by `scalar` in place and writes the products,
+  // encoded in `encoding`, to `out`, which must have room for all of them.
+  void MultiplyAndEncode(absl::Span<JacobianPoint> points,
+                         const RecodedScalar& scalar, EcPointEncoding encoding,
+                         std::string* out) const;
+
+  // Shared by all ciphers.
+  const Sm2Group& group_;
+  const Sm2HashToCurve& hash_to_curve_;
+
+  std::string key_bytes_;
+  RecodedScalar key_;
+  RecodedScalar inverse_key_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM2_BATCH_CIPHER_H_
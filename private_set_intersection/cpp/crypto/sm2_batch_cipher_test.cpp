@@ -0,0 +1,210 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_batch_cipher.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "openssl/obj_mac.h"
+#include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/util/parallel.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+
+namespace private_set_intersection {
+namespace {
+
+using ::private_join_and_compute::ECCommutativeCipher;
+
+constexpr EcPointEncoding kCompressed = EcPointEncoding::kCompressed;
+constexpr EcPointEncoding kXOnly = EcPointEncoding::kXOnly;
+
+class Sm2BatchCipherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        reference_, ECCommutativeCipher::CreateWithNewKey(
+                        NID_sm2, ECCommutativeCipher::HashType::SM3));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto ec_cipher,
+        ECCommutativeCipher::CreateFromKey(
+            NID_sm2, reference_->GetPrivateKeyBytes(),
+            ECCommutativeCipher::HashType::SM3));
+    PSI_ASSERT_OK_AND_ASSIGN(cipher_,
+                             Sm2BatchCipher::Create(std::move(ec_cipher)));
+
+    // Enough elements to span more than one normalization batch.
+    for (int i = 0; i < 1500; i++) {
+      plaintexts_.push_back(absl::StrCat("Element ", i));
+    }
+  }
+
+  std::unique_ptr<ECCommutativeCipher> reference_;
+  std::unique_ptr<Sm2BatchCipher> cipher_;
+  std::vector<std::string> plaintexts_;
+};
+
+TEST_F(Sm2BatchCipherTest, TestMatchesElementwiseCipher) {
+  // Encryption is hashing to the curve followed by re-encryption.
+  Sm2Group group;
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto hasher,
+      Sm2HashToCurve::Create(group, Sm2BatchCipher::kHashToCurveDst));
+  std::vector<JacobianPoint> hashed(plaintexts_.size());
+  hasher->HashBatch(plaintexts_, absl::MakeSpan(hashed));
+  std::vector<AffinePoint> hashed_affine(hashed.size());
+  group.BatchNormalize(hashed, absl::MakeSpan(hashed_affine));
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  ASSERT_EQ(encrypted.size(), plaintexts_.size());
+  for (size_t i = 0; i < plaintexts_.size(); i++) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto expected, reference_->ReEncrypt(group.Encode(hashed_affine[i])));
+    EXPECT_EQ(encrypted[i], expected);
+  }
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted,
+                           cipher_->ReEncryptBatch(encrypted, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto decrypted,
+                           cipher_->DecryptBatch(encrypted, kCompressed));
+  for (size_t i = 0; i < encrypted.size(); i++) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto expected_reencrypted,
+                             reference_->ReEncrypt(encrypted[i]));
+    EXPECT_EQ(reencrypted[i], expected_reencrypted);
+    PSI_ASSERT_OK_AND_ASSIGN(auto expected_decrypted,
+                             reference_->Decrypt(encrypted[i]));
+    EXPECT_EQ(decrypted[i], expected_decrypted);
+  }
+}
+
+TEST_F(Sm2BatchCipherTest, TestDecryptInvertsReEncrypt) {
+  std::vector<std::string> hashed;
+  for (const auto& plaintext : plaintexts_) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto point, reference_->HashToTheCurve(plaintext));
+    hashed.push_back(point);
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->ReEncryptBatch(hashed, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto decrypted,
+                           cipher_->DecryptBatch(encrypted, kCompressed));
+  EXPECT_EQ(decrypted, hashed);
+}
+
+TEST_F(Sm2BatchCipherTest, TestXOnlyMatchesCompressed) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto compressed,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch(plaintexts_, kXOnly));
+  ASSERT_EQ(encrypted.size(), compressed.size());
+  for (size_t i = 0; i < encrypted.size(); i++) {
+    EXPECT_EQ(encrypted[i], compressed[i].substr(1));
+  }
+
+  // Re-encryption and decryption only depend on the x-coordinate.
+  PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted_compressed,
+                           cipher_->ReEncryptBatch(compressed, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto reencrypted,
+                           cipher_->ReEncryptBatch(encrypted, kXOnly));
+  for (size_t i = 0; i < encrypted.size(); i++) {
+    EXPECT_EQ(reencrypted[i], reencrypted_compressed[i].substr(1));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto decrypted,
+                           cipher_->DecryptBatch(reencrypted, kXOnly));
+  EXPECT_EQ(decrypted, encrypted);
+
+  // Compressed points are not x-coordinates.
+  EXPECT_EQ(cipher_->ReEncryptBatch(compressed, kXOnly).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(Sm2BatchCipherTest, TestEmptyBatch) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch({}, kCompressed));
+  EXPECT_TRUE(encrypted.empty());
+}
+
+TEST_F(Sm2BatchCipherTest, TestInvalidPoint) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  encrypted[7] = "not a point";
+  auto result = cipher_->ReEncryptBatch(encrypted, kCompressed);
+  EXPECT_EQ(result.status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(Sm2BatchCipherTest, TestGetPrivateKeyBytes) {
+  EXPECT_EQ(cipher_->GetPrivateKeyBytes(), reference_->GetPrivateKeyBytes());
+}
+
+TEST_F(Sm2BatchCipherTest, TestCreateFromKeyMatchesCreate) {
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto from_key,
+      Sm2BatchCipher::CreateFromKey(reference_->GetPrivateKeyBytes()));
+  PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           from_key->EncryptBatch(plaintexts_, kCompressed));
+  EXPECT_EQ(encrypted, expected);
+}
+
+TEST_F(Sm2BatchCipherTest, TestCreateWithNewKey) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto first, Sm2BatchCipher::CreateWithNewKey());
+  PSI_ASSERT_OK_AND_ASSIGN(auto second, Sm2BatchCipher::CreateWithNewKey());
+  EXPECT_NE(first->GetPrivateKeyBytes(), second->GetPrivateKeyBytes());
+
+  // A new key is a valid key of the same cipher.
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto from_key,
+      Sm2BatchCipher::CreateFromKey(first->GetPrivateKeyBytes()));
+  PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                           first->EncryptBatch(plaintexts_, kCompressed));
+  PSI_ASSERT_OK_AND_ASSIGN(auto encrypted,
+                           from_key->EncryptBatch(plaintexts_, kCompressed));
+  EXPECT_EQ(encrypted, expected);
+}
+
+TEST_F(Sm2BatchCipherTest, TestCreateFromKeyRejectsInvalidKeys) {
+  const std::string order = absl::HexStringToBytes(
+      "FFFFFFFEFFFFFFFFFFFFFFFFFFFFFFFF7203DF6B21C6052B53BBF40939D54123");
+  for (const std::string& key :
+       {std::string(33, '\x01'), std::string(32, '\0'), std::string(), order}) {
+    EXPECT_EQ(Sm2BatchCipher::CreateFromKey(key).status().code(),
+              absl::StatusCode::kInvalidArgument);
+  }
+}
+
+TEST_F(Sm2BatchCipherTest, TestSharedAcrossThreads) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto expected,
+                           cipher_->EncryptBatch(plaintexts_, kCompressed));
+  // Every thread encrypts all elements with the same cipher.
+  std::vector<std::vector<std::string>> encrypted(4);
+  absl::Status status = ParallelFor(
+      4, 4, [&](int thread, int64_t, int64_t) -> absl::Status {
+        ASSIGN_OR_RETURN(encrypted[thread],
+                         cipher_->EncryptBatch(plaintexts_, kCompressed));
+        return absl::OkStatus();
+      });
+  ASSERT_TRUE(status.ok());
+  for (const auto& result : encrypted) {
+    EXPECT_EQ(result, expected);
+  }
+}
+
+}  // namespace
+}  // namespace private_set_intersection
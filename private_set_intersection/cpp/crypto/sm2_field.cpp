@@ -0,0 +1,158 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_field.h"
+
+namespace private_set_intersection {
+
+using sm2_internal::AddCarry;
+using sm2_internal::SubBorrow;
+
+namespace {
+
+// The SM2 field prime from GB/T 32918.5, as little-endian 64-bit limbs.
+constexpr U256 kSm2Prime = {0xffffffffffffffff, 0xffffffff00000000,
+                            0xffffffffffffffff, 0xfffffffeffffffff};
+
+}  // namespace
+
+/**
+ * @brief Reads a 32-byte big-endian integer
+ *
+ * @param bytes The big-endian bytes
+ * @return U256
+ */
+U256 U256FromBytes(const uint8_t bytes[32]) {
+  U256 value;
+  for (int i = 0; i < 4; i++) {
+    uint64_t limb = 0;
+    for (int j = 0; j < 8; j++) {
+      limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+    }
+    value[i] = limb;
+  }
+  return value;
+}
+
+/**
+ * @brief Writes `value` as a 32-byte big-endian integer
+ *
+ * @param value The integer to write
+ * @param bytes The output buffer of 32 bytes
+ */
+void U256ToBytes(const U256& value, uint8_t bytes[32]) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 8; j++) {
+      bytes[(3 - i) * 8 + j] = static_cast<uint8_t>(value[i] >> (56 - 8 * j));
+    }
+  }
+}
+
+/**
+ * @brief Compares two integers in constant time
+ *
+ * @param a The left operand
+ * @param b The right operand
+ * @return All ones if `a < b`, zero otherwise
+ */
+uint64_t U256LessThanMask(const U256& a, const U256& b) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    SubBorrow(a[i], b[i], borrow, &borrow);
+  }
+  return 0 - borrow;
+}
+
+/**
+ * @brief Precomputes the Montgomery constants for `modulus`
+ *
+ * @param modulus An odd 256-bit modulus
+ */
+MontgomeryField::MontgomeryField(const U256& modulus)
+    : modulus_(modulus), sm2_prime_(modulus == kSm2Prime) {
+  // Newton iteration for m^-1 mod 2^64; each step doubles the correct bits.
+  uint64_t inv = 1;
+  for (int i = 0; i < 6; i++) {
+    inv *= 2 - modulus[0] * inv;
+  }
+  m0_inv_ = 0 - inv;
+
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    modulus_minus_2_[i] = SubBorrow(modulus[i], i == 0 ? 2 : 0, borrow,
+                                    &borrow);
+  }
+
+  // Modular addition does not care about the representation, so doubling 1
+  // repeatedly yields 2^256 mod m and then 2^512 mod m.
+  Element value = {1, 0, 0, 0};
+  for (int i = 0; i < 256; i++) {
+    value = Add(value, value);
+  }
+  one_ = value;
+  for (int i = 0; i < 256; i++) {
+    value = Add(value, value);
+  }
+  r_squared_ = value;
+}
+
+MontgomeryField::Element MontgomeryField::FromInt(const U256& value) const {
+  return Mul(value, r_squared_);
+}
+
+U256 MontgomeryField::ToInt(const Element& a) const {
+  return Mul(a, {1, 0, 0, 0});
+}
+
+/**
+ * @brief Left-to-right exponentiation with a fixed 4-bit window
+ *
+ * @param a The base in Montgomery form
+ * @param exponent The public exponent as an integer
+ * @return `a^exponent` in Montgomery form
+ */
+MontgomeryField::Element MontgomeryField::Pow(const Element& a,
+                                              const U256& exponent) const {
+  Element table[16];
+  table[0] = one_;
+  for (int i = 1; i < 16; i++) {
+    table[i] = Mul(table[i - 1], a);
+  }
+
+  Element result = one_;
+  for (int bit = 252; bit >= 0; bit -= 4) {
+    for (int i = 0; i < 4; i++) {
+      result = Sqr(result);
+    }
+    const int window = static_cast<int>(exponent[bit / 64] >> (bit % 64)) & 15;
+    if (window != 0) {
+      result = Mul(result, table[window]);
+    }
+  }
+  return result;
+}
+
+uint64_t MontgomeryField::IsZeroMask(const Element& a) {
+  const uint64_t bits = a[0] | a[1] | a[2] | a[3];
+  // The top bit of `bits | -bits` is set iff `bits` is non-zero.
+  return ((bits | (0 - bits)) >> 63) - 1;
+}
+
+uint64_t MontgomeryField::EqualMask(const Element& a, const Element& b) {
+  return IsZeroMask({a[0] ^ b[0], a[1] ^ b[1], a[2] ^ b[2], a[3] ^ b[3]});
+}
+
+}  // namespace private_set_intersection
@@ -0,0 +1,401 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM2_FIELD_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM2_FIELD_H_
+
+#include <array>
+#include <cstdint>
+
+#include "absl/numeric/int128.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+namespace private_set_intersection {
+
+// A 256-bit unsigned integer as four 64-bit limbs, least significant first.
+using U256 = std::array<uint64_t, 4>;
+
+// Converts between `U256` and 32-byte big-endian strings.
+U256 U256FromBytes(const uint8_t bytes[32]);
+void U256ToBytes(const U256& value, uint8_t bytes[32]);
+
+// Returns all ones if `a < b` and zero otherwise, in constant time.
+uint64_t U256LessThanMask(const U256& a, const U256& b);
+
+// Arithmetic modulo an odd 256-bit modulus `m`, with elements kept fully
+// reduced in Montgomery form (x * 2^256 mod m).
+//
+// For the SM2 prime p = 2^256 - 2^224 - 2^96 + 2^64 - 1, multiplication and
+// squaring use a reduction tailored to the shape of p, and squaring computes
+// each cross product once. Elements have the same form either way.
+//
+// All operations except `Pow` and `Inv` run in time independent of the
+// values of their operands. `Pow` only leaks its exponent, which is public
+// wherever it is used (inversion and square roots).
+class MontgomeryField {
+ public:
+  using Element = U256;
+
+  explicit MontgomeryField(const U256& modulus);
+
+  const U256& modulus() const { return modulus_; }
+  const Element& one() const { return one_; }
+
+  // Converts an integer in [0, m) into Montgomery form and back.
+  Element FromInt(const U256& value) const;
+  U256 ToInt(const Element& a) const;
+
+  Element Add(const Element& a, const Element& b) const;
+  Element Sub(const Element& a, const Element& b) const;
+  Element Neg(const Element& a) const;
+  Element Mul(const Element& a, const Element& b) const;
+  Element Sqr(const Element& a) const;
+
+  // Returns `a^exponent`, where `exponent` is an integer (not in Montgomery
+  // form) that is treated as public.
+  Element Pow(const Element& a, const U256& exponent) const;
+
+  // Returns `a^-1`, or zero for `a == 0`. Requires a prime modulus.
+  Element Inv(const Element& a) const { return Pow(a, modulus_minus_2_); }
+
+  // Returns `a` if `mask` is all ones and `b` if `mask` is zero.
+  static Element Select(uint64_t mask, const Element& a, const Element& b);
+
+  // Returns all ones if `a == 0` (resp. `a == b`) and zero otherwise.
+  static uint64_t IsZeroMask(const Element& a);
+  static uint64_t EqualMask(const Element& a, const Element& b);
+
+ private:
+  // Subtracts the modulus from `value + 2^256 * carry` if the result stays
+  // non-negative. Requires `value + 2^256 * carry < 2m`.
+  Element ReduceOnce(const U256& value, uint64_t carry) const;
+
+  // `Mul` for any modulus, with the reduction interleaved.
+  Element MulGeneric(const Element& a, const Element& b) const;
+
+  // `Mul` and `Sqr` for the SM2 prime: the 512-bit product, then
+  // `ReduceSm2`.
+  Element MulSm2(const Element& a, const Element& b) const;
+  Element SqrSm2(const Element& a) const;
+
+  // Returns `t / 2^256 mod p` for the 512-bit `t = (t0, ..., t7)`, least
+  // significant word first, where p is the SM2 prime and `t < p * 2^256`.
+  Element ReduceSm2(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3,
+                    uint64_t t4, uint64_t t5, uint64_t t6, uint64_t t7) const;
+
+  U256 modulus_;
+  // True if the modulus is the SM2 prime.
+  bool sm2_prime_;
+  U256 modulus_minus_2_;
+  // -m^-1 mod 2^64.
+  uint64_t m0_inv_;
+  // 2^256 mod m, which is one in Montgomery form.
+  Element one_;
+  // 2^512 mod m, which converts integers into Montgomery form.
+  Element r_squared_;
+};
+
+// The arithmetic below sits on the innermost loop of every scalar
+// multiplication, so it is defined inline and unrolled by hand.
+
+namespace sm2_internal {
+
+// absl::uint128 is a struct on most compilers and its arithmetic ends up on
+// the stack without full optimization, so use the native type if there is
+// one.
+#if defined(__SIZEOF_INT128__)
+using Wide = unsigned __int128;
+inline uint64_t Low64(Wide value) { return static_cast<uint64_t>(value); }
+inline uint64_t High64(Wide value) {
+  return static_cast<uint64_t>(value >> 64);
+}
+#else
+using Wide = absl::uint128;
+inline uint64_t Low64(Wide value) { return absl::Uint128Low64(value); }
+inline uint64_t High64(Wide value) { return absl::Uint128High64(value); }
+#endif
+
+// The helpers below only widen the product. On x86-64 carries and borrows go
+// through the add-with-carry intrinsics, which compile to adc/sbb chains;
+// elsewhere they are propagated with 64-bit compares, which compilers turn
+// into such chains more reliably than 128-bit additions.
+
+// Returns `a + b + carry_in` and stores the carry out in `carry_out`.
+// `carry_in` must be 0 or 1.
+inline uint64_t AddCarry(uint64_t a, uint64_t b, uint64_t carry_in,
+                         uint64_t* carry_out) {
+#if defined(__x86_64__) || defined(_M_X64)
+  unsigned long long result;
+  *carry_out =
+      _addcarry_u64(static_cast<unsigned char>(carry_in), a, b, &result);
+  return result;
+#else
+  const uint64_t sum = a + b;
+  const uint64_t result = sum + carry_in;
+  *carry_out = static_cast<uint64_t>(sum < a) | (result < sum);
+  return result;
+#endif
+}
+
+// Returns `a - b - borrow_in` and stores the borrow out in `borrow_out`.
+// `borrow_in` must be 0 or 1.
+inline uint64_t SubBorrow(uint64_t a, uint64_t b, uint64_t borrow_in,
+                          uint64_t* borrow_out) {
+#if defined(__x86_64__) || defined(_M_X64)
+  unsigned long long result;
+  *borrow_out =
+      _subborrow_u64(static_cast<unsigned char>(borrow_in), a, b, &result);
+  return result;
+#else
+  const uint64_t diff = a - b;
+  *borrow_out = static_cast<uint64_t>(a < b) | (diff < borrow_in);
+  return diff - borrow_in;
+#endif
+}
+
+// Returns `a * b + c + d`, which cannot overflow 128 bits, split into words.
+inline uint64_t MulAdd(uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                       uint64_t* high) {
+  const Wide product = Wide(a) * b;
+  uint64_t low = Low64(product);
+  uint64_t hi = High64(product);
+  low += c;
+  hi += low < c;
+  low += d;
+  hi += low < d;
+  *high = hi;
+  return low;
+}
+
+// One word of the Montgomery reduction modulo the SM2 prime p. Since
+// p = -1 mod 2^64, the multiple of p that clears the low word `t0` is
+// `t0 * p`, and adding it leaves zero in that word and adds
+// t0 * (2^192 - 2^160 - 2^32 + 1) to the words above. That term is built from
+// shifts and subtractions instead of the four multiplications of the generic
+// reduction. Adds it to (t1, t2, t3, t4) and returns the carry out of `t4`.
+inline uint64_t Sm2ReduceWord(uint64_t t0, uint64_t* t1, uint64_t* t2,
+                              uint64_t* t3, uint64_t* t4) {
+  // t0 * 2^192 + t0 - (t0 * 2^160 + t0 * 2^32), which is non-negative.
+  const uint64_t low = t0 << 32;
+  const uint64_t high = t0 >> 32;
+  uint64_t borrow, carry;
+  const uint64_t v0 = SubBorrow(t0, low, 0, &borrow);
+  const uint64_t v1 = SubBorrow(0, high, borrow, &borrow);
+  const uint64_t v2 = SubBorrow(0, low, borrow, &borrow);
+  const uint64_t v3 = SubBorrow(t0, high, borrow, &borrow);
+  *t1 = AddCarry(*t1, v0, 0, &carry);
+  *t2 = AddCarry(*t2, v1, carry, &carry);
+  *t3 = AddCarry(*t3, v2, carry, &carry);
+  *t4 = AddCarry(*t4, v3, carry, &carry);
+  return carry;
+}
+
+}  // namespace sm2_internal
+
+inline MontgomeryField::Element MontgomeryField::Select(uint64_t mask,
+                                                        const Element& a,
+                                                        const Element& b) {
+  return {(a[0] & mask) | (b[0] & ~mask), (a[1] & mask) | (b[1] & ~mask),
+          (a[2] & mask) | (b[2] & ~mask), (a[3] & mask) | (b[3] & ~mask)};
+}
+
+inline MontgomeryField::Element MontgomeryField::ReduceOnce(
+    const U256& value, uint64_t carry) const {
+  using sm2_internal::SubBorrow;
+  U256 reduced;
+  uint64_t borrow;
+  reduced[0] = SubBorrow(value[0], modulus_[0], 0, &borrow);
+  reduced[1] = SubBorrow(value[1], modulus_[1], borrow, &borrow);
+  reduced[2] = SubBorrow(value[2], modulus_[2], borrow, &borrow);
+  reduced[3] = SubBorrow(value[3], modulus_[3], borrow, &borrow);
+  // Keep `value` only if the subtraction borrowed past the carry word.
+  SubBorrow(carry, 0, borrow, &borrow);
+  return Select(0 - borrow, value, reduced);
+}
+
+inline MontgomeryField::Element MontgomeryField::Add(const Element& a,
+                                                     const Element& b) const {
+  using sm2_internal::AddCarry;
+  U256 sum;
+  uint64_t carry;
+  sum[0] = AddCarry(a[0], b[0], 0, &carry);
+  sum[1] = AddCarry(a[1], b[1], carry, &carry);
+  sum[2] = AddCarry(a[2], b[2], carry, &carry);
+  sum[3] = AddCarry(a[3], b[3], carry, &carry);
+  return ReduceOnce(sum, carry);
+}
+
+inline MontgomeryField::Element MontgomeryField::Sub(const Element& a,
+                                                     const Element& b) const {
+  using sm2_internal::AddCarry;
+  using sm2_internal::SubBorrow;
+  U256 diff;
+  uint64_t borrow;
+  diff[0] = SubBorrow(a[0], b[0], 0, &borrow);
+  diff[1] = SubBorrow(a[1], b[1], borrow, &borrow);
+  diff[2] = SubBorrow(a[2], b[2], borrow, &borrow);
+  diff[3] = SubBorrow(a[3], b[3], borrow, &borrow);
+  // Add the modulus back if the difference went negative.
+  const uint64_t mask = 0 - borrow;
+  uint64_t carry;
+  diff[0] = AddCarry(diff[0], modulus_[0] & mask, 0, &carry);
+  diff[1] = AddCarry(diff[1], modulus_[1] & mask, carry, &carry);
+  diff[2] = AddCarry(diff[2], modulus_[2] & mask, carry, &carry);
+  diff[3] = AddCarry(diff[3], modulus_[3] & mask, carry, &carry);
+  return diff;
+}
+
+inline MontgomeryField::Element MontgomeryField::Neg(const Element& a) const {
+  return Sub({0, 0, 0, 0}, a);
+}
+
+inline MontgomeryField::Element MontgomeryField::Mul(const Element& a,
+                                                     const Element& b) const {
+  return sm2_prime_ ? MulSm2(a, b) : MulGeneric(a, b);
+}
+
+inline MontgomeryField::Element MontgomeryField::Sqr(const Element& a) const {
+  return sm2_prime_ ? SqrSm2(a) : MulGeneric(a, a);
+}
+
+// Montgomery multiplication `a * b / 2^256 mod m` with interleaved reduction
+// (CIOS). Each round adds `a * b[i]` and then one multiple of `m` that clears
+// the lowest word, so the accumulator shifts down one word per round.
+inline MontgomeryField::Element MontgomeryField::MulGeneric(
+    const Element& a, const Element& b) const {
+  using sm2_internal::AddCarry;
+  using sm2_internal::MulAdd;
+  uint64_t t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0;
+  for (int i = 0; i < 4; i++) {
+    uint64_t carry, t5;
+    t0 = MulAdd(a[0], b[i], t0, 0, &carry);
+    t1 = MulAdd(a[1], b[i], t1, carry, &carry);
+    t2 = MulAdd(a[2], b[i], t2, carry, &carry);
+    t3 = MulAdd(a[3], b[i], t3, carry, &carry);
+    t4 = AddCarry(t4, carry, 0, &t5);
+
+    const uint64_t q = t0 * m0_inv_;
+    MulAdd(q, modulus_[0], t0, 0, &carry);
+    t0 = MulAdd(q, modulus_[1], t1, carry, &carry);
+    t1 = MulAdd(q, modulus_[2], t2, carry, &carry);
+    t2 = MulAdd(q, modulus_[3], t3, carry, &carry);
+    t3 = AddCarry(t4, carry, 0, &carry);
+    t4 = t5 + carry;
+  }
+  return ReduceOnce({t0, t1, t2, t3}, t4);
+}
+
+// Reduces one word at a time from the bottom, carrying into the words above,
+// and keeps the top half. The result is below 2p, so one conditional
+// subtraction brings it into [0, p).
+inline MontgomeryField::Element MontgomeryField::ReduceSm2(
+    uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4,
+    uint64_t t5, uint64_t t6, uint64_t t7) const {
+  using sm2_internal::AddCarry;
+  using sm2_internal::Sm2ReduceWord;
+  uint64_t carry, top;
+  carry = Sm2ReduceWord(t0, &t1, &t2, &t3, &t4);
+  t5 = AddCarry(t5, 0, carry, &carry);
+  t6 = AddCarry(t6, 0, carry, &carry);
+  t7 = AddCarry(t7, 0, carry, &top);
+  carry = Sm2ReduceWord(t1, &t2, &t3, &t4, &t5);
+  t6 = AddCarry(t6, 0, carry, &carry);
+  t7 = AddCarry(t7, 0, carry, &carry);
+  top += carry;
+  carry = Sm2ReduceWord(t2, &t3, &t4, &t5, &t6);
+  t7 = AddCarry(t7, 0, carry, &carry);
+  top += carry;
+  top += Sm2ReduceWord(t3, &t4, &t5, &t6, &t7);
+  return ReduceOnce({t4, t5, t6, t7}, top);
+}
+
+// Schoolbook product, one row per word of `b`.
+inline MontgomeryField::Element MontgomeryField::MulSm2(
+    const Element& a, const Element& b) const {
+  using sm2_internal::MulAdd;
+  uint64_t t0, t1, t2, t3, t4, t5, t6, t7, carry;
+  t0 = MulAdd(a[0], b[0], 0, 0, &carry);
+  t1 = MulAdd(a[1], b[0], 0, carry, &carry);
+  t2 = MulAdd(a[2], b[0], 0, carry, &carry);
+  t3 = MulAdd(a[3], b[0], 0, carry, &t4);
+
+  t1 = MulAdd(a[0], b[1], t1, 0, &carry);
+  t2 = MulAdd(a[1], b[1], t2, carry, &carry);
+  t3 = MulAdd(a[2], b[1], t3, carry, &carry);
+  t4 = MulAdd(a[3], b[1], t4, carry, &t5);
+
+  t2 = MulAdd(a[0], b[2], t2, 0, &carry);
+  t3 = MulAdd(a[1], b[2], t3, carry, &carry);
+  t4 = MulAdd(a[2], b[2], t4, carry, &carry);
+  t5 = MulAdd(a[3], b[2], t5, carry, &t6);
+
+  t3 = MulAdd(a[0], b[3], t3, 0, &carry);
+  t4 = MulAdd(a[1], b[3], t4, carry, &carry);
+  t5 = MulAdd(a[2], b[3], t5, carry, &carry);
+  t6 = MulAdd(a[3], b[3], t6, carry, &t7);
+  return ReduceSm2(t0, t1, t2, t3, t4, t5, t6, t7);
+}
+
+// The six cross products, doubled, plus the four squares: 10 multiplications
+// instead of 16.
+inline MontgomeryField::Element MontgomeryField::SqrSm2(
+    const Element& a) const {
+  using sm2_internal::AddCarry;
+  using sm2_internal::High64;
+  using sm2_internal::Low64;
+  using sm2_internal::MulAdd;
+  using sm2_internal::Wide;
+  uint64_t t1, t2, t3, t4, t5, t6, t7, carry;
+  t1 = MulAdd(a[0], a[1], 0, 0, &carry);
+  t2 = MulAdd(a[0], a[2], 0, carry, &carry);
+  t3 = MulAdd(a[0], a[3], 0, carry, &t4);
+  t3 = MulAdd(a[1], a[2], t3, 0, &carry);
+  t4 = MulAdd(a[1], a[3], t4, carry, &t5);
+  t5 = MulAdd(a[2], a[3], t5, 0, &t6);
+
+  t7 = t6 >> 63;
+  t6 = (t6 << 1) | (t5 >> 63);
+  t5 = (t5 << 1) | (t4 >> 63);
+  t4 = (t4 << 1) | (t3 >> 63);
+  t3 = (t3 << 1) | (t2 >> 63);
+  t2 = (t2 << 1) | (t1 >> 63);
+  t1 <<= 1;
+
+  const Wide square0 = Wide(a[0]) * a[0];
+  const Wide square1 = Wide(a[1]) * a[1];
+  const Wide square2 = Wide(a[2]) * a[2];
+  const Wide square3 = Wide(a[3]) * a[3];
+  const uint64_t t0 = Low64(square0);
+  t1 = AddCarry(t1, High64(square0), 0, &carry);
+  t2 = AddCarry(t2, Low64(square1), carry, &carry);
+  t3 = AddCarry(t3, High64(square1), carry, &carry);
+  t4 = AddCarry(t4, Low64(square2), carry, &carry);
+  t5 = AddCarry(t5, High64(square2), carry, &carry);
+  t6 = AddCarry(t6, Low64(square3), carry, &carry);
+  t7 = AddCarry(t7, High64(square3), carry, &carry);
+  return ReduceSm2(t0, t1, t2, t3, t4, t5, t6, t7);
+}
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM2_FIELD_H_
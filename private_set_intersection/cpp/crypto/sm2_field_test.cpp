@@ -0,0 +1,162 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_field.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace private_set_intersection {
+namespace {
+
+// The SM2 field prime.
+constexpr U256 kP = {0xffffffffffffffff, 0xffffffff00000000,
+                     0xffffffffffffffff, 0xfffffffeffffffff};
+
+// Returns a uniformly random integer below `bound`.
+U256 RandomBelow(const U256& bound, std::mt19937_64& rng) {
+  while (true) {
+    U256 value = {rng(), rng(), rng(), rng()};
+    if (U256LessThanMask(value, bound)) {
+      return value;
+    }
+  }
+}
+
+// The SM2 group order, which takes the generic reduction.
+constexpr U256 kN = {0x53bbf40939d54123, 0x7203df6b21c6052b,
+                     0xffffffffffffffff, 0xfffffffeffffffff};
+
+// Returns `x * y` modulo the field's modulus by double-and-add, which only
+// needs modular addition and so does not depend on the Montgomery form.
+U256 MulByAdding(const MontgomeryField& field, const U256& x, const U256& y) {
+  U256 result = {0, 0, 0, 0};
+  for (int bit = 255; bit >= 0; bit--) {
+    result = field.Add(result, result);
+    if ((y[bit / 64] >> (bit % 64)) & 1) {
+      result = field.Add(result, x);
+    }
+  }
+  return result;
+}
+
+// Returns random integers below `modulus`, and values whose words are all
+// zeros or all ones, which stress the carries.
+std::vector<U256> TestValues(const U256& modulus, std::mt19937_64& rng) {
+  const U256 minus_one = {modulus[0] - 1, modulus[1], modulus[2], modulus[3]};
+  std::vector<U256> values = {{0, 0, 0, 0},
+                              {1, 0, 0, 0},
+                              minus_one,
+                              {~uint64_t{0}, 0, 0, 0},
+                              {0, ~uint64_t{0}, ~uint64_t{0}, 0},
+                              {~uint64_t{0}, ~uint64_t{0}, ~uint64_t{0}, 0}};
+  for (int i = 0; i < 30; i++) {
+    values.push_back(RandomBelow(modulus, rng));
+  }
+  return values;
+}
+
+TEST(MontgomeryFieldTest, TestBytesRoundTrip) {
+  uint8_t bytes[32];
+  for (int i = 0; i < 32; i++) {
+    bytes[i] = static_cast<uint8_t>(i + 1);
+  }
+  const U256 value = U256FromBytes(bytes);
+  EXPECT_EQ(value[3], 0x0102030405060708u);
+  EXPECT_EQ(value[0], 0x191a1b1c1d1e1f20u);
+
+  uint8_t out[32];
+  U256ToBytes(value, out);
+  EXPECT_EQ(std::vector<uint8_t>(out, out + 32),
+            std::vector<uint8_t>(bytes, bytes + 32));
+}
+
+TEST(MontgomeryFieldTest, TestMontgomeryFormRoundTrip) {
+  MontgomeryField field(kP);
+  std::mt19937_64 rng(1);
+  for (int i = 0; i < 100; i++) {
+    const U256 value = RandomBelow(kP, rng);
+    EXPECT_EQ(field.ToInt(field.FromInt(value)), value);
+  }
+  EXPECT_EQ(field.ToInt(field.one()), U256({1, 0, 0, 0}));
+}
+
+TEST(MontgomeryFieldTest, TestKnownValues) {
+  MontgomeryField field(kP);
+  const U256 minus_one = {kP[0] - 1, kP[1], kP[2], kP[3]};
+  const auto a = field.FromInt(minus_one);
+  // (-1) * (-1) = 1 and (-1) + (-1) = -2.
+  EXPECT_EQ(field.ToInt(field.Mul(a, a)), U256({1, 0, 0, 0}));
+  EXPECT_EQ(field.ToInt(field.Add(a, a)),
+            U256({kP[0] - 2, kP[1], kP[2], kP[3]}));
+  EXPECT_EQ(field.ToInt(field.Neg(field.one())), minus_one);
+  EXPECT_EQ(field.ToInt(field.Sub(field.one(), a)), U256({2, 0, 0, 0}));
+}
+
+TEST(MontgomeryFieldTest, TestFieldIdentities) {
+  MontgomeryField field(kP);
+  std::mt19937_64 rng(2);
+  for (int i = 0; i < 100; i++) {
+    const auto a = field.FromInt(RandomBelow(kP, rng));
+    const auto b = field.FromInt(RandomBelow(kP, rng));
+    const auto c = field.FromInt(RandomBelow(kP, rng));
+
+    EXPECT_EQ(field.Sub(field.Add(a, b), b), a);
+    EXPECT_EQ(field.Add(a, field.Neg(a)), U256({0, 0, 0, 0}));
+    EXPECT_EQ(field.Mul(a, b), field.Mul(b, a));
+    EXPECT_EQ(field.Mul(a, field.Add(b, c)),
+              field.Add(field.Mul(a, b), field.Mul(a, c)));
+    EXPECT_EQ(field.Mul(a, field.Inv(a)), field.one());
+    EXPECT_EQ(field.Pow(a, {3, 0, 0, 0}), field.Mul(field.Sqr(a), a));
+  }
+}
+
+TEST(MontgomeryFieldTest, TestMulMatchesDoubleAndAdd) {
+  // The SM2 prime has its own reduction; the group order takes the generic
+  // one.
+  for (const U256& modulus : {kP, kN}) {
+    MontgomeryField field(modulus);
+    std::mt19937_64 rng(3);
+    const std::vector<U256> values = TestValues(modulus, rng);
+    for (const U256& x : values) {
+      const auto a = field.FromInt(x);
+      EXPECT_EQ(field.Sqr(a), field.Mul(a, a));
+      for (const U256& y : values) {
+        EXPECT_EQ(field.ToInt(field.Mul(a, field.FromInt(y))),
+                  MulByAdding(field, x, y));
+      }
+    }
+  }
+}
+
+TEST(MontgomeryFieldTest, TestMasks) {
+  MontgomeryField field(kP);
+  const U256 zero = {0, 0, 0, 0};
+  EXPECT_EQ(MontgomeryField::IsZeroMask(zero), ~uint64_t{0});
+  EXPECT_EQ(MontgomeryField::IsZeroMask(field.one()), 0u);
+  EXPECT_EQ(MontgomeryField::EqualMask(field.one(), field.one()),
+            ~uint64_t{0});
+  EXPECT_EQ(MontgomeryField::Select(~uint64_t{0}, field.one(), zero),
+            field.one());
+  EXPECT_EQ(MontgomeryField::Select(0, field.one(), zero), zero);
+  EXPECT_EQ(U256LessThanMask(zero, kP), ~uint64_t{0});
+  EXPECT_EQ(U256LessThanMask(kP, kP), 0u);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
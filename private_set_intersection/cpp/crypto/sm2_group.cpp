@@ -0,0 +1,383 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_group.h"
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "private_set_intersection/cpp/crypto/sm2_internal.h"
+#include "private_set_intersection/cpp/util/cpu_features.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+using Element = MontgomeryField::Element;
+using sm2_internal::MultiplyKernel;
+
+// Curve parameters from GB/T 32918.5, as little-endian 64-bit limbs.
+constexpr U256 kP = {0xffffffffffffffff, 0xffffffff00000000,
+                     0xffffffffffffffff, 0xfffffffeffffffff};
+constexpr U256 kN = {0x53bbf40939d54123, 0x7203df6b21c6052b,
+                     0xffffffffffffffff, 0xfffffffeffffffff};
+constexpr U256 kB = {0xddbcbd414d940e93, 0xf39789f515ab8f92,
+                     0x4d5a9e4bcf6509a7, 0x28e9fa9e9d9f5e34};
+constexpr U256 kGx = {0x715a4589334c74c7, 0x8fe30bbff2660be1,
+                      0x5f9904466a39c994, 0x32c4ae2c1f198119};
+constexpr U256 kGy = {0x02df32e52139f0a0, 0xd0a9877cc62a4740,
+                      0x59bdcee36b692153, 0xbc3736a2f4f6779c};
+constexpr U256 kSqrtExponent = {0x4000000000000000, 0xffffffffc0000000,
+                                0xffffffffffffffff, 0x3fffffffbfffffff};
+
+constexpr int kTableSize = 1 << (RecodedScalar::kWindow - 1);
+
+static_assert(RecodedScalar::kWindow == sm2_internal::kRecodeWindow &&
+                  RecodedScalar::kNumDigits == sm2_internal::kRecodeDigits,
+              "The kernels must recode scalars like Sm2Group");
+static_assert(sizeof(JacobianPoint) ==
+                  sm2_internal::kPointWords * sizeof(uint64_t),
+              "The kernels read points as arrays of words");
+
+MultiplyKernel SelectMultiplyKernel() {
+  if (MultiplyKernel ifma = sm2_internal::GetIfmaMultiplyKernel();
+      ifma != nullptr && CpuSupportsAvx512Ifma()) {
+    return ifma;
+  }
+  return nullptr;
+}
+
+// Returns the multi-lane kernel for this CPU, or null if there is none.
+MultiplyKernel GetMultiplyKernel() {
+  static const MultiplyKernel kernel = SelectMultiplyKernel();
+  return kernel;
+}
+
+// Returns all ones if `a == b` and zero otherwise, for small non-negative
+// values.
+inline uint64_t EqualMask(uint64_t a, uint64_t b) {
+  return 0 - (((a ^ b) - 1) >> 63);
+}
+
+}  // namespace
+
+Sm2Group::Sm2Group()
+    : field_(kP),
+      scalar_field_(kN),
+      b_(field_.FromInt(kB)),
+      sqrt_exponent_(kSqrtExponent) {}
+
+JacobianPoint Sm2Group::Generator() const {
+  return {field_.FromInt(kGx), field_.FromInt(kGy), field_.one()};
+}
+
+Element Sm2Group::CurveRhs(const Element& x) const {
+  const Element x3 = field_.Mul(field_.Sqr(x), x);
+  const Element three_x = field_.Add(field_.Add(x, x), x);
+  return field_.Add(field_.Sub(x3, three_x), b_);
+}
+
+/**
+ * @brief Decodes a SEC1 compressed point and checks that it is on the curve
+ *
+ * @param bytes The 33-byte compressed encoding
+ * @return StatusOr<JacobianPoint>
+ */
+StatusOr<JacobianPoint> Sm2Group::Decode(absl::string_view bytes) const {
+  const auto* data = reinterpret_cast<const uint8_t*>(bytes.data());
+  if (bytes.size() != kCompressedPointSize ||
+      (data[0] != 0x02 && data[0] != 0x03)) {
+    return absl::InvalidArgumentError(
+        "Sm2Group::Decode - Could not decode point.");
+  }
+  StatusOr<JacobianPoint> point = DecodeX(data + 1);
+  if (!point.ok()) {
+    return point.status();
+  }
+  // y is never zero: the group has odd order, so it has no 2-torsion.
+  if ((field_.ToInt(point->y)[0] & 1) != (data[0] & 1)) {
+    point->y = field_.Neg(point->y);
+  }
+  return point;
+}
+
+/**
+ * @brief Returns the SEC1 compressed encoding of an affine point
+ *
+ * @param point The point to encode
+ * @return std::string
+ */
+std::string Sm2Group::Encode(const AffinePoint& point) const {
+  uint8_t bytes[kCompressedPointSize];
+  bytes[0] = static_cast<uint8_t>(0x02 | (field_.ToInt(point.y)[0] & 1));
+  U256ToBytes(field_.ToInt(point.x), bytes + 1);
+  return std::string(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+/**
+ * @brief Decodes an x-coordinate and checks that it is on the curve. The sign
+ * of y is not fixed, since multiples of the two points share x-coordinates.
+ *
+ * @param bytes The 32-byte big-endian x-coordinate
+ * @return StatusOr<JacobianPoint>
+ */
+StatusOr<JacobianPoint> Sm2Group::DecodeXOnly(absl::string_view bytes) const {
+  if (bytes.size() != kXOnlyPointSize) {
+    return absl::InvalidArgumentError(
+        "Sm2Group::DecodeXOnly - Could not decode point.");
+  }
+  return DecodeX(reinterpret_cast<const uint8_t*>(bytes.data()));
+}
+
+/**
+ * @brief Returns the big-endian x-coordinate of an affine point
+ *
+ * @param point The point to encode
+ * @return std::string
+ */
+std::string Sm2Group::EncodeXOnly(const AffinePoint& point) const {
+  uint8_t bytes[kXOnlyPointSize];
+  U256ToBytes(field_.ToInt(point.x), bytes);
+  return std::string(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+/**
+ * @brief Recovers a point from its x-coordinate with a square root
+ *
+ * @param bytes The 32-byte big-endian x-coordinate
+ * @return StatusOr<JacobianPoint>
+ */
+StatusOr<JacobianPoint> Sm2Group::DecodeX(const uint8_t* bytes) const {
+  const U256 x_int = U256FromBytes(bytes);
+  if (!U256LessThanMask(x_int, kP)) {
+    return absl::InvalidArgumentError(
+        "Sm2Group::Decode - Could not decode point.");
+  }
+
+  const Element x = field_.FromInt(x_int);
+  const Element rhs = CurveRhs(x);
+  const Element y = field_.Pow(rhs, sqrt_exponent_);
+  if (!MontgomeryField::EqualMask(field_.Sqr(y), rhs)) {
+    return absl::InvalidArgumentError(
+        "Sm2Group::Decode - Point is not on the curve.");
+  }
+  return JacobianPoint{x, y, field_.one()};
+}
+
+/**
+ * @brief Point doubling for a = -3 ("dbl-2001-b", 3M + 5S)
+ *
+ * @param point The point to double
+ * @return JacobianPoint
+ */
+JacobianPoint Sm2Group::Double(const JacobianPoint& point) const {
+  const Element delta = field_.Sqr(point.z);
+  const Element gamma = field_.Sqr(point.y);
+  const Element beta = field_.Mul(point.x, gamma);
+  Element alpha = field_.Mul(field_.Sub(point.x, delta),
+                             field_.Add(point.x, delta));
+  alpha = field_.Add(field_.Add(alpha, alpha), alpha);
+
+  const Element beta2 = field_.Add(beta, beta);
+  const Element beta4 = field_.Add(beta2, beta2);
+  const Element beta8 = field_.Add(beta4, beta4);
+
+  JacobianPoint result;
+  result.x = field_.Sub(field_.Sqr(alpha), beta8);
+  result.z = field_.Sub(
+      field_.Sub(field_.Sqr(field_.Add(point.y, point.z)), gamma), delta);
+  Element gamma8 = field_.Sqr(gamma);
+  gamma8 = field_.Add(gamma8, gamma8);
+  gamma8 = field_.Add(gamma8, gamma8);
+  gamma8 = field_.Add(gamma8, gamma8);
+  result.y =
+      field_.Sub(field_.Mul(alpha, field_.Sub(beta4, result.x)), gamma8);
+  return result;
+}
+
+/**
+ * @brief Point addition ("add-2007-bl", 11M + 5S)
+ *
+ * @param a The first point
+ * @param b The second point, which must differ from `a` and `-a`
+ * @return JacobianPoint
+ */
+JacobianPoint Sm2Group::Add(const JacobianPoint& a,
+                            const JacobianPoint& b) const {
+  const Element z1z1 = field_.Sqr(a.z);
+  const Element z2z2 = field_.Sqr(b.z);
+  const Element u1 = field_.Mul(a.x, z2z2);
+  const Element u2 = field_.Mul(b.x, z1z1);
+  const Element s1 = field_.Mul(a.y, field_.Mul(b.z, z2z2));
+  const Element s2 = field_.Mul(b.y, field_.Mul(a.z, z1z1));
+  const Element h = field_.Sub(u2, u1);
+  const Element i = field_.Sqr(field_.Add(h, h));
+  const Element j = field_.Mul(h, i);
+  Element r = field_.Sub(s2, s1);
+  r = field_.Add(r, r);
+  const Element v = field_.Mul(u1, i);
+
+  JacobianPoint result;
+  result.x = field_.Sub(field_.Sub(field_.Sqr(r), j), field_.Add(v, v));
+  const Element s1j = field_.Mul(s1, j);
+  result.y = field_.Sub(field_.Mul(r, field_.Sub(v, result.x)),
+                        field_.Add(s1j, s1j));
+  result.z = field_.Mul(
+      field_.Sub(field_.Sub(field_.Sqr(field_.Add(a.z, b.z)), z1z1), z2z2),
+      h);
+  return result;
+}
+
+/**
+ * @brief Recodes a scalar into signed odd base-2^w digits (Joye-Tunstall), so
+ * that every window adds exactly one precomputed point.
+ *
+ * @param scalar The scalar in [1, n)
+ * @return RecodedScalar
+ */
+RecodedScalar Sm2Group::Recode(const U256& scalar) const {
+  RecodedScalar recoded;
+  // Even scalars are replaced by n - scalar, which is odd.
+  recoded.negate_mask = (scalar[0] & 1) - 1;
+  U256 negated;
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    negated[i] = sm2_internal::SubBorrow(kN[i], scalar[i], borrow, &borrow);
+  }
+  U256 value = MontgomeryField::Select(recoded.negate_mask, negated, scalar);
+
+  constexpr int kWindow = RecodedScalar::kWindow;
+  constexpr uint64_t kDigitMask = (uint64_t{1} << (kWindow + 1)) - 1;
+  for (int i = 0; i < RecodedScalar::kNumDigits - 1; i++) {
+    // For odd v, d = (v mod 2^(w+1)) - 2^w is odd and (v - d) / 2^w is odd.
+    recoded.digits[i] =
+        static_cast<int8_t>(static_cast<int>(value[0] & kDigitMask) -
+                            (1 << kWindow));
+    for (int j = 0; j < 3; j++) {
+      value[j] = (value[j] >> kWindow) | (value[j + 1] << (64 - kWindow));
+    }
+    value[3] >>= kWindow;
+    value[0] |= 1;
+  }
+  recoded.digits[RecodedScalar::kNumDigits - 1] =
+      static_cast<int8_t>(value[0]);
+  return recoded;
+}
+
+/**
+ * @brief Multiplies `point` by a recoded scalar: one doubling per bit and one
+ * addition per window, with constant-time table lookups.
+ *
+ * @param scalar The recoded scalar
+ * @param point The point to multiply
+ * @return JacobianPoint
+ */
+JacobianPoint Sm2Group::Multiply(const RecodedScalar& scalar,
+                                 const JacobianPoint& point) const {
+  // table[i] = (2i + 1) * point
+  JacobianPoint table[kTableSize];
+  table[0] = point;
+  const JacobianPoint twice = Double(point);
+  for (int i = 1; i < kTableSize; i++) {
+    table[i] = Add(table[i - 1], twice);
+  }
+
+  // Returns digit * point by scanning the whole table.
+  auto lookup = [&](int8_t digit) {
+    const int sign = digit >> 7;
+    const uint64_t index = static_cast<uint64_t>((digit ^ sign) - sign) >> 1;
+    JacobianPoint selected = table[0];
+    for (int i = 1; i < kTableSize; i++) {
+      const uint64_t mask = EqualMask(static_cast<uint64_t>(i), index);
+      selected.x = MontgomeryField::Select(mask, table[i].x, selected.x);
+      selected.y = MontgomeryField::Select(mask, table[i].y, selected.y);
+      selected.z = MontgomeryField::Select(mask, table[i].z, selected.z);
+    }
+    selected.y = MontgomeryField::Select(static_cast<uint64_t>(sign),
+                                         field_.Neg(selected.y), selected.y);
+    return selected;
+  };
+
+  // The top digit is positive, and since the running multiple is always
+  // larger than any table entry, the additions never hit `a == ±b` unless
+  // the scalar wraps around n, which happens with negligible probability.
+  JacobianPoint result = lookup(scalar.digits[RecodedScalar::kNumDigits - 1]);
+  for (int i = RecodedScalar::kNumDigits - 2; i >= 0; i--) {
+    for (int j = 0; j < RecodedScalar::kWindow; j++) {
+      result = Double(result);
+    }
+    result = Add(result, lookup(scalar.digits[i]));
+  }
+  result.y = MontgomeryField::Select(scalar.negate_mask, field_.Neg(result.y),
+                                     result.y);
+  return result;
+}
+
+/**
+ * @brief Multiplies points by one scalar, in groups of eight lanes where the
+ * CPU has AVX-512 IFMA. The points left over are multiplied one by one, since
+ * a partial group costs as much as a full one.
+ *
+ * @param scalar The recoded scalar
+ * @param points The points to multiply, overwritten with the products
+ */
+void Sm2Group::MultiplyBatch(const RecodedScalar& scalar,
+                             absl::Span<JacobianPoint> points) const {
+  size_t begin = 0;
+  if (MultiplyKernel kernel = GetMultiplyKernel(); kernel != nullptr) {
+    begin = points.size() - points.size() % sm2_internal::kIfmaLanes;
+    kernel(scalar.digits.data(), scalar.negate_mask,
+           reinterpret_cast<uint64_t*>(points.data()), begin);
+  }
+  for (size_t i = begin; i < points.size(); i++) {
+    points[i] = Multiply(scalar, points[i]);
+  }
+}
+
+/**
+ * @brief Converts points to affine coordinates, sharing one inversion across
+ * the batch (Montgomery's trick)
+ *
+ * @param points The points to normalize
+ * @param out The affine points, of the same size as `points`
+ */
+void Sm2Group::BatchNormalize(absl::Span<const JacobianPoint> points,
+                              absl::Span<AffinePoint> out) const {
+  if (points.empty()) {
+    return;
+  }
+  // prefix[i] = z_0 * ... * z_i
+  std::vector<Element> prefix(points.size());
+  prefix[0] = points[0].z;
+  for (size_t i = 1; i < points.size(); i++) {
+    prefix[i] = field_.Mul(prefix[i - 1], points[i].z);
+  }
+
+  // Invariant: inverse = (z_0 * ... * z_i)^-1
+  Element inverse = field_.Inv(prefix.back());
+  for (size_t i = points.size(); i-- > 0;) {
+    Element z_inv = inverse;
+    if (i > 0) {
+      z_inv = field_.Mul(inverse, prefix[i - 1]);
+      inverse = field_.Mul(inverse, points[i].z);
+    }
+    const Element z_inv2 = field_.Sqr(z_inv);
+    out[i].x = field_.Mul(points[i].x, z_inv2);
+    out[i].y = field_.Mul(points[i].y, field_.Mul(z_inv2, z_inv));
+  }
+}
+
+}  // namespace private_set_intersection
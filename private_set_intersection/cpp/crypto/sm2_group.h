@@ -0,0 +1,141 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM2_GROUP_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM2_GROUP_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/cpp/crypto/sm2_field.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// A point (X / Z^2, Y / Z^3) in Jacobian coordinates, with every coordinate
+// in Montgomery form. Z is never zero: the point at infinity is not needed,
+// since the group has prime order and inputs are validated.
+struct JacobianPoint {
+  U256 x;
+  U256 y;
+  U256 z;
+};
+
+// An affine point with coordinates in Montgomery form.
+struct AffinePoint {
+  U256 x;
+  U256 y;
+};
+
+// A scalar recoded once into signed odd digits, so that multiplying many
+// points by it needs no per-point scalar processing.
+struct RecodedScalar {
+  // Window width in bits. The table of odd multiples holds 2^(w-1) points.
+  static constexpr int kWindow = 5;
+  // Enough digits to cover any 256-bit scalar: 51 * 5 = 255 shifted bits.
+  static constexpr int kNumDigits = 52;
+
+  // Odd digits in [-(2^w - 1), 2^w - 1], least significant first, with
+  // scalar = sum(digits[i] * 2^(w * i)) up to the sign below.
+  std::array<int8_t, kNumDigits> digits;
+  // All ones if the recoded value is `n - scalar`, so the product must be
+  // negated. Recoding needs an odd value, and `n` is odd.
+  uint64_t negate_mask;
+};
+
+// The SM2 elliptic curve y^2 = x^3 - 3x + b over GF(p) (GB/T 32918.5), with
+// the constant-time point arithmetic needed to multiply many points by one
+// fixed scalar.
+class Sm2Group {
+ public:
+  // Size in bytes of a SEC1 compressed point.
+  static constexpr int kCompressedPointSize = 33;
+  // Size in bytes of the big-endian x-coordinate of a point.
+  static constexpr int kXOnlyPointSize = 32;
+
+  Sm2Group();
+
+  // Arithmetic modulo the field prime p and the group order n.
+  const MontgomeryField& field() const { return field_; }
+  const MontgomeryField& scalar_field() const { return scalar_field_; }
+
+  // The curve constant b in Montgomery form.
+  const MontgomeryField::Element& b() const { return b_; }
+
+  // Returns the generator of the group.
+  JacobianPoint Generator() const;
+
+  // Decodes a SEC1 compressed point. Returns INVALID_ARGUMENT if `bytes` is
+  // not the encoding of a point on the curve.
+  StatusOr<JacobianPoint> Decode(absl::string_view bytes) const;
+
+  // Returns the SEC1 compressed encoding of `point`.
+  std::string Encode(const AffinePoint& point) const;
+
+  // Decodes a big-endian x-coordinate into one of the two points that have
+  // it. Returns INVALID_ARGUMENT if no point on the curve has it.
+  StatusOr<JacobianPoint> DecodeXOnly(absl::string_view bytes) const;
+
+  // Returns the big-endian x-coordinate of `point`.
+  std::string EncodeXOnly(const AffinePoint& point) const;
+
+  // Returns 2 * `point`.
+  JacobianPoint Double(const JacobianPoint& point) const;
+
+  // Returns `a + b`. Requires `a != ±b`.
+  JacobianPoint Add(const JacobianPoint& a, const JacobianPoint& b) const;
+
+  // Recodes `scalar`, which must be in [1, n).
+  RecodedScalar Recode(const U256& scalar) const;
+
+  // Returns `scalar * point` using a fixed sequence of field operations.
+  JacobianPoint Multiply(const RecodedScalar& scalar,
+                         const JacobianPoint& point) const;
+
+  // Multiplies every point of `points` by `scalar` in place. The products are
+  // those of `Multiply`, but on CPUs with AVX-512 IFMA eight points are
+  // multiplied at once.
+  void MultiplyBatch(const RecodedScalar& scalar,
+                     absl::Span<JacobianPoint> points) const;
+
+  // Converts `points` to affine coordinates with a single field inversion
+  // (Montgomery's trick). `out` must have the same size as `points`.
+  void BatchNormalize(absl::Span<const JacobianPoint> points,
+                      absl::Span<AffinePoint> out) const;
+
+ private:
+  // Decodes the big-endian x-coordinate at `bytes` into the point whose y is
+  // the square root computed by `Pow`, which may be either of the two.
+  StatusOr<JacobianPoint> DecodeX(const uint8_t* bytes) const;
+
+  // Returns x^3 - 3x + b.
+  MontgomeryField::Element CurveRhs(const MontgomeryField::Element& x) const;
+
+  MontgomeryField field_;
+  MontgomeryField scalar_field_;
+  MontgomeryField::Element b_;
+  // (p + 1) / 4; p = 3 mod 4, so a^((p+1)/4) is a square root of squares a.
+  U256 sqrt_exponent_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM2_GROUP_H_
@@ -0,0 +1,225 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_group.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "openssl/bn.h"
+#include "openssl/ec.h"
+#include "openssl/obj_mac.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+
+namespace private_set_intersection {
+namespace {
+
+// Computes `scalar * G` with OpenSSL as a reference.
+std::string ReferenceMultiplyGenerator(const U256& scalar) {
+  uint8_t scalar_bytes[32];
+  U256ToBytes(scalar, scalar_bytes);
+  EC_GROUP* group = EC_GROUP_new_by_curve_name(NID_sm2);
+  BN_CTX* ctx = BN_CTX_new();
+  BIGNUM* k = BN_bin2bn(scalar_bytes, sizeof(scalar_bytes), nullptr);
+  EC_POINT* point = EC_POINT_new(group);
+  EC_POINT_mul(group, point, k, nullptr, nullptr, ctx);
+  uint8_t out[Sm2Group::kCompressedPointSize];
+  EC_POINT_point2oct(group, point, POINT_CONVERSION_COMPRESSED, out,
+                     sizeof(out), ctx);
+  EC_POINT_free(point);
+  BN_free(k);
+  BN_CTX_free(ctx);
+  EC_GROUP_free(group);
+  return std::string(reinterpret_cast<const char*>(out), sizeof(out));
+}
+
+std::string EncodeJacobian(const Sm2Group& group, const JacobianPoint& point) {
+  AffinePoint affine;
+  group.BatchNormalize(absl::MakeConstSpan(&point, 1),
+                       absl::MakeSpan(&affine, 1));
+  return group.Encode(affine);
+}
+
+U256 RandomScalar(const Sm2Group& group, std::mt19937_64& rng) {
+  while (true) {
+    U256 value = {rng(), rng(), rng(), rng()};
+    if (U256LessThanMask(value, group.scalar_field().modulus()) &&
+        !MontgomeryField::IsZeroMask(value)) {
+      return value;
+    }
+  }
+}
+
+TEST(Sm2GroupTest, TestGeneratorRoundTrip) {
+  Sm2Group group;
+  const std::string encoded = EncodeJacobian(group, group.Generator());
+  EXPECT_EQ(encoded, ReferenceMultiplyGenerator({1, 0, 0, 0}));
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded, group.Decode(encoded));
+  EXPECT_EQ(EncodeJacobian(group, decoded), encoded);
+}
+
+TEST(Sm2GroupTest, TestDecodeRejectsInvalidPoints) {
+  Sm2Group group;
+  const std::string generator = EncodeJacobian(group, group.Generator());
+
+  EXPECT_FALSE(group.Decode("").ok());
+  EXPECT_FALSE(group.Decode(generator.substr(1)).ok());
+  std::string bad_prefix = generator;
+  bad_prefix[0] = 0x04;
+  EXPECT_FALSE(group.Decode(bad_prefix).ok());
+  // x = p is not a field element.
+  std::string out_of_range(Sm2Group::kCompressedPointSize, '\xff');
+  out_of_range[0] = 0x02;
+  EXPECT_FALSE(group.Decode(out_of_range).ok());
+
+  // Roughly half of all x coordinates are not on the curve.
+  int rejected = 0;
+  std::string candidate = generator;
+  for (int i = 0; i < 64; i++) {
+    candidate[Sm2Group::kCompressedPointSize - 1] = static_cast<char>(i);
+    rejected += group.Decode(candidate).ok() ? 0 : 1;
+  }
+  EXPECT_GT(rejected, 0);
+  EXPECT_LT(rejected, 64);
+}
+
+TEST(Sm2GroupTest, TestXOnlyRoundTrip) {
+  Sm2Group group;
+  const std::string compressed = EncodeJacobian(group, group.Generator());
+  AffinePoint generator;
+  const JacobianPoint g = group.Generator();
+  group.BatchNormalize(absl::MakeConstSpan(&g, 1),
+                       absl::MakeSpan(&generator, 1));
+  const std::string x_only = group.EncodeXOnly(generator);
+  ASSERT_EQ(x_only.size(), Sm2Group::kXOnlyPointSize);
+  EXPECT_EQ(x_only, compressed.substr(1));
+
+  // The decoded point is the generator or its negation.
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded, group.DecodeXOnly(x_only));
+  const std::string decoded_compressed = EncodeJacobian(group, decoded);
+  EXPECT_EQ(decoded_compressed.substr(1), x_only);
+
+  EXPECT_FALSE(group.DecodeXOnly(compressed).ok());
+  EXPECT_FALSE(
+      group.DecodeXOnly(std::string(Sm2Group::kXOnlyPointSize, '\xff')).ok());
+  int rejected = 0;
+  std::string candidate = x_only;
+  for (int i = 0; i < 64; i++) {
+    candidate[Sm2Group::kXOnlyPointSize - 1] = static_cast<char>(i);
+    rejected += group.DecodeXOnly(candidate).ok() ? 0 : 1;
+  }
+  EXPECT_GT(rejected, 0);
+  EXPECT_LT(rejected, 64);
+}
+
+TEST(Sm2GroupTest, TestDoubleAndAdd) {
+  Sm2Group group;
+  const JacobianPoint g = group.Generator();
+  const JacobianPoint g2 = group.Double(g);
+  const JacobianPoint g3 = group.Add(g2, g);
+  EXPECT_EQ(EncodeJacobian(group, g2),
+            ReferenceMultiplyGenerator({2, 0, 0, 0}));
+  EXPECT_EQ(EncodeJacobian(group, g3),
+            ReferenceMultiplyGenerator({3, 0, 0, 0}));
+  EXPECT_EQ(EncodeJacobian(group, group.Add(g, g2)),
+            EncodeJacobian(group, g3));
+}
+
+TEST(Sm2GroupTest, TestMultiplyMatchesReference) {
+  Sm2Group group;
+  std::mt19937_64 rng(3);
+  std::vector<U256> scalars = {
+      {1, 0, 0, 0},
+      {2, 0, 0, 0},
+      {31, 0, 0, 0},
+      {32, 0, 0, 0},
+  };
+  // n - 1 and n - 2.
+  U256 n_minus_1 = group.scalar_field().modulus();
+  n_minus_1[0] -= 1;
+  U256 n_minus_2 = n_minus_1;
+  n_minus_2[0] -= 1;
+  scalars.push_back(n_minus_1);
+  scalars.push_back(n_minus_2);
+  for (int i = 0; i < 20; i++) {
+    scalars.push_back(RandomScalar(group, rng));
+  }
+
+  for (const U256& scalar : scalars) {
+    const RecodedScalar recoded = group.Recode(scalar);
+    EXPECT_EQ(EncodeJacobian(group, group.Multiply(recoded, group.Generator())),
+              ReferenceMultiplyGenerator(scalar));
+  }
+}
+
+TEST(Sm2GroupTest, TestMultiplyBatchMatchesMultiply) {
+  Sm2Group group;
+  std::mt19937_64 rng(6);
+  for (int count : {0, 1, 7, 8, 9, 20}) {
+    const RecodedScalar recoded = group.Recode(RandomScalar(group, rng));
+    std::vector<JacobianPoint> points;
+    for (int i = 0; i < count; i++) {
+      points.push_back(group.Multiply(group.Recode(RandomScalar(group, rng)),
+                                      group.Generator()));
+    }
+    std::vector<JacobianPoint> products = points;
+    group.MultiplyBatch(recoded, absl::MakeSpan(products));
+    for (int i = 0; i < count; i++) {
+      const JacobianPoint expected = group.Multiply(recoded, points[i]);
+      EXPECT_EQ(products[i].x, expected.x) << count << " " << i;
+      EXPECT_EQ(products[i].y, expected.y) << count << " " << i;
+      EXPECT_EQ(products[i].z, expected.z) << count << " " << i;
+    }
+  }
+}
+
+TEST(Sm2GroupTest, TestRecodedDigits) {
+  Sm2Group group;
+  std::mt19937_64 rng(4);
+  for (int i = 0; i < 20; i++) {
+    const RecodedScalar recoded = group.Recode(RandomScalar(group, rng));
+    for (int8_t digit : recoded.digits) {
+      EXPECT_EQ(digit & 1, 1);
+      EXPECT_LT(digit, 1 << RecodedScalar::kWindow);
+      EXPECT_GT(digit, -(1 << RecodedScalar::kWindow));
+    }
+    EXPECT_GT(recoded.digits.back(), 0);
+  }
+}
+
+TEST(Sm2GroupTest, TestBatchNormalize) {
+  Sm2Group group;
+  std::mt19937_64 rng(5);
+  std::vector<JacobianPoint> points;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 10; i++) {
+    points.push_back(
+        group.Multiply(group.Recode(RandomScalar(group, rng)),
+                       group.Generator()));
+    expected.push_back(EncodeJacobian(group, points.back()));
+  }
+
+  std::vector<AffinePoint> affine(points.size());
+  group.BatchNormalize(points, absl::MakeSpan(affine));
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_EQ(group.Encode(affine[i]), expected[i]);
+  }
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -0,0 +1,285 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_hash_to_curve.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "openssl/ec.h"
+#include "openssl/err.h"
+#include "openssl/obj_mac.h"
+#include "private_set_intersection/cpp/crypto/sm3.h"
+
+namespace private_set_intersection {
+
+using Element = MontgomeryField::Element;
+
+namespace {
+
+// Bytes per field element: L = ceil((ceil(log2(p)) + k) / 8) with k = 128.
+constexpr size_t kFieldElementSize = 48;
+// Two field elements per message.
+constexpr size_t kExpandedSize = 2 * kFieldElementSize;
+// ell = ceil(kExpandedSize / 32) SM3 outputs make up the expanded message.
+constexpr int kExpandBlocks = 3;
+// Input block size of SM3, the length of Z_pad.
+constexpr size_t kSm3BlockSize = 64;
+
+// (p - 3) / 4, the exponent of sqrt_ratio for p = 3 mod 4.
+constexpr U256 kSqrtRatioExponent = {0x3fffffffffffffff, 0xffffffffc0000000,
+                                     0xffffffffffffffff, 0x3fffffffbfffffff};
+
+// Messages checked against BoringSSL when a hasher is created.
+constexpr absl::string_view kProbeMessages[] = {"", "abc"};
+
+struct EcGroupDeleter {
+  void operator()(EC_GROUP* group) const { EC_GROUP_free(group); }
+};
+
+struct EcPointDeleter {
+  void operator()(EC_POINT* point) const { EC_POINT_free(point); }
+};
+
+uint64_t Sgn0(const MontgomeryField& field, const Element& a) {
+  return field.ToInt(a)[0] & 1;
+}
+
+}  // namespace
+
+Sm2HashToCurve::Sm2HashToCurve(const Sm2Group& group, std::string dst)
+    : group_(group), dst_prime_(std::move(dst)) {
+  const MontgomeryField& field = group_.field();
+  dst_prime_.push_back(static_cast<char>(dst_prime_.size()));
+  z_ = field.Neg(field.FromInt({9, 0, 0, 0}));
+  a_ = field.Neg(field.FromInt({3, 0, 0, 0}));
+  sqrt_minus_z_ = field.FromInt({3, 0, 0, 0});
+  // one() is 2^256 mod p as an integer.
+  two_to_256_ = field.FromInt(field.one());
+}
+
+/**
+ * @brief Creates a hasher and checks it against BoringSSL on a few messages
+ *
+ * @param group The SM2 group
+ * @param dst The domain separation tag
+ * @return StatusOr<std::unique_ptr<Sm2HashToCurve>>
+ */
+StatusOr<std::unique_ptr<Sm2HashToCurve>> Sm2HashToCurve::Create(
+    const Sm2Group& group, absl::string_view dst) {
+  if (dst.empty() || dst.size() > 255) {
+    return absl::InvalidArgumentError(
+        "Sm2HashToCurve: `dst` must be between 1 and 255 bytes long");
+  }
+  auto hasher = absl::WrapUnique(new Sm2HashToCurve(group, std::string(dst)));
+
+  std::vector<std::string> probes(std::begin(kProbeMessages),
+                                  std::end(kProbeMessages));
+  std::vector<JacobianPoint> batched(probes.size());
+  std::vector<JacobianPoint> reference(probes.size());
+  hasher->HashBatch(probes, absl::MakeSpan(batched));
+  for (size_t i = 0; i < probes.size(); i++) {
+    absl::Status status = hasher->HashWithLibrary(probes[i], &reference[i]);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  std::vector<AffinePoint> batched_affine(probes.size());
+  std::vector<AffinePoint> reference_affine(probes.size());
+  group.BatchNormalize(batched, absl::MakeSpan(batched_affine));
+  group.BatchNormalize(reference, absl::MakeSpan(reference_affine));
+  for (size_t i = 0; i < probes.size(); i++) {
+    if (group.Encode(batched_affine[i]) != group.Encode(reference_affine[i])) {
+      return absl::InternalError(absl::StrCat(
+          "Sm2HashToCurve: hashing \"", probes[i],
+          "\" differs from EC_hash_to_curve_sm2p256v1_xmd_sm3_sswu"));
+    }
+  }
+  return hasher;
+}
+
+/**
+ * @brief Hashes messages to the curve in batches
+ *
+ * @param messages The messages to hash
+ * @param points Receives one point per message
+ */
+void Sm2HashToCurve::HashBatch(absl::Span<const std::string> messages,
+                               absl::Span<JacobianPoint> points) const {
+  std::vector<uint8_t> expanded;
+  ExpandMessageBatch(messages, &expanded);
+  for (size_t i = 0; i < messages.size(); i++) {
+    const uint8_t* bytes = expanded.data() + i * kExpandedSize;
+    const JacobianPoint q0 = MapToCurve(FieldElementFromBytes(bytes));
+    const JacobianPoint q1 =
+        MapToCurve(FieldElementFromBytes(bytes + kFieldElementSize));
+    // q0 and q1 are independent random points, so q0 = ±q1 only happens
+    // with negligible probability.
+    points[i] = group_.Add(q0, q1);
+  }
+}
+
+/**
+ * @brief expand_message_xmd with SM3 for a batch of messages. Each of the
+ * four hashing steps of the construction is one call to `Sm3Batch`.
+ *
+ * @param messages The messages to expand
+ * @param out Receives `kExpandedSize` bytes per message
+ */
+void Sm2HashToCurve::ExpandMessageBatch(absl::Span<const std::string> messages,
+                                        std::vector<uint8_t>* out) const {
+  const size_t n = messages.size();
+  const std::string z_pad(kSm3BlockSize, '\0');
+  const std::string l_i_b_str = {static_cast<char>(kExpandedSize >> 8),
+                                 static_cast<char>(kExpandedSize & 0xff)};
+
+  // b_0 = H(Z_pad || msg || I2OSP(len_in_bytes, 2) || I2OSP(0, 1) || DST')
+  std::vector<std::string> inputs(n);
+  for (size_t i = 0; i < n; i++) {
+    inputs[i] = absl::StrCat(z_pad, messages[i], l_i_b_str,
+                             absl::string_view("\0", 1), dst_prime_);
+  }
+  std::vector<absl::string_view> views(inputs.begin(), inputs.end());
+  std::vector<Sm3Digest> b0(n);
+  Sm3Batch(views, absl::MakeSpan(b0));
+
+  // b_1 = H(b_0 || I2OSP(1, 1) || DST')
+  // b_i = H(strxor(b_0, b_(i - 1)) || I2OSP(i, 1) || DST')
+  out->resize(n * kExpandedSize);
+  std::vector<Sm3Digest> b(n);
+  for (int step = 1; step <= kExpandBlocks; step++) {
+    for (size_t i = 0; i < n; i++) {
+      std::string& input = inputs[i];
+      input.resize(kSm3DigestSize);
+      for (size_t j = 0; j < kSm3DigestSize; j++) {
+        input[j] = static_cast<char>(step == 1 ? b0[i][j] : b0[i][j] ^ b[i][j]);
+      }
+      input.push_back(static_cast<char>(step));
+      input.append(dst_prime_);
+      views[i] = input;
+    }
+    Sm3Batch(views, absl::MakeSpan(b));
+    for (size_t i = 0; i < n; i++) {
+      std::copy(b[i].begin(), b[i].end(),
+                out->data() + i * kExpandedSize + (step - 1) * kSm3DigestSize);
+    }
+  }
+}
+
+Element Sm2HashToCurve::FieldElementFromBytes(const uint8_t* bytes) const {
+  const MontgomeryField& field = group_.field();
+  // bytes = high (128 bits) || low (256 bits); low < 2^256 < 2p.
+  U256 high = {0, 0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    high[1 - i / 8] = (high[1 - i / 8] << 8) | bytes[i];
+  }
+  U256 low = U256FromBytes(bytes + 16);
+  const U256 low_minus_p = field.Sub(low, field.modulus());
+  low = MontgomeryField::Select(U256LessThanMask(low, field.modulus()), low,
+                                low_minus_p);
+  return field.Add(field.FromInt(low),
+                   field.Mul(field.FromInt(high), two_to_256_));
+}
+
+/**
+ * @brief map_to_curve_simple_swu, following the straight-line procedure of
+ * RFC 9380 appendix F.2 with sqrt_ratio for p = 3 mod 4 (F.2.1.2)
+ *
+ * @param u The field element to map
+ * @return The point in Jacobian coordinates
+ */
+JacobianPoint Sm2HashToCurve::MapToCurve(const Element& u) const {
+  const MontgomeryField& field = group_.field();
+  const Element& b = group_.b();
+
+  Element tv1 = field.Mul(z_, field.Sqr(u));
+  Element tv2 = field.Add(field.Sqr(tv1), tv1);
+  Element tv3 = field.Mul(b, field.Add(tv2, field.one()));
+  Element tv4 = MontgomeryField::Select(MontgomeryField::IsZeroMask(tv2), z_,
+                                        field.Neg(tv2));
+  tv4 = field.Mul(a_, tv4);
+  tv2 = field.Sqr(tv3);
+  Element tv6 = field.Sqr(tv4);
+  Element tv5 = field.Mul(a_, tv6);
+  tv2 = field.Mul(field.Add(tv2, tv5), tv3);
+  tv6 = field.Mul(tv6, tv4);
+  tv5 = field.Mul(b, tv6);
+  tv2 = field.Add(tv2, tv5);
+  Element x = field.Mul(tv1, tv3);
+
+  // (is_gx1_square, y1) = sqrt_ratio(tv2, tv6)
+  Element s1 = field.Sqr(tv6);
+  const Element s2 = field.Mul(tv2, tv6);
+  s1 = field.Mul(s1, s2);
+  Element y1 = field.Mul(field.Pow(s1, kSqrtRatioExponent), s2);
+  const Element y2 = field.Mul(y1, sqrt_minus_z_);
+  const uint64_t is_gx1_square =
+      MontgomeryField::EqualMask(field.Mul(field.Sqr(y1), tv6), tv2);
+  y1 = MontgomeryField::Select(is_gx1_square, y1, y2);
+
+  Element y = field.Mul(field.Mul(tv1, u), y1);
+  x = MontgomeryField::Select(is_gx1_square, tv3, x);
+  y = MontgomeryField::Select(is_gx1_square, y1, y);
+  const uint64_t same_sign = (Sgn0(field, u) ^ Sgn0(field, y)) - 1;
+  y = MontgomeryField::Select(same_sign, y, field.Neg(y));
+
+  // (x / tv4, y) = (x * tv4 / tv4^2, y * tv4^3 / tv4^3)
+  const Element tv4_squared = field.Sqr(tv4);
+  return {field.Mul(x, tv4), field.Mul(y, field.Mul(tv4_squared, tv4)), tv4};
+}
+
+/**
+ * @brief Hashes one message with BoringSSL's implementation
+ *
+ * @param message The message to hash
+ * @param point Receives the point
+ * @return absl::Status
+ */
+absl::Status Sm2HashToCurve::HashWithLibrary(absl::string_view message,
+                                             JacobianPoint* point) const {
+  std::unique_ptr<EC_GROUP, EcGroupDeleter> ec_group(
+      EC_GROUP_new_by_curve_name(NID_sm2));
+  if (ec_group == nullptr) {
+    return absl::InternalError("Sm2HashToCurve: SM2 is not supported");
+  }
+  std::unique_ptr<EC_POINT, EcPointDeleter> ec_point(
+      EC_POINT_new(ec_group.get()));
+  const absl::string_view dst(dst_prime_.data(), dst_prime_.size() - 1);
+  uint8_t bytes[1 + 2 * 32];
+  if (ec_point == nullptr ||
+      !EC_hash_to_curve_sm2p256v1_xmd_sm3_sswu(
+          ec_group.get(), ec_point.get(),
+          reinterpret_cast<const uint8_t*>(dst.data()), dst.size(),
+          reinterpret_cast<const uint8_t*>(message.data()), message.size()) ||
+      EC_POINT_point2oct(ec_group.get(), ec_point.get(),
+                         POINT_CONVERSION_UNCOMPRESSED, bytes, sizeof(bytes),
+                         nullptr) != sizeof(bytes)) {
+    ERR_clear_error();
+    return absl::InternalError(
+        "Sm2HashToCurve: could not hash the message to the curve");
+  }
+
+  const MontgomeryField& field = group_.field();
+  point->x = field.FromInt(U256FromBytes(bytes + 1));
+  point->y = field.FromInt(U256FromBytes(bytes + 33));
+  point->z = field.one();
+  return absl::OkStatus();
+}
+
+}  // namespace private_set_intersection
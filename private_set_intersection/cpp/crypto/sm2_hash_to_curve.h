@@ -0,0 +1,97 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM2_HASH_TO_CURVE_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM2_HASH_TO_CURVE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/cpp/crypto/sm2_group.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// Hashes messages to SM2 points as in RFC 9380 (hash_to_curve, random oracle
+// encoding) with the suite SM2_XMD:SM3_SSWU_RO_: expand_message_xmd with SM3,
+// two field elements per message, the simplified SWU map with Z = -9 (the
+// value the RFC's selection procedure yields for SM2) and one point addition.
+// SM2 has cofactor 1, so there is no cofactor to clear. The result is meant
+// to equal BoringSSL's EC_hash_to_curve_sm2p256v1_xmd_sm3_sswu, which
+// `Create` checks.
+//
+// Messages are hashed a batch at a time: all SM3 calls of a step run through
+// the multi-buffer engine, and each mapped point keeps the map's denominator
+// as its Jacobian Z coordinate, so no field inversion is needed at all. The
+// points are meant to go straight into `Sm2Group::Multiply`.
+class Sm2HashToCurve {
+ public:
+  Sm2HashToCurve() = delete;
+
+  // Returns a hasher for the domain separation tag `dst`.
+  //
+  // A few probe messages are also hashed with BoringSSL, so that the hasher
+  // never produces points that differ from the library's.
+  //
+  // Returns INVALID_ARGUMENT if `dst` is empty or longer than 255 bytes, or
+  // INTERNAL if BoringSSL fails to hash a probe message or hashes one to a
+  // different point.
+  static StatusOr<std::unique_ptr<Sm2HashToCurve>> Create(
+      const Sm2Group& group, absl::string_view dst);
+
+  // Hashes each message of `messages` to the point at the same position of
+  // `points`, which must be as long as `messages`.
+  void HashBatch(absl::Span<const std::string> messages,
+                 absl::Span<JacobianPoint> points) const;
+
+ private:
+  Sm2HashToCurve(const Sm2Group& group, std::string dst);
+
+  // Computes expand_message_xmd(msg, DST, 96) for every message, writing 96
+  // bytes per message to `out`.
+  void ExpandMessageBatch(absl::Span<const std::string> messages,
+                          std::vector<uint8_t>* out) const;
+
+  // Reduces 48 big-endian bytes modulo p (hash_to_field).
+  MontgomeryField::Element FieldElementFromBytes(const uint8_t* bytes) const;
+
+  // The simplified SWU map, returning (x_n / d, y) as the Jacobian point
+  // (x_n * d, y * d^3, d).
+  JacobianPoint MapToCurve(const MontgomeryField::Element& u) const;
+
+  // Hashes `message` with EC_hash_to_curve_sm2p256v1_xmd_sm3_sswu.
+  absl::Status HashWithLibrary(absl::string_view message,
+                               JacobianPoint* point) const;
+
+  Sm2Group group_;
+  std::string dst_prime_;
+
+  // Constants of the map in Montgomery form.
+  MontgomeryField::Element z_;
+  MontgomeryField::Element a_;
+  MontgomeryField::Element sqrt_minus_z_;
+  MontgomeryField::Element two_to_256_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM2_HASH_TO_CURVE_H_
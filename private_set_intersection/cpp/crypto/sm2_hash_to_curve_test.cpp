@@ -0,0 +1,145 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm2_hash_to_curve.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+
+namespace private_set_intersection {
+namespace {
+
+constexpr char kTestDst[] = "QUUX-V01-CS02-with-SM2_XMD:SM3_SSWU_RO_";
+
+std::vector<std::string> EncodeAll(const Sm2Group& group,
+                                   absl::Span<const JacobianPoint> points) {
+  std::vector<AffinePoint> affine(points.size());
+  group.BatchNormalize(points, absl::MakeSpan(affine));
+  std::vector<std::string> encoded;
+  for (const AffinePoint& point : affine) {
+    encoded.push_back(group.Encode(point));
+  }
+  return encoded;
+}
+
+TEST(Sm2HashToCurveTest, TestVectors) {
+  // Computed with a straightforward implementation of RFC 9380 for the suite
+  // SM2_XMD:SM3_SSWU_RO_ with Z = -9, which reproduces the P256_XMD:SHA-256
+  // vectors of the RFC when given that suite's parameters.
+  struct Vector {
+    std::string message;
+    std::string x;
+    std::string y;
+  };
+  const std::vector<Vector> vectors = {
+      {"", "80048bf6454de460598966bc3bc9a3213e8776668817d85cf447eda370991a41",
+       "cf41fd9fa681d1416ddb5129e570bef4d74c4e0c1a5be8009717eb1c02e8e9e9"},
+      {"abc",
+       "7cf8871dffcb584997d9b27cbc1b12308eec4544f38688f7b8c53531afb9fdcd",
+       "e803123cc855d859d58857cbea53c0cf0187b160e3a4996a9260879a1b059203"},
+      {"abcdef0123456789",
+       "9fbfac2f80e2492165c664f1329a2e8391d39ec33e6c7a57c0e582d17e533c0e",
+       "733e1148256a3fcb971b89789755fd8e8c292b7e82a67ab38c46a827b6cacc0b"},
+      {absl::StrCat("q128_", std::string(128, 'q')),
+       "7eccdb5a62d795ff497c6f24ba10049945a384df187717667deddeea465cd927",
+       "b869d3c923de3afccad7e09b27fda5b3f4732a1bc44eee62532b6f90ba524ea5"},
+      {absl::StrCat("a512_", std::string(512, 'a')),
+       "ac24c8657b4e116c8b5a92136d41947839e5a61fdab3ac1529d2fbd9b9959691",
+       "db6c91d5b977aecaec71956df70547369a63af795066d6c223c836bb5b70389a"},
+  };
+
+  Sm2Group group;
+  PSI_ASSERT_OK_AND_ASSIGN(auto hasher,
+                           Sm2HashToCurve::Create(group, kTestDst));
+  std::vector<std::string> messages;
+  for (const Vector& vector : vectors) {
+    messages.push_back(vector.message);
+  }
+  std::vector<JacobianPoint> points(messages.size());
+  hasher->HashBatch(messages, absl::MakeSpan(points));
+  std::vector<AffinePoint> affine(points.size());
+  group.BatchNormalize(points, absl::MakeSpan(affine));
+
+  const MontgomeryField& field = group.field();
+  for (size_t i = 0; i < vectors.size(); i++) {
+    uint8_t x[32];
+    uint8_t y[32];
+    U256ToBytes(field.ToInt(affine[i].x), x);
+    U256ToBytes(field.ToInt(affine[i].y), y);
+    EXPECT_EQ(absl::BytesToHexString(absl::string_view(
+                  reinterpret_cast<const char*>(x), sizeof(x))),
+              vectors[i].x);
+    EXPECT_EQ(absl::BytesToHexString(absl::string_view(
+                  reinterpret_cast<const char*>(y), sizeof(y))),
+              vectors[i].y);
+  }
+}
+
+TEST(Sm2HashToCurveTest, TestBatchMatchesSingle) {
+  Sm2Group group;
+  PSI_ASSERT_OK_AND_ASSIGN(auto hasher,
+                           Sm2HashToCurve::Create(group, kTestDst));
+  std::vector<std::string> messages;
+  for (int i = 0; i < 50; i++) {
+    messages.push_back(absl::StrCat("Element ", i));
+  }
+  std::vector<JacobianPoint> points(messages.size());
+  hasher->HashBatch(messages, absl::MakeSpan(points));
+  const std::vector<std::string> encoded = EncodeAll(group, points);
+
+  for (size_t i = 0; i < messages.size(); i++) {
+    JacobianPoint point;
+    hasher->HashBatch(absl::MakeConstSpan(&messages[i], 1),
+                      absl::MakeSpan(&point, 1));
+    EXPECT_EQ(EncodeAll(group, absl::MakeConstSpan(&point, 1))[0],
+              encoded[i]);
+    // Every output must decode as a point on the curve.
+    EXPECT_TRUE(group.Decode(encoded[i]).ok());
+  }
+}
+
+TEST(Sm2HashToCurveTest, TestDstSeparatesDomains) {
+  Sm2Group group;
+  PSI_ASSERT_OK_AND_ASSIGN(auto hasher1,
+                           Sm2HashToCurve::Create(group, "DST one"));
+  PSI_ASSERT_OK_AND_ASSIGN(auto hasher2,
+                           Sm2HashToCurve::Create(group, "DST two"));
+  const std::vector<std::string> messages = {"message"};
+  JacobianPoint point1;
+  JacobianPoint point2;
+  hasher1->HashBatch(messages, absl::MakeSpan(&point1, 1));
+  hasher2->HashBatch(messages, absl::MakeSpan(&point2, 1));
+  EXPECT_NE(EncodeAll(group, absl::MakeConstSpan(&point1, 1)),
+            EncodeAll(group, absl::MakeConstSpan(&point2, 1)));
+}
+
+TEST(Sm2HashToCurveTest, TestInvalidDst) {
+  Sm2Group group;
+  EXPECT_EQ(Sm2HashToCurve::Create(group, "").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(Sm2HashToCurve::Create(group, std::string(256, 'd'))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -0,0 +1,333 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Built with -mavx512f -mavx512ifma on x86-64; only called after a runtime
+// CPU check.
+
+#include "private_set_intersection/cpp/crypto/sm2_internal.h"
+
+#if defined(__AVX512F__) && defined(__AVX512IFMA__)
+#include <immintrin.h>
+#endif
+
+namespace private_set_intersection {
+namespace sm2_internal {
+
+#if defined(__AVX512F__) && defined(__AVX512IFMA__)
+
+namespace {
+
+// A field element is held in five 52-bit limbs, the width of the IFMA
+// multipliers, and in Montgomery form x * 2^260 mod p. Each limb is a
+// register of eight 64-bit lanes, one point per lane.
+constexpr int kLimbs = 5;
+constexpr uint64_t kLimbMask = (uint64_t{1} << 52) - 1;
+
+constexpr int kTableSize = 1 << (kRecodeWindow - 1);
+
+// The SM2 prime and the factors that move an element between the Montgomery
+// form of `MontgomeryField`, x * 2^256, and that of the lanes: 2^264 mod p
+// into the lanes and 2^256 mod p out of them. Least significant limb first.
+constexpr uint64_t kP[kLimbs] = {0xfffffffffffff, 0xff00000000fff,
+                                 0xfffffffffffff, 0xfffffffffffff,
+                                 0xfffffffeffff};
+constexpr uint64_t kToLanes[kLimbs] = {0x100, 0xffffffff00000, 0x0, 0x0,
+                                       0x1000000};
+constexpr uint64_t kFromLanes[kLimbs] = {0x1, 0xffffffff000, 0x0, 0x0,
+                                         0x10000};
+
+struct Fe {
+  __m512i v[kLimbs];
+};
+
+struct Point {
+  Fe x;
+  Fe y;
+  Fe z;
+};
+
+inline __m512i Set(uint64_t value) {
+  return _mm512_set1_epi64(static_cast<long long>(value));
+}
+
+// Returns `mask ? a : b`, bitwise.
+inline __m512i Select(__m512i mask, __m512i a, __m512i b) {
+  return _mm512_ternarylogic_epi64(mask, a, b, 0xca);
+}
+
+inline Fe Constant(const uint64_t limbs[kLimbs]) {
+  Fe a;
+  for (int i = 0; i < kLimbs; i++) {
+    a.v[i] = Set(limbs[i]);
+  }
+  return a;
+}
+
+// Propagates carries so that the low limbs are in [0, 2^52). The top limb
+// takes the sign of a negative value.
+inline void Normalize(Fe* a) {
+  const __m512i mask = Set(kLimbMask);
+  for (int i = 0; i < kLimbs - 1; i++) {
+    const __m512i carry = _mm512_srai_epi64(a->v[i], 52);
+    a->v[i + 1] = _mm512_add_epi64(a->v[i + 1], carry);
+    a->v[i] = _mm512_and_si512(a->v[i], mask);
+  }
+}
+
+// Returns `a - p` in the lanes where it is not negative and `a` elsewhere.
+// Requires a normalized `a` in [0, 2p).
+inline Fe ReduceOnce(const Fe& a) {
+  Fe d;
+  for (int i = 0; i < kLimbs; i++) {
+    d.v[i] = _mm512_sub_epi64(a.v[i], Set(kP[i]));
+  }
+  Normalize(&d);
+  const __mmask8 negative =
+      _mm512_cmplt_epi64_mask(d.v[kLimbs - 1], _mm512_setzero_si512());
+  for (int i = 0; i < kLimbs; i++) {
+    d.v[i] = _mm512_mask_blend_epi64(negative, d.v[i], a.v[i]);
+  }
+  return d;
+}
+
+inline Fe Add(const Fe& a, const Fe& b) {
+  Fe s;
+  for (int i = 0; i < kLimbs; i++) {
+    s.v[i] = _mm512_add_epi64(a.v[i], b.v[i]);
+  }
+  Normalize(&s);
+  return ReduceOnce(s);
+}
+
+inline Fe Sub(const Fe& a, const Fe& b) {
+  Fe d;
+  for (int i = 0; i < kLimbs; i++) {
+    d.v[i] = _mm512_sub_epi64(a.v[i], b.v[i]);
+  }
+  Normalize(&d);
+  const __mmask8 negative =
+      _mm512_cmplt_epi64_mask(d.v[kLimbs - 1], _mm512_setzero_si512());
+  for (int i = 0; i < kLimbs; i++) {
+    d.v[i] =
+        _mm512_add_epi64(d.v[i], _mm512_maskz_mov_epi64(negative, Set(kP[i])));
+  }
+  Normalize(&d);
+  return d;
+}
+
+inline Fe Neg(const Fe& a) {
+  Fe zero;
+  for (int i = 0; i < kLimbs; i++) {
+    zero.v[i] = _mm512_setzero_si512();
+  }
+  return Sub(zero, a);
+}
+
+// Montgomery multiplication, a * b / 2^260 mod p, interleaving one row of the
+// product with one reduction step per limb of `b`. Since -p^-1 = 1 mod 2^52,
+// the multiple of p that clears the low limb is the low limb itself.
+inline Fe Mul(const Fe& a, const Fe& b) {
+  const __m512i mask = Set(kLimbMask);
+  __m512i t[kLimbs + 1];
+  for (int i = 0; i <= kLimbs; i++) {
+    t[i] = _mm512_setzero_si512();
+  }
+  for (int i = 0; i < kLimbs; i++) {
+    for (int j = 0; j < kLimbs; j++) {
+      t[j] = _mm512_madd52lo_epu64(t[j], a.v[j], b.v[i]);
+      t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], a.v[j], b.v[i]);
+    }
+    const __m512i q = _mm512_and_si512(t[0], mask);
+    for (int j = 0; j < kLimbs; j++) {
+      t[j] = _mm512_madd52lo_epu64(t[j], Set(kP[j]), q);
+      t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], Set(kP[j]), q);
+    }
+    // The low limb is now a multiple of 2^52; shift it out with its carry.
+    t[1] = _mm512_add_epi64(t[1], _mm512_srli_epi64(t[0], 52));
+    for (int j = 0; j < kLimbs; j++) {
+      t[j] = t[j + 1];
+    }
+    t[kLimbs] = _mm512_setzero_si512();
+  }
+  Fe r;
+  for (int i = 0; i < kLimbs; i++) {
+    r.v[i] = t[i];
+  }
+  Normalize(&r);
+  return ReduceOnce(r);
+}
+
+inline Fe Sqr(const Fe& a) { return Mul(a, a); }
+
+// The point formulas are those of `Sm2Group::Double` and `Sm2Group::Add`,
+// step for step, so the lanes compute the same Jacobian coordinates.
+Point Double(const Point& point) {
+  const Fe delta = Sqr(point.z);
+  const Fe gamma = Sqr(point.y);
+  const Fe beta = Mul(point.x, gamma);
+  Fe alpha = Mul(Sub(point.x, delta), Add(point.x, delta));
+  alpha = Add(Add(alpha, alpha), alpha);
+
+  const Fe beta2 = Add(beta, beta);
+  const Fe beta4 = Add(beta2, beta2);
+  const Fe beta8 = Add(beta4, beta4);
+
+  Point result;
+  result.x = Sub(Sqr(alpha), beta8);
+  result.z = Sub(Sub(Sqr(Add(point.y, point.z)), gamma), delta);
+  Fe gamma8 = Sqr(gamma);
+  gamma8 = Add(gamma8, gamma8);
+  gamma8 = Add(gamma8, gamma8);
+  gamma8 = Add(gamma8, gamma8);
+  result.y = Sub(Mul(alpha, Sub(beta4, result.x)), gamma8);
+  return result;
+}
+
+Point Add(const Point& a, const Point& b) {
+  const Fe z1z1 = Sqr(a.z);
+  const Fe z2z2 = Sqr(b.z);
+  const Fe u1 = Mul(a.x, z2z2);
+  const Fe u2 = Mul(b.x, z1z1);
+  const Fe s1 = Mul(a.y, Mul(b.z, z2z2));
+  const Fe s2 = Mul(b.y, Mul(a.z, z1z1));
+  const Fe h = Sub(u2, u1);
+  const Fe i = Sqr(Add(h, h));
+  const Fe j = Mul(h, i);
+  Fe r = Sub(s2, s1);
+  r = Add(r, r);
+  const Fe v = Mul(u1, i);
+
+  Point result;
+  result.x = Sub(Sub(Sqr(r), j), Add(v, v));
+  const Fe s1j = Mul(s1, j);
+  result.y = Sub(Mul(r, Sub(v, result.x)), Add(s1j, s1j));
+  result.z = Mul(Sub(Sub(Sqr(Add(a.z, b.z)), z1z1), z2z2), h);
+  return result;
+}
+
+// Multiplies the point of every lane by the recoded scalar, with the window
+// method and constant-time table lookups of `Sm2Group::Multiply`. The digits
+// are shared by all lanes.
+Point Multiply(const int8_t* digits, uint64_t negate_mask,
+               const Point& point) {
+  // table[i] = (2i + 1) * point
+  Point table[kTableSize];
+  table[0] = point;
+  const Point twice = Double(point);
+  for (int i = 1; i < kTableSize; i++) {
+    table[i] = Add(table[i - 1], twice);
+  }
+
+  // Returns digit * point by scanning the whole table.
+  auto lookup = [&](int8_t digit) {
+    const int sign = digit >> 7;
+    const uint64_t index = static_cast<uint64_t>((digit ^ sign) - sign) >> 1;
+    Point selected = table[0];
+    for (int i = 1; i < kTableSize; i++) {
+      const __m512i mask =
+          Set(0 - (((static_cast<uint64_t>(i) ^ index) - 1) >> 63));
+      for (int k = 0; k < kLimbs; k++) {
+        selected.x.v[k] = Select(mask, table[i].x.v[k], selected.x.v[k]);
+        selected.y.v[k] = Select(mask, table[i].y.v[k], selected.y.v[k]);
+        selected.z.v[k] = Select(mask, table[i].z.v[k], selected.z.v[k]);
+      }
+    }
+    const Fe negated = Neg(selected.y);
+    const __m512i sign_mask = Set(static_cast<uint64_t>(sign));
+    for (int k = 0; k < kLimbs; k++) {
+      selected.y.v[k] = Select(sign_mask, negated.v[k], selected.y.v[k]);
+    }
+    return selected;
+  };
+
+  Point result = lookup(digits[kRecodeDigits - 1]);
+  for (int i = kRecodeDigits - 2; i >= 0; i--) {
+    for (int j = 0; j < kRecodeWindow; j++) {
+      result = Double(result);
+    }
+    result = Add(result, lookup(digits[i]));
+  }
+  const Fe negated = Neg(result.y);
+  const __m512i mask = Set(negate_mask);
+  for (int k = 0; k < kLimbs; k++) {
+    result.y.v[k] = Select(mask, negated.v[k], result.y.v[k]);
+  }
+  return result;
+}
+
+// Loads coordinate `coordinate` of eight points into the lanes and converts
+// it to their Montgomery form.
+Fe Load(const uint64_t* points, int coordinate) {
+  alignas(64) uint64_t limbs[kLimbs][kIfmaLanes];
+  for (int lane = 0; lane < kIfmaLanes; lane++) {
+    const uint64_t* w = points + lane * kPointWords + 4 * coordinate;
+    limbs[0][lane] = w[0] & kLimbMask;
+    limbs[1][lane] = ((w[0] >> 52) | (w[1] << 12)) & kLimbMask;
+    limbs[2][lane] = ((w[1] >> 40) | (w[2] << 24)) & kLimbMask;
+    limbs[3][lane] = ((w[2] >> 28) | (w[3] << 36)) & kLimbMask;
+    limbs[4][lane] = w[3] >> 16;
+  }
+  Fe a;
+  for (int i = 0; i < kLimbs; i++) {
+    a.v[i] = _mm512_load_si512(limbs[i]);
+  }
+  return Mul(a, Constant(kToLanes));
+}
+
+// Converts `a` back to the Montgomery form of `MontgomeryField` and stores it
+// as coordinate `coordinate` of eight points.
+void Store(const Fe& a, uint64_t* points, int coordinate) {
+  const Fe b = Mul(a, Constant(kFromLanes));
+  alignas(64) uint64_t limbs[kLimbs][kIfmaLanes];
+  for (int i = 0; i < kLimbs; i++) {
+    _mm512_store_si512(limbs[i], b.v[i]);
+  }
+  for (int lane = 0; lane < kIfmaLanes; lane++) {
+    uint64_t* w = points + lane * kPointWords + 4 * coordinate;
+    w[0] = limbs[0][lane] | (limbs[1][lane] << 52);
+    w[1] = (limbs[1][lane] >> 12) | (limbs[2][lane] << 40);
+    w[2] = (limbs[2][lane] >> 24) | (limbs[3][lane] << 28);
+    w[3] = (limbs[3][lane] >> 36) | (limbs[4][lane] << 16);
+  }
+}
+
+void MultiplyIfma(const int8_t* digits, uint64_t negate_mask,
+                  uint64_t* points, size_t count) {
+  for (size_t begin = 0; begin < count; begin += kIfmaLanes) {
+    uint64_t* group = points + begin * kPointWords;
+    Point point;
+    point.x = Load(group, 0);
+    point.y = Load(group, 1);
+    point.z = Load(group, 2);
+    const Point product = Multiply(digits, negate_mask, point);
+    Store(product.x, group, 0);
+    Store(product.y, group, 1);
+    Store(product.z, group, 2);
+  }
+}
+
+}  // namespace
+
+MultiplyKernel GetIfmaMultiplyKernel() { return &MultiplyIfma; }
+
+#else
+
+MultiplyKernel GetIfmaMultiplyKernel() { return nullptr; }
+
+#endif
+
+}  // namespace sm2_internal
+}  // namespace private_set_intersection
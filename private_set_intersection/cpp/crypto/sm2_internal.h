@@ -0,0 +1,58 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM2_INTERNAL_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM2_INTERNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Shared between `Sm2Group` and the SIMD scalar multiplication kernels, which
+// are built in their own translation units with extra instruction-set flags.
+// Only plain words cross the boundary, so that none of the inline arithmetic
+// of the field and group headers is compiled with those flags and picked by
+// the linker for use on CPUs without them.
+
+namespace private_set_intersection {
+namespace sm2_internal {
+
+// The window width and number of digits of a `RecodedScalar`.
+constexpr int kRecodeWindow = 5;
+constexpr int kRecodeDigits = 52;
+
+// Number of words of a point passed to a kernel: X, Y and Z in Montgomery
+// form, four little-endian 64-bit limbs each, laid out as in `JacobianPoint`.
+constexpr int kPointWords = 12;
+
+// Multiplies each of the `count` points at `points` by the scalar recoded into
+// `digits` and `negate_mask`, as in `RecodedScalar`, and overwrites them with
+// the products. The products are the same field elements `Sm2Group::Multiply`
+// computes. `count` must be a multiple of the kernel's number of lanes.
+using MultiplyKernel = void (*)(const int8_t* digits, uint64_t negate_mask,
+                                uint64_t* points, size_t count);
+
+// Number of points the AVX-512 IFMA kernel multiplies at once.
+constexpr int kIfmaLanes = 8;
+
+// Returns the kernel, or null if it was not compiled in (for example on other
+// architectures). It must only be called if the CPU supports AVX-512F and
+// AVX-512 IFMA.
+MultiplyKernel GetIfmaMultiplyKernel();
+
+}  // namespace sm2_internal
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM2_INTERNAL_H_
@@ -0,0 +1,255 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm3.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/numeric/int128.h"
+#include "private_set_intersection/cpp/crypto/sm3_internal.h"
+#include "private_set_intersection/cpp/util/cpu_features.h"
+
+namespace private_set_intersection {
+
+using sm3_internal::kInitialState;
+using sm3_internal::kMaxLanes;
+using sm3_internal::LanesKernel;
+
+namespace {
+
+constexpr size_t kBlockSize = 64;
+
+// A single lane in a general-purpose register.
+struct ScalarLane {
+  using Vec = uint32_t;
+  static Vec Add(Vec a, Vec b) { return a + b; }
+  static Vec Xor(Vec a, Vec b) { return a ^ b; }
+  static Vec Xor3(Vec a, Vec b, Vec c) { return a ^ b ^ c; }
+  static Vec Majority(Vec a, Vec b, Vec c) {
+    return (a & b) | (a & c) | (b & c);
+  }
+  static Vec Choose(Vec a, Vec b, Vec c) { return (a & b) | (~a & c); }
+  static Vec Set(uint32_t value) { return value; }
+  template <int N>
+  static Vec Rotl(Vec x) {
+    return (x << N) | (x >> (32 - N));
+  }
+};
+
+uint32_t LoadBigEndian32(const uint8_t* bytes) {
+  return (static_cast<uint32_t>(bytes[0]) << 24) |
+         (static_cast<uint32_t>(bytes[1]) << 16) |
+         (static_cast<uint32_t>(bytes[2]) << 8) |
+         static_cast<uint32_t>(bytes[3]);
+}
+
+void StoreBigEndian32(uint32_t value, uint8_t* bytes) {
+  bytes[0] = static_cast<uint8_t>(value >> 24);
+  bytes[1] = static_cast<uint8_t>(value >> 16);
+  bytes[2] = static_cast<uint8_t>(value >> 8);
+  bytes[3] = static_cast<uint8_t>(value);
+}
+
+// The blocks of a message, with the padded tail kept in a local buffer so
+// that full blocks are read in place.
+class PaddedMessage {
+ public:
+  PaddedMessage() = default;
+
+  explicit PaddedMessage(absl::string_view message) { Reset(message); }
+
+  void Reset(absl::string_view message) {
+    data_ = reinterpret_cast<const uint8_t*>(message.data());
+    full_blocks_ = message.size() / kBlockSize;
+    const size_t tail_size = message.size() % kBlockSize;
+    // The tail needs room for the 0x80 byte and the 64-bit length.
+    tail_blocks_ = tail_size + 9 <= kBlockSize ? 1 : 2;
+
+    std::memset(tail_, 0, sizeof(tail_));
+    if (tail_size > 0) {
+      std::memcpy(tail_, data_ + full_blocks_ * kBlockSize, tail_size);
+    }
+    tail_[tail_size] = 0x80;
+    const uint64_t bit_length = static_cast<uint64_t>(message.size()) * 8;
+    uint8_t* length = tail_ + tail_blocks_ * kBlockSize - 8;
+    StoreBigEndian32(static_cast<uint32_t>(bit_length >> 32), length);
+    StoreBigEndian32(static_cast<uint32_t>(bit_length), length + 4);
+  }
+
+  size_t num_blocks() const { return full_blocks_ + tail_blocks_; }
+
+  const uint8_t* Block(size_t index) const {
+    return index < full_blocks_ ? data_ + index * kBlockSize
+                                : tail_ + (index - full_blocks_) * kBlockSize;
+  }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t full_blocks_ = 0;
+  size_t tail_blocks_ = 0;
+  uint8_t tail_[2 * kBlockSize];
+};
+
+struct Kernel {
+  LanesKernel compress = nullptr;
+  int lanes = 1;
+};
+
+/**
+ * @brief Picks the widest kernel that is compiled in and supported by the CPU
+ *
+ * @return The kernel, whose `compress` is null if none can be used
+ */
+Kernel SelectKernel() {
+  Kernel kernel;
+  if (LanesKernel avx512 = sm3_internal::GetAvx512Kernel();
+      avx512 != nullptr && CpuSupportsAvx512f()) {
+    kernel.compress = avx512;
+    kernel.lanes = 16;
+  } else if (LanesKernel avx2 = sm3_internal::GetAvx2Kernel();
+             avx2 != nullptr && CpuSupportsAvx2()) {
+    kernel.compress = avx2;
+    kernel.lanes = 8;
+  }
+  return kernel;
+}
+
+const Kernel& GetKernel() {
+  static const Kernel kernel = SelectKernel();
+  return kernel;
+}
+
+/**
+ * @brief Hashes up to `kernel.lanes` messages with one call to the kernel per
+ * block. Lanes whose message has run out of blocks keep their state.
+ *
+ * @param kernel The SIMD kernel
+ * @param messages The messages, at most `kernel.lanes` of them
+ * @param digests The output digests
+ */
+void HashGroup(const Kernel& kernel,
+               absl::Span<const absl::string_view> messages,
+               Sm3Digest* digests) {
+  const size_t lanes = messages.size();
+  PaddedMessage padded[kMaxLanes];
+  size_t max_blocks = 0;
+  for (size_t lane = 0; lane < lanes; lane++) {
+    padded[lane].Reset(messages[lane]);
+    max_blocks = std::max(max_blocks, padded[lane].num_blocks());
+  }
+
+  uint32_t state[8][kMaxLanes] = {};
+  for (int i = 0; i < 8; i++) {
+    std::fill_n(state[i], kMaxLanes, kInitialState[i]);
+  }
+  uint32_t block[16][kMaxLanes] = {};
+  uint32_t saved[8][kMaxLanes];
+  for (size_t index = 0; index < max_blocks; index++) {
+    bool all_active = true;
+    for (size_t lane = 0; lane < lanes; lane++) {
+      if (index >= padded[lane].num_blocks()) {
+        all_active = false;
+        continue;
+      }
+      const uint8_t* bytes = padded[lane].Block(index);
+      for (int j = 0; j < 16; j++) {
+        block[j][lane] = LoadBigEndian32(bytes + 4 * j);
+      }
+    }
+    if (!all_active) {
+      std::memcpy(saved, state, sizeof(state));
+    }
+    kernel.compress(state, block);
+    if (!all_active) {
+      for (size_t lane = 0; lane < lanes; lane++) {
+        if (index >= padded[lane].num_blocks()) {
+          for (int i = 0; i < 8; i++) {
+            state[i][lane] = saved[i][lane];
+          }
+        }
+      }
+    }
+  }
+
+  for (size_t lane = 0; lane < lanes; lane++) {
+    for (int i = 0; i < 8; i++) {
+      StoreBigEndian32(state[i][lane], digests[lane].data() + 4 * i);
+    }
+  }
+}
+
+}  // namespace
+
+Sm3Digest Sm3(absl::string_view message) {
+  const PaddedMessage padded(message);
+  uint32_t state[8];
+  std::copy_n(kInitialState, 8, state);
+  uint32_t block[16];
+  for (size_t index = 0; index < padded.num_blocks(); index++) {
+    const uint8_t* bytes = padded.Block(index);
+    for (int j = 0; j < 16; j++) {
+      block[j] = LoadBigEndian32(bytes + 4 * j);
+    }
+    sm3_internal::CompressLanes<ScalarLane>(state, block);
+  }
+
+  Sm3Digest digest;
+  for (int i = 0; i < 8; i++) {
+    StoreBigEndian32(state[i], digest.data() + 4 * i);
+  }
+  return digest;
+}
+
+void Sm3Batch(absl::Span<const absl::string_view> messages,
+              absl::Span<Sm3Digest> digests) {
+  const Kernel& kernel = GetKernel();
+  size_t i = 0;
+  if (kernel.compress != nullptr) {
+    // A short final group still beats hashing its messages one by one.
+    const size_t min_group = std::max(2, kernel.lanes / 4);
+    while (messages.size() - i >= min_group) {
+      const size_t count =
+          std::min<size_t>(kernel.lanes, messages.size() - i);
+      HashGroup(kernel, messages.subspan(i, count), &digests[i]);
+      i += count;
+    }
+  }
+  for (; i < messages.size(); i++) {
+    digests[i] = Sm3(messages[i]);
+  }
+}
+
+int Sm3BatchLanes() { return GetKernel().lanes; }
+
+uint64_t Sm3DigestMod(const Sm3Digest& digest, uint64_t modulus) {
+  if (modulus == 0) {
+    return 0;
+  }
+  // Horner's rule over the 64-bit words, most significant first.
+  uint64_t remainder = 0;
+  for (size_t i = 0; i < kSm3DigestSize; i += 8) {
+    uint64_t word = 0;
+    for (size_t j = 0; j < 8; j++) {
+      word = (word << 8) | digest[i + j];
+    }
+    remainder = absl::Uint128Low64(
+        absl::MakeUint128(remainder, word) % modulus);
+  }
+  return remainder;
+}
+
+}  // namespace private_set_intersection
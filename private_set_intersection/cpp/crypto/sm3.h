@@ -0,0 +1,56 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM3_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM3_H_
+
+#include <array>
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace private_set_intersection {
+
+// Size of an SM3 digest in bytes.
+constexpr size_t kSm3DigestSize = 32;
+
+using Sm3Digest = std::array<uint8_t, kSm3DigestSize>;
+
+// Returns the SM3 digest (GB/T 32905-2016) of `message`.
+Sm3Digest Sm3(absl::string_view message);
+
+// Computes the SM3 digest of every message in `messages` into the entry of
+// `digests` at the same position. `digests` must be as long as `messages`.
+//
+// Independent messages are hashed side by side in the lanes of the widest
+// vector unit the CPU supports (16 with AVX-512, 8 with AVX2), which is much
+// faster than hashing them one at a time. Messages of similar length batch
+// best, since a group of lanes runs until its longest message is done.
+void Sm3Batch(absl::Span<const absl::string_view> messages,
+              absl::Span<Sm3Digest> digests);
+
+// Returns the number of messages `Sm3Batch` hashes at once on this CPU, or 1
+// if it falls back to the portable implementation.
+int Sm3BatchLanes();
+
+// Returns `digest`, read as a big-endian integer, modulo `modulus`, or 0 if
+// `modulus` is 0. This equals reducing the digest as an OpenSSL BigNum.
+uint64_t Sm3DigestMod(const Sm3Digest& digest, uint64_t modulus);
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM3_H_
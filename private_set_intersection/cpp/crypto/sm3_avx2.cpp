@@ -0,0 +1,83 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Built with -mavx2 on x86-64; only called after a runtime CPU check.
+
+#include "private_set_intersection/cpp/crypto/sm3_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace private_set_intersection {
+namespace sm3_internal {
+
+#if defined(__AVX2__)
+
+namespace {
+
+// Eight lanes in a 256-bit register.
+struct Avx2Lanes {
+  using Vec = __m256i;
+  static Vec Add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+  static Vec Xor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+  static Vec Xor3(Vec a, Vec b, Vec c) { return Xor(Xor(a, b), c); }
+  static Vec Majority(Vec a, Vec b, Vec c) {
+    // (a & b) | (c & (a | b))
+    return _mm256_or_si256(_mm256_and_si256(a, b),
+                           _mm256_and_si256(c, _mm256_or_si256(a, b)));
+  }
+  static Vec Choose(Vec a, Vec b, Vec c) {
+    return _mm256_or_si256(_mm256_and_si256(a, b), _mm256_andnot_si256(a, c));
+  }
+  static Vec Set(uint32_t value) {
+    return _mm256_set1_epi32(static_cast<int>(value));
+  }
+  template <int N>
+  static Vec Rotl(Vec x) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, N),
+                           _mm256_srli_epi32(x, 32 - N));
+  }
+};
+
+void CompressAvx2(uint32_t state[8][kMaxLanes],
+                  const uint32_t block[16][kMaxLanes]) {
+  __m256i v[8];
+  __m256i w[16];
+  for (int i = 0; i < 8; i++) {
+    v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state[i]));
+  }
+  for (int j = 0; j < 16; j++) {
+    w[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block[j]));
+  }
+  CompressLanes<Avx2Lanes>(v, w);
+  for (int i = 0; i < 8; i++) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[i]), v[i]);
+  }
+}
+
+}  // namespace
+
+LanesKernel GetAvx2Kernel() { return &CompressAvx2; }
+
+#else
+
+LanesKernel GetAvx2Kernel() { return nullptr; }
+
+#endif
+
+}  // namespace sm3_internal
+}  // namespace private_set_intersection
@@ -0,0 +1,83 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Built with -mavx512f on x86-64; only called after a runtime CPU check.
+
+#include "private_set_intersection/cpp/crypto/sm3_internal.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace private_set_intersection {
+namespace sm3_internal {
+
+#if defined(__AVX512F__)
+
+namespace {
+
+// Sixteen lanes in a 512-bit register. The three-input boolean functions map
+// to a single vpternlogd, whose immediate is the function's truth table.
+struct Avx512Lanes {
+  using Vec = __m512i;
+  static Vec Add(Vec a, Vec b) { return _mm512_add_epi32(a, b); }
+  static Vec Xor(Vec a, Vec b) { return _mm512_xor_si512(a, b); }
+  static Vec Xor3(Vec a, Vec b, Vec c) {
+    return _mm512_ternarylogic_epi32(a, b, c, 0x96);
+  }
+  static Vec Majority(Vec a, Vec b, Vec c) {
+    return _mm512_ternarylogic_epi32(a, b, c, 0xe8);
+  }
+  static Vec Choose(Vec a, Vec b, Vec c) {
+    return _mm512_ternarylogic_epi32(a, b, c, 0xca);
+  }
+  static Vec Set(uint32_t value) {
+    return _mm512_set1_epi32(static_cast<int>(value));
+  }
+  template <int N>
+  static Vec Rotl(Vec x) {
+    return _mm512_rol_epi32(x, N);
+  }
+};
+
+void CompressAvx512(uint32_t state[8][kMaxLanes],
+                    const uint32_t block[16][kMaxLanes]) {
+  __m512i v[8];
+  __m512i w[16];
+  for (int i = 0; i < 8; i++) {
+    v[i] = _mm512_loadu_si512(state[i]);
+  }
+  for (int j = 0; j < 16; j++) {
+    w[j] = _mm512_loadu_si512(block[j]);
+  }
+  CompressLanes<Avx512Lanes>(v, w);
+  for (int i = 0; i < 8; i++) {
+    _mm512_storeu_si512(state[i], v[i]);
+  }
+}
+
+}  // namespace
+
+LanesKernel GetAvx512Kernel() { return &CompressAvx512; }
+
+#else
+
+LanesKernel GetAvx512Kernel() { return nullptr; }
+
+#endif
+
+}  // namespace sm3_internal
+}  // namespace private_set_intersection
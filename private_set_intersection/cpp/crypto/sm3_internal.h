@@ -0,0 +1,121 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_SM3_INTERNAL_H_
+#define PRIVATE_SET_INTERSECTION_CPP_SM3_INTERNAL_H_
+
+#include <cstdint>
+
+// Shared between the portable SM3 code and the SIMD kernels, which are built
+// in their own translation units with extra instruction-set flags. Everything
+// here is either a constant or a template instantiated with a lane type that
+// is private to one translation unit, so no code compiled for AVX2 or AVX-512
+// can be picked by the linker for use on CPUs without it.
+
+namespace private_set_intersection {
+namespace sm3_internal {
+
+// Maximum number of lanes of any kernel. Lane-major buffers passed to kernels
+// are always this wide, and a kernel with fewer lanes uses the first ones.
+constexpr int kMaxLanes = 16;
+
+// Compresses one 64-byte block into the state of each lane:
+// `state[i][lane]` is word i of the state, and `block[j][lane]` is the j-th
+// big-endian word of the block.
+using LanesKernel = void (*)(uint32_t state[8][kMaxLanes],
+                             const uint32_t block[16][kMaxLanes]);
+
+// Return the kernels, or null if they were not compiled in (for example on
+// other architectures). They must only be called if the CPU supports them.
+LanesKernel GetAvx2Kernel();
+LanesKernel GetAvx512Kernel();
+
+constexpr uint32_t kInitialState[8] = {0x7380166f, 0x4914b2b9, 0x172442d7,
+                                       0xda8a0600, 0xa96f30bc, 0x163138aa,
+                                       0xe38dee4d, 0xb0fb0e4e};
+
+constexpr uint32_t RotlConst(uint32_t x, int n) {
+  return n == 0 ? x : (x << n) | (x >> (32 - n));
+}
+
+// T_j rotated left by j mod 32, as added in round j.
+struct RoundConstants {
+  uint32_t values[64];
+  constexpr RoundConstants() : values() {
+    for (int j = 0; j < 64; j++) {
+      values[j] = RotlConst(j < 16 ? 0x79cc4519 : 0x7a879d8a, j % 32);
+    }
+  }
+};
+constexpr RoundConstants kRoundConstants;
+
+// The SM3 compression function on `L::Vec`, which holds one 32-bit word per
+// lane. `L` provides Add, Xor, Xor3, Majority (bitwise majority), Choose
+// (x ? y : z, bitwise), Set (broadcast) and Rotl<n>.
+template <class L>
+inline void CompressLanes(typename L::Vec v[8],
+                          const typename L::Vec block[16]) {
+  using Vec = typename L::Vec;
+  Vec w[68];
+  for (int j = 0; j < 16; j++) {
+    w[j] = block[j];
+  }
+  for (int j = 16; j < 68; j++) {
+    const Vec x =
+        L::Xor3(w[j - 16], w[j - 9], L::template Rotl<15>(w[j - 3]));
+    // P1(x) = x ^ (x <<< 15) ^ (x <<< 23)
+    const Vec p1 =
+        L::Xor3(x, L::template Rotl<15>(x), L::template Rotl<23>(x));
+    w[j] = L::Xor3(p1, L::template Rotl<7>(w[j - 13]), w[j - 6]);
+  }
+
+  Vec a = v[0], b = v[1], c = v[2], d = v[3];
+  Vec e = v[4], f = v[5], g = v[6], h = v[7];
+  for (int j = 0; j < 64; j++) {
+    const Vec a12 = L::template Rotl<12>(a);
+    const Vec ss1 = L::template Rotl<7>(
+        L::Add(L::Add(a12, e), L::Set(kRoundConstants.values[j])));
+    const Vec ss2 = L::Xor(ss1, a12);
+    const Vec ff = j < 16 ? L::Xor3(a, b, c) : L::Majority(a, b, c);
+    const Vec gg = j < 16 ? L::Xor3(e, f, g) : L::Choose(e, f, g);
+    const Vec tt1 =
+        L::Add(L::Add(ff, d), L::Add(ss2, L::Xor(w[j], w[j + 4])));
+    const Vec tt2 = L::Add(L::Add(gg, h), L::Add(ss1, w[j]));
+    d = c;
+    c = L::template Rotl<9>(b);
+    b = a;
+    a = tt1;
+    h = g;
+    g = L::template Rotl<19>(f);
+    f = e;
+    // P0(x) = x ^ (x <<< 9) ^ (x <<< 17)
+    e = L::Xor3(tt2, L::template Rotl<9>(tt2), L::template Rotl<17>(tt2));
+  }
+
+  v[0] = L::Xor(v[0], a);
+  v[1] = L::Xor(v[1], b);
+  v[2] = L::Xor(v[2], c);
+  v[3] = L::Xor(v[3], d);
+  v[4] = L::Xor(v[4], e);
+  v[5] = L::Xor(v[5], f);
+  v[6] = L::Xor(v[6], g);
+  v[7] = L::Xor(v[7], h);
+}
+
+}  // namespace sm3_internal
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_SM3_INTERNAL_H_
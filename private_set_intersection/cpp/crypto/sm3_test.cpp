@@ -0,0 +1,118 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/crypto/sm3.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_join_and_compute/crypto/context.h"
+
+namespace private_set_intersection {
+namespace {
+
+std::string ToHex(const Sm3Digest& digest) {
+  return absl::BytesToHexString(absl::string_view(
+      reinterpret_cast<const char*>(digest.data()), digest.size()));
+}
+
+std::string ToBytes(const Sm3Digest& digest) {
+  return std::string(reinterpret_cast<const char*>(digest.data()),
+                     digest.size());
+}
+
+TEST(Sm3Test, TestKnownAnswers) {
+  // Examples 1 and 2 of GB/T 32905-2016.
+  EXPECT_EQ(ToHex(Sm3("abc")),
+            "66c7f0f462eeedd9d1f2d46bdc10e4e24167c4875cf2f7a2297da02b8f4ba8e0");
+  std::string abcd;
+  for (int i = 0; i < 16; i++) {
+    abcd += "abcd";
+  }
+  EXPECT_EQ(ToHex(Sm3(abcd)),
+            "debe9ff92275b8a138604889c18e5a4d6fdb70e5387e5765293dcba39c0c5732");
+}
+
+TEST(Sm3Test, TestMatchesContext) {
+  ::private_join_and_compute::Context context;
+  // Cover every tail length, including the ones that need a second padding
+  // block, plus a few multi-block messages.
+  for (size_t length = 0; length <= 200; length++) {
+    const std::string message(length, static_cast<char>('a' + length % 26));
+    EXPECT_EQ(ToBytes(Sm3(message)), context.Sm3String(message)) << length;
+  }
+}
+
+TEST(Sm3Test, TestBatchMatchesSingle) {
+  // Mixed lengths make the lanes of a group finish at different blocks, and
+  // the count leaves a partial group at the end.
+  std::vector<std::string> messages;
+  for (int i = 0; i < 101; i++) {
+    messages.push_back(std::string((i * 37) % 300, static_cast<char>(i)) +
+                       absl::StrCat(i));
+  }
+  std::vector<absl::string_view> views(messages.begin(), messages.end());
+  std::vector<Sm3Digest> digests(messages.size());
+  Sm3Batch(views, absl::MakeSpan(digests));
+  for (size_t i = 0; i < messages.size(); i++) {
+    EXPECT_EQ(digests[i], Sm3(messages[i])) << i;
+  }
+}
+
+TEST(Sm3Test, TestBatchSizes) {
+  for (size_t count = 0; count <= 40; count++) {
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < count; i++) {
+      messages.push_back(absl::StrCat("Element ", i));
+    }
+    std::vector<absl::string_view> views(messages.begin(), messages.end());
+    std::vector<Sm3Digest> digests(count);
+    Sm3Batch(views, absl::MakeSpan(digests));
+    for (size_t i = 0; i < count; i++) {
+      EXPECT_EQ(digests[i], Sm3(messages[i])) << count << " " << i;
+    }
+  }
+}
+
+TEST(Sm3Test, TestBatchLanes) {
+  const int lanes = Sm3BatchLanes();
+  EXPECT_TRUE(lanes == 1 || lanes == 8 || lanes == 16);
+}
+
+TEST(Sm3Test, TestDigestMod) {
+  ::private_join_and_compute::Context context;
+  const std::vector<uint64_t> moduli = {1, 2, 3, 1000, 1ULL << 32, 999999937,
+                                        (1ULL << 63) - 25};
+  for (int i = 0; i < 20; i++) {
+    const std::string message = absl::StrCat(i);
+    const Sm3Digest digest = Sm3(message);
+    for (uint64_t modulus : moduli) {
+      const uint64_t expected =
+          context.CreateBigNum(ToBytes(digest))
+              .Mod(context.CreateBigNum(modulus))
+              .ToIntValue()
+              .value();
+      EXPECT_EQ(Sm3DigestMod(digest, modulus), expected);
+    }
+  }
+  EXPECT_EQ(Sm3DigestMod(Sm3("abc"), 0), 0);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
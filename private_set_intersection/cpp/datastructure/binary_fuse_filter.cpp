@@ -0,0 +1,397 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "absl/base/internal/endian.h"
+#include "absl/base/prefetch.h"
+#include "absl/memory/memory.h"
+#include "absl/numeric/int128.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/util/parallel.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+constexpr uint32_t kMaxSegmentLength = 1 << 18;
+
+// Number of seeds tried before giving up. A single seed fails with a
+// probability well below 1% for all but tiny sets.
+constexpr int kMaxAttempts = 100;
+
+// Start of the fixed sequence of seeds tried during construction.
+constexpr uint64_t kSeedSequenceStart = 0x6a09e667f3bcc908;
+
+// Number of elements whose slots are prefetched before any of them is
+// tested.
+constexpr size_t kQueryBatchSize = 32;
+
+// Rehashes a key with the filter's seed (the MurmurHash3 finalizer, which is
+// a bijection on 64-bit words).
+uint64_t MixKey(uint64_t key, uint64_t seed) {
+  uint64_t h = key + seed;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53;
+  h ^= h >> 33;
+  return h;
+}
+
+// Advances `state` and returns the next seed (SplitMix64).
+uint64_t NextSeed(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+// The three slots of a mixed hash: one in each of three consecutive
+// segments, the first segment being picked by the high bits of the hash.
+void SlotsFor(uint64_t hash, uint32_t segment_length, uint32_t segment_count,
+              uint32_t slots[3]) {
+  const uint64_t mask = segment_length - 1;
+  const auto first = static_cast<uint32_t>(absl::Uint128High64(
+      absl::uint128(hash) * (uint64_t{segment_count} * segment_length)));
+  slots[0] = first;
+  slots[1] = static_cast<uint32_t>((first + segment_length) ^
+                                   ((hash >> 18) & mask));
+  slots[2] = static_cast<uint32_t>((first + 2 * segment_length) ^
+                                   (hash & mask));
+}
+
+uint32_t FingerprintOf(uint64_t hash) {
+  return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+/**
+ * @brief Solves the filter for `keys` and `seed` by peeling: a slot used by a
+ * single remaining key determines that key's fingerprint last, so the key is
+ * removed and the slot recorded. If all keys can be removed, fingerprints
+ * are assigned in reverse removal order.
+ *
+ * @param keys The distinct keys
+ * @param seed The seed keys are mixed with
+ * @param segment_length The number of slots per segment, a power of two
+ * @param segment_count The number of segments a first slot can fall into
+ * @param fingerprint_mask The mask of a fingerprint's bits
+ * @param fingerprints Receives the (segment_count + 2) * segment_length
+ * fingerprints on success
+ * @return Whether the keys could be peeled with this seed
+ */
+bool Solve(const std::vector<uint64_t>& keys, uint64_t seed,
+           uint32_t segment_length, uint32_t segment_count,
+           uint32_t fingerprint_mask, std::vector<uint32_t>* fingerprints) {
+  const size_t num_slots =
+      (static_cast<size_t>(segment_count) + 2) * segment_length;
+
+  // Per slot, the number of keys using it times 4 plus the XOR of the
+  // positions (0, 1 or 2) it has among their slots, and the XOR of their
+  // hashes. Once a single key is left, they identify it and its position.
+  std::vector<uint8_t> counts(num_slots);
+  std::vector<uint64_t> hashes(num_slots);
+  uint32_t slots[3];
+  for (uint64_t key : keys) {
+    const uint64_t hash = MixKey(key, seed);
+    SlotsFor(hash, segment_length, segment_count, slots);
+    for (uint8_t j = 0; j < 3; j++) {
+      uint8_t& count = counts[slots[j]];
+      if (count >= 252) {
+        return false;
+      }
+      count = static_cast<uint8_t>((count + 4) ^ j);
+      hashes[slots[j]] ^= hash;
+    }
+  }
+
+  std::vector<uint32_t> alone;
+  for (uint32_t slot = 0; slot < num_slots; slot++) {
+    if ((counts[slot] >> 2) == 1) {
+      alone.push_back(slot);
+    }
+  }
+  std::vector<uint64_t> order;
+  std::vector<uint8_t> positions;
+  order.reserve(keys.size());
+  positions.reserve(keys.size());
+  while (!alone.empty()) {
+    const uint32_t slot = alone.back();
+    alone.pop_back();
+    if ((counts[slot] >> 2) != 1) {
+      continue;
+    }
+    const uint64_t hash = hashes[slot];
+    const uint8_t position = counts[slot] & 3;
+    order.push_back(hash);
+    positions.push_back(position);
+    counts[slot] = 0;
+    SlotsFor(hash, segment_length, segment_count, slots);
+    for (uint8_t j = 0; j < 3; j++) {
+      if (j == position) {
+        continue;
+      }
+      uint8_t& count = counts[slots[j]];
+      count = static_cast<uint8_t>((count - 4) ^ j);
+      hashes[slots[j]] ^= hash;
+      if ((count >> 2) == 1) {
+        alone.push_back(slots[j]);
+      }
+    }
+  }
+  if (order.size() != keys.size()) {
+    return false;
+  }
+
+  fingerprints->assign(num_slots, 0);
+  for (size_t i = order.size(); i-- > 0;) {
+    const uint64_t hash = order[i];
+    SlotsFor(hash, segment_length, segment_count, slots);
+    const uint8_t position = positions[i];
+    (*fingerprints)[slots[position]] =
+        (FingerprintOf(hash) & fingerprint_mask) ^
+        (*fingerprints)[slots[(position + 1) % 3]] ^
+        (*fingerprints)[slots[(position + 2) % 3]];
+  }
+  return true;
+}
+
+template <typename Fingerprint>
+uint32_t LoadFingerprint(const char* data, uint32_t slot) {
+  const char* bytes = data + static_cast<size_t>(slot) * sizeof(Fingerprint);
+  if constexpr (sizeof(Fingerprint) == 1) {
+    return static_cast<uint8_t>(*bytes);
+  } else if constexpr (sizeof(Fingerprint) == 2) {
+    return absl::little_endian::Load16(bytes);
+  } else {
+    return absl::little_endian::Load32(bytes);
+  }
+}
+
+}  // namespace
+
+BinaryFuseFilter::BinaryFuseFilter(uint64_t seed, int fingerprint_bits,
+                                   uint32_t segment_length,
+                                   uint32_t segment_count,
+                                   std::string fingerprints)
+    : seed_(seed),
+      fingerprint_bits_(fingerprint_bits),
+      segment_length_(segment_length),
+      segment_count_(segment_count),
+      fingerprints_(std::move(fingerprints)) {}
+
+/**
+ * @brief Sizes the filter as in the reference implementation of binary fuse
+ * filters, then tries seeds from a fixed sequence until the keys peel
+ *
+ * @param fpr The target false-positive rate
+ * @param num_client_inputs The number of client inputs (unused, the size of
+ * the filter only depends on the server elements)
+ * @param elements The elements to insert
+ * @param num_threads The number of threads to hash and sort the elements on
+ * @return The filter
+ */
+StatusOr<std::unique_ptr<BinaryFuseFilter>> BinaryFuseFilter::Create(
+    double fpr, int64_t /*num_client_inputs*/,
+    absl::Span<const std::string> elements, int num_threads) {
+  if (fpr <= 0 || fpr >= 1) {
+    return absl::InvalidArgumentError("`fpr` must be in (0,1)");
+  }
+  int fingerprint_bits;
+  if (fpr >= std::ldexp(1.0, -8)) {
+    fingerprint_bits = 8;
+  } else if (fpr >= std::ldexp(1.0, -16)) {
+    fingerprint_bits = 16;
+  } else if (fpr >= std::ldexp(1.0, -32)) {
+    fingerprint_bits = 32;
+  } else {
+    return absl::InvalidArgumentError(
+        "`fpr` must be at least 2^-32 for binary fuse filters");
+  }
+
+  // Hashing cannot fail.
+  std::vector<uint64_t> keys(elements.size());
+  ParallelFor(num_threads, static_cast<int64_t>(elements.size()),
+              [&](int, int64_t begin, int64_t end) {
+                for (int64_t i = begin; i < end; i++) {
+                  keys[i] = FilterHash64(elements[i]);
+                }
+                return absl::OkStatus();
+              })
+      .IgnoreError();
+  ParallelSort(keys.begin(), keys.end(), num_threads);
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  const size_t n = keys.size();
+  uint32_t segment_length = 4;
+  uint32_t segment_count = 1;
+  if (n > 1) {
+    const int log_segment_length = static_cast<int>(
+        std::floor(std::log(static_cast<double>(n)) / std::log(3.33) + 2.25));
+    segment_length = std::min(kMaxSegmentLength, 1u << log_segment_length);
+    const double size_factor = std::max(
+        1.125, 0.875 + 0.25 * std::log(1e6) / std::log(static_cast<double>(n)));
+    const auto capacity =
+        static_cast<int64_t>(std::round(static_cast<double>(n) * size_factor));
+    segment_count = static_cast<uint32_t>(std::max<int64_t>(
+        1, (capacity + segment_length - 1) / segment_length - 2));
+  }
+
+  const uint32_t fingerprint_mask =
+      fingerprint_bits == 32 ? ~uint32_t{0}
+                             : (uint32_t{1} << fingerprint_bits) - 1;
+  uint64_t seed_state = kSeedSequenceStart;
+  std::vector<uint32_t> fingerprints;
+  for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+    const uint64_t seed = NextSeed(&seed_state);
+    if (!Solve(keys, seed, segment_length, segment_count, fingerprint_mask,
+               &fingerprints)) {
+      continue;
+    }
+    const size_t width = fingerprint_bits / 8;
+    std::string bytes(fingerprints.size() * width, '\0');
+    for (size_t i = 0; i < fingerprints.size(); i++) {
+      for (size_t b = 0; b < width; b++) {
+        bytes[i * width + b] = static_cast<char>(fingerprints[i] >> (8 * b));
+      }
+    }
+    return absl::WrapUnique(new BinaryFuseFilter(seed, fingerprint_bits,
+                                                 segment_length, segment_count,
+                                                 std::move(bytes)));
+  }
+  return absl::InternalError("Failed to construct a binary fuse filter");
+}
+
+StatusOr<std::unique_ptr<BinaryFuseFilter>>
+BinaryFuseFilter::CreateFromProtobuf(
+    const psi_proto::ServerSetup& encoded_filter) {
+  if (!encoded_filter.IsInitialized()) {
+    return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
+  }
+  const auto& info = encoded_filter.binary_fuse_filter();
+  const int fingerprint_bits = info.fingerprint_bits();
+  if (fingerprint_bits != 8 && fingerprint_bits != 16 &&
+      fingerprint_bits != 32) {
+    return absl::InvalidArgumentError(
+        "`fingerprint_bits` must be 8, 16 or 32");
+  }
+  const uint32_t segment_length = info.segment_length();
+  if (segment_length == 0 || segment_length > kMaxSegmentLength ||
+      (segment_length & (segment_length - 1)) != 0) {
+    return absl::InvalidArgumentError(
+        "`segment_length` must be a power of two of at most 2^18");
+  }
+  const uint64_t num_slots =
+      (uint64_t{info.segment_count()} + 2) * segment_length;
+  if (info.segment_count() == 0 || num_slots > (uint64_t{1} << 32) ||
+      info.fingerprints().size() != num_slots * (fingerprint_bits / 8)) {
+    return absl::InvalidArgumentError(
+        "`fingerprints` does not match `segment_count` and `segment_length`");
+  }
+  return absl::WrapUnique(new BinaryFuseFilter(
+      info.seed(), fingerprint_bits, segment_length, info.segment_count(),
+      info.fingerprints()));
+}
+
+BinaryFuseFilter::Probe BinaryFuseFilter::ProbeFor(uint64_t key) const {
+  const uint64_t hash = MixKey(key, seed_);
+  Probe probe;
+  SlotsFor(hash, segment_length_, segment_count_, probe.slots);
+  probe.fingerprint = FingerprintOf(hash);
+  return probe;
+}
+
+template <typename Fingerprint>
+uint32_t BinaryFuseFilter::Residue(const Probe& probe) const {
+  const char* data = fingerprints_.data();
+  const uint32_t residue =
+      probe.fingerprint ^
+      LoadFingerprint<Fingerprint>(data, probe.slots[0]) ^
+      LoadFingerprint<Fingerprint>(data, probe.slots[1]) ^
+      LoadFingerprint<Fingerprint>(data, probe.slots[2]);
+  return static_cast<Fingerprint>(residue);
+}
+
+template <typename Fingerprint>
+void BinaryFuseFilter::IntersectKeys(absl::Span<const uint64_t> keys,
+                                     int64_t offset,
+                                     std::vector<int64_t>* res) const {
+  Probe probes[kQueryBatchSize];
+  for (size_t begin = 0; begin < keys.size(); begin += kQueryBatchSize) {
+    const size_t count = std::min(kQueryBatchSize, keys.size() - begin);
+    for (size_t i = 0; i < count; i++) {
+      probes[i] = ProbeFor(keys[begin + i]);
+      for (uint32_t slot : probes[i].slots) {
+        absl::PrefetchToLocalCache(fingerprints_.data() +
+                                   slot * sizeof(Fingerprint));
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (Residue<Fingerprint>(probes[i]) == 0) {
+        res->push_back(offset + static_cast<int64_t>(begin + i));
+      }
+    }
+  }
+}
+
+std::vector<int64_t> BinaryFuseFilter::Intersect(
+    absl::Span<const std::string> elements) const {
+  std::vector<int64_t> res;
+  std::vector<uint64_t> keys(elements.size());
+  for (size_t i = 0; i < elements.size(); i++) {
+    keys[i] = FilterHash64(elements[i]);
+  }
+  switch (fingerprint_bits_) {
+    case 8:
+      IntersectKeys<uint8_t>(keys, 0, &res);
+      break;
+    case 16:
+      IntersectKeys<uint16_t>(keys, 0, &res);
+      break;
+    default:
+      IntersectKeys<uint32_t>(keys, 0, &res);
+      break;
+  }
+  return res;
+}
+
+bool BinaryFuseFilter::Check(const std::string& input) const {
+  return !Intersect(absl::MakeConstSpan(&input, 1)).empty();
+}
+
+psi_proto::ServerSetup BinaryFuseFilter::ToProtobuf() const {
+  psi_proto::ServerSetup server_setup;
+  auto* info = server_setup.mutable_binary_fuse_filter();
+  info->set_seed(seed_);
+  info->set_fingerprint_bits(fingerprint_bits_);
+  info->set_segment_length(segment_length_);
+  info->set_segment_count(segment_count_);
+  info->set_fingerprints(fingerprints_);
+  return server_setup;
+}
+
+int BinaryFuseFilter::FingerprintBits() const { return fingerprint_bits_; }
+
+int64_t BinaryFuseFilter::NumSlots() const {
+  return static_cast<int64_t>(fingerprints_.size() / (fingerprint_bits_ / 8));
+}
+
+}  // namespace private_set_intersection
@@ -0,0 +1,121 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_BINARY_FUSE_FILTER_H_
+#define PRIVATE_SET_INTERSECTION_CPP_BINARY_FUSE_FILTER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// A binary fuse filter (Graf and Lemire, "Binary Fuse Filters: Fast and
+// Smaller Than Xor Filters", 2022) with three hash functions. Every element
+// is mapped to three slots of an array of F-bit fingerprints, and the array
+// is solved such that the XOR of an element's three slots equals its
+// fingerprint. A lookup is therefore three memory accesses, and an element
+// that was not inserted matches with probability 2^-F. The array holds about
+// 1.13 slots per element, so the filter is about 13% above the
+// information-theoretic bound, against 44% for a Bloom filter.
+//
+// The slots of an element lie in three consecutive segments of the array,
+// which keeps construction cache-friendly. Construction hashes the elements
+// with `FilterHash64`, rehashes the 64-bit keys with a seed, and retries with
+// the next seed in a fixed sequence if the keys cannot be peeled, so the
+// filter only depends on the set of elements.
+class BinaryFuseFilter {
+ public:
+  BinaryFuseFilter() = delete;
+
+  // Creates a filter containing `elements`, with the fewest fingerprint bits
+  // (8, 16 or 32) whose false-positive rate is at most `fpr`. The elements are
+  // hashed on up to `num_threads` threads.
+  //
+  // Returns INVALID_ARGUMENT if `fpr` is not in [2^-32, 1), or INTERNAL if the
+  // filter cannot be built, which is vanishingly unlikely.
+  static StatusOr<std::unique_ptr<BinaryFuseFilter>> Create(
+      double fpr, int64_t num_client_inputs,
+      absl::Span<const std::string> elements, int num_threads = 1);
+
+  // Creates a filter from the passed protobuf.
+  //
+  // Returns INVALID_ARGUMENT if the protobuf does not describe a valid filter.
+  static StatusOr<std::unique_ptr<BinaryFuseFilter>> CreateFromProtobuf(
+      const psi_proto::ServerSetup& encoded_filter);
+
+  // Returns the indices of all elements that are in the filter. The elements
+  // are looked up in batches, prefetching the slots of a batch before testing
+  // them. No state of the filter is touched, so disjoint chunks can be
+  // intersected concurrently from several threads.
+  std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
+
+  // Checks if an element is present in the filter.
+  bool Check(const std::string& input) const;
+
+  // Returns a protobuf representation of the filter.
+  psi_proto::ServerSetup ToProtobuf() const;
+
+  // Returns the number of bits per fingerprint: 8, 16 or 32.
+  int FingerprintBits() const;
+
+  // Returns the number of fingerprints of the filter.
+  int64_t NumSlots() const;
+
+ private:
+  BinaryFuseFilter(uint64_t seed, int fingerprint_bits,
+                   uint32_t segment_length, uint32_t segment_count,
+                   std::string fingerprints);
+
+  // The three slots and the fingerprint of an element.
+  struct Probe {
+    uint32_t slots[3];
+    uint32_t fingerprint;
+  };
+
+  // Computes the probe of the element with key `key`.
+  Probe ProbeFor(uint64_t key) const;
+
+  // Returns the XOR of the fingerprints in the slots of `probe` with its
+  // fingerprint, which is zero for the elements in the filter.
+  template <typename Fingerprint>
+  uint32_t Residue(const Probe& probe) const;
+
+  // Looks up `keys` and appends `offset + i` to `res` for every key `keys[i]`
+  // in the filter.
+  template <typename Fingerprint>
+  void IntersectKeys(absl::Span<const uint64_t> keys, int64_t offset,
+                     std::vector<int64_t>* res) const;
+
+  uint64_t seed_;
+  int fingerprint_bits_;
+  uint32_t segment_length_;
+  uint32_t segment_count_;
+
+  // The fingerprints, little-endian, `fingerprint_bits_ / 8` bytes each.
+  std::string fingerprints_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_BINARY_FUSE_FILTER_H_
@@ -0,0 +1,193 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+
+#include <cmath>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+TEST(BinaryFuseFilterTest, TestCheck) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  PSI_ASSERT_OK_AND_ASSIGN(auto filter,
+                           BinaryFuseFilter::Create(0.001, 10, elements));
+  for (const auto& element : elements) {
+    EXPECT_TRUE(filter->Check(element));
+  }
+  EXPECT_FALSE(filter->Check("not present"));
+}
+
+TEST(BinaryFuseFilterTest, TestEmptyAndDuplicates) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto empty, BinaryFuseFilter::Create(0.001, 10, {}));
+  EXPECT_FALSE(empty->Check("a"));
+
+  std::vector<std::string> elements = {"a", "b", "a", "b", "a"};
+  PSI_ASSERT_OK_AND_ASSIGN(auto filter,
+                           BinaryFuseFilter::Create(0.001, 10, elements));
+  EXPECT_TRUE(filter->Check("a"));
+  EXPECT_TRUE(filter->Check("b"));
+}
+
+TEST(BinaryFuseFilterTest, TestFingerprintBits) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 100; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  const std::vector<std::pair<double, int>> cases = {
+      {0.1, 8}, {1.0 / 256, 8}, {0.001, 16}, {1e-6, 32}, {1e-9, 32}};
+  for (const auto& [fpr, bits] : cases) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto filter,
+                             BinaryFuseFilter::Create(fpr, 10, elements));
+    EXPECT_EQ(filter->FingerprintBits(), bits) << fpr;
+
+    // Every width is stored as `bits / 8` little-endian bytes per slot, and
+    // decodes to the same filter.
+    const psi_proto::ServerSetup encoded_filter = filter->ToProtobuf();
+    EXPECT_EQ(encoded_filter.binary_fuse_filter().fingerprint_bits(), bits);
+    EXPECT_EQ(encoded_filter.binary_fuse_filter().fingerprints().size(),
+              bits / 8 * filter->NumSlots());
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto decoded, BinaryFuseFilter::CreateFromProtobuf(encoded_filter));
+    EXPECT_EQ(decoded->ToProtobuf().SerializeAsString(),
+              encoded_filter.SerializeAsString());
+    EXPECT_EQ(decoded->Intersect(elements).size(), elements.size());
+  }
+}
+
+TEST(BinaryFuseFilterTest, TestFPR) {
+  std::vector<std::string> tests;
+  for (int i = 0; i < 100000; i++) {
+    tests.push_back(absl::StrCat("Test ", i));
+  }
+  for (double target_fpr : {0.1, 0.001}) {
+    for (int num_elements = 1 << 10; num_elements < (1 << 18);
+         num_elements *= 4) {
+      std::vector<std::string> elements;
+      for (int i = 0; i < num_elements; i++) {
+        elements.push_back(absl::StrCat("Element ", i));
+      }
+      PSI_ASSERT_OK_AND_ASSIGN(
+          auto filter, BinaryFuseFilter::Create(target_fpr, 100000, elements));
+      // Test 100k elements to measure FPR.
+      double actual_fpr =
+          static_cast<double>(filter->Intersect(tests).size()) / tests.size();
+      // The rate is 2^-bits, at most the target; allow for 20% error.
+      EXPECT_LT(actual_fpr, 1.2 * target_fpr) << absl::StrCat(
+          "fpr: ", target_fpr, ", num_elements: ", num_elements);
+      // About 1.13 slots per element for large sets.
+      EXPECT_LT(filter->NumSlots(), 1.3 * num_elements + 1024);
+    }
+  }
+}
+
+TEST(BinaryFuseFilterTest, TestParallelConstructionIsDeterministic) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 50000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto filter1,
+                           BinaryFuseFilter::Create(0.001, 10, elements, 1));
+  PSI_ASSERT_OK_AND_ASSIGN(auto filter4,
+                           BinaryFuseFilter::Create(0.001, 10, elements, 4));
+  EXPECT_EQ(filter1->ToProtobuf().SerializeAsString(),
+            filter4->ToProtobuf().SerializeAsString());
+  EXPECT_EQ(filter4->Intersect(elements).size(), elements.size());
+}
+
+TEST(BinaryFuseFilterTest, TestIntersectMatchesCheck) {
+  std::vector<std::string> server_elements;
+  for (int i = 0; i < 1000; i++) {
+    server_elements.push_back(absl::StrCat("Element ", i));
+  }
+  for (double fpr : {0.1, 0.001, 1e-6}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto filter, BinaryFuseFilter::Create(fpr, 10, server_elements));
+    std::vector<std::string> elements;
+    std::vector<int64_t> expected;
+    for (int i = 0; i < 2000; i++) {
+      elements.push_back(absl::StrCat(i % 2 == 0 ? "Element " : "Test ", i));
+      if (filter->Check(elements.back())) {
+        expected.push_back(i);
+      }
+    }
+    EXPECT_EQ(filter->Intersect(elements), expected);
+  }
+}
+
+TEST(BinaryFuseFilterTest, TestCreateFromInvalidProtobuf) {
+  PSI_ASSERT_OK_AND_ASSIGN(auto filter,
+                           BinaryFuseFilter::Create(0.001, 10, {"a", "b"}));
+  const psi_proto::ServerSetup valid = filter->ToProtobuf();
+
+  // Widths other than 8, 16 and 32 bits have no lookup.
+  psi_proto::ServerSetup encoded_filter = valid;
+  encoded_filter.mutable_binary_fuse_filter()->set_fingerprint_bits(12);
+  EXPECT_EQ(
+      BinaryFuseFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+
+  // Slots are found by masking with `segment_length - 1`.
+  encoded_filter = valid;
+  encoded_filter.mutable_binary_fuse_filter()->set_segment_length(6);
+  EXPECT_EQ(
+      BinaryFuseFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+
+  encoded_filter = valid;
+  encoded_filter.mutable_binary_fuse_filter()->set_segment_count(0);
+  EXPECT_EQ(
+      BinaryFuseFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+
+  // More slots than 32-bit slot indices can address.
+  encoded_filter = valid;
+  encoded_filter.mutable_binary_fuse_filter()->set_segment_length(1 << 18);
+  encoded_filter.mutable_binary_fuse_filter()->set_segment_count(1 << 14);
+  EXPECT_EQ(
+      BinaryFuseFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+
+  encoded_filter = valid;
+  encoded_filter.mutable_binary_fuse_filter()
+      ->mutable_fingerprints()
+      ->pop_back();
+  EXPECT_EQ(
+      BinaryFuseFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+}
+
+TEST(BinaryFuseFilterTest, TestFprBelowWidestFingerprint) {
+  // 32-bit fingerprints reach 2^-32 and no further.
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto filter, BinaryFuseFilter::Create(std::ldexp(1.0, -32), 10, {"a"}));
+  EXPECT_EQ(filter->FingerprintBits(), 32);
+  EXPECT_EQ(BinaryFuseFilter::Create(std::ldexp(1.0, -33), 10, {"a"})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  // A rate of 1 would need fingerprints of no bits.
+  EXPECT_EQ(BinaryFuseFilter::Create(1.0, 10, {"a"}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -0,0 +1,261 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "absl/base/prefetch.h"
+#include "absl/memory/memory.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+constexpr int kBlockBits = 512;
+constexpr int kBlockBytes = kBlockBits / 8;
+
+// Multiplier deriving the bit positions inside a block from the hash.
+constexpr uint64_t kPositionMultiplier = 0x9e3779b97f4a7c15;
+
+// Number of elements whose blocks are prefetched before any of them is
+// tested, enough to keep several cache misses in flight.
+constexpr size_t kQueryBatchSize = 64;
+
+}  // namespace
+
+BlockedBloomFilter::BlockedBloomFilter(int num_hash_functions,
+                                       std::vector<Block> blocks)
+    : num_hash_functions_(num_hash_functions), blocks_(std::move(blocks)) {}
+
+StatusOr<std::unique_ptr<BlockedBloomFilter>> BlockedBloomFilter::Create(
+    double fpr, int64_t num_client_inputs,
+    absl::Span<const std::string> elements) {
+  auto num_server_inputs = static_cast<int64_t>(elements.size());
+  auto filter =
+      CreateEmpty(fpr, std::max(num_client_inputs, num_server_inputs));
+  if (!filter.ok()) {
+    return filter.status();
+  }
+  (*filter)->Add(elements);
+  return filter;
+}
+
+/**
+ * @brief Sizes the filter like a classic Bloom filter, then adds blocks until
+ * the expected false-positive rate of the blocked layout meets `fpr`
+ *
+ * @param fpr The target false-positive rate
+ * @param max_elements The maximum number of elements to insert
+ * @return The empty filter
+ */
+StatusOr<std::unique_ptr<BlockedBloomFilter>> BlockedBloomFilter::CreateEmpty(
+    double fpr, int64_t max_elements) {
+  if (fpr <= 0 || fpr >= 1) {
+    return absl::InvalidArgumentError("`fpr` must be in (0,1)");
+  }
+  if (max_elements < 0) {
+    return absl::InvalidArgumentError("`max_elements` must be non-negative");
+  }
+  const int max_hash_functions = static_cast<int>(std::ceil(-std::log2(fpr)));
+  const double num_bits = -max_elements * std::log2(fpr) / std::log(2);
+  auto num_blocks = std::max<int64_t>(
+      1, static_cast<int64_t>(std::ceil(num_bits / kBlockBits)));
+
+  // A loaded block favours slightly fewer hash functions than a classic
+  // filter, so the best count up to the classic one is picked for each size.
+  int num_hash_functions = max_hash_functions;
+  while (true) {
+    double best_fpr = 1;
+    for (int k = 1; k <= max_hash_functions; k++) {
+      const double expected = ExpectedFpr(num_blocks, k, max_elements);
+      if (expected < best_fpr) {
+        best_fpr = expected;
+        num_hash_functions = k;
+      }
+    }
+    if (best_fpr <= fpr) {
+      break;
+    }
+    num_blocks += std::max<int64_t>(1, num_blocks / 64);
+  }
+
+  return absl::WrapUnique(new BlockedBloomFilter(
+      num_hash_functions, std::vector<Block>(num_blocks, Block{})));
+}
+
+StatusOr<std::unique_ptr<BlockedBloomFilter>>
+BlockedBloomFilter::CreateFromProtobuf(
+    const psi_proto::ServerSetup& encoded_filter) {
+  if (!encoded_filter.IsInitialized()) {
+    return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
+  }
+  const auto& info = encoded_filter.blocked_bloom_filter();
+  if (info.num_hash_functions() < 1 ||
+      info.num_hash_functions() > kBlockBits) {
+    return absl::InvalidArgumentError(
+        "`num_hash_functions` must be in [1, 512]");
+  }
+  const std::string& bits = info.bits();
+  if (bits.empty() || bits.size() % kBlockBytes != 0) {
+    return absl::InvalidArgumentError(
+        "`bits` must be a positive multiple of 64 bytes");
+  }
+
+  std::vector<Block> blocks(bits.size() / kBlockBytes);
+  for (size_t i = 0; i < bits.size(); i++) {
+    blocks[i / kBlockBytes].words[(i % kBlockBytes) / 8] |=
+        static_cast<uint64_t>(static_cast<uint8_t>(bits[i])) << (8 * (i % 8));
+  }
+  return absl::WrapUnique(
+      new BlockedBloomFilter(info.num_hash_functions(), std::move(blocks)));
+}
+
+const BlockedBloomFilter::Block& BlockedBloomFilter::BlockFor(
+    uint64_t hash) const {
+  return blocks_[ReduceToRange(hash, blocks_.size())];
+}
+
+void BlockedBloomFilter::Insert(uint64_t hash) {
+  Block& block = blocks_[ReduceToRange(hash, blocks_.size())];
+  uint64_t state = hash;
+  for (int i = 0; i < num_hash_functions_; i++) {
+    state *= kPositionMultiplier;
+    const uint64_t position = state >> 55;
+    block.words[position / 64] |= uint64_t{1} << (position % 64);
+  }
+}
+
+bool BlockedBloomFilter::Contains(const Block& block, uint64_t hash) const {
+  uint64_t state = hash;
+  for (int i = 0; i < num_hash_functions_; i++) {
+    state *= kPositionMultiplier;
+    const uint64_t position = state >> 55;
+    if (((block.words[position / 64] >> (position % 64)) & 1) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void BlockedBloomFilter::Add(const std::string& input) {
+  Insert(FilterHash64(input));
+}
+
+void BlockedBloomFilter::Add(absl::Span<const std::string> inputs) {
+  for (const std::string& input : inputs) {
+    Insert(FilterHash64(input));
+  }
+}
+
+bool BlockedBloomFilter::Check(const std::string& input) const {
+  const uint64_t hash = FilterHash64(input);
+  return Contains(BlockFor(hash), hash);
+}
+
+/**
+ * @brief Hashes a batch of elements and prefetches all their blocks before
+ * testing any of them, so that the cache misses of a batch overlap
+ *
+ * @param elements The elements to look up
+ * @return The indices of the elements found in the filter
+ */
+std::vector<int64_t> BlockedBloomFilter::Intersect(
+    absl::Span<const std::string> elements) const {
+  std::vector<int64_t> res;
+  uint64_t hashes[kQueryBatchSize];
+  const Block* blocks[kQueryBatchSize];
+
+  for (size_t begin = 0; begin < elements.size(); begin += kQueryBatchSize) {
+    const size_t count = std::min(kQueryBatchSize, elements.size() - begin);
+    for (size_t i = 0; i < count; i++) {
+      hashes[i] = FilterHash64(elements[begin + i]);
+      blocks[i] = &BlockFor(hashes[i]);
+      absl::PrefetchToLocalCache(blocks[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (Contains(*blocks[i], hashes[i])) {
+        res.push_back(static_cast<int64_t>(begin + i));
+      }
+    }
+  }
+
+  return res;
+}
+
+psi_proto::ServerSetup BlockedBloomFilter::ToProtobuf() const {
+  psi_proto::ServerSetup server_setup;
+  server_setup.mutable_blocked_bloom_filter()->set_num_hash_functions(
+      num_hash_functions_);
+  server_setup.mutable_blocked_bloom_filter()->set_bits(Bits());
+  return server_setup;
+}
+
+int BlockedBloomFilter::NumHashFunctions() const {
+  return num_hash_functions_;
+}
+
+int64_t BlockedBloomFilter::NumBlocks() const {
+  return static_cast<int64_t>(blocks_.size());
+}
+
+std::string BlockedBloomFilter::Bits() const {
+  std::string bits(blocks_.size() * kBlockBytes, '\0');
+  for (size_t i = 0; i < bits.size(); i++) {
+    bits[i] = static_cast<char>(
+        blocks_[i / kBlockBytes].words[(i % kBlockBytes) / 8] >> (8 * (i % 8)));
+  }
+  return bits;
+}
+
+/**
+ * @brief Averages the false-positive rate of a 512-bit Bloom filter holding
+ * j elements, (1 - (1 - 1/512)^(k j))^k, over the Poisson distribution of the
+ * number j of elements per block
+ *
+ * @param num_blocks The number of blocks
+ * @param num_hash_functions The number of hash functions k
+ * @param num_elements The number of inserted elements
+ * @return The expected false-positive rate
+ */
+double BlockedBloomFilter::ExpectedFpr(int64_t num_blocks,
+                                       int num_hash_functions,
+                                       int64_t num_elements) {
+  if (num_elements <= 0) {
+    return 0;
+  }
+  const double load = static_cast<double>(num_elements) / num_blocks;
+  const double spread = 10 * std::sqrt(load) + 10;
+  const auto first = static_cast<int64_t>(std::max(0.0, load - spread));
+  const auto last = static_cast<int64_t>(load + spread);
+  const double log_miss = std::log1p(-1.0 / kBlockBits);
+
+  double fpr = 0;
+  for (int64_t j = first; j <= last; j++) {
+    const double log_probability =
+        -load + j * std::log(load) - std::lgamma(static_cast<double>(j) + 1);
+    const double block_fpr = std::pow(
+        -std::expm1(log_miss * num_hash_functions * static_cast<double>(j)),
+        num_hash_functions);
+    fpr += std::exp(log_probability) * block_fpr;
+  }
+  return fpr;
+}
+
+}  // namespace private_set_intersection
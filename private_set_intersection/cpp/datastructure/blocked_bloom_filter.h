@@ -0,0 +1,133 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_BLOCKED_BLOOM_FILTER_H_
+#define PRIVATE_SET_INTERSECTION_CPP_BLOCKED_BLOOM_FILTER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// A cache-line blocked Bloom filter. The bits are split into blocks of 512
+// bits (64 bytes, one cache line), and all k bits of an element are set in a
+// single block chosen by the element's hash. A query therefore touches one
+// cache line instead of k random ones, which makes lookups in large filters
+// bound by memory bandwidth rather than latency.
+//
+// Confining an element to one block raises the false-positive rate a little,
+// since the number of elements per block varies. `CreateEmpty` accounts for
+// that by sizing the filter with `ExpectedFpr`, which averages the rate of a
+// classic Bloom filter of 512 bits over the Poisson-distributed load of a
+// block, and growing it until the target is met.
+//
+// Elements are hashed with `FilterHash64`: the high bits of the hash pick the
+// block, and the bit positions inside the block are the top 9 bits of the
+// hash multiplied by successive powers of an odd constant.
+class BlockedBloomFilter {
+ public:
+  BlockedBloomFilter() = delete;
+
+  static StatusOr<std::unique_ptr<BlockedBloomFilter>> Create(
+      double fpr, int64_t num_client_inputs,
+      absl::Span<const std::string> elements);
+
+  // Creates a new blocked Bloom filter. As long as less than `max_elements`
+  // are inserted, the probability of false positives when performing checks
+  // against the returned filter is less than `fpr`.
+  //
+  // Returns INVALID_ARGUMENT if fpr is not in (0,1) or max_elements is
+  // negative.
+  static StatusOr<std::unique_ptr<BlockedBloomFilter>> CreateEmpty(
+      double fpr, int64_t max_elements);
+
+  // Creates a blocked Bloom filter from the bits and number of hash functions
+  // of the passed protobuf.
+  //
+  // Returns INVALID_ARGUMENT if the number of hash functions is not in
+  // [1, 512] or if the bits are empty or not a whole number of blocks.
+  static StatusOr<std::unique_ptr<BlockedBloomFilter>> CreateFromProtobuf(
+      const psi_proto::ServerSetup& encoded_filter);
+
+  // Returns the indices of all elements that are in the filter. No state of
+  // the filter is touched, so disjoint chunks can be intersected concurrently
+  // from several threads.
+  std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
+
+  // Adds `input` to the filter.
+  void Add(const std::string& input);
+
+  // Adds all elements in `inputs` to the filter.
+  void Add(absl::Span<const std::string> inputs);
+
+  // Checks if an element is present in the filter.
+  bool Check(const std::string& input) const;
+
+  // Returns a protobuf representation of the filter.
+  psi_proto::ServerSetup ToProtobuf() const;
+
+  // Returns the number of hash functions of the filter.
+  int NumHashFunctions() const;
+
+  // Returns the number of 512-bit blocks of the filter.
+  int64_t NumBlocks() const;
+
+  // Returns the bit representation of the filter in its current state, 64
+  // bytes per block with the bits of each byte in little-endian order.
+  std::string Bits() const;
+
+  // Returns the expected false-positive rate of a filter with `num_blocks`
+  // blocks and `num_hash_functions` hash functions once `num_elements`
+  // elements have been inserted.
+  static double ExpectedFpr(int64_t num_blocks, int num_hash_functions,
+                            int64_t num_elements);
+
+ private:
+  // One cache line of bits.
+  struct alignas(64) Block {
+    uint64_t words[8];
+  };
+
+  BlockedBloomFilter(int num_hash_functions, std::vector<Block> blocks);
+
+  // Returns the block that holds the bits of an element with hash `hash`.
+  const Block& BlockFor(uint64_t hash) const;
+
+  // Sets the bits of an element with hash `hash`.
+  void Insert(uint64_t hash);
+
+  // Returns true if all bits of an element with hash `hash` are set in
+  // `block`, which must be `BlockFor(hash)`.
+  bool Contains(const Block& block, uint64_t hash) const;
+
+  // Number of hash functions.
+  int num_hash_functions_;
+
+  // The blocks, aligned to cache lines.
+  std::vector<Block> blocks_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_BLOCKED_BLOOM_FILTER_H_
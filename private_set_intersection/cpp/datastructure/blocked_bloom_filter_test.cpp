@@ -0,0 +1,161 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
+
+#include <cmath>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+class BlockedBloomFilterTest : public ::testing::Test {
+ protected:
+  void SetUp() { return SetUp(0.001, 1 << 10); }
+  void SetUp(double fpr, int max_elements) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        filter_, BlockedBloomFilter::CreateEmpty(fpr, max_elements));
+  }
+
+  std::unique_ptr<BlockedBloomFilter> filter_;
+};
+
+TEST_F(BlockedBloomFilterTest, TestAdd) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+
+  // Test both variants of Add.
+  filter_->Add(elements[0]);
+  filter_->Add(absl::MakeConstSpan(&elements[1], elements.size() - 1));
+
+  // Check if all elements are present.
+  for (const auto& element : elements) {
+    EXPECT_TRUE(filter_->Check(element));
+  }
+  EXPECT_FALSE(filter_->Check("not present"));
+}
+
+TEST_F(BlockedBloomFilterTest, TestFPR) {
+  for (double target_fpr : {0.1, 0.001}) {
+    for (int max_elements = 1 << 10; max_elements < (1 << 18);
+         max_elements *= 4) {
+      SetUp(target_fpr, max_elements);
+      for (int i = 0; i < max_elements; i++) {
+        filter_->Add(absl::StrCat("Element ", i));
+      }
+      // Test 100k elements to measure FPR.
+      std::vector<std::string> tests;
+      for (int i = 0; i < 100000; i++) {
+        tests.push_back(absl::StrCat("Test ", i));
+      }
+      double actual_fpr =
+          static_cast<double>(filter_->Intersect(tests).size()) / tests.size();
+      // Check if actual FPR matches the target FPR, allowing for 20% error.
+      EXPECT_LT(actual_fpr, 1.2 * target_fpr) << absl::StrCat(
+          "fpr: ", target_fpr, ", max_elements: ", max_elements);
+    }
+  }
+}
+
+TEST_F(BlockedBloomFilterTest, TestExpectedFpr) {
+  // At the optimal load of a classic filter with k hash functions, about
+  // 512 ln(2) / k elements per block, the blocked layout is somewhat worse
+  // than a classic filter of the same size, whose rate is
+  // (1 - e^(-k load / 512))^k.
+  for (int k : {4, 7, 10}) {
+    const int load = static_cast<int>(512 * std::log(2) / k);
+    const double classic = std::pow(-std::expm1(-k * load / 512.0), k);
+    const double blocked =
+        BlockedBloomFilter::ExpectedFpr(1000, k, 1000 * load);
+    EXPECT_GT(blocked, classic);
+    EXPECT_LT(blocked, 2 * classic);
+  }
+  EXPECT_EQ(BlockedBloomFilter::ExpectedFpr(10, 4, 0), 0);
+  EXPECT_LT(BlockedBloomFilter::ExpectedFpr(2000, 7, 100000),
+            BlockedBloomFilter::ExpectedFpr(1000, 7, 100000));
+}
+
+TEST_F(BlockedBloomFilterTest, TestSizing) {
+  for (double fpr : {0.1, 0.01, 0.001, 1e-6}) {
+    SetUp(fpr, 100000);
+    EXPECT_LE(BlockedBloomFilter::ExpectedFpr(
+                  filter_->NumBlocks(), filter_->NumHashFunctions(), 100000),
+              fpr);
+    // The blocked layout costs a few percent over a classic filter.
+    const double classic_bits = -100000 * std::log2(fpr) / std::log(2);
+    EXPECT_LT(filter_->NumBlocks() * 512, 1.5 * classic_bits);
+  }
+  SetUp(0.001, 0);
+  EXPECT_EQ(filter_->NumBlocks(), 1);
+}
+
+TEST_F(BlockedBloomFilterTest, TestIntersectMatchesCheck) {
+  for (int i = 0; i < 1000; i++) {
+    filter_->Add(absl::StrCat("Element ", 2 * i));
+  }
+  std::vector<std::string> elements;
+  std::vector<int64_t> expected;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+    if (filter_->Check(elements.back())) {
+      expected.push_back(i);
+    }
+  }
+  EXPECT_EQ(filter_->Intersect(elements), expected);
+}
+
+TEST_F(BlockedBloomFilterTest, TestCreateFromProtobuf) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  filter_->Add(elements);
+  psi_proto::ServerSetup encoded_filter = filter_->ToProtobuf();
+  EXPECT_EQ(encoded_filter.blocked_bloom_filter().num_hash_functions(),
+            filter_->NumHashFunctions());
+  EXPECT_EQ(encoded_filter.blocked_bloom_filter().bits(), filter_->Bits());
+  EXPECT_EQ(filter_->Bits().size(), 64 * filter_->NumBlocks());
+
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto filter2, BlockedBloomFilter::CreateFromProtobuf(encoded_filter));
+  EXPECT_EQ(filter2->Bits(), filter_->Bits());
+  for (const auto& element : elements) {
+    EXPECT_TRUE(filter2->Check(element));
+  }
+  EXPECT_FALSE(filter2->Check("not present"));
+}
+
+TEST_F(BlockedBloomFilterTest, TestCreateFromInvalidProtobuf) {
+  psi_proto::ServerSetup encoded_filter = filter_->ToProtobuf();
+  encoded_filter.mutable_blocked_bloom_filter()->set_num_hash_functions(0);
+  EXPECT_EQ(
+      BlockedBloomFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+
+  encoded_filter = filter_->ToProtobuf();
+  encoded_filter.mutable_blocked_bloom_filter()->mutable_bits()->pop_back();
+  EXPECT_EQ(
+      BlockedBloomFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+
+  encoded_filter.mutable_blocked_bloom_filter()->clear_bits();
+  EXPECT_EQ(
+      BlockedBloomFilter::CreateFromProtobuf(encoded_filter).status().code(),
+      absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -16,30 +16,105 @@
 
 #include "private_set_intersection/cpp/datastructure/bloom_filter.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
+#include "absl/base/prefetch.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
+#include "private_set_intersection/cpp/crypto/sm3.h"
+#include "private_set_intersection/cpp/datastructure/bloom_filter_internal.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/util/cpu_features.h"
+#include "private_set_intersection/cpp/util/parallel.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
 
+namespace {
+
+// Number of elements hashed per call to `BloomFilter::HashBatch`, which
+// bounds the size of its temporary buffers.
+constexpr size_t kHashBatchSize = 1024;
+
+// Number of elements probed at a time by `BloomFilter::Intersect`. The bits
+// of the next group are prefetched while a group is probed, which keeps many
+// cache misses in flight without evicting what was prefetched.
+constexpr size_t kProbeBatchSize = 32;
+
+using bloom_filter_internal::ProbeKernel;
+
+/**
+ * @brief The portable counterpart of the SIMD probe kernels, which handles
+ * every element it is given
+ *
+ * @return `num_elements`
+ */
+size_t ProbeScalar(const uint8_t* bits, const int64_t* indices,
+                   int num_hash_functions, size_t num_elements,
+                   uint8_t* found) {
+  for (size_t i = 0; i < num_elements; i++) {
+    const int64_t* element = indices + i * num_hash_functions;
+    uint8_t result = 1;
+    for (int j = 0; j < num_hash_functions && result; j++) {
+      result = (bits[element[j] / 8] >> (element[j] % 8)) & 1;
+    }
+    found[i] = result;
+  }
+  return num_elements;
+}
+
+ProbeKernel SelectProbeKernel() {
+  if (ProbeKernel avx2 = bloom_filter_internal::GetAvx2ProbeKernel();
+      avx2 != nullptr && CpuSupportsAvx2()) {
+    return avx2;
+  }
+  return nullptr;
+}
+
+ProbeKernel GetProbeKernel() {
+  static const ProbeKernel kernel = SelectProbeKernel();
+  return kernel;
+}
+
+// Prefetches the bytes holding the first two bit indices of each of `count`
+// elements with `k` indices each. Most elements are not in the filter, and
+// the probe of such an element rarely gets past its second bit, so fetching
+// all k bits would mostly waste memory bandwidth.
+void PrefetchBits(const uint8_t* bits, const int64_t* indices, size_t count,
+                  size_t k) {
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < std::min<size_t>(k, 2); j++) {
+      absl::PrefetchToLocalCache(bits + indices[i * k + j] / 8);
+    }
+  }
+}
+
+}  // namespace
+
 BloomFilter::BloomFilter(
     int num_hash_functions, std::string bits,
+    psi_proto::HashVersion hash_version,
     std::unique_ptr<::private_join_and_compute::Context> context)
     : num_hash_functions_(num_hash_functions),
-      bits_(std::move(bits)),
+      owned_bits_(std::move(bits)),
+      bits_(owned_bits_),
+      hash_version_(hash_version),
       context_(std::move(context)) {}
 
 StatusOr<std::unique_ptr<BloomFilter>> BloomFilter::Create(
     double fpr, int64_t num_client_inputs,
-    absl::Span<const std::string> elements) {
+    absl::Span<const std::string> elements,
+    psi_proto::HashVersion hash_version, int num_threads) {
   auto num_server_inputs = static_cast<int64_t>(elements.size());
-  ASSIGN_OR_RETURN(auto filter, CreateEmpty(fpr, std::max(num_client_inputs,
-                                                          num_server_inputs)));
+  ASSIGN_OR_RETURN(
+      auto filter,
+      CreateEmpty(fpr, std::max(num_client_inputs, num_server_inputs),
+                  hash_version));
 
-  filter->Add(elements);
+  filter->Add(elements, num_threads);
   // This move seems to be needed for some versions of GCC. See for example this
   // failing build:
   // https://github.com/OpenMined/PSI/pull/109/checks?check_run_id=1487034145#step:3:61
@@ -48,95 +123,242 @@ StatusOr<std::unique_ptr<BloomFilter>> BloomFilter::Create(
 }
 
 StatusOr<std::unique_ptr<BloomFilter>> BloomFilter::CreateEmpty(
-    double fpr, int64_t max_elements) {
+    double fpr, int64_t max_elements, psi_proto::HashVersion hash_version) {
   if (fpr <= 0 || fpr >= 1) {
     return absl::InvalidArgumentError("`fpr` must be in (0,1)");
   }
   if (max_elements < 0) {
     return absl::InvalidArgumentError("`max_elements` must be positive");
   }
+  if (!psi_proto::HashVersion_IsValid(hash_version)) {
+    return absl::InvalidArgumentError("Unknown `hash_version`");
+  }
   int num_hash_functions = static_cast<int>(std::ceil(-std::log2(fpr)));
   int64_t num_bytes = static_cast<int64_t>(
       std::ceil(-max_elements * std::log2(fpr) / std::log(2) / 8));
   std::string bits(num_bytes, '\0');
   auto context = absl::make_unique<::private_join_and_compute::Context>();
-  return absl::WrapUnique(
-      new BloomFilter(num_hash_functions, std::move(bits), std::move(context)));
+  return absl::WrapUnique(new BloomFilter(num_hash_functions, std::move(bits),
+                                         hash_version, std::move(context)));
 }
 
 StatusOr<std::unique_ptr<BloomFilter>> BloomFilter::CreateFromProtobuf(
     const psi_proto::ServerSetup& encoded_filter) {
+  ASSIGN_OR_RETURN(auto filter, CreateViewFromProtobuf(encoded_filter));
+  filter->owned_bits_ = std::string(filter->bits_);
+  filter->bits_ = filter->owned_bits_;
+  return filter;
+}
+
+StatusOr<std::unique_ptr<BloomFilter>> BloomFilter::CreateViewFromProtobuf(
+    const psi_proto::ServerSetup& encoded_filter) {
   if (!encoded_filter.IsInitialized()) {
     return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
   }
+  const psi_proto::HashVersion hash_version =
+      encoded_filter.bloom_filter().hash_version();
+  if (!psi_proto::HashVersion_IsValid(hash_version)) {
+    return absl::InvalidArgumentError("Unknown `hash_version`");
+  }
 
   auto context = absl::make_unique<::private_join_and_compute::Context>();
-  return absl::WrapUnique(new BloomFilter(
-      encoded_filter.bloom_filter().num_hash_functions(),
-      std::move(encoded_filter.bloom_filter().bits()), std::move(context)));
+  auto filter = absl::WrapUnique(
+      new BloomFilter(encoded_filter.bloom_filter().num_hash_functions(),
+                      std::string(), hash_version, std::move(context)));
+  filter->bits_ = encoded_filter.bloom_filter().bits();
+  return filter;
 }
 
 void BloomFilter::Add(const std::string& input) {
   Add(absl::MakeConstSpan(&input, 1));
 }
 
-void BloomFilter::Add(absl::Span<const std::string> inputs) {
-  for (const std::string& input : inputs) {
-    for (int64_t index : Hash(input)) {
-      bits_[index / 8] |= (1 << (index % 8));
-    }
+/**
+ * @brief Adds the inputs in batches of `kHashBatchSize`. Threads share the bit
+ * array, so with more than one of them the bits are set with atomic byte ORs,
+ * which only contend when two threads hit the same byte at the same time.
+ *
+ * @param inputs The elements to add
+ * @param num_threads The number of threads to add the elements on
+ */
+void BloomFilter::Add(absl::Span<const std::string> inputs, int num_threads) {
+  const auto num_inputs = static_cast<int64_t>(inputs.size());
+  // Ranges of less than a batch are not worth a thread.
+  const int num_ranges = static_cast<int>(std::max<int64_t>(
+      1, std::min<int64_t>(ResolveNumThreads(num_threads),
+                           num_inputs / static_cast<int64_t>(kHashBatchSize))));
+  // A view copies the bits before it is written to.
+  if (bits_.data() != owned_bits_.data()) {
+    owned_bits_ = std::string(bits_);
+    bits_ = owned_bits_;
   }
+  char* bits = &owned_bits_[0];
+  // Adding cannot fail.
+  ParallelFor(num_ranges, num_inputs,
+              [&](int, int64_t range_begin, int64_t range_end) {
+                std::vector<int64_t> indices;
+                for (int64_t begin = range_begin; begin < range_end;
+                     begin += kHashBatchSize) {
+                  HashBatch(inputs.subspan(begin, std::min<int64_t>(
+                                                      kHashBatchSize,
+                                                      range_end - begin)),
+                            &indices);
+                  for (int64_t index : indices) {
+                    const char mask = static_cast<char>(1 << (index % 8));
+                    if (num_ranges == 1) {
+                      bits[index / 8] |= mask;
+                    } else {
+                      AtomicOr(&bits[index / 8], mask);
+                    }
+                  }
+                }
+                return absl::OkStatus();
+              })
+      .IgnoreError();
 }
 
 bool BloomFilter::Check(const std::string& input) const {
+  std::vector<int64_t> indices;
+  HashBatch(absl::MakeConstSpan(&input, 1), &indices);
   bool result = true;
-  for (int64_t index : Hash(input)) {
+  for (int64_t index : indices) {
     result &= ((bits_[index / 8] >> (index % 8)) & 1);
   }
   return result;
 }
 
+/**
+ * @brief Hashes the elements a batch at a time, then probes the filter for
+ * `kProbeBatchSize` elements at a time with the SIMD kernel if the CPU has
+ * one, prefetching the bits of the following elements meanwhile
+ *
+ * @param elements The elements to look up
+ * @param consume Called with the offset, the results and the size of every
+ * batch
+ */
+template <typename Consume>
+void BloomFilter::Probe(absl::Span<const std::string> elements,
+                        Consume consume) const {
+  std::vector<int64_t> indices;
+  std::vector<uint8_t> found(kHashBatchSize);
+
+  const auto* bits = reinterpret_cast<const uint8_t*>(bits_.data());
+  const size_t num_bytes = bits_.size();
+  const auto k = static_cast<size_t>(num_hash_functions_);
+  // The kernels address bytes with 32-bit offsets and read 4 bytes at once.
+  ProbeKernel kernel = GetProbeKernel();
+  if (num_bytes < 4 ||
+      8 * num_bytes > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    kernel = nullptr;
+  }
+
+  for (size_t begin = 0; begin < elements.size(); begin += kHashBatchSize) {
+    const auto batch = elements.subspan(begin, kHashBatchSize);
+    const size_t n = batch.size();
+    HashBatch(batch, &indices);
+
+    PrefetchBits(bits, indices.data(), std::min(kProbeBatchSize, n), k);
+    for (size_t group = 0; group < n; group += kProbeBatchSize) {
+      const size_t count = std::min(kProbeBatchSize, n - group);
+      const size_t next = group + count;
+      PrefetchBits(bits, indices.data() + next * k,
+                   std::min(kProbeBatchSize, n - next), k);
+
+      const int64_t* group_indices = indices.data() + group * k;
+      size_t done = 0;
+      if (kernel != nullptr) {
+        done = kernel(bits, num_bytes, group_indices, num_hash_functions_,
+                      count, &found[group]);
+      }
+      ProbeScalar(bits, group_indices + done * k, num_hash_functions_,
+                  count - done, &found[group + done]);
+    }
+
+    consume(begin, found.data(), n);
+  }
+}
+
 std::vector<int64_t> BloomFilter::Intersect(
     absl::Span<const std::string> elements) const {
   std::vector<int64_t> res;
+  Probe(elements, [&res](size_t begin, const uint8_t* found, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      if (found[i]) {
+        res.push_back(static_cast<int64_t>(begin + i));
+      }
+    }
+  });
+  return res;
+}
 
-  for (size_t i = 0; i < elements.size(); i++) {
-    if (Check(elements[i])) {
-      res.push_back(i);
+int64_t BloomFilter::CountIntersection(
+    absl::Span<const std::string> elements) const {
+  int64_t count = 0;
+  Probe(elements, [&count](size_t, const uint8_t* found, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      count += found[i] != 0;
     }
-  }
+  });
+  return count;
+}
 
-  return res;
+std::vector<uint64_t> BloomFilter::IntersectBitmap(
+    absl::Span<const std::string> elements) const {
+  std::vector<uint64_t> bitmap((elements.size() + 63) / 64);
+  Probe(elements, [&bitmap](size_t begin, const uint8_t* found, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      bitmap[(begin + i) / 64] |= uint64_t{found[i] != 0} << ((begin + i) % 64);
+    }
+  });
+  return bitmap;
+}
+
+psi_proto::ServerSetup BloomFilter::ToProtobuf() const& {
+  return ToProtobuf(std::string(bits_));
+}
+
+psi_proto::ServerSetup BloomFilter::ToProtobuf() && {
+  // A view does not own its bits, which are copied.
+  std::string bits = bits_.data() == owned_bits_.data()
+                         ? std::move(owned_bits_)
+                         : std::string(bits_);
+  owned_bits_.clear();
+  bits_ = owned_bits_;
+  return ToProtobuf(std::move(bits));
 }
 
-psi_proto::ServerSetup BloomFilter::ToProtobuf() const {
+psi_proto::ServerSetup BloomFilter::ToProtobuf(std::string bits) const {
   psi_proto::ServerSetup server_setup;
   server_setup.mutable_bloom_filter()->set_num_hash_functions(
       NumHashFunctions());
-  server_setup.mutable_bloom_filter()->set_bits(bits_);
+  server_setup.mutable_bloom_filter()->set_bits(std::move(bits));
+  server_setup.mutable_bloom_filter()->set_hash_version(hash_version_);
   return server_setup;
 }
 
 int BloomFilter::NumHashFunctions() const { return num_hash_functions_; }
 
-std::string BloomFilter::Bits() const { return bits_; }
+std::string BloomFilter::Bits() const { return std::string(bits_); }
 
-std::vector<int64_t> BloomFilter::Hash_SHA256(const std::string& x) const {
+psi_proto::HashVersion BloomFilter::Version() const { return hash_version_; }
+
+std::vector<int64_t> BloomFilter::Hash_SHA256(
+    const std::string& x, ::private_join_and_compute::Context& context) const {
   // Compute the number of bits (= size of the output domain) as an OpenSSL
   // BigNum.
   const int64_t num_bits = 8 * bits_.size();
-  const auto bn_num_bits = context_->CreateBigNum(num_bits);
+  const auto bn_num_bits = context.CreateBigNum(num_bits);
 
   // Compute the i-th hash function as SHA256(1 || x) + i * SHA256(2 || x)
   // (modulo num_bits).
   std::vector<int64_t> result(num_hash_functions_);
   const int64_t h1 =
-      context_->CreateBigNum(context_->Sha256String(absl::StrCat(1, x)))
+      context.CreateBigNum(context.Sha256String(absl::StrCat(1, x)))
           .Mod(bn_num_bits)
           .ToIntValue()
           .value();  // value() is safe here since bn_num_bits fits in an int64.
   const int64_t h2 =
-      context_->CreateBigNum(context_->Sha256String(absl::StrCat(2, x)))
+      context.CreateBigNum(context.Sha256String(absl::StrCat(2, x)))
           .Mod(bn_num_bits)
           .ToIntValue()
           .value();
@@ -147,34 +369,101 @@ std::vector<int64_t> BloomFilter::Hash_SHA256(const std::string& x) const {
 }
 //新建sm3哈希函数
 std::vector<int64_t> BloomFilter::Hash_SM3(const std::string& x) const {
-  // Compute the number of bits (= size of the output domain) as an OpenSSL
-  // BigNum.
   const int64_t num_bits = 8 * bits_.size();
-  const auto bn_num_bits = context_->CreateBigNum(num_bits);
 
   // Compute the i-th hash function as SM3(1 || x) + i * SM3(2 || x)
   // (modulo num_bits).
   std::vector<int64_t> result(num_hash_functions_);
-  const int64_t h1 =
-      context_->CreateBigNum(context_->Sm3String(absl::StrCat(1, x)))
-          .Mod(bn_num_bits)
-          .ToIntValue()
-          .value();  // value() is safe here since bn_num_bits fits in an int64.
-  const int64_t h2 =
-      context_->CreateBigNum(context_->Sm3String(absl::StrCat(2, x)))
-          .Mod(bn_num_bits)
-          .ToIntValue()
-          .value();
+  const auto h1 =
+      static_cast<int64_t>(Sm3DigestMod(Sm3(absl::StrCat(1, x)), num_bits));
+  const auto h2 =
+      static_cast<int64_t>(Sm3DigestMod(Sm3(absl::StrCat(2, x)), num_bits));
   for (int i = 0; i < num_hash_functions_; i++) {
     result[i] = (h1 + i * h2) % num_bits;
   }
   return result;
 }
-std::vector<int64_t> BloomFilter::Hash(const std::string& input) const{
+std::vector<int64_t> BloomFilter::Hash(const std::string& input) const {
   // 这里可以切换哈希函数,默认选用SM3
-  // return Hash_SHA256(input);
+  // return Hash_SHA256(input, *context_);
   return Hash_SM3(input);
 }
 
+void BloomFilter::HashBatch(absl::Span<const std::string> inputs,
+                            std::vector<int64_t>* indices) const {
+  if (hash_version_ == psi_proto::HASH_VERSION_LEGACY) {
+    HashBatchSm3(inputs, indices);
+  } else {
+    HashBatchFast64(inputs, indices);
+  }
+}
+
+/**
+ * @brief Batched `Hash_SM3`: the 1 || x and 2 || x messages of all inputs are
+ * laid out in one buffer and digested together by `Sm3Batch`
+ *
+ * @param inputs The inputs to hash
+ * @param indices Receives `num_hash_functions_` bit indices per input
+ */
+void BloomFilter::HashBatchSm3(absl::Span<const std::string> inputs,
+                               std::vector<int64_t>* indices) const {
+  const int64_t num_bits = 8 * bits_.size();
+  const size_t n = inputs.size();
+
+  size_t total_size = 0;
+  for (const std::string& input : inputs) {
+    total_size += 2 * (input.size() + 1);
+  }
+  std::string buffer;
+  buffer.reserve(total_size);
+  for (const std::string& input : inputs) {
+    absl::StrAppend(&buffer, 1, input, 2, input);
+  }
+
+  // Message 2i is 1 || inputs[i] and message 2i + 1 is 2 || inputs[i].
+  std::vector<absl::string_view> messages(2 * n);
+  absl::string_view rest = buffer;
+  for (size_t i = 0; i < n; i++) {
+    const size_t size = inputs[i].size() + 1;
+    messages[2 * i] = rest.substr(0, size);
+    messages[2 * i + 1] = rest.substr(size, size);
+    rest.remove_prefix(2 * size);
+  }
+  std::vector<Sm3Digest> digests(2 * n);
+  Sm3Batch(messages, absl::MakeSpan(digests));
+
+  indices->resize(n * num_hash_functions_);
+  for (size_t i = 0; i < n; i++) {
+    const auto h1 =
+        static_cast<int64_t>(Sm3DigestMod(digests[2 * i], num_bits));
+    const auto h2 =
+        static_cast<int64_t>(Sm3DigestMod(digests[2 * i + 1], num_bits));
+    for (int j = 0; j < num_hash_functions_; j++) {
+      (*indices)[i * num_hash_functions_ + j] = (h1 + j * h2) % num_bits;
+    }
+  }
+}
+
+/**
+ * @brief Double hashing on 64-bit words: the indices of an input come from a
+ * single `FilterHash64` and need no division at all
+ *
+ * @param inputs The inputs to hash
+ * @param indices Receives `num_hash_functions_` bit indices per input
+ */
+void BloomFilter::HashBatchFast64(absl::Span<const std::string> inputs,
+                                  std::vector<int64_t>* indices) const {
+  const uint64_t num_bits = 8 * bits_.size();
+  indices->resize(inputs.size() * num_hash_functions_);
+  int64_t* out = indices->data();
+  for (const std::string& input : inputs) {
+    uint64_t h = FilterHash64(input);
+    const uint64_t g = ((h << 32) | (h >> 32)) | 1;
+    for (int j = 0; j < num_hash_functions_; j++) {
+      *out++ = static_cast<int64_t>(ReduceToRange(h, num_bits));
+      h += g;
+    }
+  }
+}
 
 }  // namespace private_set_intersection
@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "private_join_and_compute/crypto/context.h"
 #include "private_set_intersection/proto/psi.pb.h"
@@ -44,40 +45,72 @@ class BloomFilter {
  public:
   BloomFilter() = delete;
 
+  // Creates a Bloom filter for `max(num_client_inputs, elements.size())`
+  // elements and adds `elements` to it on up to `num_threads` threads.
   static StatusOr<std::unique_ptr<BloomFilter>> Create(
       double fpr, int64_t num_client_inputs,
-      absl::Span<const std::string> elements);
+      absl::Span<const std::string> elements,
+      psi_proto::HashVersion hash_version = psi_proto::HASH_VERSION_FAST64,
+      int num_threads = 1);
 
   // Creates a new Bloom filter. As long as less than `max_elements` are
   // inserted, the probability of false positives when performing checks
-  // against the returned Bloom filter is less than `fpr`.
+  // against the returned Bloom filter is less than `fpr`. Elements are mapped
+  // to bits as prescribed by `hash_version`.
   //
-  // Returns INVALID_ARGUMENT if fpr is not in (0,1) or max_elements is not
-  // positive.
+  // Returns INVALID_ARGUMENT if fpr is not in (0,1), max_elements is not
+  // positive or `hash_version` is unknown.
   static StatusOr<std::unique_ptr<BloomFilter>> CreateEmpty(
-      double fpr, int64_t max_elements);
+      double fpr, int64_t max_elements,
+      psi_proto::HashVersion hash_version = psi_proto::HASH_VERSION_FAST64);
 
   // Creates a Bloom filter containing the bits of the passed protobuf, and the
-  // given number of hash functions.
+  // given number of hash functions and hash version.
   //
-  // Returns INVALID_ARGUMENT if `num_hash_functions` is not positive or if
-  // `bits` is empty.
+  // Returns INVALID_ARGUMENT if the protobuf is corrupt or its hash version is
+  // unknown.
   static StatusOr<std::unique_ptr<BloomFilter>> CreateFromProtobuf(
       const psi_proto::ServerSetup& encoded_filter);
 
+  // Like `CreateFromProtobuf`, but the filter reads the bits in place instead
+  // of copying them, so `encoded_filter` must outlive it. The bits are only
+  // copied if elements are added to the filter.
+  static StatusOr<std::unique_ptr<BloomFilter>> CreateViewFromProtobuf(
+      const psi_proto::ServerSetup& encoded_filter);
+
+  BloomFilter(const BloomFilter&) = delete;
+  BloomFilter& operator=(const BloomFilter&) = delete;
+
+  // Returns the indices of all elements that are in the Bloom filter. The
+  // elements are hashed in batches and no state of the filter is touched, so
+  // disjoint chunks can be intersected concurrently from several threads.
   std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
 
+  // Returns the number of elements that are in the Bloom filter, without
+  // collecting their indices.
+  int64_t CountIntersection(absl::Span<const std::string> elements) const;
+
+  // Returns a bitmap of the elements that are in the Bloom filter: element `i`
+  // is bit `i % 64` of word `i / 64`.
+  std::vector<uint64_t> IntersectBitmap(
+      absl::Span<const std::string> elements) const;
+
   // Adds `input` to the Bloom filter.
   void Add(const std::string& input);
 
-  // Adds all elements in `inputs` to the Bloom filter.
-  void Add(absl::Span<const std::string> inputs);
+  // Adds all elements in `inputs` to the Bloom filter. With more than one
+  // thread, each thread hashes a contiguous range of `inputs` and sets its
+  // bits with atomic byte ORs, so the result does not depend on `num_threads`.
+  void Add(absl::Span<const std::string> inputs, int num_threads = 1);
 
   // Checks if an element is present in the Bloom filter.
   bool Check(const std::string& input) const;
 
-  // Returns a protobuf representation of the Bloom filter
-  psi_proto::ServerSetup ToProtobuf() const;
+  // Returns a protobuf representation of the Bloom filter. The consuming
+  // overload moves the bits of a filter that owns them into the protobuf
+  // instead of copying them, and leaves the filter empty.
+  psi_proto::ServerSetup ToProtobuf() const&;
+  psi_proto::ServerSetup ToProtobuf() &&;
 
   // Returns the number of hash functions of the Bloom filter.
   int NumHashFunctions() const;
@@ -85,8 +118,12 @@ class BloomFilter {
   // Returns the bit representation of the Bloom filter in its current state.
   std::string Bits() const;
 
+  // Returns how elements are mapped to bits.
+  psi_proto::HashVersion Version() const;
+
  private:
   BloomFilter(int num_hash_functions, std::string bits,
+              psi_proto::HashVersion hash_version,
               std::unique_ptr<::private_join_and_compute::Context> context);
 
   // Hashes the input with all `num_hash_functions_` hash functions and
@@ -95,16 +132,52 @@ class BloomFilter {
   // input and num_bits is the number of bits in the Bloom filter.
 //   std::vector<int64_t> Hash(const std::string& input) const;
 // 使用sm3
-  std::vector<int64_t> Hash_SHA256(const std::string& input) const;
+  std::vector<int64_t> Hash_SHA256(
+      const std::string& input,
+      ::private_join_and_compute::Context& context) const;
   std::vector<int64_t> Hash_SM3(const std::string& input) const;
   std::vector<int64_t> Hash(const std::string& input) const;
 
+  // Computes the bit indices of every input at once. The `num_hash_functions_`
+  // indices of `inputs[i]` are written to `indices` starting at position
+  // `i * num_hash_functions_`.
+  void HashBatch(absl::Span<const std::string> inputs,
+                 std::vector<int64_t>* indices) const;
+
+  // `HashBatch` for `HASH_VERSION_LEGACY`: computes `Hash_SM3` for every
+  // input, hashing many inputs in parallel with the multi-buffer SM3 engine.
+  void HashBatchSm3(absl::Span<const std::string> inputs,
+                    std::vector<int64_t>* indices) const;
+
+  // Probes the filter for `elements` a batch at a time and calls
+  // `consume(begin, found, n)` for each batch, where `found[i]` is nonzero if
+  // `elements[begin + i]` is in the filter, for `i` in [0, n).
+  template <typename Consume>
+  void Probe(absl::Span<const std::string> elements, Consume consume) const;
+
+  // `HashBatch` for `HASH_VERSION_FAST64`: the i-th index of x is
+  // (h + i * g) mod 2^64 reduced to num_bits by multiply-shift, where
+  // h = FilterHash64(x) and g is h with its halves swapped, made odd.
+  void HashBatchFast64(absl::Span<const std::string> inputs,
+                       std::vector<int64_t>* indices) const;
+
+  // Returns a protobuf representation of the Bloom filter with `bits` as its
+  // bits.
+  psi_proto::ServerSetup ToProtobuf(std::string bits) const;
+
   // Number of hash functions.
   int num_hash_functions_;
 
   // Compact representation of the bits. We use a std::string as opposed to
-  // std::vector<bool> to allow serialization with ToString().
-  std::string bits_;
+  // std::vector<bool> to allow serialization with ToString(). Empty for a
+  // view until elements are added.
+  std::string owned_bits_;
+
+  // The bits, in `owned_bits_` or in the caller's buffer.
+  absl::string_view bits_;
+
+  // How elements are mapped to bits.
+  psi_proto::HashVersion hash_version_;
 
   // OpenSSL context used for hashing.
   std::unique_ptr<::private_join_and_compute::Context> context_;
@@ -0,0 +1,95 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Built with -mavx2 on x86-64; only called after a runtime CPU check.
+
+#include "private_set_intersection/cpp/datastructure/bloom_filter_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace private_set_intersection {
+namespace bloom_filter_internal {
+
+#if defined(__AVX2__)
+
+namespace {
+
+/**
+ * @brief Probes eight elements at a time, one per 32-bit lane. For each hash
+ * function, the byte holding each lane's bit is gathered together with the
+ * three bytes after it (moved back at the end of the filter so as not to
+ * read past it), and lanes whose bit is clear drop out of the gather mask.
+ * A group stops as soon as all of its lanes have dropped out.
+ *
+ * @return The number of elements probed, a multiple of eight
+ */
+size_t ProbeAvx2(const uint8_t* bits, size_t num_bytes,
+                 const int64_t* indices, int num_hash_functions,
+                 size_t num_elements, uint8_t* found) {
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i max_offset =
+      _mm256_set1_epi32(static_cast<int>(num_bytes - 4));
+  const size_t k = static_cast<size_t>(num_hash_functions);
+  const auto* base = reinterpret_cast<const int*>(bits);
+
+  size_t i = 0;
+  for (; i + 8 <= num_elements; i += 8) {
+    const int64_t* group = indices + i * k;
+    __m256i alive = _mm256_set1_epi32(-1);
+    for (size_t j = 0; j < k; j++) {
+      const __m256i index = _mm256_setr_epi32(
+          static_cast<int>(group[j]), static_cast<int>(group[k + j]),
+          static_cast<int>(group[2 * k + j]),
+          static_cast<int>(group[3 * k + j]),
+          static_cast<int>(group[4 * k + j]),
+          static_cast<int>(group[5 * k + j]),
+          static_cast<int>(group[6 * k + j]),
+          static_cast<int>(group[7 * k + j]));
+      const __m256i offset =
+          _mm256_min_epi32(_mm256_srli_epi32(index, 3), max_offset);
+      const __m256i shift =
+          _mm256_sub_epi32(index, _mm256_slli_epi32(offset, 3));
+      const __m256i word = _mm256_mask_i32gather_epi32(
+          _mm256_setzero_si256(), base, offset, alive, 1);
+      const __m256i bit =
+          _mm256_and_si256(_mm256_srlv_epi32(word, shift), one);
+      alive = _mm256_and_si256(alive, _mm256_cmpeq_epi32(bit, one));
+      if (_mm256_testz_si256(alive, alive)) {
+        break;
+      }
+    }
+    const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(alive));
+    for (int lane = 0; lane < 8; lane++) {
+      found[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+    }
+  }
+  return i;
+}
+
+}  // namespace
+
+ProbeKernel GetAvx2ProbeKernel() { return &ProbeAvx2; }
+
+#else
+
+ProbeKernel GetAvx2ProbeKernel() { return nullptr; }
+
+#endif
+
+}  // namespace bloom_filter_internal
+}  // namespace private_set_intersection
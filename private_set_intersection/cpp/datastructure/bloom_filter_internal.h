@@ -0,0 +1,48 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_BLOOM_FILTER_INTERNAL_H_
+#define PRIVATE_SET_INTERSECTION_CPP_BLOOM_FILTER_INTERNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Shared between the portable Bloom filter code and its SIMD probe kernel,
+// which is built in its own translation unit with extra instruction-set
+// flags.
+
+namespace private_set_intersection {
+namespace bloom_filter_internal {
+
+// Tests the bits of `num_elements` elements against the filter `bits` of
+// `num_bytes` bytes. The `num_hash_functions` bit indices of element i are
+// `indices[i * num_hash_functions]` onwards, and `found[i]` is set to 1 if
+// all of them are set and to 0 otherwise. Elements are handled in groups of
+// eight; returns how many were handled, leaving the rest to the caller.
+//
+// Requires `num_bytes` to be at least 4 and every index to fit in 31 bits.
+using ProbeKernel = size_t (*)(const uint8_t* bits, size_t num_bytes,
+                               const int64_t* indices, int num_hash_functions,
+                               size_t num_elements, uint8_t* found);
+
+// Returns the AVX2 kernel, or null if it was not compiled in (for example on
+// other architectures). It must only be called if the CPU supports AVX2.
+ProbeKernel GetAvx2ProbeKernel();
+
+}  // namespace bloom_filter_internal
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_BLOOM_FILTER_INTERNAL_H_
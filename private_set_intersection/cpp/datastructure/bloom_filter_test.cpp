@@ -28,9 +28,11 @@ namespace {
 class BloomFilterTest : public ::testing::Test {
  protected:
   void SetUp() { return SetUp(0.001, 1 << 10); }
-  void SetUp(double fpr, int max_elements) {
-    PSI_ASSERT_OK_AND_ASSIGN(filter_,
-                             BloomFilter::CreateEmpty(fpr, max_elements));
+  void SetUp(double fpr, int max_elements,
+             psi_proto::HashVersion hash_version =
+                 psi_proto::HASH_VERSION_FAST64) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        filter_, BloomFilter::CreateEmpty(fpr, max_elements, hash_version));
   }
 
   std::unique_ptr<BloomFilter> filter_;
@@ -50,11 +52,15 @@ TEST_F(BloomFilterTest, TestAdd) {
   EXPECT_FALSE(filter_->Check("not present"));
 }
 
-TEST_F(BloomFilterTest, TestFPR) {
+class BloomFilterVersionTest
+    : public BloomFilterTest,
+      public ::testing::WithParamInterface<psi_proto::HashVersion> {};
+
+TEST_P(BloomFilterVersionTest, TestFPR) {
   for (int max_elements = 1 << 10; max_elements < (1 << 20);
        max_elements *= 2) {
     double target_fpr = 0.1;
-    SetUp(target_fpr, max_elements);
+    SetUp(target_fpr, max_elements, GetParam());
     // Insert `max_elements` elements.
     for (int i = 0; i < max_elements; i++) {
       filter_->Add(absl::StrCat("Element ", i));
@@ -74,10 +80,75 @@ TEST_F(BloomFilterTest, TestFPR) {
   }
 }
 
+TEST_P(BloomFilterVersionTest, TestIntersectMatchesCheck) {
+  // Filters of a few bytes up to several kilobytes, queried with batches that
+  // end inside a probe group and straddle hash batches.
+  for (int max_elements : {1, 10, 1000}) {
+    SetUp(0.01, max_elements, GetParam());
+    for (int i = 0; i < max_elements; i++) {
+      filter_->Add(absl::StrCat("Element ", 3 * i));
+    }
+    for (int num_queries : {0, 7, 100, 2500}) {
+      std::vector<std::string> queries;
+      std::vector<int64_t> expected;
+      for (int i = 0; i < num_queries; i++) {
+        queries.push_back(absl::StrCat("Element ", i));
+        if (filter_->Check(queries.back())) {
+          expected.push_back(i);
+        }
+      }
+      EXPECT_EQ(filter_->Intersect(queries), expected)
+          << absl::StrCat("max_elements: ", max_elements,
+                          ", num_queries: ", num_queries);
+    }
+  }
+}
+
+TEST_P(BloomFilterVersionTest, TestCountAndBitmapMatchIntersect) {
+  SetUp(0.01, 1000, GetParam());
+  for (int i = 0; i < 1000; i++) {
+    filter_->Add(absl::StrCat("Element ", 3 * i));
+  }
+  for (int num_queries : {0, 7, 64, 2500}) {
+    std::vector<std::string> queries;
+    for (int i = 0; i < num_queries; i++) {
+      queries.push_back(absl::StrCat("Element ", i));
+    }
+    const std::vector<int64_t> expected = filter_->Intersect(queries);
+    EXPECT_EQ(filter_->CountIntersection(queries), expected.size());
+
+    std::vector<uint64_t> bitmap((num_queries + 63) / 64);
+    for (int64_t i : expected) {
+      bitmap[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    EXPECT_EQ(filter_->IntersectBitmap(queries), bitmap) << num_queries;
+  }
+}
+
+TEST_P(BloomFilterVersionTest, TestCreateMultiThreaded) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 100000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto filter, BloomFilter::Create(0.001, 1000, elements, GetParam()));
+  PSI_ASSERT_OK_AND_ASSIGN(auto parallel_filter,
+                           BloomFilter::Create(0.001, 1000, elements,
+                                               GetParam(), /*num_threads=*/4));
+  EXPECT_EQ(parallel_filter->Bits(), filter->Bits());
+}
+
+INSTANTIATE_TEST_SUITE_P(HashVersions, BloomFilterVersionTest,
+                         ::testing::Values(psi_proto::HASH_VERSION_LEGACY,
+                                           psi_proto::HASH_VERSION_FAST64));
+
 TEST_F(BloomFilterTest, TestToProtobuf) {
   double fpr = 0.01;
   int max_elements = 100;
-  SetUp(fpr, max_elements);
+  // The expected bits below were computed with the legacy hash functions,
+  // SM3(1 || x) + i * SM3(2 || x) modulo the number of bits.
+  SetUp(fpr, max_elements, psi_proto::HASH_VERSION_LEGACY);
   for (int i = 0; i < max_elements; i++) {
     filter_->Add(absl::StrCat("Element ", i));
   }
@@ -88,12 +159,13 @@ TEST_F(BloomFilterTest, TestToProtobuf) {
             filter_->NumHashFunctions());
   EXPECT_EQ(encoded_filter.bloom_filter().num_hash_functions(), 7);
   EXPECT_EQ(encoded_filter.bloom_filter().bits(), filter_->Bits());
+  EXPECT_EQ(encoded_filter.bloom_filter().hash_version(),
+            psi_proto::HASH_VERSION_LEGACY);
   EXPECT_EQ(
       absl::Base64Escape(encoded_filter.bloom_filter().bits()),
-      "VN3/"
-      "BXfUjEDvJLcxCTepUCTXGQwlTax0xHiMohCNb45uShFsznK099RH0CFVIMn91Bdc7jLkXHXr"
-      "Xp1NimmZSDrYSj5sd/"
-      "500nroNOdXbtd53u8cejPMGxbx7kR1E1zyO19mSkYLXq4xf7au5dFN0qhxqfLnjaCE");
+      "mhO2+ecxZMxzD3n8LIy5jm3Tj0StVoi6PWXB8OceyFSmuhJl5cVYxxlpqfx53BTGY3XMoNbX"
+      "KjZG9lY63LiHLjC+lmomx+wH6rH3F6FR9QKa2+zcpJBflNglnLojpK6mwdMpKkIE1W+d6M63"
+      "yHYk9OWpIiXDI6bM");
 }
 
 TEST_F(BloomFilterTest, TestCreateFromProtobuf) {
@@ -106,6 +178,68 @@ TEST_F(BloomFilterTest, TestCreateFromProtobuf) {
     EXPECT_TRUE(filter2->Check(element));
   }
   EXPECT_FALSE(filter2->Check("not present"));
+  EXPECT_EQ(filter2->Version(), filter_->Version());
+}
+
+TEST_F(BloomFilterTest, TestMoveToProtobuf) {
+  filter_->Add({"a", "b", "c", "d"});
+  const psi_proto::ServerSetup expected = filter_->ToProtobuf();
+
+  // A view copies the bits it does not own.
+  PSI_ASSERT_OK_AND_ASSIGN(auto view,
+                           BloomFilter::CreateViewFromProtobuf(expected));
+  EXPECT_EQ(std::move(*view).ToProtobuf().SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_EQ(expected.bloom_filter().bits(), filter_->Bits());
+
+  EXPECT_EQ(std::move(*filter_).ToProtobuf().SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_TRUE(filter_->Bits().empty());
+}
+
+TEST_F(BloomFilterTest, TestCreateViewFromProtobuf) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  filter_->Add(elements);
+  const psi_proto::ServerSetup encoded_filter = filter_->ToProtobuf();
+  PSI_ASSERT_OK_AND_ASSIGN(auto view,
+                           BloomFilter::CreateViewFromProtobuf(encoded_filter));
+  EXPECT_EQ(view->Intersect(elements).size(), elements.size());
+  EXPECT_FALSE(view->Check("not present"));
+  EXPECT_EQ(view->Bits(), encoded_filter.bloom_filter().bits());
+
+  // Adding to a view copies the bits rather than writing to the protobuf.
+  const std::string bits = encoded_filter.bloom_filter().bits();
+  view->Add("not present");
+  EXPECT_TRUE(view->Check("not present"));
+  EXPECT_EQ(encoded_filter.bloom_filter().bits(), bits);
+}
+
+TEST_F(BloomFilterTest, TestCreateFromProtobufLegacy) {
+  // Setups written before hash versions existed have no `hash_version` and
+  // must still be read with the legacy hash functions.
+  SetUp(0.001, 1 << 10, psi_proto::HASH_VERSION_LEGACY);
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  filter_->Add(elements);
+  psi_proto::ServerSetup encoded_filter = filter_->ToProtobuf();
+  encoded_filter.mutable_bloom_filter()->clear_hash_version();
+  PSI_ASSERT_OK_AND_ASSIGN(auto filter2,
+                           BloomFilter::CreateFromProtobuf(encoded_filter));
+  EXPECT_EQ(filter2->Version(), psi_proto::HASH_VERSION_LEGACY);
+  EXPECT_EQ(filter2->Intersect(elements).size(), elements.size());
+}
+
+TEST_F(BloomFilterTest, TestUnknownHashVersion) {
+  EXPECT_EQ(BloomFilter::CreateEmpty(0.001, 1 << 10,
+                                     static_cast<psi_proto::HashVersion>(42))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  psi_proto::ServerSetup encoded_filter = filter_->ToProtobuf();
+  encoded_filter.mutable_bloom_filter()->set_hash_version(
+      static_cast<psi_proto::HashVersion>(42));
+  EXPECT_EQ(BloomFilter::CreateFromProtobuf(encoded_filter).status().code(),
+            absl::StatusCode::kInvalidArgument);
 }
 
 }  // namespace
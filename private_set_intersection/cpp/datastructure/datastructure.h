@@ -25,6 +25,11 @@ typedef enum DataStructure {
   Raw = 0,
   Gcs = 1,
   BloomFilter = 2,
+  BlockedBloomFilter = 3,
+  BinaryFuseFilter = 4,
+  EliasFano = 5,
+  RansSet = 6,
+  RawFingerprints = 7,
 } datastructure_t;
 
 #ifdef __cplusplus
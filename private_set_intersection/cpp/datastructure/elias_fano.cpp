@@ -0,0 +1,333 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "absl/base/internal/endian.h"
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace private_set_intersection {
+
+namespace {
+
+// Every this many zeros of the high bits, the position of the zero is kept.
+// Zeros and ones are about equally frequent, so a select scans about eight
+// words past a sample.
+constexpr uint64_t kSelectSampleRate = 256;
+
+constexpr int kMaxLowBits = 62;
+constexpr int64_t kMaxHashRange = int64_t{1} << 62;
+
+/**
+ * @brief Returns the position of the `rank`-th set bit of `word`, which must
+ * have more than `rank` set bits
+ */
+int SelectInWord(uint64_t word, int rank) {
+#if defined(__BMI2__)
+  return absl::countr_zero(_pdep_u64(uint64_t{1} << rank, word));
+#else
+  int pos = 0;
+  for (int count = absl::popcount(word & 0xff); count <= rank;
+       count = absl::popcount(word & 0xff)) {
+    rank -= count;
+    word >>= 8;
+    pos += 8;
+  }
+  for (; rank > 0; rank--) {
+    word &= word - 1;
+  }
+  return pos + absl::countr_zero(word);
+#endif
+}
+
+uint64_t NumWords(uint64_t num_bits) { return (num_bits + 63) / 64; }
+
+uint64_t CountBuckets(int64_t hash_range, int low_bits) {
+  return (static_cast<uint64_t>(hash_range - 1) >> low_bits) + 1;
+}
+
+// Returns `num_bytes` little-endian bytes of `words`.
+std::string WordsToBytes(const std::vector<uint64_t>& words,
+                         uint64_t num_bytes) {
+  std::string bytes(words.size() * 8, '\0');
+  for (size_t i = 0; i < words.size(); i++) {
+    absl::little_endian::Store64(&bytes[8 * i], words[i]);
+  }
+  bytes.resize(num_bytes);
+  return bytes;
+}
+
+// Returns `bytes` followed by eight zero bytes.
+std::string PadBytes(const std::string& bytes) {
+  std::string padded;
+  padded.reserve(bytes.size() + 8);
+  padded.append(bytes);
+  padded.append(8, '\0');
+  return padded;
+}
+
+// Reads little-endian `bytes` into `num_words` words.
+std::vector<uint64_t> BytesToWords(const std::string& bytes,
+                                   uint64_t num_words) {
+  std::vector<uint64_t> words(num_words);
+  std::memcpy(words.data(), bytes.data(), bytes.size());
+  for (uint64_t& word : words) {
+    word = absl::little_endian::ToHost64(word);
+  }
+  return words;
+}
+
+}  // namespace
+
+EliasFano::EliasFano(int64_t hash_range, int64_t num_elements, int low_bits,
+                     std::string low, std::vector<uint64_t> high)
+    : hash_range_(hash_range),
+      num_elements_(num_elements),
+      low_bits_(low_bits),
+      low_(std::move(low)),
+      high_(std::move(high)) {}
+
+/**
+ * @brief Hashes the elements, sorts them and writes the low bits of every
+ * hash into the packed array and its high part in unary
+ *
+ * @param fpr The target false-positive rate
+ * @param num_client_inputs The number of client inputs
+ * @param elements The elements to insert
+ * @return The set
+ */
+StatusOr<std::unique_ptr<EliasFano>> EliasFano::Create(
+    double fpr, int64_t num_client_inputs,
+    absl::Span<const std::string> elements) {
+  if (fpr <= 0 || fpr >= 1) {
+    return absl::InvalidArgumentError("`fpr` must be in (0,1)");
+  }
+  auto num_server_inputs = static_cast<int64_t>(elements.size());
+  const double range =
+      static_cast<double>(std::max(num_client_inputs, num_server_inputs)) / fpr;
+  if (range > static_cast<double>(kMaxHashRange)) {
+    return absl::InvalidArgumentError(
+        "`fpr` is too small for the number of inputs");
+  }
+  const int64_t hash_range = std::max<int64_t>(1, static_cast<int64_t>(range));
+
+  std::vector<uint64_t> hashes(elements.size());
+  for (size_t i = 0; i < elements.size(); i++) {
+    hashes[i] = ReduceToRange(FilterHash64(elements[i]), hash_range);
+  }
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+  const auto n = static_cast<uint64_t>(hashes.size());
+  // An empty set still splits the range as if it had one element, so that
+  // its high bits are a couple of buckets rather than one per hash value.
+  const uint64_t split = std::max<uint64_t>(n, 1);
+  int low_bits = 0;
+  if (static_cast<uint64_t>(hash_range) > split) {
+    low_bits = absl::bit_width(static_cast<uint64_t>(hash_range) / split) - 1;
+  }
+  const uint64_t low_mask = (uint64_t{1} << low_bits) - 1;
+  std::vector<uint64_t> low(NumWords(n * low_bits) + 1);
+  std::vector<uint64_t> high(
+      NumWords(n + CountBuckets(hash_range, low_bits)) + 1);
+  for (uint64_t i = 0; i < n; i++) {
+    if (low_bits > 0) {
+      const uint64_t bit = i * low_bits;
+      const uint64_t value = hashes[i] & low_mask;
+      low[bit / 64] |= value << (bit % 64);
+      if (bit % 64 + low_bits > 64) {
+        low[bit / 64 + 1] |= value >> (64 - bit % 64);
+      }
+    }
+    const uint64_t position = (hashes[i] >> low_bits) + i;
+    high[position / 64] |= uint64_t{1} << (position % 64);
+  }
+
+  auto set = absl::WrapUnique(new EliasFano(
+      hash_range, static_cast<int64_t>(n), low_bits,
+      PadBytes(WordsToBytes(low, (n * low_bits + 7) / 8)), std::move(high)));
+  set->BuildSelectIndex();
+  return set;
+}
+
+StatusOr<std::unique_ptr<EliasFano>> EliasFano::CreateFromProtobuf(
+    const psi_proto::ServerSetup& encoded_set) {
+  if (!encoded_set.IsInitialized()) {
+    return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
+  }
+  const auto& info = encoded_set.elias_fano();
+  const int64_t hash_range = info.hash_range();
+  const int64_t num_elements = info.num_elements();
+  const int low_bits = info.low_bits();
+  if (hash_range <= 0 || hash_range > kMaxHashRange) {
+    return absl::InvalidArgumentError("`hash_range` must be in [1, 2^62]");
+  }
+  if (num_elements < 0 || num_elements > hash_range) {
+    return absl::InvalidArgumentError(
+        "`num_elements` must be in [0, hash_range]");
+  }
+  if (low_bits < 0 || low_bits > kMaxLowBits) {
+    return absl::InvalidArgumentError("`low_bits` must be in [0, 62]");
+  }
+  const auto n = static_cast<uint64_t>(num_elements);
+  const uint64_t num_high_bits = n + CountBuckets(hash_range, low_bits);
+  if (info.low().size() != (n * low_bits + 7) / 8 ||
+      info.high().size() != (num_high_bits + 7) / 8) {
+    return absl::InvalidArgumentError(
+        "`low` or `high` does not match `num_elements` and `low_bits`");
+  }
+
+  auto set = absl::WrapUnique(new EliasFano(
+      hash_range, num_elements, low_bits,
+      PadBytes(info.low()),
+      BytesToWords(info.high(), NumWords(num_high_bits) + 1)));
+  if (!set->BuildSelectIndex()) {
+    return absl::InvalidArgumentError(
+        "`high` does not hold `num_elements` ones");
+  }
+  return set;
+}
+
+bool EliasFano::BuildSelectIndex() {
+  const uint64_t num_bits = static_cast<uint64_t>(num_elements_) + NumBuckets();
+  uint64_t ones = 0;
+  uint64_t zeros = 0;
+  zero_samples_.clear();
+  for (uint64_t i = 0; i < high_.size(); i++) {
+    ones += absl::popcount(high_[i]);
+    if (i * 64 >= num_bits) {
+      continue;
+    }
+    uint64_t word = ~high_[i];
+    if (num_bits - i * 64 < 64) {
+      word &= (uint64_t{1} << (num_bits - i * 64)) - 1;
+    }
+    const int count = absl::popcount(word);
+    // Sample the zeros of rank 0, kSelectSampleRate, ... in this word.
+    for (uint64_t rank = zero_samples_.size() * kSelectSampleRate;
+         rank < zeros + count; rank += kSelectSampleRate) {
+      zero_samples_.push_back(
+          i * 64 + SelectInWord(word, static_cast<int>(rank - zeros)));
+    }
+    zeros += count;
+  }
+  return ones == static_cast<uint64_t>(num_elements_) && zeros == NumBuckets();
+}
+
+uint64_t EliasFano::SelectZero(uint64_t rank) const {
+  const uint64_t sample = zero_samples_[rank / kSelectSampleRate];
+  auto remaining = static_cast<int>(rank % kSelectSampleRate);
+  uint64_t index = sample / 64;
+  uint64_t word = ~high_[index] & (~uint64_t{0} << (sample % 64));
+  for (int count = absl::popcount(word); count <= remaining;
+       count = absl::popcount(word)) {
+    remaining -= count;
+    word = ~high_[++index];
+  }
+  return index * 64 + SelectInWord(word, remaining);
+}
+
+uint64_t EliasFano::Low(uint64_t index) const {
+  if (low_bits_ == 0) {
+    return 0;
+  }
+  const uint64_t bit = index * low_bits_;
+  const char* bytes = low_.data() + bit / 8;
+  const uint64_t offset = bit % 8;
+  uint64_t value = absl::little_endian::Load64(bytes) >> offset;
+  if (offset + low_bits_ > 64) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[8]))
+             << (64 - offset);
+  }
+  return value & ((uint64_t{1} << low_bits_) - 1);
+}
+
+uint64_t EliasFano::NumBuckets() const {
+  return CountBuckets(hash_range_, low_bits_);
+}
+
+/**
+ * @brief Looks up the hashes with the same high part as `hash`: they follow
+ * the zero ending the previous high part, and are compared by their low bits
+ * until one is at least as large.
+ *
+ * @param hash The hash to look up
+ * @return Whether the hash is in the set
+ */
+bool EliasFano::Contains(int64_t hash) const {
+  if (hash < 0 || hash >= hash_range_) {
+    return false;
+  }
+  const auto value = static_cast<uint64_t>(hash);
+  const uint64_t bucket = value >> low_bits_;
+  const uint64_t low = value & ((uint64_t{1} << low_bits_) - 1);
+  uint64_t position = bucket == 0 ? 0 : SelectZero(bucket - 1) + 1;
+  // The number of ones before `position`.
+  uint64_t index = position - bucket;
+  while ((high_[position / 64] >> (position % 64)) & 1) {
+    const uint64_t other = Low(index);
+    if (other >= low) {
+      return other == low;
+    }
+    position++;
+    index++;
+  }
+  return false;
+}
+
+std::vector<int64_t> EliasFano::Intersect(
+    absl::Span<const std::string> elements) const {
+  std::vector<int64_t> res;
+  for (size_t i = 0; i < elements.size(); i++) {
+    const auto hash = static_cast<int64_t>(
+        ReduceToRange(FilterHash64(elements[i]), hash_range_));
+    if (Contains(hash)) {
+      res.push_back(static_cast<int64_t>(i));
+    }
+  }
+  return res;
+}
+
+psi_proto::ServerSetup EliasFano::ToProtobuf() const {
+  const auto n = static_cast<uint64_t>(num_elements_);
+  psi_proto::ServerSetup server_setup;
+  auto* info = server_setup.mutable_elias_fano();
+  info->set_hash_range(hash_range_);
+  info->set_num_elements(num_elements_);
+  info->set_low_bits(low_bits_);
+  info->set_low(low_.substr(0, low_.size() - 8));
+  info->set_high(WordsToBytes(high_, (n + NumBuckets() + 7) / 8));
+  return server_setup;
+}
+
+int64_t EliasFano::HashRange() const { return hash_range_; }
+
+int64_t EliasFano::NumElements() const { return num_elements_; }
+
+int EliasFano::LowBits() const { return low_bits_; }
+
+}  // namespace private_set_intersection
@@ -0,0 +1,123 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_ELIAS_FANO_H_
+#define PRIVATE_SET_INTERSECTION_CPP_ELIAS_FANO_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// A set of hashes in [0, hash_range), Elias-Fano coded. Like a GCS, the
+// server's elements are hashed into a range of about `n / fpr` values, but
+// instead of coding the gaps between them, each of the n sorted, distinct
+// hashes is split into its `l = floor(log2(hash_range / n))` low bits, which
+// are stored packed, and its high bits, which are stored in unary: hash `i`
+// with high part `h` sets bit `h + i` of a bit vector of about 2n bits. The
+// set takes about `n * (l + 2)` bits, within a bit or so per element of a
+// GCS.
+//
+// Unlike a GCS, it supports random access. The hashes with high part `h` sit
+// right after the `h`-th zero of the high bits, which is found in constant
+// time from a sample of every 256th zero's position, so a membership query
+// reads a few words regardless of the size of the set. Clients with few
+// elements therefore do work proportional to their own size.
+//
+// Elements are hashed with `FilterHash64`, reduced to the range by
+// multiply-shift.
+class EliasFano {
+ public:
+  EliasFano() = delete;
+
+  // Creates a set containing `elements`, hashed into a range of
+  // `max(num_client_inputs, elements.size()) / fpr` values.
+  //
+  // Returns INVALID_ARGUMENT if `fpr` is not in (0,1) or the range would
+  // exceed 2^62.
+  static StatusOr<std::unique_ptr<EliasFano>> Create(
+      double fpr, int64_t num_client_inputs,
+      absl::Span<const std::string> elements);
+
+  // Creates a set from the passed protobuf.
+  //
+  // Returns INVALID_ARGUMENT if the protobuf does not describe a valid set.
+  static StatusOr<std::unique_ptr<EliasFano>> CreateFromProtobuf(
+      const psi_proto::ServerSetup& encoded_set);
+
+  // Returns the indices of all elements whose hash is in the set. No state
+  // of the set is touched, so disjoint chunks can be intersected
+  // concurrently from several threads.
+  std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
+
+  // Returns true if `hash` is in the set.
+  bool Contains(int64_t hash) const;
+
+  // Returns a protobuf representation of the set.
+  psi_proto::ServerSetup ToProtobuf() const;
+
+  int64_t HashRange() const;
+
+  int64_t NumElements() const;
+
+  int LowBits() const;
+
+ private:
+  EliasFano(int64_t hash_range, int64_t num_elements, int low_bits,
+            std::string low, std::vector<uint64_t> high);
+
+  // Samples the positions of the zeros of the high bits. Returns false if
+  // the high bits do not hold exactly `num_elements_` ones and one zero per
+  // high part.
+  bool BuildSelectIndex();
+
+  // Returns the position of the `rank`-th zero (counting from 0) of the high
+  // bits.
+  uint64_t SelectZero(uint64_t rank) const;
+
+  // Returns the low bits of the `index`-th hash.
+  uint64_t Low(uint64_t index) const;
+
+  // Returns the number of high parts, i.e. of zeros in the high bits.
+  uint64_t NumBuckets() const;
+
+  int64_t hash_range_;
+  int64_t num_elements_;
+  int low_bits_;
+
+  // The low bits as in the protobuf, followed by eight zero bytes so that
+  // unaligned 64-bit loads may run over the end. They make up most of the
+  // set, so they are copied once and read in place.
+  std::string low_;
+
+  // The high bits as words, followed by a zero word.
+  std::vector<uint64_t> high_;
+
+  // The position of every `kSelectSampleRate`-th zero of `high_`.
+  std::vector<uint64_t> zero_samples_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_ELIAS_FANO_H_
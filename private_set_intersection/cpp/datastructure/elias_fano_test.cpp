@@ -0,0 +1,216 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
+
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+TEST(EliasFanoTest, TestIntersect) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  std::vector<std::string> elements2 = {"a", "b", "d", "e"};
+  PSI_ASSERT_OK_AND_ASSIGN(auto set, EliasFano::Create(0.001, 4, elements));
+  EXPECT_EQ(set->Intersect(elements2), std::vector<int64_t>({0, 1, 2}));
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto empty, EliasFano::Create(0.001, 4, {}));
+  EXPECT_TRUE(empty->Intersect(elements2).empty());
+}
+
+TEST(EliasFanoTest, TestContains) {
+  std::mt19937_64 rng(1);
+  for (int num_elements : {1, 10, 1000, 100000}) {
+    std::vector<std::string> elements;
+    for (int i = 0; i < num_elements; i++) {
+      elements.push_back(absl::StrCat("Element ", i));
+    }
+    for (double fpr : {0.5, 0.001, 1e-9}) {
+      PSI_ASSERT_OK_AND_ASSIGN(auto created,
+                               EliasFano::Create(fpr, 10, elements));
+      // Every lookup goes through the decoded set, which must encode to the
+      // same bits.
+      const psi_proto::ServerSetup encoded_set = created->ToProtobuf();
+      EXPECT_EQ(encoded_set.elias_fano().low_bits(), created->LowBits());
+      PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                               EliasFano::CreateFromProtobuf(encoded_set));
+      EXPECT_EQ(set->ToProtobuf().SerializeAsString(),
+                encoded_set.SerializeAsString());
+      absl::flat_hash_set<int64_t> hashes;
+      for (const auto& element : elements) {
+        hashes.insert(static_cast<int64_t>(
+            ReduceToRange(FilterHash64(element), set->HashRange())));
+      }
+      EXPECT_EQ(set->NumElements(), hashes.size());
+      EXPECT_EQ(set->Intersect(elements).size(), elements.size());
+      for (int64_t hash : hashes) {
+        ASSERT_TRUE(set->Contains(hash)) << hash;
+        EXPECT_EQ(set->Contains(hash + 1), hashes.contains(hash + 1));
+        EXPECT_EQ(set->Contains(hash - 1), hashes.contains(hash - 1));
+      }
+      for (int i = 0; i < 10000; i++) {
+        const auto hash = static_cast<int64_t>(rng() % set->HashRange());
+        EXPECT_EQ(set->Contains(hash), hashes.contains(hash));
+      }
+      EXPECT_FALSE(set->Contains(-1));
+      EXPECT_FALSE(set->Contains(set->HashRange()));
+    }
+  }
+}
+
+TEST(EliasFanoTest, TestFPR) {
+  std::vector<std::string> tests;
+  for (int i = 0; i < 100000; i++) {
+    tests.push_back(absl::StrCat("Test ", i));
+  }
+  for (double target_fpr : {0.1, 0.001}) {
+    for (int num_elements = 1 << 10; num_elements < (1 << 18);
+         num_elements *= 4) {
+      std::vector<std::string> elements;
+      for (int i = 0; i < num_elements; i++) {
+        elements.push_back(absl::StrCat("Element ", i));
+      }
+      PSI_ASSERT_OK_AND_ASSIGN(
+          auto set, EliasFano::Create(target_fpr, num_elements, elements));
+      // Test 100k elements to measure FPR.
+      double actual_fpr =
+          static_cast<double>(set->Intersect(tests).size()) / tests.size();
+      // Check if actual FPR matches the target FPR, allowing for 20% error.
+      EXPECT_LT(actual_fpr, 1.2 * target_fpr) << absl::StrCat(
+          "fpr: ", target_fpr, ", num_elements: ", num_elements);
+    }
+  }
+}
+
+TEST(EliasFanoTest, TestSize) {
+  const int num_elements = 100000;
+  std::vector<std::string> elements;
+  for (int i = 0; i < num_elements; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  for (double fpr : {0.01, 1e-6, 1e-12}) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                             EliasFano::Create(fpr, num_elements, elements));
+    // log2(1 / fpr) bits per element for the hash, and at most 2 more for
+    // the unary high parts and the rounding of the low bits.
+    const psi_proto::ServerSetup encoded_set = set->ToProtobuf();
+    const size_t num_bytes = encoded_set.elias_fano().low().size() +
+                             encoded_set.elias_fano().high().size();
+    EXPECT_LE(num_bytes, num_elements * (-std::log2(fpr) + 2) / 8) << fpr;
+  }
+}
+
+TEST(EliasFanoTest, TestEmptySet) {
+  // The server divides the fpr by the number of client inputs, so an empty
+  // set still comes with a huge hash range.
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  for (double fpr : {1e-9, 1e-12}) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto set, EliasFano::Create(fpr, 1000, {}));
+    EXPECT_EQ(set->NumElements(), 0);
+    const psi_proto::ServerSetup encoded_set = set->ToProtobuf();
+    EXPECT_LE(encoded_set.ByteSizeLong(), 32) << fpr;
+    EXPECT_TRUE(set->Intersect(elements).empty());
+
+    PSI_ASSERT_OK_AND_ASSIGN(auto set2,
+                             EliasFano::CreateFromProtobuf(encoded_set));
+    EXPECT_FALSE(set2->Contains(0));
+    EXPECT_FALSE(set2->Contains(set2->HashRange() - 1));
+  }
+}
+
+TEST(EliasFanoTest, TestCreateFromInvalidProtobuf) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 100; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto set, EliasFano::Create(0.001, 100, elements));
+  const psi_proto::ServerSetup encoded_set = set->ToProtobuf();
+
+  psi_proto::ServerSetup corrupt = encoded_set;
+  corrupt.mutable_elias_fano()->set_hash_range(0);
+  EXPECT_EQ(EliasFano::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  corrupt = encoded_set;
+  corrupt.mutable_elias_fano()->set_low_bits(63);
+  EXPECT_EQ(EliasFano::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  corrupt = encoded_set;
+  corrupt.mutable_elias_fano()->set_num_elements(101);
+  EXPECT_EQ(EliasFano::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  corrupt = encoded_set;
+  corrupt.mutable_elias_fano()->mutable_low()->pop_back();
+  EXPECT_EQ(EliasFano::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Same length, but one more one in the high bits.
+  corrupt = encoded_set;
+  std::string& high = *corrupt.mutable_elias_fano()->mutable_high();
+  for (char& byte : high) {
+    if (byte != static_cast<char>(0xff)) {
+      byte = static_cast<char>(byte | (~byte & (byte + 1)));
+      break;
+    }
+  }
+  EXPECT_EQ(EliasFano::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(EliasFanoTest, TestMaxHashRange) {
+  // The hash range is the larger input count over the fpr, and stops at 2^62
+  // so that a hash plus the unary high part still fits in an int64_t.
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto set, EliasFano::Create(std::ldexp(1.0, -52), 1024, {"a"}));
+  EXPECT_EQ(set->HashRange(), int64_t{1} << 62);
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto decoded, EliasFano::CreateFromProtobuf(set->ToProtobuf()));
+  EXPECT_EQ(decoded->Intersect({"a"}), std::vector<int64_t>({0}));
+
+  for (const auto& [fpr, num_client_inputs] :
+       std::vector<std::pair<double, int64_t>>{{std::ldexp(1.0, -53), 1024},
+                                               {std::ldexp(1.0, -62), 2},
+                                               {0.0, 1},
+                                               {1.0, 1}}) {
+    EXPECT_EQ(
+        EliasFano::Create(fpr, num_client_inputs, {"a"}).status().code(),
+        absl::StatusCode::kInvalidArgument)
+        << fpr;
+  }
+
+  psi_proto::ServerSetup corrupt = set->ToProtobuf();
+  corrupt.mutable_elias_fano()->set_hash_range((int64_t{1} << 62) + 1);
+  EXPECT_EQ(EliasFano::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
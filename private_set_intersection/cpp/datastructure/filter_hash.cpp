@@ -0,0 +1,86 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+
+#include <cstring>
+
+#include "absl/base/internal/endian.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+// Odd constants with well-mixed bits, from the fractional part of pi.
+constexpr uint64_t kKey = 0x243f6a8885a308d3;
+constexpr uint64_t kSecret0 = 0x13198a2e03707345;
+constexpr uint64_t kSecret1 = 0xa4093822299f31d1;
+constexpr uint64_t kSecret2 = 0x082efa98ec4e6c89;
+
+uint64_t Load64(const char* bytes) {
+  return absl::little_endian::Load64(bytes);
+}
+
+// Loads up to 8 bytes as a little-endian integer padded with zeros.
+uint64_t LoadPartial(const char* bytes, size_t size) {
+  char buffer[8] = {};
+  std::memcpy(buffer, bytes, size);
+  return absl::little_endian::Load64(buffer);
+}
+
+// Folds the 128-bit product of `a` and `b` into 64 bits.
+uint64_t Mix(uint64_t a, uint64_t b) {
+  const absl::uint128 product = absl::uint128(a) * b;
+  return absl::Uint128Low64(product) ^ absl::Uint128High64(product);
+}
+
+}  // namespace
+
+uint64_t FilterHash64(absl::string_view input) {
+  return FilterHash64(input, kKey);
+}
+
+/**
+ * @brief Hashes `input` sixteen bytes at a time, chaining the state through
+ * the second operand of each multiplication
+ *
+ * @param input The bytes to hash
+ * @param key The key the state starts from and the length is mixed with
+ * @return The 64-bit hash
+ */
+uint64_t FilterHash64(absl::string_view input, uint64_t key) {
+  const char* data = input.data();
+  size_t size = input.size();
+  uint64_t state = key ^ Mix(size ^ kSecret0, kSecret1);
+  while (size > 16) {
+    state = Mix(Load64(data) ^ kSecret1, Load64(data + 8) ^ state);
+    data += 16;
+    size -= 16;
+  }
+  uint64_t a;
+  uint64_t b;
+  if (size > 8) {
+    a = Load64(data);
+    b = LoadPartial(data + 8, size - 8);
+  } else {
+    a = LoadPartial(data, size);
+    b = 0;
+  }
+  state = Mix(a ^ kSecret1, b ^ state);
+  return Mix(state ^ kSecret2, static_cast<uint64_t>(input.size()) ^ key);
+}
+
+}  // namespace private_set_intersection
@@ -0,0 +1,50 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_FILTER_HASH_H_
+#define PRIVATE_SET_INTERSECTION_CPP_FILTER_HASH_H_
+
+#include <cstdint>
+
+#include "absl/numeric/int128.h"
+#include "absl/strings/string_view.h"
+
+namespace private_set_intersection {
+
+// Hashing for filters with `psi_proto::HASH_VERSION_FAST64`.
+//
+// Filter inputs are SM2 points encrypted under a key unknown to the client,
+// so their bytes already look uniformly random and a cryptographic hash buys
+// nothing over a fast one. The hash below reads the input eight bytes at a
+// time and mixes with 64x64->128-bit multiplications. It is fixed by this
+// definition (little-endian loads, fixed key) so that clients and servers on
+// any platform agree on it; it must never change for this hash version.
+uint64_t FilterHash64(absl::string_view input);
+
+// The same hash with `key` in place of the fixed key. Hashes under different
+// keys look independent, so they extend a hash past 64 bits where that is
+// needed.
+uint64_t FilterHash64(absl::string_view input, uint64_t key);
+
+// Maps a 64-bit hash uniformly onto [0, range) with a multiply and a shift,
+// which is far cheaper than a division and uses the high bits of `hash`.
+inline uint64_t ReduceToRange(uint64_t hash, uint64_t range) {
+  return absl::Uint128High64(absl::uint128(hash) * range);
+}
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_FILTER_HASH_H_
@@ -0,0 +1,88 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace private_set_intersection {
+namespace {
+
+TEST(FilterHashTest, TestKnownAnswers) {
+  // Clients and servers must agree on the hash, so it must never change.
+  std::string bytes;
+  for (int i = 0; i < 33; i++) {
+    bytes.push_back(static_cast<char>(i));
+  }
+  EXPECT_EQ(FilterHash64(""), 0x34cbf51ee017b0cbULL);
+  EXPECT_EQ(FilterHash64("a"), 0xadbbb3666bbdd7ccULL);
+  EXPECT_EQ(FilterHash64("abcdefgh"), 0x52a7b5ed36ee211fULL);
+  EXPECT_EQ(FilterHash64("abcdefghijklmnop"), 0x1fdc0bf67c92a3ebULL);
+  EXPECT_EQ(FilterHash64("abcdefghijklmnopq"), 0x88a6e50faac5638fULL);
+  EXPECT_EQ(FilterHash64(bytes), 0xcece9f34506fd736ULL);
+}
+
+TEST(FilterHashTest, TestNoCollisions) {
+  absl::flat_hash_set<uint64_t> hashes;
+  std::string zeros;
+  for (int i = 0; i < 100; i++) {
+    // Inputs that differ only in their length or in a single byte.
+    EXPECT_TRUE(hashes.insert(FilterHash64(zeros)).second);
+    zeros.push_back('\0');
+  }
+  for (int i = 0; i < 100000; i++) {
+    EXPECT_TRUE(
+        hashes.insert(FilterHash64(absl::StrCat("Element ", i))).second);
+  }
+}
+
+TEST(FilterHashTest, TestKeys) {
+  absl::flat_hash_set<uint64_t> hashes;
+  for (uint64_t key = 0; key < 100; key++) {
+    EXPECT_TRUE(hashes.insert(FilterHash64("Element", key)).second);
+  }
+  // The unkeyed hash uses a fixed key.
+  EXPECT_EQ(FilterHash64("a", 0x243f6a8885a308d3), FilterHash64("a"));
+}
+
+TEST(FilterHashTest, TestReduceToRange) {
+  EXPECT_EQ(ReduceToRange(0, 1000), 0);
+  EXPECT_EQ(ReduceToRange(~uint64_t{0}, 1000), 999);
+  EXPECT_EQ(ReduceToRange(uint64_t{1} << 63, 1000), 500);
+  EXPECT_EQ(ReduceToRange(12345, 0), 0);
+
+  // Hashes of distinct inputs should spread evenly over a small range.
+  constexpr int kRange = 10;
+  constexpr int kSamples = 100000;
+  std::vector<int> counts(kRange);
+  for (int i = 0; i < kSamples; i++) {
+    const uint64_t index =
+        ReduceToRange(FilterHash64(absl::StrCat("Element ", i)), kRange);
+    ASSERT_LT(index, kRange);
+    counts[index]++;
+  }
+  for (int count : counts) {
+    EXPECT_NEAR(count, kSamples / kRange, kSamples / kRange / 20);
+  }
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -22,78 +22,324 @@
 
 #include "absl/memory/memory.h"
 #include "absl/strings/escaping.h"
+#include "private_set_intersection/cpp/crypto/sm3.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
 #include "private_set_intersection/cpp/datastructure/golomb.h"
+#include "private_set_intersection/cpp/util/parallel.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
 
+namespace {
+
+// Number of elements whose digests are computed per call to `Sm3Batch`, which
+// bounds the size of the temporary buffers.
+constexpr size_t kHashBatchSize = 1024;
+
+// Pairs every hash of `element_hashes` with its index.
+std::vector<std::pair<int64_t, int64_t>> WithIndices(
+    const std::vector<int64_t>& element_hashes) {
+  std::vector<std::pair<int64_t, int64_t>> hashes;
+  hashes.reserve(element_hashes.size());
+  for (size_t i = 0; i < element_hashes.size(); i++) {
+    hashes.emplace_back(element_hashes[i], i);
+  }
+  return hashes;
+}
+
+}  // namespace
+
 GCS::GCS(std::string golomb, int64_t div, int64_t hash_range,
-         std::unique_ptr<::private_join_and_compute::Context> context)
-    : golomb_(std::move(golomb)),
+         psi_proto::HashVersion hash_version,
+         std::vector<GolombIndexEntry> index)
+    : owned_golomb_(std::move(golomb)),
+      golomb_(owned_golomb_),
       div_(div),
       hash_range_(hash_range),
-      context_(std::move(context)) {}
+      hash_version_(hash_version),
+      index_(std::move(index)) {}
 
+/**
+ * @brief Hashes the elements in contiguous ranges, one per thread, radix sorts
+ * the hashes and Golomb-codes their differences
+ *
+ * @param fpr The target false-positive rate
+ * @param num_client_inputs The number of client inputs
+ * @param elements The elements to insert
+ * @param hash_version How the elements are mapped into the hash range
+ * @param index_interval The number of elements between skip index entries
+ * @param num_threads The number of threads to hash and sort the elements on
+ * @return The set
+ */
 StatusOr<std::unique_ptr<GCS>> GCS::Create(
     double fpr, int64_t num_client_inputs,
-    absl::Span<const std::string> elements) {
+    absl::Span<const std::string> elements,
+    psi_proto::HashVersion hash_version, int64_t index_interval,
+    int num_threads) {
   if (fpr <= 0 || fpr >= 1) {
     return absl::InvalidArgumentError("`fpr` must be in (0,1)");
   }
+  if (!psi_proto::HashVersion_IsValid(hash_version)) {
+    return absl::InvalidArgumentError("Unknown `hash_version`");
+  }
+  if (index_interval < 0) {
+    return absl::InvalidArgumentError("`index_interval` must be non-negative");
+  }
   auto num_server_inputs = static_cast<int64_t>(elements.size());
   auto hash_range = static_cast<int64_t>(
       std::max(num_client_inputs, num_server_inputs) / fpr);
-  std::vector<int64_t> hashes;
-  hashes.reserve(elements.size());
-  auto context = absl::make_unique<::private_join_and_compute::Context>();
-
-  for (const std::string& element : elements) {
-    hashes.push_back(Hash(element, hash_range, *context));
-  }
+  std::vector<int64_t> hashes(elements.size());
+  // Hashing cannot fail.
+  ParallelFor(num_threads, num_server_inputs,
+              [&](int, int64_t begin, int64_t end) {
+                const std::vector<int64_t> range_hashes = Hash(
+                    elements.subspan(begin, end - begin), hash_range,
+                    hash_version);
+                std::copy(range_hashes.begin(), range_hashes.end(),
+                          hashes.begin() + begin);
+                return absl::OkStatus();
+              })
+      .IgnoreError();
 
-  std::sort(hashes.begin(), hashes.end());
-  auto compressed = golomb_compress(hashes);
+  ParallelRadixSort(&hashes, num_threads);
+  auto compressed = golomb_compress(hashes, -1, index_interval);
   auto div = compressed.div;
   return absl::WrapUnique(new GCS(std::move(compressed.compressed), div,
-                                  hash_range, std::move(context)));
+                                  hash_range, hash_version,
+                                  std::move(compressed.index)));
 }
 
 StatusOr<std::unique_ptr<GCS>> GCS::CreateFromProtobuf(
     const psi_proto::ServerSetup& encoded_set) {
+  StatusOr<std::unique_ptr<GCS>> gcs = CreateViewFromProtobuf(encoded_set);
+  if (gcs.ok()) {
+    (*gcs)->owned_golomb_ = std::string((*gcs)->golomb_);
+    (*gcs)->golomb_ = (*gcs)->owned_golomb_;
+  }
+  return gcs;
+}
+
+StatusOr<std::unique_ptr<GCS>> GCS::CreateViewFromProtobuf(
+    const psi_proto::ServerSetup& encoded_set) {
   if (!encoded_set.IsInitialized()) {
     return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
   }
+  const psi_proto::HashVersion hash_version = encoded_set.gcs().hash_version();
+  if (!psi_proto::HashVersion_IsValid(hash_version)) {
+    return absl::InvalidArgumentError("Unknown `hash_version`");
+  }
 
-  auto context = absl::make_unique<::private_join_and_compute::Context>();
-  return absl::WrapUnique(new GCS(std::move(encoded_set.gcs().bits()),
-                                  static_cast<int64_t>(encoded_set.gcs().div()),
-                                  encoded_set.gcs().hash_range(),
-                                  std::move(context)));
+  // Both the offsets and the values of the index must increase strictly, and
+  // the offsets must lie within the bits.
+  const auto& offsets = encoded_set.gcs().index_bit_offsets();
+  const auto& prefix_sums = encoded_set.gcs().index_prefix_sums();
+  if (offsets.size() != prefix_sums.size()) {
+    return absl::InvalidArgumentError(
+        "`index_bit_offsets` and `index_prefix_sums` differ in length");
+  }
+  std::vector<GolombIndexEntry> index;
+  index.reserve(offsets.size());
+  const uint64_t num_bits = encoded_set.gcs().bits().size() * CHAR_SIZE;
+  for (int i = 0; i < offsets.size(); i++) {
+    if (offsets[i] == 0 || offsets[i] >= num_bits || prefix_sums[i] < 0 ||
+        (i > 0 && (offsets[i] <= offsets[i - 1] ||
+                   prefix_sums[i] <= prefix_sums[i - 1]))) {
+      return absl::InvalidArgumentError("The skip index is corrupt");
+    }
+    index.push_back({offsets[i], prefix_sums[i]});
+  }
+
+  auto gcs = absl::WrapUnique(new GCS(
+      std::string(), static_cast<int64_t>(encoded_set.gcs().div()),
+      encoded_set.gcs().hash_range(), hash_version, std::move(index)));
+  gcs->golomb_ = encoded_set.gcs().bits();
+  return gcs;
 }
 
 std::vector<int64_t> GCS::Intersect(
     absl::Span<const std::string> elements) const {
-  std::vector<std::pair<int64_t, int64_t>> hashes;
-  hashes.reserve(elements.size());
+  return IntersectHashes(WithIndices(HashElements(elements)));
+}
 
-  for (size_t i = 0; i < elements.size(); i++) {
-    hashes.emplace_back(Hash(elements[i], hash_range_, *context_), i);
-  }
+int64_t GCS::CountIntersection(absl::Span<const std::string> elements) const {
+  return CountHashes(WithIndices(HashElements(elements)));
+}
+
+std::vector<uint64_t> GCS::IntersectBitmap(
+    absl::Span<const std::string> elements) const {
+  return IntersectHashesBitmap(WithIndices(HashElements(elements)),
+                               static_cast<int64_t>(elements.size()));
+}
 
+std::vector<int64_t> GCS::HashElements(
+    absl::Span<const std::string> elements) const {
+  return Hash(elements, hash_range_, hash_version_);
+}
+
+/**
+ * @brief Intersects the sorted hashes with the set. With a skip index, the
+ * hashes are split into runs that fall into the same block, and only those
+ * blocks are decoded, the runs being spread over the threads. Each thread
+ * collects the matches of its runs in its own vector, which is passed to
+ * `flush` after every run.
+ *
+ * @param hashes The (hash, index) pairs
+ * @param num_threads The number of threads to decode blocks on
+ * @param matches Receives the matches of each thread, in run order
+ * @param flush Called with a thread and its matches after every run
+ */
+template <typename Flush>
+void GCS::MatchHashes(std::vector<std::pair<int64_t, int64_t>> hashes,
+                      int num_threads,
+                      std::vector<std::vector<int64_t>>* matches,
+                      Flush flush) const {
   std::sort(
       hashes.begin(), hashes.end(),
       [](const std::pair<int64_t, int64_t>& a,
          const std::pair<int64_t, int64_t>& b) { return a.first < b.first; });
-  auto res = golomb_intersect(golomb_, div_, hashes);
+  matches->assign(ResolveNumThreads(num_threads), {});
+  if (index_.empty()) {
+    (*matches)[0] = golomb_intersect(golomb_, div_, hashes);
+    flush(0, &(*matches)[0]);
+    return;
+  }
 
+  // A run of hashes [begin, end) that can only be in block `block`.
+  struct Run {
+    size_t block;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Run> runs;
+  for (size_t begin = 0; begin < hashes.size();) {
+    const size_t block =
+        std::lower_bound(index_.begin(), index_.end(), hashes[begin].first,
+                         [](const GolombIndexEntry& entry, int64_t hash) {
+                           return entry.prefix_sum < hash;
+                         }) -
+        index_.begin();
+    size_t end = hashes.size();
+    if (block < index_.size()) {
+      end = std::upper_bound(hashes.begin() + begin, hashes.end(),
+                             index_[block].prefix_sum,
+                             [](int64_t prefix_sum,
+                                const std::pair<int64_t, int64_t>& hash) {
+                               return prefix_sum < hash.first;
+                             }) -
+            hashes.begin();
+    }
+    runs.push_back({block, begin, end});
+    begin = end;
+  }
+
+  const uint64_t num_bits = golomb_.size() * CHAR_SIZE;
+  const auto all_hashes = absl::MakeConstSpan(hashes);
+  // Decoding cannot fail.
+  ParallelFor(num_threads, static_cast<int64_t>(runs.size()),
+              [&](int thread, int64_t begin, int64_t end) {
+                for (int64_t r = begin; r < end; r++) {
+                  const Run& run = runs[r];
+                  const uint64_t begin_bit =
+                      run.block == 0 ? 0 : index_[run.block - 1].bit_offset;
+                  const uint64_t end_bit = run.block < index_.size()
+                                               ? index_[run.block].bit_offset
+                                               : num_bits;
+                  const int64_t prefix_sum =
+                      run.block == 0 ? 0 : index_[run.block - 1].prefix_sum;
+                  golomb_intersect_range(
+                      golomb_, div_, begin_bit, end_bit, prefix_sum,
+                      all_hashes.subspan(run.begin, run.end - run.begin),
+                      &(*matches)[thread]);
+                  flush(thread, &(*matches)[thread]);
+                }
+                return absl::OkStatus();
+              })
+      .IgnoreError();
+}
+
+std::vector<int64_t> GCS::IntersectHashes(
+    std::vector<std::pair<int64_t, int64_t>> hashes, int num_threads) const {
+  std::vector<std::vector<int64_t>> matches;
+  MatchHashes(std::move(hashes), num_threads, &matches,
+              [](int, std::vector<int64_t>*) {});
+  std::vector<int64_t> res = std::move(matches[0]);
+  for (size_t thread = 1; thread < matches.size(); thread++) {
+    res.insert(res.end(), matches[thread].begin(), matches[thread].end());
+  }
   return res;
 }
 
-psi_proto::ServerSetup GCS::ToProtobuf() const {
+int64_t GCS::CountHashes(std::vector<std::pair<int64_t, int64_t>> hashes,
+                         int num_threads) const {
+  std::vector<std::vector<int64_t>> matches;
+  std::vector<int64_t> counts(ResolveNumThreads(num_threads));
+  MatchHashes(std::move(hashes), num_threads, &matches,
+              [&counts](int thread, std::vector<int64_t>* thread_matches) {
+                counts[thread] += static_cast<int64_t>(thread_matches->size());
+                thread_matches->clear();
+              });
+  int64_t count = 0;
+  for (int64_t thread_count : counts) {
+    count += thread_count;
+  }
+  return count;
+}
+
+/**
+ * @brief Intersects the hashes like `IntersectHashes`, but sets the bits of
+ * the matches after every run instead of keeping them. The indices of a run
+ * are in no particular order, so threads set bits with atomic ORs.
+ *
+ * @param hashes The (hash, index) pairs
+ * @param num_indices The bound on the indices of the pairs
+ * @param num_threads The number of threads to decode blocks on
+ * @return The bitmap of the indices whose hash is in the set
+ */
+std::vector<uint64_t> GCS::IntersectHashesBitmap(
+    std::vector<std::pair<int64_t, int64_t>> hashes, int64_t num_indices,
+    int num_threads) const {
+  std::vector<uint64_t> bitmap((num_indices + 63) / 64);
+  std::vector<std::vector<int64_t>> matches;
+  MatchHashes(std::move(hashes), num_threads, &matches,
+              [&bitmap](int, std::vector<int64_t>* thread_matches) {
+                for (int64_t i : *thread_matches) {
+                  AtomicOr(&bitmap[i / 64], uint64_t{1} << (i % 64));
+                }
+                thread_matches->clear();
+              });
+  return bitmap;
+}
+
+std::vector<int64_t> GCS::DecodeHashes() const {
+  return golomb_decompress(golomb_, div_);
+}
+
+psi_proto::ServerSetup GCS::ToProtobuf() const& {
+  return ToProtobuf(std::string(golomb_));
+}
+
+psi_proto::ServerSetup GCS::ToProtobuf() && {
+  // A view does not own its bits, which are copied.
+  std::string golomb = golomb_.data() == owned_golomb_.data()
+                           ? std::move(owned_golomb_)
+                           : std::string(golomb_);
+  owned_golomb_.clear();
+  golomb_ = owned_golomb_;
+  psi_proto::ServerSetup server_setup = ToProtobuf(std::move(golomb));
+  index_.clear();
+  return server_setup;
+}
+
+psi_proto::ServerSetup GCS::ToProtobuf(std::string golomb) const {
   psi_proto::ServerSetup server_setup;
-  server_setup.mutable_gcs()->set_bits(golomb_);
+  server_setup.mutable_gcs()->set_bits(std::move(golomb));
   server_setup.mutable_gcs()->set_div(static_cast<int32_t>(div_));
   server_setup.mutable_gcs()->set_hash_range(hash_range_);
+  server_setup.mutable_gcs()->set_hash_version(hash_version_);
+  for (const GolombIndexEntry& entry : index_) {
+    server_setup.mutable_gcs()->add_index_bit_offsets(entry.bit_offset);
+    server_setup.mutable_gcs()->add_index_prefix_sums(entry.prefix_sum);
+  }
   return server_setup;
 }
 
@@ -101,19 +347,36 @@ int64_t GCS::Div() const { return div_; }
 
 int64_t GCS::HashRange() const { return hash_range_; }
 
-std::string GCS::Golomb() const { return golomb_; }
+std::string GCS::Golomb() const { return std::string(golomb_); }
 
-int64_t GCS::Hash(const std::string& input, int64_t hash_range,
-                  ::private_join_and_compute::Context& context) {
-  const auto bn_num_bits = context.CreateBigNum(hash_range);
+psi_proto::HashVersion GCS::Version() const { return hash_version_; }
 
-  const int64_t h =
-      // context.CreateBigNum(context.Sha256String(input))
-      context.CreateBigNum(context.Sm3String(input))
-          .Mod(bn_num_bits)
-          .ToIntValue()
-          .value();  // value() is safe here since bn_num_bits fits in an int64.
-  return h;
+int64_t GCS::IndexSize() const { return static_cast<int64_t>(index_.size()); }
+
+std::vector<int64_t> GCS::Hash(absl::Span<const std::string> inputs,
+                               int64_t hash_range,
+                               psi_proto::HashVersion hash_version) {
+  std::vector<int64_t> result(inputs.size());
+  if (hash_version == psi_proto::HASH_VERSION_FAST64) {
+    for (size_t i = 0; i < inputs.size(); i++) {
+      result[i] = static_cast<int64_t>(
+          ReduceToRange(FilterHash64(inputs[i]), hash_range));
+    }
+    return result;
+  }
+  std::vector<absl::string_view> messages;
+  std::vector<Sm3Digest> digests;
+  for (size_t begin = 0; begin < inputs.size(); begin += kHashBatchSize) {
+    const auto batch = inputs.subspan(begin, kHashBatchSize);
+    messages.assign(batch.begin(), batch.end());
+    digests.resize(batch.size());
+    Sm3Batch(messages, absl::MakeSpan(digests));
+    for (size_t i = 0; i < batch.size(); i++) {
+      result[begin + i] =
+          static_cast<int64_t>(Sm3DigestMod(digests[i], hash_range));
+    }
+  }
+  return result;
 }
 
 }  // namespace private_set_intersection
@@ -17,11 +17,13 @@
 #ifndef PRIVATE_SET_INTERSECTION_CPP_GCS_H_
 #define PRIVATE_SET_INTERSECTION_CPP_GCS_H_
 
+#include <utility>
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
-#include "private_join_and_compute/crypto/context.h"
+#include "private_set_intersection/cpp/datastructure/golomb.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
@@ -32,16 +34,91 @@ class GCS {
  public:
   GCS() = delete;
 
+  // Number of elements between two entries of the skip index by default. An
+  // entry takes about 11 bytes, against about 512 * (div + 2) bits for the
+  // elements, so the index adds well under 1% to the set.
+  static constexpr int64_t kDefaultIndexInterval = 512;
+
+  // Creates a set containing `elements`. A skip index entry is added for every
+  // `index_interval`-th element, or none if `index_interval` is 0. The
+  // elements are hashed and sorted on up to `num_threads` threads.
   static StatusOr<std::unique_ptr<GCS>> Create(
       double fpr, int64_t num_client_inputs,
-      absl::Span<const std::string> elements);
-
+      absl::Span<const std::string> elements,
+      psi_proto::HashVersion hash_version = psi_proto::HASH_VERSION_FAST64,
+      int64_t index_interval = kDefaultIndexInterval, int num_threads = 1);
+
+  // Creates a set holding a copy of the bits of `encoded_set`.
+  //
+  // Returns INVALID_ARGUMENT if the hash version is unknown or the skip index
+  // is corrupt.
   static StatusOr<std::unique_ptr<GCS>> CreateFromProtobuf(
       const psi_proto::ServerSetup& encoded_set);
 
+  // Like `CreateFromProtobuf`, but the set reads the bits in place instead of
+  // copying them, so `encoded_set` must outlive it.
+  static StatusOr<std::unique_ptr<GCS>> CreateViewFromProtobuf(
+      const psi_proto::ServerSetup& encoded_set);
+
+  GCS(const GCS&) = delete;
+  GCS& operator=(const GCS&) = delete;
+
   std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
 
-  psi_proto::ServerSetup ToProtobuf() const;
+  // Returns the number of elements whose hash is in the set, without
+  // collecting their indices.
+  int64_t CountIntersection(absl::Span<const std::string> elements) const;
+
+  // Returns a bitmap of the elements whose hash is in the set: element `i` is
+  // bit `i % 64` of word `i / 64`.
+  std::vector<uint64_t> IntersectBitmap(
+      absl::Span<const std::string> elements) const;
+
+  // Maps every element of `elements` into this set's hash range. Since no
+  // state of the set is touched, disjoint chunks of client elements can be
+  // hashed concurrently from several threads.
+  std::vector<int64_t> HashElements(
+      absl::Span<const std::string> elements) const;
+
+  // Maps each input into [0, hash_range) as prescribed by `hash_version`:
+  // SM3(input) modulo `hash_range` for `HASH_VERSION_LEGACY`, hashing many
+  // inputs in parallel with the multi-buffer SM3 engine, or FilterHash64(input)
+  // reduced by multiply-shift for `HASH_VERSION_FAST64`. This is what
+  // `HashElements` does for a set with that range and version, without a set.
+  static std::vector<int64_t> Hash(absl::Span<const std::string> inputs,
+                                   int64_t hash_range,
+                                   psi_proto::HashVersion hash_version);
+
+  // Returns the indices of all (hash, index) pairs in `hashes` whose hash is in
+  // the set. `hashes` need not be sorted.
+  //
+  // With a skip index, only the blocks between index entries that the hashes
+  // can fall into are decoded, on up to `num_threads` threads. Without one,
+  // the whole set is decoded on the calling thread.
+  std::vector<int64_t> IntersectHashes(
+      std::vector<std::pair<int64_t, int64_t>> hashes,
+      int num_threads = 1) const;
+
+  // As `IntersectHashes`, but only returns the number of pairs whose hash is
+  // in the set. The matches of one block are held at a time.
+  int64_t CountHashes(std::vector<std::pair<int64_t, int64_t>> hashes,
+                      int num_threads = 1) const;
+
+  // As `IntersectHashes`, but returns a bitmap of the indices of the pairs
+  // whose hash is in the set, which must all be less than `num_indices`: index
+  // `i` is bit `i % 64` of word `i / 64`.
+  std::vector<uint64_t> IntersectHashesBitmap(
+      std::vector<std::pair<int64_t, int64_t>> hashes, int64_t num_indices,
+      int num_threads = 1) const;
+
+  // Decodes the whole set and returns its hashes in ascending order.
+  std::vector<int64_t> DecodeHashes() const;
+
+  // Returns a protobuf representation of the set. The consuming overload moves
+  // the bits of a set that owns them into the protobuf instead of copying
+  // them, and leaves the set empty.
+  psi_proto::ServerSetup ToProtobuf() const&;
+  psi_proto::ServerSetup ToProtobuf() &&;
 
   int64_t Div() const;
 
@@ -49,20 +126,43 @@ class GCS {
 
   std::string Golomb() const;
 
+  psi_proto::HashVersion Version() const;
+
+  // Returns the number of entries of the skip index.
+  int64_t IndexSize() const;
+
  private:
   GCS(std::string golomb, int64_t div, int64_t hash_range,
-      std::unique_ptr<::private_join_and_compute::Context> context);
+      psi_proto::HashVersion hash_version,
+      std::vector<GolombIndexEntry> index);
+
+  // Sorts `hashes` and decodes the blocks they can fall into on up to
+  // `num_threads` threads. The matches of every thread are appended to its
+  // vector of `matches`, and `flush(thread, &thread_matches)` is called after
+  // every block, which may consume and clear them.
+  template <typename Flush>
+  void MatchHashes(std::vector<std::pair<int64_t, int64_t>> hashes,
+                   int num_threads, std::vector<std::vector<int64_t>>* matches,
+                   Flush flush) const;
 
-  static int64_t Hash(const std::string& input, int64_t hash_range,
-                      ::private_join_and_compute::Context& context);
+  // Returns a protobuf representation of the set with `golomb` as its bits.
+  psi_proto::ServerSetup ToProtobuf(std::string golomb) const;
 
-  std::string golomb_;
+  // The bits of a set that owns them; empty for a view.
+  std::string owned_golomb_;
+
+  // The Golomb-coded bits, in `owned_golomb_` or in the caller's buffer.
+  absl::string_view golomb_;
 
   int64_t div_;
 
   int64_t hash_range_;
 
-  std::unique_ptr<::private_join_and_compute::Context> context_;
+  psi_proto::HashVersion hash_version_;
+
+  // The skip index. Entry `b` ends block `b` and starts block `b + 1`, so
+  // block `b` holds the values up to `index_[b].prefix_sum`.
+  std::vector<GolombIndexEntry> index_;
 };
 
 }  // namespace private_set_intersection
@@ -16,6 +16,7 @@
 
 #include "private_set_intersection/cpp/datastructure/gcs.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "absl/container/flat_hash_set.h"
@@ -52,7 +53,10 @@ TEST(GCSTest, TestIntersect) {
   }
 }
 
-TEST(GCSTest, TestFPR) {
+class GCSVersionTest : public ::testing::TestWithParam<psi_proto::HashVersion> {
+};
+
+TEST_P(GCSVersionTest, TestFPR) {
   for (int max_elements = 1 << 10; max_elements < (1 << 20);
        max_elements *= 2) {
     double target_fpr = 0.1;
@@ -66,7 +70,8 @@ TEST(GCSTest, TestFPR) {
     std::unique_ptr<GCS> gcs;
     PSI_ASSERT_OK_AND_ASSIGN(
         gcs, GCS::Create(target_fpr, (int64_t)elements.size(),
-                         absl::MakeConstSpan(&elements[0], elements.size())));
+                         absl::MakeConstSpan(&elements[0], elements.size()),
+                         GetParam()));
 
     // Test 10k elements to measure FPR.
     int num_tests = 10000;
@@ -88,6 +93,10 @@ TEST(GCSTest, TestFPR) {
   }
 }
 
+INSTANTIATE_TEST_SUITE_P(HashVersions, GCSVersionTest,
+                         ::testing::Values(psi_proto::HASH_VERSION_LEGACY,
+                                           psi_proto::HASH_VERSION_FAST64));
+
 TEST(GCSTest, TestToProtobuf) {
   double fpr = 0.01;
   int max_elements = 100;
@@ -108,6 +117,47 @@ TEST(GCSTest, TestToProtobuf) {
   EXPECT_EQ(encoded_gcs.gcs().div(), gcs->Div());
   EXPECT_EQ(encoded_gcs.gcs().hash_range(), gcs->HashRange());
   EXPECT_EQ(encoded_gcs.gcs().bits(), gcs->Golomb());
+  EXPECT_EQ(encoded_gcs.gcs().hash_version(), gcs->Version());
+  EXPECT_EQ(gcs->Version(), psi_proto::HASH_VERSION_FAST64);
+}
+
+TEST(GCSTest, TestMoveToProtobuf) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(gcs, GCS::Create(0.001, 1000, elements));
+  const psi_proto::ServerSetup expected = gcs->ToProtobuf();
+
+  // A view copies the bits it does not own.
+  PSI_ASSERT_OK_AND_ASSIGN(auto view, GCS::CreateViewFromProtobuf(expected));
+  EXPECT_EQ(std::move(*view).ToProtobuf().SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_EQ(expected.gcs().bits(), gcs->Golomb());
+
+  EXPECT_EQ(std::move(*gcs).ToProtobuf().SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_TRUE(gcs->Golomb().empty());
+}
+
+TEST(GCSTest, TestCreateMultiThreaded) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 100000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+
+  for (auto hash_version :
+       {psi_proto::HASH_VERSION_LEGACY, psi_proto::HASH_VERSION_FAST64}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto gcs, GCS::Create(0.001, 1000, elements, hash_version));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto parallel_gcs,
+        GCS::Create(0.001, 1000, elements, hash_version,
+                    GCS::kDefaultIndexInterval, /*num_threads=*/4));
+    EXPECT_EQ(parallel_gcs->ToProtobuf().SerializeAsString(),
+              gcs->ToProtobuf().SerializeAsString());
+  }
 }
 
 TEST(GCSTest, TestCreateFromProtobuf) {
@@ -137,6 +187,203 @@ TEST(GCSTest, TestCreateFromProtobuf) {
   }
 }
 
+TEST(GCSTest, TestCreateViewFromProtobuf) {
+  std::vector<std::string> elements;
+  std::vector<std::string> elements2;
+  for (int i = 0; i < 10000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+    elements2.push_back(absl::StrCat("Element ", 2 * i));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto gcs, GCS::Create(0.001, 10000, elements));
+  psi_proto::ServerSetup encoded_gcs = gcs->ToProtobuf();
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto copy, GCS::CreateFromProtobuf(encoded_gcs));
+  PSI_ASSERT_OK_AND_ASSIGN(auto view,
+                           GCS::CreateViewFromProtobuf(encoded_gcs));
+  EXPECT_EQ(view->Intersect(elements2), copy->Intersect(elements2));
+  EXPECT_EQ(view->ToProtobuf().SerializeAsString(),
+            encoded_gcs.SerializeAsString());
+
+  // The copy no longer depends on the protobuf.
+  const std::vector<int64_t> expected = copy->Intersect(elements2);
+  encoded_gcs.Clear();
+  EXPECT_EQ(copy->Intersect(elements2), expected);
+}
+
+TEST(GCSTest, TestCreateFromProtobufLegacy) {
+  // Setups written before hash versions existed have no `hash_version` and
+  // must still be read with the legacy hash function.
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(
+      gcs, GCS::Create(0.001, 4, elements, psi_proto::HASH_VERSION_LEGACY));
+  psi_proto::ServerSetup encoded_gcs = gcs->ToProtobuf();
+  encoded_gcs.mutable_gcs()->clear_hash_version();
+
+  std::unique_ptr<GCS> gcs2;
+  PSI_ASSERT_OK_AND_ASSIGN(gcs2, GCS::CreateFromProtobuf(encoded_gcs));
+  EXPECT_EQ(gcs2->Version(), psi_proto::HASH_VERSION_LEGACY);
+  EXPECT_EQ(gcs2->Intersect(elements).size(), elements.size());
+}
+
+TEST(GCSTest, TestUnknownHashVersion) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  EXPECT_EQ(GCS::Create(0.001, 4, elements,
+                        static_cast<psi_proto::HashVersion>(42))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(gcs, GCS::Create(0.001, 4, elements));
+  psi_proto::ServerSetup encoded_gcs = gcs->ToProtobuf();
+  encoded_gcs.mutable_gcs()->set_hash_version(
+      static_cast<psi_proto::HashVersion>(42));
+  EXPECT_EQ(GCS::CreateFromProtobuf(encoded_gcs).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(GCSTest, TestSkipIndex) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 5000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  std::vector<std::string> elements2;
+  for (int i = 0; i < 3000; i++) {
+    elements2.push_back(absl::StrCat(i % 3 == 0 ? "Test " : "Element ", i));
+  }
+
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(gcs, GCS::Create(0.001, 3000, elements,
+                                            psi_proto::HASH_VERSION_FAST64, 0));
+  EXPECT_EQ(gcs->IndexSize(), 0);
+  std::unique_ptr<GCS> indexed;
+  PSI_ASSERT_OK_AND_ASSIGN(indexed,
+                           GCS::Create(0.001, 3000, elements,
+                                       psi_proto::HASH_VERSION_FAST64, 16));
+  EXPECT_EQ(indexed->IndexSize(), (5000 - 1) / 16);
+  EXPECT_EQ(indexed->Golomb(), gcs->Golomb());
+
+  std::vector<std::pair<int64_t, int64_t>> hashes;
+  const std::vector<int64_t> element_hashes = gcs->HashElements(elements2);
+  for (size_t i = 0; i < elements2.size(); i++) {
+    hashes.emplace_back(element_hashes[i], i);
+  }
+  std::vector<int64_t> expected = gcs->IntersectHashes(hashes);
+  std::sort(expected.begin(), expected.end());
+  EXPECT_GE(expected.size(), 2000);
+  for (int num_threads : {1, 4}) {
+    std::vector<int64_t> res = indexed->IntersectHashes(hashes, num_threads);
+    std::sort(res.begin(), res.end());
+    EXPECT_EQ(res, expected) << num_threads;
+  }
+
+  // A few hashes only touch a few blocks.
+  hashes.resize(3);
+  std::vector<int64_t> res = indexed->IntersectHashes(hashes, 4);
+  std::sort(res.begin(), res.end());
+  expected.erase(std::lower_bound(expected.begin(), expected.end(), 3),
+                 expected.end());
+  EXPECT_EQ(res, expected);
+}
+
+TEST(GCSTest, TestCountAndBitmapMatchIntersect) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 5000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  std::vector<std::string> elements2;
+  for (int i = 0; i < 3000; i++) {
+    elements2.push_back(absl::StrCat(i % 3 == 0 ? "Test " : "Element ", i));
+  }
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(
+      gcs,
+      GCS::Create(0.001, 3000, elements, psi_proto::HASH_VERSION_FAST64, 16));
+
+  const std::vector<int64_t> expected = gcs->Intersect(elements2);
+  std::vector<uint64_t> bitmap((elements2.size() + 63) / 64);
+  for (int64_t i : expected) {
+    bitmap[i / 64] |= uint64_t{1} << (i % 64);
+  }
+  EXPECT_EQ(gcs->CountIntersection(elements2), expected.size());
+  EXPECT_EQ(gcs->IntersectBitmap(elements2), bitmap);
+
+  std::vector<std::pair<int64_t, int64_t>> hashes;
+  const std::vector<int64_t> element_hashes = gcs->HashElements(elements2);
+  for (size_t i = 0; i < elements2.size(); i++) {
+    hashes.emplace_back(element_hashes[i], i);
+  }
+  for (int num_threads : {1, 4}) {
+    EXPECT_EQ(gcs->CountHashes(hashes, num_threads), expected.size());
+    EXPECT_EQ(gcs->IntersectHashesBitmap(
+                  hashes, static_cast<int64_t>(elements2.size()), num_threads),
+              bitmap)
+        << num_threads;
+  }
+}
+
+TEST(GCSTest, TestDecodeHashes) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 5000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(gcs, GCS::Create(0.001, 5000, elements));
+
+  std::vector<int64_t> expected = gcs->HashElements(elements);
+  std::sort(expected.begin(), expected.end());
+  expected.erase(std::unique(expected.begin(), expected.end()),
+                 expected.end());
+  EXPECT_EQ(gcs->DecodeHashes(), expected);
+}
+
+TEST(GCSTest, TestCreateFromProtobufWithIndex) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  std::unique_ptr<GCS> gcs;
+  PSI_ASSERT_OK_AND_ASSIGN(
+      gcs, GCS::Create(0.001, 1000, elements, psi_proto::HASH_VERSION_FAST64,
+                       64));
+  psi_proto::ServerSetup encoded_gcs = gcs->ToProtobuf();
+  EXPECT_EQ(encoded_gcs.gcs().index_bit_offsets_size(), gcs->IndexSize());
+  EXPECT_EQ(encoded_gcs.gcs().index_prefix_sums_size(), gcs->IndexSize());
+
+  std::unique_ptr<GCS> gcs2;
+  PSI_ASSERT_OK_AND_ASSIGN(gcs2, GCS::CreateFromProtobuf(encoded_gcs));
+  EXPECT_EQ(gcs2->IndexSize(), gcs->IndexSize());
+  EXPECT_EQ(gcs2->Intersect(elements).size(), elements.size());
+
+  psi_proto::ServerSetup corrupt = encoded_gcs;
+  corrupt.mutable_gcs()->mutable_index_prefix_sums()->RemoveLast();
+  EXPECT_EQ(GCS::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  corrupt = encoded_gcs;
+  corrupt.mutable_gcs()->set_index_bit_offsets(1, 1);
+  EXPECT_EQ(GCS::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  corrupt = encoded_gcs;
+  corrupt.mutable_gcs()->set_index_prefix_sums(1, 0);
+  EXPECT_EQ(GCS::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  corrupt = encoded_gcs;
+  corrupt.mutable_gcs()->set_index_bit_offsets(
+      gcs->IndexSize() - 1, encoded_gcs.gcs().bits().size() * 8);
+  EXPECT_EQ(GCS::CreateFromProtobuf(corrupt).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  EXPECT_EQ(GCS::Create(0.001, 1000, elements, psi_proto::HASH_VERSION_FAST64,
+                        -1)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 TEST(GCSTest, TestGolombSize) {
   double fpr[] = {1e-6, 1e-7, 1e-8, 1e-9, 1e-10, 1e-11, 1e-12};
   int max_elements = 10000;
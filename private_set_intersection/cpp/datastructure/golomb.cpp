@@ -17,15 +17,202 @@
 #include "private_set_intersection/cpp/datastructure/golomb.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <utility>
 #include <vector>
 
+#include "absl/base/internal/endian.h"
+
 namespace private_set_intersection {
 
+namespace {
+
+// Writes bits into a pre-sized string through a 64-bit accumulator, which is
+// stored as a little-endian word whenever it fills up. The string is
+// zero-initialized, so runs of zeros only need to advance the position.
+class BitWriter {
+ public:
+  // `max_bits` must bound the number of bits that will be written.
+  explicit BitWriter(uint64_t max_bits)
+      : out_(DIV_CEIL(max_bits, 64) * 8, '\0') {}
+
+  // Appends `num_bits` zero bits.
+  void WriteZeros(uint64_t num_bits) {
+    if (used_ + num_bits < 64) {
+      used_ += static_cast<int>(num_bits);
+      return;
+    }
+    num_bits -= 64 - used_;
+    Flush();
+    words_ += num_bits / 64;
+    used_ = static_cast<int>(num_bits % 64);
+  }
+
+  // Appends the `num_bits` low bits of `value`, least significant first.
+  // `num_bits` must be in [1, 64] and `value` less than 2^num_bits.
+  void Write(uint64_t value, int num_bits) {
+    word_ |= value << used_;
+    used_ += num_bits;
+    if (used_ >= 64) {
+      Flush();
+      used_ -= 64;
+      word_ = used_ == 0 ? 0 : value >> (num_bits - used_);
+    }
+  }
+
+  // Returns the number of bits written so far.
+  uint64_t position() const { return words_ * 64 + used_; }
+
+  // Returns the bytes written, with the last byte padded with zero bits.
+  std::string Finish() && {
+    const uint64_t num_bits = words_ * 64 + used_;
+    if (used_ > 0) {
+      Flush();
+    }
+    out_.resize(DIV_CEIL(num_bits, CHAR_SIZE));
+    return std::move(out_);
+  }
+
+ private:
+  void Flush() {
+    absl::little_endian::Store64(&out_[words_ * 8], word_);
+    words_++;
+    word_ = 0;
+  }
+
+  std::string out_;
+  uint64_t words_ = 0;
+  uint64_t word_ = 0;
+  int used_ = 0;
+};
+
+// Reads bits from a string with unaligned 64-bit little-endian loads. Bits
+// past the end of the string read as zeros.
+class BitReader {
+ public:
+  explicit BitReader(absl::string_view data)
+      : data_(data.data()), size_(data.size()) {}
+
+  uint64_t size_bits() const { return size_ * CHAR_SIZE; }
+
+  // Returns the bits starting at bit `pos` in the low bits of the result. The
+  // `64 - pos % 8` low bits are valid, all others are zero.
+  uint64_t Peek(uint64_t pos) const {
+    const uint64_t byte = pos / CHAR_SIZE;
+    uint64_t word = 0;
+    if (byte + 8 <= size_) {
+      word = absl::little_endian::Load64(data_ + byte);
+    } else if (byte < size_) {
+      std::memcpy(&word, data_ + byte, size_ - byte);
+      word = absl::little_endian::ToHost64(word);
+    }
+    return word >> (pos % CHAR_SIZE);
+  }
+
+  // Returns the `num_bits` bits starting at bit `pos`, with `num_bits` in
+  // [1, 63].
+  uint64_t Read(uint64_t pos, int num_bits) const {
+    uint64_t bits = Peek(pos);
+    if (num_bits > 56) {
+      bits = (bits & ((uint64_t{1} << 56) - 1)) | (Peek(pos + 56) << 56);
+    }
+    return bits & ((uint64_t{1} << num_bits) - 1);
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+};
+
+/**
+ * @brief Decodes the Golomb-Rice codes in a range of `reader` with the
+ * divisor fixed at compile time, and intersects the decoded values with
+ * `sorted_arr`.
+ *
+ * A single load usually yields both the unary quotient, found with a
+ * count-trailing-zeros, and the remainder.
+ *
+ * @param reader The compressed bits
+ * @param begin_bit The offset of the first code to decode
+ * @param end_bit The offset past the last code to decode
+ * @param initial_sum The value before the first code
+ * @param sorted_arr The pairs (value, index) to intersect with, sorted by value
+ * @param res Receives the indices of the pairs whose value was decoded
+ */
+template <int kDiv>
+void IntersectWithDiv(const BitReader& reader, uint64_t begin_bit,
+                      uint64_t end_bit, int64_t initial_sum,
+                      absl::Span<const std::pair<int64_t, int64_t>> sorted_arr,
+                      std::vector<int64_t>* res) {
+  constexpr uint64_t kMask = (uint64_t{1} << kDiv) - 1;
+  auto arr_it = sorted_arr.begin();
+  const uint64_t end = std::min(end_bit, reader.size_bits());
+  uint64_t pos = begin_bit;
+  uint64_t quotient = 0;
+  auto prefix_sum = static_cast<uint64_t>(initial_sum);
+
+  while (pos < end && arr_it != sorted_arr.end()) {
+    const uint64_t word = reader.Peek(pos);
+    const int valid = 64 - static_cast<int>(pos % CHAR_SIZE);
+    if (word == 0) {
+      // All valid bits belong to the unary quotient.
+      quotient += valid;
+      pos += valid;
+      continue;
+    }
+
+    // The first 1 bit ends the unary quotient.
+    const int zeros = CTZ64(word);
+    quotient += zeros;
+    pos += zeros + 1;
+    uint64_t remainder = 0;
+    if constexpr (kDiv > 0) {
+      if (zeros + 1 + kDiv <= valid) {
+        remainder = (word >> zeros >> 1) & kMask;
+      } else {
+        remainder = reader.Read(pos, kDiv);
+      }
+      pos += kDiv;
+    }
+
+    // reconstruct the value from the delta
+    prefix_sum += (quotient << kDiv) | remainder;
+    quotient = 0;
+    const auto value = static_cast<int64_t>(prefix_sum);
+
+    // now, check if the other (sorted) set contains the current value
+    while (arr_it != sorted_arr.end() && arr_it->first < value) {
+      ++arr_it;
+    }
+    while (arr_it != sorted_arr.end() && arr_it->first == value) {
+      // the other set should contain a mapping to the indexes before sorting
+      res->push_back(arr_it->second);
+      ++arr_it;
+    }
+  }
+}
+
+using IntersectFunction = void (*)(
+    const BitReader&, uint64_t, uint64_t, int64_t,
+    absl::Span<const std::pair<int64_t, int64_t>>, std::vector<int64_t>*);
+
+template <size_t... kDivs>
+constexpr std::array<IntersectFunction, sizeof...(kDivs)> MakeIntersectTable(
+    std::index_sequence<kDivs...>) {
+  return {&IntersectWithDiv<static_cast<int>(kDivs)>...};
+}
+
+// One decoder per supported divisor.
+constexpr std::array<IntersectFunction, MAX_GOLOMB_DIV + 1> kIntersectTable =
+    MakeIntersectTable(std::make_index_sequence<MAX_GOLOMB_DIV + 1>());
+
+}  // namespace
+
 GolombCompressed golomb_compress(const std::vector<int64_t>& sorted_arr,
-                                 int div_param) {
+                                 int div_param, int64_t index_interval) {
   if (sorted_arr.empty()) {
     struct GolombCompressed res;
     res.div = 0;
@@ -43,141 +230,96 @@ GolombCompressed golomb_compress(const std::vector<int64_t>& sorted_arr,
                     ? static_cast<int64_t>(div_param)
                     : static_cast<int64_t>(std::max(
                           0.0, std::round(-std::log2(-std::log2(1.0 - prob)))));
-
-  std::string compressed;
-  int64_t res_idx = 0;
-  auto it = sorted_arr.begin();
+  div = std::min(div, MAX_GOLOMB_DIV);
+  const uint64_t mask = (static_cast<uint64_t>(1) << div) - 1;
+
+  // The quotients of the deltas add up to at most the last element divided by
+  // 2^div, and each delta takes another div + 1 bits.
+  BitWriter writer((static_cast<uint64_t>(sorted_arr.back()) >> div) +
+                   sorted_arr.size() * static_cast<uint64_t>(div + 1));
+  std::vector<GolombIndexEntry> index;
+  int64_t count = 0;
   int64_t prev = 0;
   bool start = true;
-
-  while (it != sorted_arr.end()) {
-    auto curr = *it;
-
+  for (int64_t curr : sorted_arr) {
     // skip duplicates
-    if (start | (curr > prev)) {
-      auto delta = curr - prev;
-      // decompose difference into quotient and remainder
-      // divide by 2^div
-      auto quotient = delta >> div;
-      auto remainder = delta & ((static_cast<int64_t>(1) << div) - 1);
-      auto len = quotient + 1 + div;
-
-      compressed.resize(DIV_CEIL(res_idx + len, CHAR_SIZE), 0);
-
-      // unary representation is a sequence of 0s, followed by 1
-      auto unary_end = res_idx + quotient;
-      compressed[unary_end / CHAR_SIZE] |=
-          static_cast<char>(static_cast<int64_t>(1) << (unary_end % CHAR_SIZE));
-
-      auto binary_start = (unary_end + 1) % CHAR_SIZE;
-      int64_t binary_idx = 0;
-      int64_t i = (unary_end + 1) / CHAR_SIZE;
-
-      // copy each byte of the remainder to the resulting string
-      // this is represented in binary
-      while (binary_idx < div) {
-        compressed[i] |= static_cast<char>(
-            (static_cast<uint64_t>(remainder) >> binary_idx) << binary_start);
-        binary_idx += CHAR_SIZE - binary_start;
-        binary_start = 0;
-        ++i;
-      }
-
-      res_idx += len;
-      prev = curr;
-      start = false;
+    if (!start && curr <= prev) {
+      continue;
     }
-
-    ++it;
+    if (index_interval > 0 && count > 0 && count % index_interval == 0) {
+      index.push_back({writer.position(), prev});
+    }
+    count++;
+    // decompose difference into quotient and remainder
+    // divide by 2^div
+    const auto delta = static_cast<uint64_t>(curr - prev);
+    // unary representation is a sequence of 0s, followed by 1, then the
+    // remainder in binary
+    writer.WriteZeros(delta >> div);
+    writer.Write(1 | ((delta & mask) << 1), static_cast<int>(div) + 1);
+    prev = curr;
+    start = false;
   }
 
   struct GolombCompressed res;
   res.div = div;
-  res.compressed = compressed;
+  res.compressed = std::move(writer).Finish();
+  res.index = std::move(index);
   return res;
 }
 
 std::vector<int64_t> golomb_intersect(
-    const std::string& golomb_compressed, int64_t div,
+    absl::string_view golomb_compressed, int64_t div,
     const std::vector<std::pair<int64_t, int64_t>>& sorted_arr) {
-  if (golomb_compressed.empty()) {
-    return std::vector<int64_t>();
-  }
-
-  auto it = golomb_compressed.begin();
-  auto arr_it = sorted_arr.begin();
-
-  int64_t prefix_sum = 0;
-  int64_t offset = 0;
-
   std::vector<int64_t> res;
+  golomb_intersect_range(golomb_compressed, div, 0,
+                         golomb_compressed.size() * CHAR_SIZE, 0, sorted_arr,
+                         &res);
+  return res;
+}
 
-  while (true) {
-    int64_t quotient = 0;
-
-    // skip empty bytes in the string, which contain the unary quotient
-    while (it != golomb_compressed.end() &&
-           (static_cast<unsigned char>(*it) >> offset) == 0) {
-      quotient += CHAR_SIZE - offset;
-      offset = 0;
-      ++it;
-    }
-
-    if (it == golomb_compressed.end()) {
-      break;
-    }
-
-    // get the position of the first 1 bit, which is the end of the unary
-    // portion
-    auto ctz = static_cast<int64_t>(CTZ(
-        static_cast<unsigned int>(static_cast<unsigned char>(*it) >> offset)));
-    quotient += ctz;
-    auto one_idx = ctz + offset;
-    // skip the 1 bit that signals the end of the unary quotient
-    auto binary_start = (one_idx + 1) % CHAR_SIZE;
-    it += static_cast<size_t>(binary_start == 0);
-    int64_t binary_idx = 0;
-    int64_t remainder = 0;
-
-    // copy the bytes from the string to the remainder (represented with binary)
-    while (binary_idx < div) {
-      auto num_bits = std::min(CHAR_SIZE - binary_start, div - binary_idx);
-      remainder |= (static_cast<int64_t>(static_cast<unsigned char>(*it) >>
-                                         binary_start) &
-                    ((static_cast<int64_t>(1) << num_bits) - 1))
-                   << binary_idx;
-      binary_idx += num_bits;
-      binary_start = 0;
-      ++it;
-    }
-
-    // if the while loop is executed, then we may have erroneously skipped a
-    // byte
-    offset = (one_idx + 1 + div) % CHAR_SIZE;
-    it -= static_cast<size_t>((div > 0) & (offset != 0));
-
-    // reconstruct the delta
-    auto delta = (quotient << div) | remainder;
-    prefix_sum += delta;
-
-    // now, check if the current the other (sorted) set contains the current
-    // prefix_sum
-
-    while (arr_it != sorted_arr.end() && (*arr_it).first < prefix_sum) {
-      ++arr_it;
-    }
-
-    while (arr_it != sorted_arr.end() && (*arr_it).first == prefix_sum) {
-      // the other set should contain a mapping to the indexes before sorting
-      res.push_back((*arr_it).second);
-      ++arr_it;
-    }
+void golomb_intersect_range(
+    absl::string_view golomb_compressed, int64_t div, uint64_t begin_bit,
+    uint64_t end_bit, int64_t prefix_sum,
+    absl::Span<const std::pair<int64_t, int64_t>> sorted_arr,
+    std::vector<int64_t>* res) {
+  if (golomb_compressed.empty() || div < 0 || div > MAX_GOLOMB_DIV) {
+    return;
+  }
+  kIntersectTable[div](BitReader(golomb_compressed), begin_bit, end_bit,
+                       prefix_sum, sorted_arr, res);
+}
 
-    if (arr_it == sorted_arr.end()) {
-      break;
+std::vector<int64_t> golomb_decompress(absl::string_view golomb_compressed,
+                                       int64_t div) {
+  std::vector<int64_t> res;
+  if (div < 0 || div > MAX_GOLOMB_DIV) {
+    return res;
+  }
+  const BitReader reader(golomb_compressed);
+  const uint64_t end = reader.size_bits();
+  uint64_t pos = 0;
+  uint64_t quotient = 0;
+  uint64_t prefix_sum = 0;
+  while (pos < end) {
+    const uint64_t word = reader.Peek(pos);
+    if (word == 0) {
+      // All valid bits belong to the unary quotient, or are padding.
+      const int valid = 64 - static_cast<int>(pos % CHAR_SIZE);
+      quotient += valid;
+      pos += valid;
+      continue;
     }
+    const int zeros = CTZ64(word);
+    quotient += zeros;
+    pos += zeros + 1;
+    const uint64_t remainder =
+        div == 0 ? 0 : reader.Read(pos, static_cast<int>(div));
+    pos += div;
+    prefix_sum += (quotient << div) | remainder;
+    quotient = 0;
+    res.push_back(static_cast<int64_t>(prefix_sum));
   }
-
   return res;
 }
 
@@ -17,41 +17,84 @@
 #ifndef PRIVATE_SET_INTERSECTION_CPP_GOLOMB_H_
 #define PRIVATE_SET_INTERSECTION_CPP_GOLOMB_H_
 
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
 namespace private_set_intersection {
 
 const int64_t CHAR_SIZE = sizeof(char) * 8;
 
 #if defined(_MSC_VER)  // MSVC
 #include <intrin.h>
-#pragma intrinsic(_BitScanForward)
-__forceinline static int bsf(unsigned int x) {
+#pragma intrinsic(_BitScanForward64)
+__forceinline static int bsf64(unsigned __int64 x) {
   unsigned long i;
-  _BitScanForward(&i, (unsigned long)x);
+  _BitScanForward64(&i, x);
   return i;
 }
-#define CTZ(x) bsf(x)
+#define CTZ64(x) bsf64(x)
 #else  // GCC, Clang, etc.
-#define CTZ(x) __builtin_ctz(x)
+#define CTZ64(x) __builtin_ctzll(x)
 #endif
 
 #define DIV_CEIL(a, b) (((a) + (b) - 1) / (b))
 
+// Where the code of a value starts in a Golomb-coded stream: its offset in
+// bits and the value before it, from which decoding can resume.
+struct GolombIndexEntry {
+  uint64_t bit_offset;
+  int64_t prefix_sum;
+};
+
 struct GolombCompressed {
   int64_t div;
   std::string compressed;
+  // The entries of every `index_interval`-th value, starting with the
+  // `index_interval`-th one.
+  std::vector<GolombIndexEntry> index;
 };
 
+// The largest supported `div`, such that a remainder fits into a 64-bit word.
+const int64_t MAX_GOLOMB_DIV = 63;
+
+// Golomb-Rice codes the differences of the distinct values of `sorted_arr`,
+// which must be non-negative and sorted, with parameter 2^div. A difference
+// is written as its quotient in unary (zeros ended by a one) followed by the
+// `div` bits of its remainder, least significant bit first. Bits are packed
+// into bytes least significant bit first. If `div_param` is negative, `div`
+// is derived from the average difference. If `index_interval` is positive,
+// an index entry is recorded for every `index_interval`-th distinct value.
 GolombCompressed golomb_compress(const std::vector<int64_t>& sorted_arr,
-                                 int div_param = -1);
+                                 int div_param = -1,
+                                 int64_t index_interval = 0);
 
+// Decodes `golomb_compressed` and returns the second member of all pairs of
+// `sorted_arr`, sorted by their first member, whose first member is one of
+// the decoded values. Returns nothing if `div` is not in [0, MAX_GOLOMB_DIV].
 std::vector<int64_t> golomb_intersect(
-    const std::string& golomb_compressed, int64_t div,
+    absl::string_view golomb_compressed, int64_t div,
     const std::vector<std::pair<int64_t, int64_t>>& sorted_arr);
 
+// Like `golomb_intersect`, but only decodes the codes in the bits
+// [begin_bit, end_bit) of `golomb_compressed`, starting from `prefix_sum`, and
+// appends the matching indices to `res`. With the bounds taken from index
+// entries, this decodes the values between two entries.
+void golomb_intersect_range(
+    absl::string_view golomb_compressed, int64_t div, uint64_t begin_bit,
+    uint64_t end_bit, int64_t prefix_sum,
+    absl::Span<const std::pair<int64_t, int64_t>> sorted_arr,
+    std::vector<int64_t>* res);
+
+// Decodes all values of `golomb_compressed`, in ascending order. Returns
+// nothing if `div` is not in [0, MAX_GOLOMB_DIV].
+std::vector<int64_t> golomb_decompress(absl::string_view golomb_compressed,
+                                       int64_t div);
+
 }  // namespace private_set_intersection
 
 #endif  // PRIVATE_SET_INTERSECTION_CPP_GOLOMB_H_
@@ -16,6 +16,9 @@
 
 #include "private_set_intersection/cpp/datastructure/golomb.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <random>
 #include <utility>
 #include <vector>
 
@@ -56,5 +59,76 @@ TEST(GolombTest, TestEncodeDecodeLong) {
   EXPECT_EQ(intersect, decoded);
 }
 
+TEST(GolombTest, TestEncodeBitLayout) {
+  // Deltas 3, 1 and 16 with div 2: 1|11, 1|10 and 00001|00, packed least
+  // significant bit first.
+  std::vector<int64_t> elements = {3, 4, 4, 20};
+  auto encoded = golomb_compress(elements, 2);
+  std::string golomb_str = {static_cast<char>(0b00011111),
+                            static_cast<char>(0b00000100)};
+  EXPECT_EQ(encoded.compressed, golomb_str);
+  EXPECT_EQ(encoded.div, 2);
+}
+
+TEST(GolombTest, TestEncodeDecodeAllDivs) {
+  std::mt19937_64 rng(1);
+  for (int div = 0; div <= MAX_GOLOMB_DIV; div++) {
+    // Keep the average quotient small, but include a long unary run.
+    const int64_t range = int64_t{1} << std::min(div + 6, 62);
+    std::vector<int64_t> elements;
+    for (int i = 0; i < 500; i++) {
+      elements.push_back(static_cast<int64_t>(rng() % range));
+    }
+    if (div < 50) {
+      elements.push_back(range + (int64_t{300} << div));
+    }
+    std::sort(elements.begin(), elements.end());
+    auto encoded = golomb_compress(elements, div);
+    ASSERT_EQ(encoded.div, div);
+
+    std::vector<std::pair<int64_t, int64_t>> elements2;
+    for (size_t i = 0; i < elements.size(); i++) {
+      elements2.emplace_back(elements[i], i);
+      elements2.emplace_back(elements[i] + 1, -1);
+    }
+    std::sort(elements2.begin(), elements2.end());
+    std::vector<int64_t> expected;
+    for (const auto& [value, index] : elements2) {
+      if (std::binary_search(elements.begin(), elements.end(), value)) {
+        expected.push_back(index);
+      }
+    }
+    EXPECT_EQ(golomb_intersect(encoded.compressed, encoded.div, elements2),
+              expected)
+        << "div: " << div;
+  }
+}
+
+TEST(GolombTest, TestDecompress) {
+  std::mt19937_64 rng(2);
+  for (int div = 0; div <= MAX_GOLOMB_DIV; div++) {
+    const int64_t range = int64_t{1} << std::min(div + 6, 62);
+    std::vector<int64_t> elements = {0};
+    for (int i = 0; i < 500; i++) {
+      elements.push_back(static_cast<int64_t>(rng() % range));
+    }
+    std::sort(elements.begin(), elements.end());
+    elements.erase(std::unique(elements.begin(), elements.end()),
+                   elements.end());
+    auto encoded = golomb_compress(elements, div);
+    EXPECT_EQ(golomb_decompress(encoded.compressed, encoded.div), elements)
+        << "div: " << div;
+  }
+  EXPECT_TRUE(golomb_decompress("", 0).empty());
+  EXPECT_TRUE(golomb_decompress("\x01", MAX_GOLOMB_DIV + 1).empty());
+}
+
+TEST(GolombTest, TestIntersectInvalidDiv) {
+  std::vector<std::pair<int64_t, int64_t>> elements = {std::make_pair(0, 0)};
+  EXPECT_TRUE(golomb_intersect("\x01", -1, elements).empty());
+  EXPECT_TRUE(golomb_intersect("\x01", MAX_GOLOMB_DIV + 1, elements).empty());
+  EXPECT_EQ(golomb_intersect("\x01", 0, elements), std::vector<int64_t>{0});
+}
+
 }  // namespace
 }  // namespace private_set_intersection
@@ -0,0 +1,622 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/base/internal/endian.h"
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/datastructure/rans_set_internal.h"
+#include "private_set_intersection/cpp/util/cpu_features.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+using rans_set_internal::DecodeKernel;
+using rans_set_internal::kFrequencyMask;
+using rans_set_internal::kOffsetMask;
+using rans_set_internal::kOffsetShift;
+using rans_set_internal::kScale;
+using rans_set_internal::kScaleBits;
+using rans_set_internal::kStateLow;
+using rans_set_internal::kSymbolShift;
+using rans_set_internal::kWordBits;
+
+static_assert(RansSet::kNumLanes == rans_set_internal::kNumLanes,
+              "The kernels decode one group of lanes at a time");
+
+constexpr int kEscape = RansSet::kNumSymbols - 1;
+constexpr int kEscapeWidthBits = 6;
+
+constexpr int kMaxRemainderBits = 62;
+
+// The largest frequency of a symbol. Decoding a symbol then at least halves
+// the state, up to the offset, so every element takes at least one bit and a
+// lane decodes at most `kWordBits + 1` symbols per word it reads.
+constexpr uint32_t kMaxFrequency = kScale / 2;
+constexpr int64_t kMaxHashRange = int64_t{1} << 62;
+
+// Number of groups of symbols decoded at a time by `RansSet::IntersectHashes`
+// before their values are computed.
+constexpr size_t kDecodeBatchGroups = 64;
+
+/**
+ * @brief Decodes the symbol of one state and shifts in the next word if the
+ * state falls below `kStateLow` and a word is left
+ *
+ * @return The symbol
+ */
+uint32_t DecodeSymbol(const uint32_t* table, const char* words,
+                      size_t num_words, size_t* word, uint32_t* state) {
+  const uint32_t entry = table[*state & (kScale - 1)];
+  uint32_t x = (entry & kFrequencyMask) * (*state >> kScaleBits) +
+               ((entry >> kOffsetShift) & kOffsetMask);
+  if (x < kStateLow && *word < num_words) {
+    x = x << kWordBits | absl::little_endian::Load16(words + 2 * (*word)++);
+  }
+  *state = x;
+  return entry >> kSymbolShift;
+}
+
+/**
+ * @brief The portable counterpart of the SIMD decoding kernels. The word of
+ * each lane is loaded unconditionally and only kept if the lane needs it, so
+ * that the lanes do not wait on each other's branches.
+ *
+ * @return The number of groups decoded
+ */
+size_t DecodeScalar(const uint32_t* table, const char* words, size_t num_words,
+                    size_t* word, size_t num_groups, uint32_t* states,
+                    uint32_t* symbols) {
+  size_t position = *word;
+  size_t group = 0;
+  for (; group < num_groups && position + RansSet::kNumLanes <= num_words;
+       group++) {
+    for (int lane = 0; lane < RansSet::kNumLanes; lane++) {
+      const uint32_t state = states[lane];
+      const uint32_t entry = table[state & (kScale - 1)];
+      symbols[group * RansSet::kNumLanes + lane] = entry >> kSymbolShift;
+      const uint32_t x = (entry & kFrequencyMask) * (state >> kScaleBits) +
+                         ((entry >> kOffsetShift) & kOffsetMask);
+      const bool renormalize = x < kStateLow;
+      const uint32_t next_word =
+          absl::little_endian::Load16(words + 2 * position);
+      states[lane] = renormalize ? x << kWordBits | next_word : x;
+      position += renormalize;
+    }
+  }
+  *word = position;
+  return group;
+}
+
+DecodeKernel SelectDecodeKernel() {
+  if (DecodeKernel avx2 = rans_set_internal::GetAvx2DecodeKernel();
+      avx2 != nullptr && CpuSupportsAvx2()) {
+    return avx2;
+  }
+  return &DecodeScalar;
+}
+
+DecodeKernel GetDecodeKernel() {
+  static const DecodeKernel kernel = SelectDecodeKernel();
+  return kernel;
+}
+
+// An entry of the decoding table, for a slot of the symbol `symbol` that
+// lies `offset` slots past the symbol's first one.
+uint32_t MakeDecodeEntry(uint32_t frequency, uint32_t offset, int symbol) {
+  return frequency | offset << kOffsetShift |
+         static_cast<uint32_t>(symbol) << kSymbolShift;
+}
+
+// Appends bits to a string through a 64-bit accumulator, which is stored as
+// a little-endian word whenever it fills up.
+class BitWriter {
+ public:
+  // Appends the `num_bits` low bits of `value`, least significant first.
+  // `num_bits` must be in [0, 63] and `value` less than 2^num_bits.
+  void Write(uint64_t value, int num_bits) {
+    if (num_bits == 0) {
+      return;
+    }
+    word_ |= value << used_;
+    if (used_ + num_bits < 64) {
+      used_ += num_bits;
+      return;
+    }
+    char bytes[8];
+    absl::little_endian::Store64(bytes, word_);
+    out_.append(bytes, 8);
+    word_ = value >> (64 - used_);
+    used_ += num_bits - 64;
+  }
+
+  // Returns the bytes written, with the last byte padded with zero bits.
+  std::string Finish() && {
+    for (int i = 0; i < used_; i += 8) {
+      out_.push_back(static_cast<char>(word_ >> i));
+    }
+    return std::move(out_);
+  }
+
+ private:
+  std::string out_;
+  uint64_t word_ = 0;
+  int used_ = 0;
+};
+
+// Reads bits written by `BitWriter`. Bits past the end read as zeros.
+class BitReader {
+ public:
+  explicit BitReader(absl::string_view bytes) : bytes_(bytes) {}
+
+  // Returns the number of bytes that the bits read so far take up.
+  uint64_t BytesRead() const { return (position_ + 7) / 8; }
+
+  // Returns the next `num_bits` bits, which must be in [0, 63].
+  uint64_t Read(int num_bits) {
+    if (num_bits > 56) {
+      const uint64_t low = Read(32);
+      return low | Read(num_bits - 32) << 32;
+    }
+    const uint64_t byte = position_ / 8;
+    uint64_t bits;
+    if (byte + 8 <= bytes_.size()) {
+      bits = absl::little_endian::Load64(bytes_.data() + byte);
+    } else {
+      bits = 0;
+      for (uint64_t i = byte; i < bytes_.size(); i++) {
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(bytes_[i]))
+                << (8 * (i - byte));
+      }
+    }
+    bits >>= position_ % 8;
+    position_ += num_bits;
+    return bits & ((uint64_t{1} << num_bits) - 1);
+  }
+
+ private:
+  absl::string_view bytes_;
+  uint64_t position_ = 0;
+};
+
+/**
+ * @brief Scales symbol counts to frequencies that add up to `kScale`. Every
+ * symbol that occurs keeps a frequency of at least 1, and the rounding error
+ * is taken from or given to the most frequent symbol, which has a frequency
+ * of at least kScale / kNumSymbols and so stays positive. No symbol gets more
+ * than `kMaxFrequency`; the excess goes to a neighbour of the most frequent
+ * symbol, the next most likely quotient.
+ *
+ * @param counts The number of occurrences of each symbol
+ * @param total The sum of `counts`, which must be positive
+ * @return The frequencies
+ */
+std::array<uint32_t, RansSet::kNumSymbols> NormalizeFrequencies(
+    const std::array<uint64_t, RansSet::kNumSymbols>& counts, uint64_t total) {
+  std::array<uint32_t, RansSet::kNumSymbols> frequencies = {};
+  int64_t sum = 0;
+  int largest = 0;
+  for (int s = 0; s < RansSet::kNumSymbols; s++) {
+    if (counts[s] == 0) {
+      continue;
+    }
+    frequencies[s] = static_cast<uint32_t>(
+        std::max<uint64_t>(1, (counts[s] * kScale + total / 2) / total));
+    sum += frequencies[s];
+    if (counts[s] > counts[largest]) {
+      largest = s;
+    }
+  }
+  frequencies[largest] = static_cast<uint32_t>(frequencies[largest] + kScale -
+                                               static_cast<uint32_t>(sum));
+  if (frequencies[largest] > kMaxFrequency) {
+    const int neighbour =
+        largest + 1 < RansSet::kNumSymbols ? largest + 1 : largest - 1;
+    frequencies[neighbour] += frequencies[largest] - kMaxFrequency;
+    frequencies[largest] = kMaxFrequency;
+  }
+  return frequencies;
+}
+
+// Whether every lane is back at the state the encoder started from.
+bool AtInitialState(const std::array<uint32_t, RansSet::kNumLanes>& states) {
+  return std::all_of(states.begin(), states.end(),
+                     [](uint32_t state) { return state == kStateLow; });
+}
+
+}  // namespace
+
+RansSet::RansSet(int64_t hash_range, int64_t num_elements, int remainder_bits,
+                 std::array<uint32_t, kNumSymbols> frequencies,
+                 std::array<uint32_t, kNumLanes> states, std::string words,
+                 std::string remainders)
+    : hash_range_(hash_range),
+      num_elements_(num_elements),
+      remainder_bits_(remainder_bits),
+      frequencies_(frequencies),
+      states_(states),
+      words_(std::move(words)),
+      remainders_(std::move(remainders)) {}
+
+/**
+ * @brief Hashes the elements, sorts them and splits the gaps between them
+ * into remainders, which are written out right away, and quotients, which
+ * are counted and then rANS coded in reverse, so that they decode forwards.
+ *
+ * @param fpr The target false-positive rate
+ * @param num_client_inputs The number of client inputs
+ * @param elements The elements to insert
+ * @return The set
+ */
+StatusOr<std::unique_ptr<RansSet>> RansSet::Create(
+    double fpr, int64_t num_client_inputs,
+    absl::Span<const std::string> elements) {
+  if (fpr <= 0 || fpr >= 1) {
+    return absl::InvalidArgumentError("`fpr` must be in (0,1)");
+  }
+  auto num_server_inputs = static_cast<int64_t>(elements.size());
+  const double range =
+      static_cast<double>(std::max(num_client_inputs, num_server_inputs)) / fpr;
+  if (range > static_cast<double>(kMaxHashRange)) {
+    return absl::InvalidArgumentError(
+        "`fpr` is too small for the number of inputs");
+  }
+  const int64_t hash_range = std::max<int64_t>(1, static_cast<int64_t>(range));
+
+  std::vector<uint64_t> hashes(elements.size());
+  for (size_t i = 0; i < elements.size(); i++) {
+    hashes[i] = ReduceToRange(FilterHash64(elements[i]), hash_range);
+  }
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+  const auto n = static_cast<uint64_t>(hashes.size());
+
+  // Make the remainder a quarter to an eighth of the average gap, so that
+  // the quotients average four to eight.
+  int remainder_bits = 0;
+  if (n > 0 && static_cast<uint64_t>(hash_range) / n >= 8) {
+    remainder_bits = absl::bit_width(static_cast<uint64_t>(hash_range) / n) - 3;
+  }
+  const uint64_t remainder_mask = (uint64_t{1} << remainder_bits) - 1;
+
+  std::vector<uint8_t> symbols(n);
+  std::array<uint64_t, kNumSymbols> counts = {};
+  BitWriter remainders;
+  uint64_t next = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    const uint64_t gap = hashes[i] - next;
+    next = hashes[i] + 1;
+    const uint64_t quotient = gap >> remainder_bits;
+    if (quotient >= kEscape) {
+      const uint64_t excess = quotient - kEscape;
+      const int width = absl::bit_width(excess);
+      remainders.Write(width, kEscapeWidthBits);
+      remainders.Write(excess, width);
+      symbols[i] = kEscape;
+    } else {
+      symbols[i] = static_cast<uint8_t>(quotient);
+    }
+    remainders.Write(gap & remainder_mask, remainder_bits);
+    counts[symbols[i]]++;
+  }
+
+  std::array<uint32_t, kNumSymbols> frequencies = {};
+  if (n > 0) {
+    frequencies = NormalizeFrequencies(counts, n);
+  }
+  std::array<uint32_t, kNumSymbols> starts = {};
+  for (int s = 1; s < kNumSymbols; s++) {
+    starts[s] = starts[s - 1] + frequencies[s - 1];
+  }
+
+  std::array<uint32_t, kNumLanes> states;
+  states.fill(kStateLow);
+  std::vector<uint16_t> words;
+  for (uint64_t i = n; i-- > 0;) {
+    uint32_t& state = states[i % kNumLanes];
+    const uint32_t frequency = frequencies[symbols[i]];
+    // Shift a word out if the state would otherwise leave [kStateLow, 2^32).
+    if (state >= (static_cast<uint64_t>(kStateLow >> kScaleBits)
+                  << kWordBits) *
+                     frequency) {
+      words.push_back(static_cast<uint16_t>(state));
+      state >>= kWordBits;
+    }
+    state = ((state / frequency) << kScaleBits) + state % frequency +
+            starts[symbols[i]];
+  }
+  std::string word_bytes(words.size() * 2, '\0');
+  for (size_t i = 0; i < words.size(); i++) {
+    absl::little_endian::Store16(&word_bytes[2 * i],
+                                 words[words.size() - 1 - i]);
+  }
+
+  return absl::WrapUnique(
+      new RansSet(hash_range, static_cast<int64_t>(n), remainder_bits,
+                  frequencies, states, std::move(word_bytes),
+                  std::move(remainders).Finish()));
+}
+
+StatusOr<std::unique_ptr<RansSet>> RansSet::CreateFromProtobuf(
+    const psi_proto::ServerSetup& encoded_set) {
+  if (!encoded_set.IsInitialized()) {
+    return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
+  }
+  const auto& info = encoded_set.rans_set();
+  const int64_t hash_range = info.hash_range();
+  const int64_t num_elements = info.num_elements();
+  const int remainder_bits = info.remainder_bits();
+  if (hash_range <= 0 || hash_range > kMaxHashRange) {
+    return absl::InvalidArgumentError("`hash_range` must be in [1, 2^62]");
+  }
+  if (num_elements < 0 || num_elements > hash_range) {
+    return absl::InvalidArgumentError(
+        "`num_elements` must be in [0, hash_range]");
+  }
+  if (remainder_bits < 0 || remainder_bits > kMaxRemainderBits) {
+    return absl::InvalidArgumentError("`remainder_bits` must be in [0, 62]");
+  }
+
+  if (info.frequencies_size() != kNumSymbols) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("`frequencies` must have ", kNumSymbols, " entries"));
+  }
+  std::array<uint32_t, kNumSymbols> frequencies;
+  uint64_t sum = 0;
+  for (int s = 0; s < kNumSymbols; s++) {
+    frequencies[s] = info.frequencies(s);
+    if (frequencies[s] > kMaxFrequency) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("`frequencies` must be at most ", kMaxFrequency));
+    }
+    sum += frequencies[s];
+  }
+  // Every slot of the decoding table must belong to a symbol. Only an empty
+  // set, which has no table, may leave all frequencies at zero.
+  if (sum != kScale && (sum != 0 || num_elements > 0)) {
+    return absl::InvalidArgumentError("`frequencies` must add up to 4096");
+  }
+
+  if (info.states_size() != kNumLanes) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("`states` must have ", kNumLanes, " entries"));
+  }
+  std::array<uint32_t, kNumLanes> states;
+  for (int lane = 0; lane < kNumLanes; lane++) {
+    states[lane] = info.states(lane);
+    if (states[lane] < kStateLow) {
+      return absl::InvalidArgumentError("`states` must be at least 2^16");
+    }
+  }
+  if (info.words().size() % 2 != 0) {
+    return absl::InvalidArgumentError("`words` must have an even length");
+  }
+  // Bound the decoding work by the size of the setup before decoding it.
+  const uint64_t num_words = info.words().size() / 2;
+  const auto n = static_cast<uint64_t>(num_elements);
+  if (n > (kWordBits + 1) * (num_words + kNumLanes) ||
+      (remainder_bits > 0 &&
+       n > info.remainders().size() * 8 / remainder_bits)) {
+    return absl::InvalidArgumentError(
+        "`num_elements` is too large for `words` and `remainders`");
+  }
+
+  auto set = absl::WrapUnique(new RansSet(hash_range, num_elements,
+                                          remainder_bits, frequencies, states,
+                                          info.words(), info.remainders()));
+  if (!set->DecodeBatches([](const uint64_t*, size_t) { return true; })) {
+    return absl::InvalidArgumentError(
+        "`words` and `remainders` do not decode to `num_elements` values");
+  }
+  return set;
+}
+
+std::vector<int64_t> RansSet::Intersect(
+    absl::Span<const std::string> elements) const {
+  std::vector<std::pair<int64_t, int64_t>> hashes;
+  hashes.reserve(elements.size());
+
+  const std::vector<int64_t> element_hashes = HashElements(elements);
+  for (size_t i = 0; i < elements.size(); i++) {
+    hashes.emplace_back(element_hashes[i], i);
+  }
+
+  return IntersectHashes(std::move(hashes));
+}
+
+std::vector<int64_t> RansSet::HashElements(
+    absl::Span<const std::string> elements) const {
+  std::vector<int64_t> hashes(elements.size());
+  for (size_t i = 0; i < elements.size(); i++) {
+    hashes[i] = static_cast<int64_t>(
+        ReduceToRange(FilterHash64(elements[i]), hash_range_));
+  }
+  return hashes;
+}
+
+/**
+ * @brief Decodes the set in batches of groups of `kNumLanes` symbols, one per
+ * lane, with the SIMD kernel if there is one, and turns the symbols of a
+ * batch into values. The last groups, which could run past the end of the
+ * words, are decoded one symbol at a time.
+ *
+ * @param consume Called with the ascending values of every batch and their
+ * number, until it returns false
+ * @return False if the set turned out to be corrupt: a value outside the hash
+ * range, or a decoder that does not end on the last word and remainder byte
+ * with its states back at `kStateLow`
+ */
+template <typename Consume>
+bool RansSet::DecodeBatches(Consume consume) const {
+  if (num_elements_ == 0) {
+    return words_.empty() && remainders_.empty() && AtInitialState(states_);
+  }
+  std::vector<uint32_t> table(kScale);
+  for (int s = 0, slot = 0; s < kNumSymbols; s++) {
+    for (uint32_t offset = 0; offset < frequencies_[s]; offset++) {
+      table[slot++] = MakeDecodeEntry(frequencies_[s], offset, s);
+    }
+  }
+
+  const DecodeKernel kernel = GetDecodeKernel();
+  std::array<uint32_t, kNumLanes> states = states_;
+  const char* words = words_.data();
+  const size_t num_words = words_.size() / 2;
+  size_t word = 0;
+  BitReader remainders(remainders_);
+  const auto n = static_cast<uint64_t>(num_elements_);
+  uint64_t next = 0;
+  uint32_t symbols[kDecodeBatchGroups * kNumLanes];
+  uint64_t values[kDecodeBatchGroups * kNumLanes];
+  // Quotients above this make gaps past the hash range, and could overflow.
+  const uint64_t max_quotient =
+      static_cast<uint64_t>(hash_range_) >> remainder_bits_;
+  bool corrupt = false;
+  for (uint64_t base = 0; base < n;) {
+    const size_t groups = kernel(
+        table.data(), words, num_words, &word,
+        std::min<uint64_t>(kDecodeBatchGroups, (n - base) / kNumLanes),
+        states.data(), symbols);
+    size_t count = groups * kNumLanes;
+    if (count == 0) {
+      count = std::min<uint64_t>(kNumLanes, n - base);
+      for (size_t lane = 0; lane < count; lane++) {
+        symbols[lane] =
+            DecodeSymbol(table.data(), words, num_words, &word, &states[lane]);
+      }
+    }
+    base += count;
+
+    for (size_t i = 0; i < count; i++) {
+      uint64_t quotient = symbols[i];
+      if (quotient == kEscape) {
+        const int width = static_cast<int>(remainders.Read(kEscapeWidthBits));
+        quotient += remainders.Read(width);
+      }
+      corrupt |= quotient > max_quotient;
+      quotient = std::min(quotient, max_quotient);
+      const uint64_t gap =
+          quotient << remainder_bits_ | remainders.Read(remainder_bits_);
+      values[i] = next + gap;
+      next = values[i] + 1;
+    }
+    corrupt |= values[count - 1] >= static_cast<uint64_t>(hash_range_);
+    if (!consume(static_cast<const uint64_t*>(values), count)) {
+      return !corrupt;
+    }
+  }
+  return !corrupt && word == num_words &&
+         remainders.BytesRead() == remainders_.size() &&
+         AtInitialState(states);
+}
+
+/**
+ * @brief Decodes the set and merges the values of every batch with the sorted
+ * hashes. Decoding stops as soon as the hashes are exhausted.
+ *
+ * @param hashes The (hash, index) pairs
+ * @return The indices of the pairs whose hash is in the set
+ */
+std::vector<int64_t> RansSet::IntersectHashes(
+    std::vector<std::pair<int64_t, int64_t>> hashes) const {
+  std::sort(
+      hashes.begin(), hashes.end(),
+      [](const std::pair<int64_t, int64_t>& a,
+         const std::pair<int64_t, int64_t>& b) { return a.first < b.first; });
+  std::vector<int64_t> res;
+  // Negative hashes cannot be in the set.
+  size_t h =
+      std::lower_bound(hashes.begin(), hashes.end(), 0,
+                       [](const std::pair<int64_t, int64_t>& hash,
+                          int64_t value) { return hash.first < value; }) -
+      hashes.begin();
+  if (h == hashes.size() || num_elements_ == 0) {
+    return res;
+  }
+
+  // The smallest hash not yet passed.
+  auto target = static_cast<uint64_t>(hashes[h].first);
+  DecodeBatches([&](const uint64_t* values, size_t count) {
+    // The values increase, so the batch can be skipped if its last value is
+    // below the hashes left.
+    if (values[count - 1] < target) {
+      return true;
+    }
+    for (size_t i = 0; i < count; i++) {
+      while (target < values[i]) {
+        if (++h == hashes.size()) {
+          return false;
+        }
+        target = static_cast<uint64_t>(hashes[h].first);
+      }
+      while (target == values[i]) {
+        res.push_back(hashes[h].second);
+        if (++h == hashes.size()) {
+          return false;
+        }
+        target = static_cast<uint64_t>(hashes[h].first);
+      }
+    }
+    return true;
+  });
+  return res;
+}
+
+std::vector<int64_t> RansSet::DecodeHashes() const {
+  std::vector<int64_t> hashes;
+  // `CreateFromProtobuf` has checked that the set decodes to exactly
+  // `num_elements_` values, at least one bit of the setup each.
+  hashes.reserve(static_cast<size_t>(num_elements_));
+  DecodeBatches([&](const uint64_t* values, size_t count) {
+    hashes.insert(hashes.end(), values, values + count);
+    return true;
+  });
+  return hashes;
+}
+
+psi_proto::ServerSetup RansSet::ToProtobuf() const {
+  psi_proto::ServerSetup server_setup;
+  auto* info = server_setup.mutable_rans_set();
+  info->set_hash_range(hash_range_);
+  info->set_num_elements(num_elements_);
+  info->set_remainder_bits(remainder_bits_);
+  for (uint32_t frequency : frequencies_) {
+    info->add_frequencies(frequency);
+  }
+  for (uint32_t state : states_) {
+    info->add_states(state);
+  }
+  info->set_words(words_);
+  info->set_remainders(remainders_);
+  return server_setup;
+}
+
+int64_t RansSet::HashRange() const { return hash_range_; }
+
+int64_t RansSet::NumElements() const { return num_elements_; }
+
+int RansSet::RemainderBits() const { return remainder_bits_; }
+
+}  // namespace private_set_intersection
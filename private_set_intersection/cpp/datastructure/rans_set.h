@@ -0,0 +1,138 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_RANS_SET_H_
+#define PRIVATE_SET_INTERSECTION_CPP_RANS_SET_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// A set of hashes in [0, hash_range) whose gaps are entropy coded. Like a
+// GCS, the server's elements are hashed into a range of about `n / fpr`
+// values and the gaps between the sorted hashes are coded, but each gap is
+// split into a quotient and `remainder_bits` raw remainder bits, where
+// `remainder_bits` is chosen so that the quotients average four to eight.
+// The quotients are coded with rANS under their measured distribution, and
+// the remainders, which are close to uniform, are stored as they are. This
+// comes within a few hundredths of a bit per element of the entropy of the
+// gaps, whereas a GCS loses more the further the average gap is from a power
+// of two.
+//
+// The quotients are spread over `kNumLanes` interleaved rANS states sharing
+// one stream of 16-bit words, quotient `i` going to lane `i % kNumLanes`.
+// The lanes only depend on each other through the order in which they read
+// words, so they are decoded in lockstep, one per 32-bit lane of an AVX2
+// register where the CPU supports it.
+//
+// Elements are hashed with `FilterHash64`, reduced to the range by
+// multiply-shift.
+class RansSet {
+ public:
+  RansSet() = delete;
+
+  // The number of interleaved rANS states.
+  static constexpr int kNumLanes = 8;
+
+  // The number of quotient symbols. The last one is an escape, followed in
+  // the remainder bits by the excess of a quotient over it.
+  static constexpr int kNumSymbols = 64;
+
+  // Creates a set containing `elements`, hashed into a range of
+  // `max(num_client_inputs, elements.size()) / fpr` values.
+  //
+  // Returns INVALID_ARGUMENT if `fpr` is not in (0,1) or the range would
+  // exceed 2^62.
+  static StatusOr<std::unique_ptr<RansSet>> Create(
+      double fpr, int64_t num_client_inputs,
+      absl::Span<const std::string> elements);
+
+  // Creates a set from the passed protobuf, which is decoded once to check
+  // that it holds exactly `num_elements` values in the hash range.
+  //
+  // Returns INVALID_ARGUMENT if the protobuf does not describe a valid set.
+  static StatusOr<std::unique_ptr<RansSet>> CreateFromProtobuf(
+      const psi_proto::ServerSetup& encoded_set);
+
+  // Returns the indices of all elements whose hash is in the set.
+  std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
+
+  // Maps every element of `elements` into this set's hash range. Since no
+  // state of the set is touched, disjoint chunks of client elements can be
+  // hashed concurrently from several threads.
+  std::vector<int64_t> HashElements(
+      absl::Span<const std::string> elements) const;
+
+  // Returns the indices of all (hash, index) pairs in `hashes` whose hash is
+  // in the set, decoding the whole set once. `hashes` need not be sorted.
+  std::vector<int64_t> IntersectHashes(
+      std::vector<std::pair<int64_t, int64_t>> hashes) const;
+
+  // Decodes the whole set and returns its hashes in ascending order.
+  std::vector<int64_t> DecodeHashes() const;
+
+  // Returns a protobuf representation of the set.
+  psi_proto::ServerSetup ToProtobuf() const;
+
+  int64_t HashRange() const;
+
+  int64_t NumElements() const;
+
+  int RemainderBits() const;
+
+ private:
+  RansSet(int64_t hash_range, int64_t num_elements, int remainder_bits,
+          std::array<uint32_t, kNumSymbols> frequencies,
+          std::array<uint32_t, kNumLanes> states, std::string words,
+          std::string remainders);
+
+  // Decodes the set in batches, calling `consume(values, count)` with the
+  // ascending values of each batch until it returns false. Returns false if
+  // the set is found to be corrupt.
+  template <typename Consume>
+  bool DecodeBatches(Consume consume) const;
+
+  int64_t hash_range_;
+  int64_t num_elements_;
+  int remainder_bits_;
+
+  // The frequency of every quotient symbol, out of 2^12.
+  std::array<uint32_t, kNumSymbols> frequencies_;
+
+  // The final states of the encoder, which the decoder starts from.
+  std::array<uint32_t, kNumLanes> states_;
+
+  // The 16-bit words of the rANS stream, little-endian, in decoding order.
+  std::string words_;
+
+  // The remainder bits and escaped quotients, least significant bit first.
+  std::string remainders_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_RANS_SET_H_
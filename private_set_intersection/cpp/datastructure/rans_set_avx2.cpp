@@ -0,0 +1,117 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Built with -mavx2 on x86-64; only called after a runtime CPU check.
+
+#include "private_set_intersection/cpp/datastructure/rans_set_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#include <array>
+#endif
+
+namespace private_set_intersection {
+namespace rans_set_internal {
+
+#if defined(__AVX2__)
+
+namespace {
+
+static_assert(kNumLanes == 8, "One state per 32-bit lane of a register");
+
+// For every mask of the lanes that read a word, the position among the
+// loaded words of each lane's word: lane j reads the word after those of
+// the reading lanes before it.
+std::array<std::array<int32_t, 8>, 256> MakeWordPermutations() {
+  std::array<std::array<int32_t, 8>, 256> permutations = {};
+  for (int mask = 0; mask < 256; mask++) {
+    int count = 0;
+    for (int lane = 0; lane < 8; lane++) {
+      permutations[mask][lane] = count;
+      count += (mask >> lane) & 1;
+    }
+  }
+  return permutations;
+}
+
+/**
+ * @brief Advances the eight states in lockstep, one per 32-bit lane. The
+ * table entries are gathered, the states updated with a 32-bit multiply, and
+ * the lanes that fall below `kStateLow` shift in the next words, which are
+ * loaded eight at once and moved to those lanes with a permutation picked by
+ * the mask of the lanes.
+ *
+ * @return The number of groups decoded
+ */
+size_t DecodeAvx2(const uint32_t* table, const char* words, size_t num_words,
+                  size_t* word, size_t num_groups, uint32_t* states,
+                  uint32_t* symbols) {
+  static const auto* permutations =
+      new std::array<std::array<int32_t, 8>, 256>(MakeWordPermutations());
+  const __m256i slot_mask = _mm256_set1_epi32(static_cast<int>(kScale - 1));
+  const __m256i frequency_mask =
+      _mm256_set1_epi32(static_cast<int>(kFrequencyMask));
+  const __m256i offset_mask = _mm256_set1_epi32(static_cast<int>(kOffsetMask));
+  const __m256i zero = _mm256_setzero_si256();
+  const auto* entries = reinterpret_cast<const int*>(table);
+
+  __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(states));
+  size_t position = *word;
+  size_t group = 0;
+  for (; group < num_groups && position + kNumLanes <= num_words; group++) {
+    const __m256i entry = _mm256_i32gather_epi32(
+        entries, _mm256_and_si256(x, slot_mask), 4);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(symbols + group * kNumLanes),
+        _mm256_srli_epi32(entry, kSymbolShift));
+    x = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_and_si256(entry, frequency_mask),
+                           _mm256_srli_epi32(x, kScaleBits)),
+        _mm256_and_si256(_mm256_srli_epi32(entry, kOffsetShift), offset_mask));
+
+    // A state is below 2^16 if its high half is zero.
+    const __m256i renormalize =
+        _mm256_cmpeq_epi32(_mm256_srli_epi32(x, kWordBits), zero);
+    const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(renormalize));
+    const __m256i loaded = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(words + 2 * position)));
+    const std::array<int32_t, 8>& permutation = (*permutations)[mask];
+    const __m256i next_words = _mm256_permutevar8x32_epi32(
+        loaded, _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(permutation.data())));
+    x = _mm256_blendv_epi8(
+        x, _mm256_or_si256(_mm256_slli_epi32(x, kWordBits), next_words),
+        renormalize);
+    position += permutation[7] + (mask >> 7);
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(states), x);
+  *word = position;
+  return group;
+}
+
+}  // namespace
+
+DecodeKernel GetAvx2DecodeKernel() { return &DecodeAvx2; }
+
+#else
+
+DecodeKernel GetAvx2DecodeKernel() { return nullptr; }
+
+#endif
+
+}  // namespace rans_set_internal
+}  // namespace private_set_intersection
@@ -0,0 +1,71 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_RANS_SET_INTERNAL_H_
+#define PRIVATE_SET_INTERSECTION_CPP_RANS_SET_INTERNAL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Shared between the portable rANS set code and its SIMD decoding kernel,
+// which is built in its own translation unit with extra instruction-set
+// flags.
+
+namespace private_set_intersection {
+namespace rans_set_internal {
+
+// The number of interleaved states.
+constexpr int kNumLanes = 8;
+
+// The frequencies of the symbols add up to 2^kScaleBits.
+constexpr int kScaleBits = 12;
+constexpr uint32_t kScale = uint32_t{1} << kScaleBits;
+
+// The states stay in [kStateLow, 2^32) between symbols, and are renormalized
+// by shifting 16-bit words in and out.
+constexpr uint32_t kStateLow = uint32_t{1} << 16;
+constexpr int kWordBits = 16;
+
+// An entry of the decoding table, indexed by the low `kScaleBits` bits of a
+// state, holds the frequency of the slot's symbol in bits 0-12, the offset of
+// the slot from the symbol's first one in bits 13-24 and the symbol from bit
+// 25 on.
+constexpr int kOffsetShift = 13;
+constexpr int kSymbolShift = 25;
+constexpr uint32_t kFrequencyMask = (uint32_t{1} << kOffsetShift) - 1;
+constexpr uint32_t kOffsetMask = kScale - 1;
+
+// Decodes up to `num_groups` groups of `kNumLanes` symbols, symbol `j` of a
+// group from `states[j]`, with the decoding table `table`. Words are read
+// from the `num_words` little-endian 16-bit `words`, starting at `*word`,
+// which is advanced past them. Symbol `i` is written to `symbols[i]`.
+//
+// Stops before a group if fewer than `kNumLanes` words are left, so that the
+// words of a group can be loaded at once; returns the number of groups
+// decoded, leaving the rest to the caller.
+using DecodeKernel = size_t (*)(const uint32_t* table, const char* words,
+                                size_t num_words, size_t* word,
+                                size_t num_groups, uint32_t* states,
+                                uint32_t* symbols);
+
+// Returns the AVX2 kernel, or null if it was not compiled in (for example on
+// other architectures). It must only be called if the CPU supports AVX2.
+DecodeKernel GetAvx2DecodeKernel();
+
+}  // namespace rans_set_internal
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_RANS_SET_INTERNAL_H_
@@ -0,0 +1,283 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/datastructure/gcs.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+TEST(RansSetTest, TestIntersect) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  std::vector<std::string> elements2 = {"a", "b", "d", "e"};
+  PSI_ASSERT_OK_AND_ASSIGN(auto set, RansSet::Create(0.001, 4, elements));
+  std::vector<int64_t> res = set->Intersect(elements2);
+  std::sort(res.begin(), res.end());
+  EXPECT_EQ(res, std::vector<int64_t>({0, 1, 2}));
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto empty, RansSet::Create(0.001, 4, {}));
+  EXPECT_TRUE(empty->Intersect(elements2).empty());
+}
+
+TEST(RansSetTest, TestIntersectHashes) {
+  std::mt19937_64 rng(1);
+  for (int num_elements : {1, 7, 8, 9, 1000, 100000}) {
+    std::vector<std::string> elements;
+    for (int i = 0; i < num_elements; i++) {
+      elements.push_back(absl::StrCat("Element ", i));
+    }
+    // An fpr of 0.5 leaves quotients of 0 only, the others spread them over
+    // all symbols, and a huge number of client inputs makes escapes common.
+    for (auto [fpr, num_client_inputs] :
+         {std::pair<double, int64_t>{0.5, 10}, {0.001, 10}, {1e-9, 10},
+          {0.1, int64_t{1} << 40}}) {
+      PSI_ASSERT_OK_AND_ASSIGN(
+          auto created, RansSet::Create(fpr, num_client_inputs, elements));
+      // Every query goes through the decoded set, which must encode to the
+      // same frequencies, states and streams.
+      const psi_proto::ServerSetup encoded_set = created->ToProtobuf();
+      PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                               RansSet::CreateFromProtobuf(encoded_set));
+      EXPECT_EQ(set->RemainderBits(), created->RemainderBits());
+      EXPECT_EQ(set->ToProtobuf().SerializeAsString(),
+                encoded_set.SerializeAsString());
+      absl::flat_hash_set<int64_t> hashes;
+      for (const auto& element : elements) {
+        hashes.insert(static_cast<int64_t>(
+            ReduceToRange(FilterHash64(element), set->HashRange())));
+      }
+      EXPECT_EQ(set->NumElements(), hashes.size());
+      std::vector<int64_t> sorted_hashes(hashes.begin(), hashes.end());
+      std::sort(sorted_hashes.begin(), sorted_hashes.end());
+      EXPECT_EQ(set->DecodeHashes(), sorted_hashes);
+
+      // Query every hash, its neighbours and random values, in random order.
+      std::vector<std::pair<int64_t, int64_t>> queries;
+      for (int64_t hash : hashes) {
+        for (int64_t query : {hash, hash - 1, hash + 1}) {
+          queries.emplace_back(query, queries.size());
+        }
+      }
+      for (int i = 0; i < 10000; i++) {
+        queries.emplace_back(static_cast<int64_t>(rng() % set->HashRange()),
+                             queries.size());
+      }
+      std::shuffle(queries.begin(), queries.end(), rng);
+      std::vector<int64_t> expected;
+      for (const auto& [hash, index] : queries) {
+        if (hashes.contains(hash)) {
+          expected.push_back(index);
+        }
+      }
+      std::vector<int64_t> result = set->IntersectHashes(queries);
+      std::sort(expected.begin(), expected.end());
+      std::sort(result.begin(), result.end());
+      EXPECT_EQ(result, expected);
+    }
+  }
+}
+
+TEST(RansSetTest, TestFPR) {
+  const int num_elements = 100000;
+  std::vector<std::string> elements;
+  std::vector<std::string> others;
+  for (int i = 0; i < num_elements; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+    others.push_back(absl::StrCat("Other ", i));
+  }
+  for (double target_fpr : {0.1, 0.001}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto set, RansSet::Create(target_fpr, num_elements, elements));
+    const double fpr = static_cast<double>(set->Intersect(others).size()) /
+                       num_elements;
+    EXPECT_LT(fpr, target_fpr * 1.5);
+  }
+}
+
+TEST(RansSetTest, TestSmallerThanGCS) {
+  const int num_elements = 100000;
+  std::vector<std::string> elements;
+  for (int i = 0; i < num_elements; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  for (double fpr : {0.01, 0.0003, 1e-9}) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                             RansSet::Create(fpr, num_elements, elements));
+    PSI_ASSERT_OK_AND_ASSIGN(auto gcs,
+                             GCS::Create(fpr, num_elements, elements,
+                                         psi_proto::HASH_VERSION_FAST64, 0));
+    EXPECT_LT(set->ToProtobuf().ByteSizeLong(),
+              gcs->ToProtobuf().ByteSizeLong());
+    // The gaps are about geometric, with an entropy of
+    // log2(e * hash_range / n) bits.
+    const double entropy =
+        std::log2(std::exp(1.0) * set->HashRange() / num_elements);
+    EXPECT_LT(set->ToProtobuf().ByteSizeLong() * 8.0 / num_elements,
+              entropy + 0.05);
+  }
+}
+
+TEST(RansSetTest, TestCreateFromInvalidProtobuf) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto set, RansSet::Create(0.001, 10, elements));
+  const psi_proto::ServerSetup valid = set->ToProtobuf();
+
+  psi_proto::ServerSetup setup = valid;
+  setup.mutable_rans_set()->set_hash_range(0);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->set_num_elements(-1);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->set_remainder_bits(63);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->mutable_frequencies()->RemoveLast();
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->set_frequencies(
+      0, setup.rans_set().frequencies(0) + 1);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->mutable_states()->RemoveLast();
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->set_states(0, 1);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_rans_set()->mutable_words()->push_back('\0');
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+
+  // An empty set must not carry frequencies that overflow the decoding table.
+  PSI_ASSERT_OK_AND_ASSIGN(auto empty, RansSet::Create(0.001, 10, {}));
+  setup = empty->ToProtobuf();
+  setup.mutable_rans_set()->set_frequencies(0, 5000);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto decoded_empty, RansSet::CreateFromProtobuf(empty->ToProtobuf()));
+  EXPECT_TRUE(decoded_empty->DecodeHashes().empty());
+
+  // Streams that end early or run on are caught by decoding the set.
+  setup = valid;
+  setup.mutable_rans_set()->mutable_words()->resize(
+      valid.rans_set().words().size() - 2);
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  setup = valid;
+  setup.mutable_rans_set()->mutable_words()->append(2, '\0');
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  setup = valid;
+  setup.mutable_rans_set()->mutable_remainders()->pop_back();
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  setup = valid;
+  setup.mutable_rans_set()->mutable_remainders()->push_back('\0');
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  setup = valid;
+  setup.mutable_rans_set()->set_num_elements(valid.rans_set().num_elements() -
+                                             1);
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(RansSetTest, TestCreateFromInflatedProtobuf) {
+  // A tiny setup claiming many elements, all with a gap of 0 and a symbol
+  // that takes no bits, must not be decoded.
+  psi_proto::ServerSetup setup;
+  auto* info = setup.mutable_rans_set();
+  info->set_hash_range(int64_t{1} << 40);
+  info->set_num_elements(50000000);
+  info->set_remainder_bits(0);
+  for (int s = 0; s < RansSet::kNumSymbols; s++) {
+    info->add_frequencies(s == 0 ? 4096 : 0);
+  }
+  for (int lane = 0; lane < RansSet::kNumLanes; lane++) {
+    info->add_states(1 << 16);
+  }
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Every symbol takes at least a bit, so the count is bounded by the words.
+  info->set_frequencies(0, 2048);
+  info->set_frequencies(1, 2048);
+  EXPECT_EQ(RansSet::CreateFromProtobuf(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Sets with one distinct quotient still take a bit per element.
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto dense, RansSet::Create(0.999, 1, elements));
+  const psi_proto::ServerSetup dense_setup = dense->ToProtobuf();
+  for (uint32_t frequency : dense_setup.rans_set().frequencies()) {
+    EXPECT_LE(frequency, 2048);
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded,
+                           RansSet::CreateFromProtobuf(dense_setup));
+  EXPECT_EQ(decoded->DecodeHashes(), dense->DecodeHashes());
+}
+
+TEST(RansSetTest, TestMaxHashRange) {
+  // A hash range of 2^62 over one element leaves remainders of 60 bits, the
+  // widest that `Create` writes.
+  const std::vector<std::string> elements = {"a"};
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto set, RansSet::Create(std::ldexp(1.0, -52), 1024, elements));
+  EXPECT_EQ(set->HashRange(), int64_t{1} << 62);
+  EXPECT_EQ(set->RemainderBits(), 60);
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded,
+                           RansSet::CreateFromProtobuf(set->ToProtobuf()));
+  EXPECT_EQ(decoded->Intersect(elements), std::vector<int64_t>({0}));
+
+  // Larger ranges, and fprs outside (0, 1), are rejected.
+  EXPECT_FALSE(RansSet::Create(std::ldexp(1.0, -53), 1024, elements).ok());
+  EXPECT_FALSE(RansSet::Create(0, 10, {}).ok());
+  EXPECT_FALSE(RansSet::Create(1, 10, {}).ok());
+  psi_proto::ServerSetup setup = set->ToProtobuf();
+  setup.mutable_rans_set()->set_hash_range((int64_t{1} << 62) + 1);
+  EXPECT_FALSE(RansSet::CreateFromProtobuf(setup).ok());
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -16,46 +16,77 @@
 
 #include "private_set_intersection/cpp/datastructure/raw.h"
 
+#include <algorithm>
 #include <cmath>
 
+#include "absl/base/prefetch.h"
 #include "absl/memory/memory.h"
+#include "absl/random/random.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/util/parallel.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
 
 // Computes the intersection of two collections. The first collection must be a
 // `pair<T, int64_t>`. The `T` must be the same in the second collection.
+// `on_match` is called with the `int64_t` of every pair in the intersection,
+// including every pair whose `T` is repeated in the first collection.
 //
 // Requires both collections to be sorted.
 //
 // Complexity:
 // - O(max(n, m))
-template <class InputIt1, class InputIt2, class OutputIt>
+template <class InputIt1, class InputIt2, class OnMatch>
 void custom_set_intersection(InputIt1 first1, InputIt1 last1, InputIt2 first2,
-                             InputIt2 last2, OutputIt d_first) {
+                             InputIt2 last2, OnMatch on_match) {
   while (first1 != last1 && first2 != last2) {
     if ((*first1).first < *first2)
       ++first1;
-    else {
-      // *first1 and *first2 are equivalent.
-      if (!(*first2 < (*first1).first)) {
-        *d_first++ = (*first1++).second;
-      }
+    else if (*first2 < (*first1).first)
       ++first2;
-    }
+    else
+      // *first1 and *first2 are equivalent. `first2` stays, so that the next
+      // pair matches it too if it is a duplicate.
+      on_match((*first1++).second);
   }
 }
 
-Raw::Raw(std::vector<std::string> elements) : encrypted_(std::move(elements)) {}
+namespace {
+
+// Number of elements probed at a time by `Raw::ForEachMatchWithIndex`. The
+// slots of the next group are prefetched while a group is probed.
+constexpr size_t kProbeBatchSize = 32;
+
+}  // namespace
+
+Raw::Raw(std::vector<std::string> elements)
+    : owned_(std::move(elements)),
+      index_key_(absl::Uniform<uint64_t>(absl::BitGen())) {
+  if (!std::is_sorted(owned_.begin(), owned_.end())) {
+    std::sort(owned_.begin(), owned_.end());
+  }
+  encrypted_.assign(owned_.begin(), owned_.end());
+}
+
+Raw::Raw(std::vector<absl::string_view> elements)
+    : encrypted_(std::move(elements)),
+      index_key_(absl::Uniform<uint64_t>(absl::BitGen())) {
+  if (!std::is_sorted(encrypted_.begin(), encrypted_.end())) {
+    std::sort(encrypted_.begin(), encrypted_.end());
+  }
+}
 
 StatusOr<std::unique_ptr<Raw>> Raw::Create(int64_t num_client_inputs,
-                                           std::vector<std::string> elements) {
+                                           std::vector<std::string> elements,
+                                           int num_threads) {
   // We sort to make intersections easier to find later
-  std::sort(elements.begin(), elements.end());
+  ParallelSort(elements.begin(), elements.end(), num_threads);
 
-  return absl::WrapUnique(new Raw(elements));
+  return absl::WrapUnique(new Raw(std::move(elements)));
 }
 
 StatusOr<std::unique_ptr<Raw>> Raw::CreateFromProtobuf(
@@ -68,39 +99,230 @@ StatusOr<std::unique_ptr<Raw>> Raw::CreateFromProtobuf(
       encoded_filter.raw().encrypted_elements().begin(),
       encoded_filter.raw().encrypted_elements().end());
 
-  return absl::WrapUnique(new Raw(encrypted_elements));
+  return absl::WrapUnique(new Raw(std::move(encrypted_elements)));
+}
+
+StatusOr<std::unique_ptr<Raw>> Raw::CreateViewFromProtobuf(
+    const psi_proto::ServerSetup& encoded_filter) {
+  if (!encoded_filter.IsInitialized()) {
+    return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
+  }
+
+  std::vector<absl::string_view> encrypted_elements(
+      encoded_filter.raw().encrypted_elements().begin(),
+      encoded_filter.raw().encrypted_elements().end());
+
+  return absl::WrapUnique(new Raw(std::move(encrypted_elements)));
+}
+
+/**
+ * @brief Inserts the keyed hash and position of every value into a table with
+ * linear probing. A value equal to one already in the table is left out, so
+ * probing finds every value at most once.
+ */
+void Raw::BuildIndex() const {
+  if (encrypted_.empty()) {
+    return;
+  }
+  int log_num_slots = 1;
+  while ((size_t{1} << log_num_slots) < 2 * encrypted_.size()) {
+    log_num_slots++;
+  }
+  index_.assign(size_t{1} << log_num_slots, IndexSlot{0, -1});
+  index_shift_ = 64 - log_num_slots;
+  const size_t slot_mask = index_.size() - 1;
+
+  for (size_t i = 0; i < encrypted_.size(); i++) {
+    const uint64_t hash = FilterHash64(encrypted_[i], index_key_);
+    size_t slot = hash >> index_shift_;
+    bool duplicate = false;
+    while (index_[slot].position >= 0) {
+      if (index_[slot].hash == hash &&
+          encrypted_[index_[slot].position] == encrypted_[i]) {
+        duplicate = true;
+        break;
+      }
+      slot = (slot + 1) & slot_mask;
+    }
+    if (!duplicate) {
+      index_[slot] = {hash, static_cast<int64_t>(i)};
+    }
+  }
 }
 
 std::vector<int64_t> Raw::Intersect(
     absl::Span<const std::string> elements) const {
-  // This implementation creates a copy of `elements`, but the tradeoff is that
-  // we can compute the intersection in O(nlog(n) + max(n, m)) where `n` and `m`
-  // correspond to the number of client and server elements respectively.
-  std::vector<std::pair<std::string, int64_t>> vp(elements.size());
+  std::vector<int64_t> res;
+  ForEachMatch(elements, [&res](int64_t i) { res.push_back(i); });
+  return res;
+}
+
+int64_t Raw::CountIntersection(absl::Span<const std::string> elements) const {
+  int64_t count = 0;
+  ForEachMatch(elements, [&count](int64_t) { count++; });
+  return count;
+}
+
+std::vector<uint64_t> Raw::IntersectBitmap(
+    absl::Span<const std::string> elements) const {
+  std::vector<uint64_t> bitmap((elements.size() + 63) / 64);
+  ForEachMatch(elements, [&bitmap](int64_t i) {
+    bitmap[i / 64] |= uint64_t{1} << (i % 64);
+  });
+  return bitmap;
+}
+
+/**
+ * @brief Picks binary search for small batches. Larger ones are sorted and
+ * merged until the elements merged so far outnumber the values, at which point
+ * the index, which costs about as much to build as merging that many, is built
+ * and probed from then on.
+ *
+ * @param elements The elements to look up
+ * @param on_match Called with the indices of the elements found
+ */
+template <typename OnMatch>
+void Raw::ForEachMatch(absl::Span<const std::string> elements,
+                       OnMatch on_match) const {
+  const auto num_values = static_cast<int64_t>(encrypted_.size());
+  const auto num_elements = static_cast<int64_t>(elements.size());
+  if (num_values == 0 || num_elements == 0) {
+    return;
+  }
+  // Looking up element by element takes O(n log(m)), sorting and merging
+  // O(n log(n) + m), and probing the index O(n) once it is built in O(m).
+  if (static_cast<double>(num_elements) *
+          std::log2(static_cast<double>(num_values) + 1) <
+      static_cast<double>(num_values)) {
+    ForEachMatchBySearch(elements, on_match);
+  } else if (merged_elements_.fetch_add(num_elements,
+                                        std::memory_order_relaxed) +
+                 num_elements <
+             num_values) {
+    ForEachMatchSorted(elements, on_match);
+  } else {
+    absl::call_once(index_once_, &Raw::BuildIndex, this);
+    ForEachMatchWithIndex(elements, on_match);
+  }
+}
+
+/**
+ * @brief Looks each element up by binary search in the sorted values
+ *
+ * @param elements The elements to look up
+ * @param on_match Called with the indices of the elements found, in ascending
+ * order
+ */
+template <typename OnMatch>
+void Raw::ForEachMatchBySearch(absl::Span<const std::string> elements,
+                               OnMatch on_match) const {
+  for (size_t i = 0; i < elements.size(); ++i) {
+    if (std::binary_search(encrypted_.begin(), encrypted_.end(),
+                           absl::string_view(elements[i]))) {
+      on_match(static_cast<int64_t>(i));
+    }
+  }
+}
+
+/**
+ * @brief Hashes the elements and probes the index for them in groups of
+ * `kProbeBatchSize`, prefetching the home slots of the next group while one
+ * is probed so that the cache misses of a large table overlap
+ *
+ * @param elements The elements to look up
+ * @param on_match Called with the indices of the elements found, in ascending
+ * order
+ */
+template <typename OnMatch>
+void Raw::ForEachMatchWithIndex(absl::Span<const std::string> elements,
+                                OnMatch on_match) const {
+  if (index_.empty()) {
+    return;
+  }
+  const size_t n = elements.size();
+  const size_t slot_mask = index_.size() - 1;
+  std::vector<uint64_t> hashes(n);
+  for (size_t i = 0; i < n; i++) {
+    hashes[i] = FilterHash64(elements[i], index_key_);
+  }
+  const auto prefetch = [&](size_t begin) {
+    for (size_t i = begin; i < std::min(begin + kProbeBatchSize, n); i++) {
+      absl::PrefetchToLocalCache(&index_[hashes[i] >> index_shift_]);
+    }
+  };
+
+  prefetch(0);
+  for (size_t group = 0; group < n; group += kProbeBatchSize) {
+    prefetch(group + kProbeBatchSize);
+    for (size_t i = group; i < std::min(group + kProbeBatchSize, n); i++) {
+      for (size_t slot = hashes[i] >> index_shift_; index_[slot].position >= 0;
+           slot = (slot + 1) & slot_mask) {
+        if (index_[slot].hash == hashes[i] &&
+            encrypted_[index_[slot].position] == elements[i]) {
+          on_match(static_cast<int64_t>(i));
+          break;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Sorts views of the elements and merges them with the sorted values
+ *
+ * @param elements The elements to look up
+ * @param on_match Called with the indices of the elements found
+ */
+template <typename OnMatch>
+void Raw::ForEachMatchSorted(absl::Span<const std::string> elements,
+                             OnMatch on_match) const {
+  // Sorting views of `elements` lets us compute the intersection in
+  // O(nlog(n) + max(n, m)) where `n` and `m` correspond to the number of client
+  // and server elements respectively, without copying the elements.
+  std::vector<std::pair<absl::string_view, int64_t>> vp(elements.size());
 
   // Collect a pair with the index to track the original index after sorting.
   for (size_t i = 0; i < elements.size(); ++i) {
-    vp[i] = make_pair(elements[i], (int64_t)i);
+    vp[i] = std::make_pair(absl::string_view(elements[i]), (int64_t)i);
   }
 
   // Next, we sort the collection. O(nlog(n))
   std::sort(vp.begin(), vp.end());
 
-  std::vector<int64_t> res;
   // Compute intersection. O(max(m, n))
   custom_set_intersection(vp.begin(), vp.end(), encrypted_.begin(),
-                          encrypted_.end(), std::back_inserter(res));
-
-  return res;
+                          encrypted_.end(), on_match);
 }
 
 size_t Raw::size() const { return encrypted_.size(); }
 
-psi_proto::ServerSetup Raw::ToProtobuf() const {
+psi_proto::ServerSetup Raw::ToProtobuf() const& {
   psi_proto::ServerSetup server_setup;
-  *server_setup.mutable_raw()->mutable_encrypted_elements() = {
-      encrypted_.begin(), encrypted_.end()};
+  auto* encrypted_elements =
+      server_setup.mutable_raw()->mutable_encrypted_elements();
+  encrypted_elements->Reserve(static_cast<int>(encrypted_.size()));
+  for (absl::string_view element : encrypted_) {
+    encrypted_elements->Add(std::string(element));
+  }
+
+  return server_setup;
+}
 
+psi_proto::ServerSetup Raw::ToProtobuf() && {
+  if (owned_.empty()) {
+    // A view does not own its values, which are copied.
+    return ToProtobuf();
+  }
+  psi_proto::ServerSetup server_setup;
+  auto* encrypted_elements =
+      server_setup.mutable_raw()->mutable_encrypted_elements();
+  encrypted_elements->Reserve(static_cast<int>(owned_.size()));
+  for (std::string& element : owned_) {
+    *encrypted_elements->Add() = std::move(element);
+  }
+  owned_ = std::vector<std::string>();
+  encrypted_ = std::vector<absl::string_view>();
+  index_ = std::vector<IndexSlot>();
   return server_setup;
 }
 
@@ -17,9 +17,14 @@
 #ifndef PRIVATE_SET_INTERSECTION_CPP_RAW_H_
 #define PRIVATE_SET_INTERSECTION_CPP_RAW_H_
 
+#include <atomic>
+#include <cstdint>
+#include <string>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "private_join_and_compute/crypto/context.h"
 #include "private_set_intersection/proto/psi.pb.h"
@@ -29,30 +34,127 @@ namespace private_set_intersection {
 using absl::StatusOr;
 
 // A Raw datastructure is a simple container for holding raw encrypted values.
+//
+// The values are kept sorted, and each intersection picks its strategy from
+// the number of elements `n` against the number of values `m`. A batch with
+// `n * log2(m) < m`, such as one chunk of a client response, is looked up by
+// binary search. Larger batches are sorted and merged with the values until
+// as many elements have been merged as there are values; from then on the
+// container holds a hash index over its values, built once, and a batch is
+// hashed and probed in O(n) instead. The index is an open-addressing table of
+// the values' `FilterHash64` hashes under a random key of the container, so
+// that the values of a setup cannot be chosen to collide in it.
+//
+// The index is built under a once flag and read-only afterwards, so disjoint
+// chunks of elements can be intersected concurrently from several threads.
 class Raw {
  public:
   Raw() = delete;
 
+  // Creates a container holding `elements`, which are sorted on up to
+  // `num_threads` threads.
   static StatusOr<std::unique_ptr<Raw>> Create(
-      int64_t num_client_inputs, std::vector<std::string> elements);
+      int64_t num_client_inputs, std::vector<std::string> elements,
+      int num_threads = 1);
 
   // Creates a container containing holding encrypted values from a protocol
   // buffer
   static StatusOr<std::unique_ptr<Raw>> CreateFromProtobuf(
       const psi_proto::ServerSetup& encoded_filter);
 
-  // Calculates the intersection
+  // Like `CreateFromProtobuf`, but the container refers to the values of
+  // `encoded_filter` instead of copying them, so `encoded_filter` must outlive
+  // it.
+  static StatusOr<std::unique_ptr<Raw>> CreateViewFromProtobuf(
+      const psi_proto::ServerSetup& encoded_filter);
+
+  Raw(const Raw&) = delete;
+  Raw& operator=(const Raw&) = delete;
+
+  // Returns the indices of all elements that are in the container, in
+  // ascending order when found by binary search or through the index. Every
+  // copy of a repeated element is reported.
   std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
 
+  // Returns the number of elements that are in the container, without
+  // collecting their indices.
+  int64_t CountIntersection(absl::Span<const std::string> elements) const;
+
+  // Returns a bitmap of the elements that are in the container: element `i` is
+  // bit `i % 64` of word `i / 64`.
+  std::vector<uint64_t> IntersectBitmap(
+      absl::Span<const std::string> elements) const;
+
   // Returns the size of the encrypted elements
   size_t size() const;
 
-  // Returns a protobuf representation of the container
-  psi_proto::ServerSetup ToProtobuf() const;
+  // Returns a protobuf representation of the container. The consuming
+  // overload moves the values of a container that owns them into the protobuf
+  // instead of copying them, and leaves the container empty.
+  psi_proto::ServerSetup ToProtobuf() const&;
+  psi_proto::ServerSetup ToProtobuf() &&;
 
  private:
-  Raw(std::vector<std::string> encrypted);
-  const std::vector<std::string> encrypted_;
+  // A slot of the hash index: the hash of a value and its position in
+  // `encrypted_`, or -1 if the slot is empty.
+  struct IndexSlot {
+    uint64_t hash;
+    int64_t position;
+  };
+
+  // Creates a container owning `encrypted`, which is sorted if it is not
+  // already.
+  explicit Raw(std::vector<std::string> encrypted);
+
+  // Creates a container viewing `encrypted`, whose views are sorted if they
+  // are not already.
+  explicit Raw(std::vector<absl::string_view> encrypted);
+
+  // Fills `index_` with every distinct value of `encrypted_`.
+  void BuildIndex() const;
+
+  // Calls `on_match(i)` for the index `i` of every element that is in the
+  // container.
+  template <typename OnMatch>
+  void ForEachMatch(absl::Span<const std::string> elements,
+                    OnMatch on_match) const;
+
+  // `ForEachMatch` by binary search in `encrypted_`.
+  template <typename OnMatch>
+  void ForEachMatchBySearch(absl::Span<const std::string> elements,
+                            OnMatch on_match) const;
+
+  // `ForEachMatch` by probing `index_`.
+  template <typename OnMatch>
+  void ForEachMatchWithIndex(absl::Span<const std::string> elements,
+                             OnMatch on_match) const;
+
+  // `ForEachMatch` by sorting the elements and merging them with
+  // `encrypted_`.
+  template <typename OnMatch>
+  void ForEachMatchSorted(absl::Span<const std::string> elements,
+                          OnMatch on_match) const;
+
+  // The values of a container that owns them; empty for a view.
+  std::vector<std::string> owned_;
+
+  // The values, in `owned_` or in the caller's buffers.
+  std::vector<absl::string_view> encrypted_;
+
+  // The key of the hashes in `index_`, drawn at random for each container.
+  uint64_t index_key_;
+
+  // The number of elements sorted and merged with the values so far. The
+  // index is built once this reaches the number of values.
+  mutable std::atomic<int64_t> merged_elements_{0};
+
+  // Has a power-of-two number of slots, at least twice the number of values,
+  // or none until it is built under `index_once_`. A hash goes to the slot
+  // given by its top bits, `hash >> index_shift_`, or the next free one after
+  // it.
+  mutable absl::once_flag index_once_;
+  mutable std::vector<IndexSlot> index_;
+  mutable int index_shift_ = 64;
 };
 
 }  // namespace private_set_intersection
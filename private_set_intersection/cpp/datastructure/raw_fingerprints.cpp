@@ -0,0 +1,226 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "private_set_intersection/cpp/datastructure/filter_hash.h"
+#include "private_set_intersection/cpp/util/parallel.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+namespace {
+
+// The key of the hash giving the low 64 bits of a fingerprint, from the
+// fractional part of pi like the fixed key of `FilterHash64`.
+constexpr uint64_t kLowKey = 0x452821e638d01377;
+
+// Directory buckets hold two to four fingerprints on average.
+constexpr int kBucketBitsBelowSize = 2;
+
+// Returns the fingerprint of `element` of `num_bytes` bytes, in the top bits.
+absl::uint128 Fingerprint(const std::string& element, int num_bytes) {
+  const uint64_t high = FilterHash64(element);
+  if (num_bytes <= 8) {
+    // Shifting by 64 is undefined, so whole hashes are kept as they are.
+    const int shift = 64 - 8 * num_bytes;
+    return absl::MakeUint128(shift == 0 ? high : high >> shift << shift, 0);
+  }
+  const int shift = 128 - 8 * num_bytes;
+  const uint64_t low = FilterHash64(element, kLowKey);
+  return absl::MakeUint128(high, shift == 0 ? low : low >> shift << shift);
+}
+
+// Appends the top `num_bytes` bytes of `value`, most significant first.
+void AppendBytes(absl::uint128 value, int num_bytes, std::string* bytes) {
+  for (int i = 0; i < num_bytes; i++) {
+    bytes->push_back(static_cast<char>(
+        absl::Uint128High64(value) >> (56 - 8 * (i % 8))));
+    if (i == 7) {
+      value <<= 64;
+    }
+  }
+}
+
+// Reads `num_bytes` bytes, most significant first, into the top bits.
+absl::uint128 ReadBytes(const char* bytes, int num_bytes) {
+  uint64_t high = 0;
+  uint64_t low = 0;
+  for (int i = 0; i < num_bytes; i++) {
+    const auto byte = static_cast<uint64_t>(static_cast<uint8_t>(bytes[i]));
+    if (i < 8) {
+      high |= byte << (56 - 8 * i);
+    } else {
+      low |= byte << (56 - 8 * (i - 8));
+    }
+  }
+  return absl::MakeUint128(high, low);
+}
+
+}  // namespace
+
+RawFingerprints::RawFingerprints(int fingerprint_bytes,
+                                 std::vector<absl::uint128> fingerprints)
+    : fingerprint_bytes_(fingerprint_bytes),
+      fingerprints_(std::move(fingerprints)) {
+  const auto n = static_cast<uint64_t>(fingerprints_.size());
+  bucket_bits_ = std::min(
+      std::max(static_cast<int>(absl::bit_width(n)) - kBucketBitsBelowSize, 0),
+      std::min(8 * fingerprint_bytes_, 32));
+  directory_.assign((uint64_t{1} << bucket_bits_) + 1, n);
+  for (uint64_t i = n; i-- > 0;) {
+    directory_[Bucket(fingerprints_[i])] = i;
+  }
+  // Empty buckets start where the next bucket does.
+  for (uint64_t bucket = directory_.size() - 1; bucket-- > 0;) {
+    directory_[bucket] = std::min(directory_[bucket], directory_[bucket + 1]);
+  }
+}
+
+/**
+ * @brief Hashes the elements in contiguous ranges, one per thread, truncates
+ * the hashes to the fingerprint length and sorts them
+ *
+ * @param fpr The target false-positive rate
+ * @param num_client_inputs The number of client inputs
+ * @param elements The elements to insert
+ * @param num_threads The number of threads to hash and sort the elements on
+ * @return The set
+ */
+StatusOr<std::unique_ptr<RawFingerprints>> RawFingerprints::Create(
+    double fpr, int64_t num_client_inputs,
+    absl::Span<const std::string> elements, int num_threads) {
+  if (fpr <= 0 || fpr >= 1) {
+    return absl::InvalidArgumentError("`fpr` must be in (0,1)");
+  }
+  auto num_server_inputs = static_cast<int64_t>(elements.size());
+  const double num_bits = std::log2(
+      static_cast<double>(std::max<int64_t>(
+          {1, num_client_inputs, num_server_inputs})) /
+      fpr);
+  const int fingerprint_bytes =
+      std::max(1, static_cast<int>(std::ceil(num_bits / 8)));
+  if (fingerprint_bytes > kMaxFingerprintBytes) {
+    return absl::InvalidArgumentError(
+        "`fpr` is too small for the number of inputs");
+  }
+
+  std::vector<absl::uint128> fingerprints(elements.size());
+  // Hashing cannot fail.
+  ParallelFor(num_threads, num_server_inputs,
+              [&](int, int64_t begin, int64_t end) {
+                for (int64_t i = begin; i < end; i++) {
+                  fingerprints[i] =
+                      Fingerprint(elements[i], fingerprint_bytes);
+                }
+                return absl::OkStatus();
+              })
+      .IgnoreError();
+  ParallelSort(fingerprints.begin(), fingerprints.end(), num_threads);
+  fingerprints.erase(std::unique(fingerprints.begin(), fingerprints.end()),
+                     fingerprints.end());
+
+  return absl::WrapUnique(
+      new RawFingerprints(fingerprint_bytes, std::move(fingerprints)));
+}
+
+StatusOr<std::unique_ptr<RawFingerprints>> RawFingerprints::CreateFromProtobuf(
+    const psi_proto::ServerSetup& encoded_set) {
+  if (!encoded_set.IsInitialized()) {
+    return absl::InvalidArgumentError("`ServerSetup` is corrupt!");
+  }
+  const auto& info = encoded_set.raw_fingerprints();
+  const int fingerprint_bytes = info.fingerprint_bytes();
+  if (fingerprint_bytes < 1 || fingerprint_bytes > kMaxFingerprintBytes) {
+    return absl::InvalidArgumentError(
+        "`fingerprint_bytes` must be in [1, 16]");
+  }
+  const std::string& bytes = info.fingerprints();
+  if (bytes.size() % fingerprint_bytes != 0) {
+    return absl::InvalidArgumentError(
+        "`fingerprints` must be a multiple of `fingerprint_bytes` long");
+  }
+
+  std::vector<absl::uint128> fingerprints(bytes.size() / fingerprint_bytes);
+  for (size_t i = 0; i < fingerprints.size(); i++) {
+    fingerprints[i] =
+        ReadBytes(bytes.data() + i * fingerprint_bytes, fingerprint_bytes);
+    if (i > 0 && fingerprints[i] <= fingerprints[i - 1]) {
+      return absl::InvalidArgumentError(
+          "`fingerprints` must be sorted and distinct");
+    }
+  }
+  return absl::WrapUnique(
+      new RawFingerprints(fingerprint_bytes, std::move(fingerprints)));
+}
+
+std::vector<int64_t> RawFingerprints::Intersect(
+    absl::Span<const std::string> elements) const {
+  std::vector<int64_t> res;
+  for (size_t i = 0; i < elements.size(); i++) {
+    if (Contains(Fingerprint(elements[i], fingerprint_bytes_))) {
+      res.push_back(static_cast<int64_t>(i));
+    }
+  }
+  return res;
+}
+
+psi_proto::ServerSetup RawFingerprints::ToProtobuf() const {
+  psi_proto::ServerSetup server_setup;
+  auto* info = server_setup.mutable_raw_fingerprints();
+  info->set_fingerprint_bytes(fingerprint_bytes_);
+  std::string* bytes = info->mutable_fingerprints();
+  bytes->reserve(fingerprints_.size() * fingerprint_bytes_);
+  for (absl::uint128 fingerprint : fingerprints_) {
+    AppendBytes(fingerprint, fingerprint_bytes_, bytes);
+  }
+  return server_setup;
+}
+
+int RawFingerprints::FingerprintBytes() const { return fingerprint_bytes_; }
+
+int64_t RawFingerprints::NumElements() const {
+  return static_cast<int64_t>(fingerprints_.size());
+}
+
+/**
+ * @brief Scans the fingerprints that share the top bits of `fingerprint`,
+ * which are about as many as there are per directory entry
+ */
+bool RawFingerprints::Contains(absl::uint128 fingerprint) const {
+  const uint64_t bucket = Bucket(fingerprint);
+  for (uint64_t i = directory_[bucket]; i < directory_[bucket + 1]; i++) {
+    if (fingerprints_[i] >= fingerprint) {
+      return fingerprints_[i] == fingerprint;
+    }
+  }
+  return false;
+}
+
+uint64_t RawFingerprints::Bucket(absl::uint128 fingerprint) const {
+  if (bucket_bits_ == 0) {
+    return 0;
+  }
+  return absl::Uint128High64(fingerprint) >> (64 - bucket_bits_);
+}
+
+}  // namespace private_set_intersection
@@ -0,0 +1,111 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_RAW_FINGERPRINTS_H_
+#define PRIVATE_SET_INTERSECTION_CPP_RAW_FINGERPRINTS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/numeric/int128.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// The sorted, distinct fingerprints of the server's encrypted elements, each
+// the top `8 * fingerprint_bytes` bits of a 128-bit hash of the element. It
+// stands in for `Raw` with a fraction of the bandwidth: the fingerprints are
+// made just long enough that a client element collides with any of the
+// server's with probability below `fpr`, so they are usually 6 to 10 bytes
+// instead of a 33-byte ciphertext, and there is nothing to decode. Unlike a
+// GCS, the gaps between the fingerprints are not compressed.
+//
+// The client keeps the fingerprints as 128-bit integers, with a directory of
+// where each value of their top bits starts, so that a lookup reads the few
+// fingerprints sharing the top bits of the one looked up.
+//
+// The top 64 bits of the hash are `FilterHash64` of the element and the rest
+// `FilterHash64` under a second key, which is only computed for fingerprints
+// of more than 8 bytes.
+class RawFingerprints {
+ public:
+  RawFingerprints() = delete;
+
+  // Fingerprints are at most 16 bytes long.
+  static constexpr int kMaxFingerprintBytes = 16;
+
+  // Creates the fingerprints of `elements`, with the fewest whole bytes that
+  // keep the probability of a client element matching one of the
+  // `max(num_client_inputs, elements.size())` fingerprints below `fpr`. The
+  // elements are hashed and sorted on up to `num_threads` threads.
+  //
+  // Returns INVALID_ARGUMENT if `fpr` is not in (0,1) or would need
+  // fingerprints of more than 16 bytes.
+  static StatusOr<std::unique_ptr<RawFingerprints>> Create(
+      double fpr, int64_t num_client_inputs,
+      absl::Span<const std::string> elements, int num_threads = 1);
+
+  // Creates the fingerprints from the passed protobuf.
+  //
+  // Returns INVALID_ARGUMENT if the protobuf does not hold sorted, distinct
+  // fingerprints of a valid length.
+  static StatusOr<std::unique_ptr<RawFingerprints>> CreateFromProtobuf(
+      const psi_proto::ServerSetup& encoded_set);
+
+  // Returns the indices of all elements whose fingerprint is in the set. No
+  // state of the set is touched, so disjoint chunks can be intersected
+  // concurrently from several threads.
+  std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
+
+  // Returns a protobuf representation of the fingerprints.
+  psi_proto::ServerSetup ToProtobuf() const;
+
+  int FingerprintBytes() const;
+
+  int64_t NumElements() const;
+
+ private:
+  RawFingerprints(int fingerprint_bytes,
+                  std::vector<absl::uint128> fingerprints);
+
+  // Returns true if `fingerprint` is in the set.
+  bool Contains(absl::uint128 fingerprint) const;
+
+  // Returns the index of the directory entry for `fingerprint`.
+  uint64_t Bucket(absl::uint128 fingerprint) const;
+
+  int fingerprint_bytes_;
+
+  // The fingerprints in ascending order, in the top bits.
+  std::vector<absl::uint128> fingerprints_;
+
+  // The number of top bits the directory is indexed by.
+  int bucket_bits_;
+
+  // The index of the first fingerprint of each bucket, followed by the
+  // number of fingerprints.
+  std::vector<uint64_t> directory_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_RAW_FINGERPRINTS_H_
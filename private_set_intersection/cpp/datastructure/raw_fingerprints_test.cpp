@@ -0,0 +1,182 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
+
+#include <cmath>
+#include <tuple>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+TEST(RawFingerprintsTest, TestIntersect) {
+  std::vector<std::string> elements = {"a", "b", "c", "d"};
+  std::vector<std::string> elements2 = {"a", "b", "d", "e"};
+  PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                           RawFingerprints::Create(0.001, 4, elements));
+  EXPECT_EQ(set->Intersect(elements2), std::vector<int64_t>({0, 1, 2}));
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto empty, RawFingerprints::Create(0.001, 4, {}));
+  EXPECT_TRUE(empty->Intersect(elements2).empty());
+}
+
+TEST(RawFingerprintsTest, TestFingerprintBytes) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  // log2(max(n, m) / fpr) bits, rounded up to whole bytes.
+  for (auto [fpr, num_client_inputs, expected_bytes] :
+       {std::tuple<double, int64_t, int>{0.5, 1, 2},
+        {0.5, 100, 2},
+        {1e-9, 10, 5},
+        {1e-9, 1000000, 7},
+        {1e-6, 10, 4},
+        {1e-30, 10, 14}}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto set, RawFingerprints::Create(fpr, num_client_inputs, elements));
+    EXPECT_EQ(set->FingerprintBytes(), expected_bytes)
+        << "fpr: " << fpr << ", num_client_inputs: " << num_client_inputs;
+    // Short fingerprints of different elements may coincide.
+    EXPECT_LE(set->NumElements(), elements.size());
+    EXPECT_EQ(set->Intersect(elements).size(), elements.size());
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto small, RawFingerprints::Create(0.5, 1, {"a"}));
+  EXPECT_EQ(small->FingerprintBytes(), 1);
+}
+
+TEST(RawFingerprintsTest, TestFPR) {
+  const int num_elements = 100000;
+  std::vector<std::string> elements;
+  std::vector<std::string> others;
+  for (int i = 0; i < num_elements; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+    others.push_back(absl::StrCat("Other ", i));
+  }
+  for (double target_fpr : {0.1, 0.001}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto set, RawFingerprints::Create(target_fpr, num_elements, elements));
+    const double fpr =
+        static_cast<double>(set->Intersect(others).size()) / num_elements;
+    EXPECT_LT(fpr, target_fpr * 1.5);
+  }
+}
+
+TEST(RawFingerprintsTest, TestCreateMultiThreaded) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 100000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  for (double fpr : {1e-6, 1e-20}) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                             RawFingerprints::Create(fpr, 10, elements));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto parallel_set,
+        RawFingerprints::Create(fpr, 10, elements, /*num_threads=*/4));
+    EXPECT_EQ(parallel_set->ToProtobuf().SerializeAsString(),
+              set->ToProtobuf().SerializeAsString());
+  }
+}
+
+TEST(RawFingerprintsTest, TestCreateFromProtobuf) {
+  std::vector<std::string> elements;
+  std::vector<std::string> others;
+  for (int i = 0; i < 10000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+    others.push_back(absl::StrCat("Other ", i));
+  }
+  // Fingerprints of less than, exactly and more than 64 bits.
+  for (double fpr : {1e-6, 1e-15, 1e-20, 1e-30}) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                             RawFingerprints::Create(fpr, 10, elements));
+    const psi_proto::ServerSetup setup = set->ToProtobuf();
+    EXPECT_EQ(setup.raw_fingerprints().fingerprints().size(),
+              elements.size() * set->FingerprintBytes());
+    PSI_ASSERT_OK_AND_ASSIGN(auto decoded,
+                             RawFingerprints::CreateFromProtobuf(setup));
+    EXPECT_EQ(decoded->FingerprintBytes(), set->FingerprintBytes());
+    EXPECT_EQ(decoded->NumElements(), set->NumElements());
+    EXPECT_EQ(decoded->ToProtobuf().SerializeAsString(),
+              setup.SerializeAsString());
+    EXPECT_EQ(decoded->Intersect(elements).size(), elements.size());
+    EXPECT_TRUE(decoded->Intersect(others).empty());
+  }
+}
+
+TEST(RawFingerprintsTest, TestCreateFromInvalidProtobuf) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto set,
+                           RawFingerprints::Create(0.001, 10, elements));
+  const psi_proto::ServerSetup valid = set->ToProtobuf();
+  const int fingerprint_bytes = set->FingerprintBytes();
+
+  psi_proto::ServerSetup setup = valid;
+  setup.mutable_raw_fingerprints()->set_fingerprint_bytes(0);
+  EXPECT_FALSE(RawFingerprints::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_raw_fingerprints()->set_fingerprint_bytes(17);
+  EXPECT_FALSE(RawFingerprints::CreateFromProtobuf(setup).ok());
+
+  setup = valid;
+  setup.mutable_raw_fingerprints()->mutable_fingerprints()->push_back('\0');
+  EXPECT_FALSE(RawFingerprints::CreateFromProtobuf(setup).ok());
+
+  // The last fingerprint repeated, and moved to the front.
+  setup = valid;
+  std::string* bytes = setup.mutable_raw_fingerprints()->mutable_fingerprints();
+  const std::string last = bytes->substr(bytes->size() - fingerprint_bytes);
+  bytes->append(last);
+  EXPECT_FALSE(RawFingerprints::CreateFromProtobuf(setup).ok());
+  setup = valid;
+  bytes = setup.mutable_raw_fingerprints()->mutable_fingerprints();
+  bytes->insert(0, last);
+  bytes->resize(valid.raw_fingerprints().fingerprints().size());
+  EXPECT_FALSE(RawFingerprints::CreateFromProtobuf(setup).ok());
+}
+
+TEST(RawFingerprintsTest, TestMaxFingerprintBytes) {
+  // log2(1024 / 2^-118) is exactly 128 bits, the widest fingerprint.
+  const std::vector<std::string> elements = {"a", "b", "c"};
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto set, RawFingerprints::Create(std::ldexp(1.0, -118), 1024, elements));
+  EXPECT_EQ(set->FingerprintBytes(), 16);
+  const psi_proto::ServerSetup setup = set->ToProtobuf();
+  EXPECT_EQ(setup.raw_fingerprints().fingerprints().size(),
+            16 * elements.size());
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded,
+                           RawFingerprints::CreateFromProtobuf(setup));
+  EXPECT_EQ(decoded->Intersect(elements), std::vector<int64_t>({0, 1, 2}));
+
+  // One more bit, from the fpr or from the client inputs, needs 17 bytes.
+  EXPECT_FALSE(
+      RawFingerprints::Create(std::ldexp(1.0, -119), 1024, elements).ok());
+  EXPECT_FALSE(
+      RawFingerprints::Create(std::ldexp(1.0, -118), 2048, elements).ok());
+  EXPECT_FALSE(RawFingerprints::Create(0, 10, {}).ok());
+  EXPECT_FALSE(RawFingerprints::Create(1, 10, {}).ok());
+}
+
+}  // namespace
+}  // namespace private_set_intersection
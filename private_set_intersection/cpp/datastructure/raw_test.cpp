@@ -16,6 +16,8 @@
 
 #include "private_set_intersection/cpp/datastructure/raw.h"
 
+#include <algorithm>
+
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
 #include "gtest/gtest.h"
@@ -74,6 +76,19 @@ TEST_F(RawTest, TestToProtobuf) {
   EXPECT_EQ(encoded_filter.raw().encrypted_elements()[0], "a");
 }
 
+TEST_F(RawTest, TestCreateMultiThreaded) {
+  std::vector<std::string> server;
+  for (int i = 0; i < 100000; i++) {
+    server.push_back(absl::StrCat("Element ", i * 7919 % 100003));
+  }
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto container, Raw::Create(10, server));
+  PSI_ASSERT_OK_AND_ASSIGN(auto parallel_container,
+                           Raw::Create(10, server, /*num_threads=*/4));
+  EXPECT_EQ(parallel_container->ToProtobuf().SerializeAsString(),
+            container->ToProtobuf().SerializeAsString());
+}
+
 TEST_F(RawTest, TestIntersectionFromProtobuf) {
   std::vector<std::string> server = {"a", "b", "c", "d", "e"};
   std::vector<std::string> client = {"b", "c", "d", "z"};
@@ -89,5 +104,135 @@ TEST_F(RawTest, TestIntersectionFromProtobuf) {
   EXPECT_EQ(results, expected);
 }
 
+TEST_F(RawTest, TestIntersectionFromProtobufView) {
+  std::vector<std::string> server = {"a", "b", "c", "d", "e"};
+  std::vector<std::string> client = {"b", "c", "d", "z"};
+
+  SetUp(static_cast<int64_t>(client.size()), server);
+
+  const psi_proto::ServerSetup setup = container_->ToProtobuf();
+  PSI_ASSERT_OK_AND_ASSIGN(auto view, Raw::CreateViewFromProtobuf(setup));
+  EXPECT_EQ(view->Intersect(absl::MakeSpan(client)),
+            std::vector<int64_t>({0, 1, 2}));
+  EXPECT_EQ(view->size(), server.size());
+  EXPECT_EQ(view->ToProtobuf().SerializeAsString(), setup.SerializeAsString());
+}
+
+TEST_F(RawTest, TestMoveToProtobuf) {
+  SetUp(4, {"b", "a", "c", "d", "e"});
+  const psi_proto::ServerSetup expected = container_->ToProtobuf();
+
+  // A view copies the values it does not own.
+  PSI_ASSERT_OK_AND_ASSIGN(auto view, Raw::CreateViewFromProtobuf(expected));
+  EXPECT_EQ(std::move(*view).ToProtobuf().SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_EQ(expected.raw().encrypted_elements_size(), 5);
+
+  EXPECT_EQ(std::move(*container_).ToProtobuf().SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_EQ(container_->size(), 0);
+  EXPECT_TRUE(container_->Intersect({"a"}).empty());
+}
+
+TEST_F(RawTest, TestStrategiesAgree) {
+  // Duplicates on both sides. Batches of 100 are looked up by binary search,
+  // batches of 5000 are sorted and merged until 20000 elements have been, and
+  // every batch after that goes through the index.
+  std::vector<std::string> server;
+  for (int i = 0; i < 20000; i++) {
+    server.push_back(absl::StrCat("Element ", i * 3 % 10000));
+  }
+  SetUp(10, server);
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded,
+                           Raw::CreateFromProtobuf(container_->ToProtobuf()));
+
+  for (int num_queries :
+       {0, 1, 100, 5000, 5000, 5000, 5000, 5000, 100, 30000}) {
+    std::vector<std::string> client;
+    std::vector<int64_t> expected;
+    for (int i = 0; i < num_queries; i++) {
+      client.push_back(absl::StrCat("Element ", i * 7 % 15000));
+      if (i * 7 % 15000 < 10000) {
+        expected.push_back(i);
+      }
+    }
+    for (const Raw* raw : {container_.get(), decoded.get()}) {
+      std::vector<int64_t> results = raw->Intersect(client);
+      std::sort(results.begin(), results.end());
+      EXPECT_EQ(results, expected) << num_queries;
+    }
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto empty, Raw::CreateFromProtobuf(psi_proto::ServerSetup()));
+  EXPECT_TRUE(empty->Intersect({"a"}).empty());
+}
+
+TEST_F(RawTest, TestUnsortedProtobuf) {
+  // Binary search and merging need sorted values, whatever order a setup
+  // lists them in.
+  psi_proto::ServerSetup setup;
+  for (const char* value : {"d", "b", "a", "c"}) {
+    setup.mutable_raw()->add_encrypted_elements(value);
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto container, Raw::CreateFromProtobuf(setup));
+  PSI_ASSERT_OK_AND_ASSIGN(auto view, Raw::CreateViewFromProtobuf(setup));
+  for (const Raw* raw : {container.get(), view.get()}) {
+    EXPECT_EQ(raw->Intersect({"c"}), std::vector<int64_t>({0}));
+    EXPECT_EQ(raw->Intersect({"z", "a", "d", "e"}),
+              std::vector<int64_t>({1, 2}));
+    EXPECT_EQ(raw->ToProtobuf().raw().encrypted_elements(0), "a");
+  }
+}
+
+TEST_F(RawTest, TestRepeatedClientElements) {
+  std::vector<std::string> server;
+  for (int i = 0; i < 1000; i++) {
+    server.push_back(absl::StrCat("Element ", i));
+  }
+  SetUp(10, server);
+
+  // Every copy of a repeated element is reported, whether the batch is small
+  // enough for binary search or large enough to be sorted and merged.
+  for (int copies : {2, 200}) {
+    std::vector<std::string> client;
+    std::vector<int64_t> expected;
+    for (int i = 0; i < copies; i++) {
+      client.push_back("Element 7");
+      expected.push_back(2 * i);
+      client.push_back("Other");
+    }
+    std::vector<int64_t> results = container_->Intersect(client);
+    std::sort(results.begin(), results.end());
+    EXPECT_EQ(results, expected) << copies;
+  }
+}
+
+TEST_F(RawTest, TestCountAndBitmapMatchIntersect) {
+  std::vector<std::string> server;
+  for (int i = 0; i < 10000; i++) {
+    server.push_back(absl::StrCat("Element ", i * 3));
+  }
+  SetUp(10, server);
+  PSI_ASSERT_OK_AND_ASSIGN(auto decoded,
+                           Raw::CreateFromProtobuf(container_->ToProtobuf()));
+
+  for (int num_queries : {0, 1, 100, 30000}) {
+    std::vector<std::string> client;
+    for (int i = 0; i < num_queries; i++) {
+      client.push_back(absl::StrCat("Element ", i));
+    }
+    for (const Raw* raw : {container_.get(), decoded.get()}) {
+      std::vector<int64_t> expected = raw->Intersect(client);
+      EXPECT_EQ(raw->CountIntersection(client), expected.size());
+
+      std::vector<uint64_t> bitmap((num_queries + 63) / 64);
+      for (int64_t i : expected) {
+        bitmap[i / 64] |= uint64_t{1} << (i % 64);
+      }
+      EXPECT_EQ(raw->IntersectBitmap(client), bitmap) << num_queries;
+    }
+  }
+}
+
 }  // namespace
 }  // namespace private_set_intersection
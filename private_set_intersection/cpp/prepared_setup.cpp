@@ -0,0 +1,255 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/prepared_setup.h"
+
+#include <algorithm>
+#include <utility>
+#include <variant>
+
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_cat.h"
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
+#include "private_set_intersection/cpp/datastructure/gcs.h"
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
+#include "private_set_intersection/cpp/datastructure/raw.h"
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
+
+namespace private_set_intersection {
+
+struct PreparedSetup::Container {
+  std::variant<std::unique_ptr<Raw>, std::unique_ptr<BloomFilter>,
+               std::unique_ptr<BlockedBloomFilter>,
+               std::unique_ptr<BinaryFuseFilter>, std::unique_ptr<EliasFano>,
+               std::unique_ptr<RawFingerprints>>
+      value;
+};
+
+namespace {
+
+// Returns the hashes of a decoded set that are in [0, `hash_range`), sorted
+// and distinct. A well-formed setup only holds such hashes, but the decoded
+// values of a corrupt one can be anything.
+std::vector<int64_t> CleanHashes(std::vector<int64_t> hashes,
+                                 int64_t hash_range) {
+  hashes.erase(std::remove_if(hashes.begin(), hashes.end(),
+                              [hash_range](int64_t hash) {
+                                return hash < 0 || hash >= hash_range;
+                              }),
+               hashes.end());
+  if (!std::is_sorted(hashes.begin(), hashes.end())) {
+    std::sort(hashes.begin(), hashes.end());
+  }
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+  return hashes;
+}
+
+}  // namespace
+
+/**
+ * @brief Builds a directory with at most one entry per hash over the top bits
+ * of the hash range, so that an entry covers one or two hashes on average
+ */
+PreparedSetup::PreparedSetup(
+    psi_proto::ServerSetup::DataStructureCase data_structure,
+    psi_proto::PointEncoding point_encoding,
+    psi_proto::CipherSuite cipher_suite, std::unique_ptr<Container> container,
+    int64_t hash_range, psi_proto::HashVersion hash_version,
+    std::vector<int64_t> hashes)
+    : data_structure_(data_structure),
+      point_encoding_(point_encoding),
+      cipher_suite_(cipher_suite),
+      container_(std::move(container)),
+      hash_range_(hash_range),
+      hash_version_(hash_version),
+      hashes_(std::move(hashes)) {
+  const auto n = static_cast<uint64_t>(hashes_.size());
+  if (n == 0) {
+    return;
+  }
+  const auto max_hash = static_cast<uint64_t>(hash_range - 1);
+  const int bucket_bits = static_cast<int>(absl::bit_width(n)) - 1;
+  directory_shift_ =
+      std::max(static_cast<int>(absl::bit_width(max_hash)) - bucket_bits, 0);
+  directory_.assign((max_hash >> directory_shift_) + 2, n);
+  for (uint64_t i = n; i-- > 0;) {
+    directory_[static_cast<uint64_t>(hashes_[i]) >> directory_shift_] = i;
+  }
+  // Empty entries start where the next entry does.
+  for (uint64_t entry = directory_.size() - 1; entry-- > 0;) {
+    directory_[entry] = std::min(directory_[entry], directory_[entry + 1]);
+  }
+}
+
+PreparedSetup::~PreparedSetup() = default;
+
+/**
+ * @brief Creates the container of the setup. GCS and rANS sets are validated
+ * and decoded into their sorted hashes, and only their hash range and hash
+ * version are kept.
+ *
+ * @param server_setup The server's setup
+ * @return The prepared setup
+ */
+StatusOr<std::unique_ptr<PreparedSetup>> PreparedSetup::Create(
+    const psi_proto::ServerSetup& server_setup) {
+  if (!server_setup.IsInitialized()) {
+    return absl::InvalidArgumentError("`server_setup` is corrupt!");
+  }
+  const psi_proto::PointEncoding point_encoding = server_setup.point_encoding();
+  if (!psi_proto::PointEncoding_IsValid(point_encoding)) {
+    return absl::InvalidArgumentError(
+        "`server_setup` has an unknown point encoding");
+  }
+  const psi_proto::CipherSuite cipher_suite = server_setup.cipher_suite();
+  if (!psi_proto::CipherSuite_IsValid(cipher_suite)) {
+    return absl::InvalidArgumentError(
+        "`server_setup` has an unknown cipher suite");
+  }
+  if (cipher_suite == psi_proto::CIPHER_SUITE_UNSPECIFIED) {
+    return absl::InvalidArgumentError(
+        "`server_setup` has no cipher suite, so it is from an older server");
+  }
+
+  const auto data_structure = server_setup.data_structure_case();
+  // Wraps a container that is queried as it is.
+  auto wrap = [data_structure, point_encoding, cipher_suite](auto container)
+      -> StatusOr<std::unique_ptr<PreparedSetup>> {
+    if (!container.ok()) {
+      return container.status();
+    }
+    return absl::WrapUnique(new PreparedSetup(
+        data_structure, point_encoding, cipher_suite,
+        absl::WrapUnique(new Container{std::move(*container)}), 0,
+        psi_proto::HASH_VERSION_FAST64, std::vector<int64_t>()));
+  };
+  // Keeps the decoded hashes of a set, which are all that is left of it.
+  auto decoded = [data_structure, point_encoding, cipher_suite](
+                     int64_t hash_range, psi_proto::HashVersion hash_version,
+                     std::vector<int64_t> hashes) {
+    return absl::WrapUnique(new PreparedSetup(
+        data_structure, point_encoding, cipher_suite, nullptr, hash_range,
+        hash_version, CleanHashes(std::move(hashes), hash_range)));
+  };
+
+  switch (data_structure) {
+    case psi_proto::ServerSetup::DataStructureCase::kRaw:
+      return wrap(Raw::CreateFromProtobuf(server_setup));
+    case psi_proto::ServerSetup::DataStructureCase::kGcs: {
+      // The bits are decoded in place, since they are not kept.
+      auto gcs = GCS::CreateViewFromProtobuf(server_setup);
+      if (!gcs.ok()) {
+        return gcs.status();
+      }
+      const int64_t hash_range = (*gcs)->HashRange();
+      if (hash_range <= 0) {
+        return absl::InvalidArgumentError("`hash_range` must be positive");
+      }
+      if ((*gcs)->Div() < 0 || (*gcs)->Div() > MAX_GOLOMB_DIV) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("`div` must be in [0, ", MAX_GOLOMB_DIV, "]"));
+      }
+      return decoded(hash_range, (*gcs)->Version(), (*gcs)->DecodeHashes());
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kBloomFilter:
+      return wrap(BloomFilter::CreateFromProtobuf(server_setup));
+    case psi_proto::ServerSetup::DataStructureCase::kBlockedBloomFilter:
+      return wrap(BlockedBloomFilter::CreateFromProtobuf(server_setup));
+    case psi_proto::ServerSetup::DataStructureCase::kBinaryFuseFilter:
+      return wrap(BinaryFuseFilter::CreateFromProtobuf(server_setup));
+    case psi_proto::ServerSetup::DataStructureCase::kEliasFano:
+      return wrap(EliasFano::CreateFromProtobuf(server_setup));
+    case psi_proto::ServerSetup::DataStructureCase::kRansSet: {
+      // Rejects sets that do not decode to `num_elements` hashes, which are
+      // then at most one per bit of the setup.
+      auto set = RansSet::CreateFromProtobuf(server_setup);
+      if (!set.ok()) {
+        return set.status();
+      }
+      // rANS sets hash elements like a GCS of `HASH_VERSION_FAST64`.
+      return decoded((*set)->HashRange(), psi_proto::HASH_VERSION_FAST64,
+                     (*set)->DecodeHashes());
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kRawFingerprints:
+      return wrap(RawFingerprints::CreateFromProtobuf(server_setup));
+    default:
+      return absl::InvalidArgumentError("Impossible");
+  }
+}
+
+/**
+ * @brief Intersects the elements with the container, or, for GCS and rANS
+ * sets, hashes them into the set's range and looks the hashes up
+ *
+ * @param elements The elements to look up
+ * @return The indices of the elements found, in ascending order
+ */
+std::vector<int64_t> PreparedSetup::Intersect(
+    absl::Span<const std::string> elements) const {
+  if (container_ == nullptr) {
+    const std::vector<int64_t> hashes =
+        GCS::Hash(elements, hash_range_, hash_version_);
+    std::vector<int64_t> res;
+    for (size_t i = 0; i < hashes.size(); i++) {
+      if (ContainsHash(hashes[i])) {
+        res.push_back(static_cast<int64_t>(i));
+      }
+    }
+    return res;
+  }
+  return std::visit(
+      [&](const auto& container) { return container->Intersect(elements); },
+      container_->value);
+}
+
+psi_proto::ServerSetup::DataStructureCase PreparedSetup::DataStructure()
+    const {
+  return data_structure_;
+}
+
+psi_proto::PointEncoding PreparedSetup::PointEncoding() const {
+  return point_encoding_;
+}
+
+psi_proto::CipherSuite PreparedSetup::CipherSuite() const {
+  return cipher_suite_;
+}
+
+/**
+ * @brief Scans the hashes of the directory entry of `hash`, which are one or
+ * two on average
+ */
+bool PreparedSetup::ContainsHash(int64_t hash) const {
+  if (hash < 0 || directory_.empty()) {
+    return false;
+  }
+  const uint64_t entry = static_cast<uint64_t>(hash) >> directory_shift_;
+  if (entry + 1 >= directory_.size()) {
+    return false;
+  }
+  for (uint64_t i = directory_[entry]; i < directory_[entry + 1]; i++) {
+    if (hashes_[i] >= hash) {
+      return hashes_[i] == hash;
+    }
+  }
+  return false;
+}
+
+}  // namespace private_set_intersection
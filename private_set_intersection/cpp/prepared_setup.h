@@ -0,0 +1,117 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PRIVATE_SET_INTERSECTION_CPP_PREPARED_SETUP_H_
+#define PRIVATE_SET_INTERSECTION_CPP_PREPARED_SETUP_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+
+using absl::StatusOr;
+
+// A server setup decoded once into a layout that is fast to query, for a
+// client that intersects many responses against the same setup.
+//
+// Raw setups, Bloom filters and the other filters are copied as they are; a
+// Raw container indexes its values by hash once enough elements have been
+// intersected with it. The entropy-coded sets, GCS and rANS, are
+// decoded in full into a sorted array of their hashes with a directory on the
+// top bits, so a lookup reads a handful of neighbouring hashes instead of
+// decoding part of the stream; this takes 8 bytes per server element, and the
+// encoded sets are not kept.
+//
+// A prepared setup does not refer to the `ServerSetup` it was created from
+// and is never modified, so it can be shared by any number of threads and
+// clients.
+class PreparedSetup {
+ public:
+  PreparedSetup() = delete;
+
+  // Decodes `server_setup`.
+  //
+  // Returns INVALID_ARGUMENT if `server_setup` is malformed, holds no data
+  // structure or has an unknown point encoding or cipher suite.
+  static StatusOr<std::unique_ptr<PreparedSetup>> Create(
+      const psi_proto::ServerSetup& server_setup);
+
+  PreparedSetup(const PreparedSetup&) = delete;
+  PreparedSetup& operator=(const PreparedSetup&) = delete;
+
+  ~PreparedSetup();
+
+  // Returns the indices of all elements that are in the server's set, up to
+  // the false-positive rate of the setup.
+  std::vector<int64_t> Intersect(absl::Span<const std::string> elements) const;
+
+  // Returns the data structure the setup was created from.
+  psi_proto::ServerSetup::DataStructureCase DataStructure() const;
+
+  // Returns the encoding of the encrypted elements of the setup.
+  psi_proto::PointEncoding PointEncoding() const;
+
+  // Returns the cipher suite the elements of the setup were encrypted with.
+  psi_proto::CipherSuite CipherSuite() const;
+
+ private:
+  // Holds the container of one of the data structures. It is only defined in
+  // the implementation, since the names of the data structures' classes are
+  // hidden by those of the `DataStructure` enum wherever both are visible.
+  struct Container;
+
+  PreparedSetup(psi_proto::ServerSetup::DataStructureCase data_structure,
+                psi_proto::PointEncoding point_encoding,
+                psi_proto::CipherSuite cipher_suite,
+                std::unique_ptr<Container> container, int64_t hash_range,
+                psi_proto::HashVersion hash_version,
+                std::vector<int64_t> hashes);
+
+  // Returns true if `hash` is one of `hashes_`.
+  bool ContainsHash(int64_t hash) const;
+
+  psi_proto::ServerSetup::DataStructureCase data_structure_;
+  psi_proto::PointEncoding point_encoding_;
+  psi_proto::CipherSuite cipher_suite_;
+
+  // The container of the setup, or null for a GCS or rANS set, whose
+  // elements are looked up in `hashes_` instead.
+  std::unique_ptr<Container> container_;
+
+  // How the client's elements are hashed into the range of a GCS or rANS set.
+  int64_t hash_range_;
+  psi_proto::HashVersion hash_version_;
+
+  // The decoded hashes of a GCS or rANS set, in ascending order.
+  std::vector<int64_t> hashes_;
+
+  // The number of low bits of a hash below its directory entry.
+  int directory_shift_ = 0;
+
+  // The index of the first hash of each directory entry, followed by the
+  // number of hashes.
+  std::vector<uint64_t> directory_;
+};
+
+}  // namespace private_set_intersection
+
+#endif  // PRIVATE_SET_INTERSECTION_CPP_PREPARED_SETUP_H_
@@ -0,0 +1,170 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/prepared_setup.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
+#include "private_set_intersection/cpp/datastructure/gcs.h"
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
+#include "private_set_intersection/cpp/datastructure/raw.h"
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
+#include "private_set_intersection/cpp/util/status_matchers.h"
+#include "private_set_intersection/proto/psi.pb.h"
+
+namespace private_set_intersection {
+namespace {
+
+// Returns one setup of every data structure holding `elements`.
+std::vector<psi_proto::ServerSetup> MakeSetups(
+    double fpr, int64_t num_client_inputs,
+    const std::vector<std::string>& elements) {
+  std::vector<psi_proto::ServerSetup> setups;
+  setups.push_back(
+      Raw::Create(num_client_inputs, elements).value()->ToProtobuf());
+  setups.push_back(
+      GCS::Create(fpr, num_client_inputs, elements).value()->ToProtobuf());
+  setups.push_back(BloomFilter::Create(fpr, num_client_inputs, elements)
+                       .value()
+                       ->ToProtobuf());
+  setups.push_back(BlockedBloomFilter::Create(fpr, num_client_inputs, elements)
+                       .value()
+                       ->ToProtobuf());
+  setups.push_back(BinaryFuseFilter::Create(fpr, num_client_inputs, elements)
+                       .value()
+                       ->ToProtobuf());
+  setups.push_back(EliasFano::Create(fpr, num_client_inputs, elements)
+                       .value()
+                       ->ToProtobuf());
+  setups.push_back(
+      RansSet::Create(fpr, num_client_inputs, elements).value()->ToProtobuf());
+  setups.push_back(RawFingerprints::Create(fpr, num_client_inputs, elements)
+                       .value()
+                       ->ToProtobuf());
+  for (auto& setup : setups) {
+    setup.set_cipher_suite(psi_proto::CIPHER_SUITE_SM2_SM3);
+  }
+  return setups;
+}
+
+TEST(PreparedSetupTest, TestIntersect) {
+  // The first half of the queries are in the set.
+  std::vector<std::string> elements;
+  std::vector<std::string> queries;
+  for (int i = 0; i < 20000; i++) {
+    queries.push_back(absl::StrCat("Element ", i));
+  }
+  elements.assign(queries.begin(), queries.begin() + 10000);
+  for (int i = 0; i < 10000; i++) {
+    queries.push_back(absl::StrCat("Other ", i));
+  }
+  std::vector<int64_t> expected(10000);
+  for (int64_t i = 0; i < 10000; i++) {
+    expected[i] = i;
+  }
+
+  for (const psi_proto::ServerSetup& setup :
+       MakeSetups(1e-9, static_cast<int64_t>(queries.size()), elements)) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto prepared, PreparedSetup::Create(setup));
+    EXPECT_EQ(prepared->DataStructure(), setup.data_structure_case());
+    std::vector<int64_t> res = prepared->Intersect(queries);
+    std::sort(res.begin(), res.end());
+    EXPECT_EQ(res, expected) << setup.data_structure_case();
+
+    // Chunks of the queries find the same elements.
+    std::vector<int64_t> chunked;
+    for (size_t offset = 0; offset < queries.size(); offset += 1000) {
+      for (int64_t i : prepared->Intersect(
+               absl::MakeConstSpan(queries).subspan(offset, 1000))) {
+        chunked.push_back(static_cast<int64_t>(offset) + i);
+      }
+    }
+    std::sort(chunked.begin(), chunked.end());
+    EXPECT_EQ(chunked, expected) << setup.data_structure_case();
+  }
+}
+
+TEST(PreparedSetupTest, TestEmpty) {
+  for (const psi_proto::ServerSetup& setup : MakeSetups(0.001, 10, {})) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto prepared, PreparedSetup::Create(setup));
+    EXPECT_TRUE(prepared->Intersect({"a", "b"}).empty())
+        << setup.data_structure_case();
+  }
+}
+
+TEST(PreparedSetupTest, TestIndependentOfProtobuf) {
+  std::vector<std::string> elements;
+  for (int i = 0; i < 1000; i++) {
+    elements.push_back(absl::StrCat("Element ", i));
+  }
+  for (psi_proto::ServerSetup setup : MakeSetups(0.001, 1000, elements)) {
+    PSI_ASSERT_OK_AND_ASSIGN(auto prepared, PreparedSetup::Create(setup));
+    setup.Clear();
+    EXPECT_EQ(prepared->Intersect(elements).size(), elements.size());
+  }
+}
+
+TEST(PreparedSetupTest, TestInvalidSetup) {
+  EXPECT_EQ(PreparedSetup::Create(psi_proto::ServerSetup()).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  psi_proto::ServerSetup setup;
+  setup.mutable_raw_fingerprints()->set_fingerprint_bytes(0);
+  EXPECT_EQ(PreparedSetup::Create(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Sets that are decoded while preparing are validated first.
+  setup = GCS::Create(0.001, 10, {"a"}).value()->ToProtobuf();
+  setup.mutable_gcs()->set_div(64);
+  EXPECT_EQ(PreparedSetup::Create(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  setup.mutable_gcs()->set_div(0);
+  setup.mutable_gcs()->set_hash_range(0);
+  EXPECT_EQ(PreparedSetup::Create(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  setup = RansSet::Create(0.001, 10, {}).value()->ToProtobuf();
+  setup.mutable_rans_set()->set_frequencies(0, 5000);
+  EXPECT_EQ(PreparedSetup::Create(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // A set claiming far more elements than its words hold is not decoded.
+  setup = RansSet::Create(0.001, 10, {"a"}).value()->ToProtobuf();
+  setup.mutable_rans_set()->set_hash_range(int64_t{1} << 40);
+  setup.mutable_rans_set()->set_num_elements(50000000);
+  EXPECT_EQ(PreparedSetup::Create(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(PreparedSetupTest, TestCipherSuite) {
+  psi_proto::ServerSetup setup = MakeSetups(0.001, 10, {})[0];
+  setup.set_cipher_suite(psi_proto::CIPHER_SUITE_P256_SHA256);
+  PSI_ASSERT_OK_AND_ASSIGN(auto prepared, PreparedSetup::Create(setup));
+  EXPECT_EQ(prepared->CipherSuite(), psi_proto::CIPHER_SUITE_P256_SHA256);
+
+  setup.set_cipher_suite(static_cast<psi_proto::CipherSuite>(7));
+  EXPECT_EQ(PreparedSetup::Create(setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace private_set_intersection
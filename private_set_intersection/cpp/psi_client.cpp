@@ -16,103 +16,215 @@
 
 #include "private_set_intersection/cpp/psi_client.h"
 
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
-#include "openssl/obj_mac.h"
+#include "private_join_and_compute/util/status_macros.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
+#include "private_set_intersection/cpp/crypto/cipher_suite.h"
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
 #include "private_set_intersection/cpp/datastructure/bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
 #include "private_set_intersection/cpp/datastructure/gcs.h"
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
 #include "private_set_intersection/cpp/datastructure/raw.h"
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
+#include "private_set_intersection/cpp/util/parallel.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
 
+namespace {
+
+// Number of response elements a worker decrypts before handing them to the
+// container. This bounds the decrypted data held in memory per thread.
+constexpr int64_t kDecryptChunkSize = 1024;
+
+// Returns INVALID_ARGUMENT unless the response is in `setup_encoding`, the
+// point encoding of the setup it is intersected with.
+absl::Status CheckPointEncoding(psi_proto::PointEncoding setup_encoding,
+                                const psi_proto::Response& server_response) {
+  if (!psi_proto::PointEncoding_IsValid(server_response.point_encoding())) {
+    return absl::InvalidArgumentError(
+        "`server_response` has an unknown point encoding");
+  }
+  if (server_response.point_encoding() != setup_encoding) {
+    return absl::InvalidArgumentError(
+        "`server_setup` and `server_response` use different point encodings");
+  }
+  return absl::OkStatus();
+}
+
+// Returns INVALID_ARGUMENT unless `setup_suite`, the cipher suite of a setup,
+// is `cipher_suite`, that of the client.
+absl::Status CheckCipherSuite(psi_proto::CipherSuite setup_suite,
+                              psi_proto::CipherSuite cipher_suite) {
+  if (!psi_proto::CipherSuite_IsValid(setup_suite)) {
+    return absl::InvalidArgumentError(
+        "`server_setup` has an unknown cipher suite");
+  }
+  if (setup_suite == psi_proto::CIPHER_SUITE_UNSPECIFIED) {
+    return absl::InvalidArgumentError(
+        "`server_setup` has no cipher suite, so it is from an older server");
+  }
+  if (setup_suite != cipher_suite) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "`server_setup` uses cipher suite ",
+        psi_proto::CipherSuite_Name(setup_suite), ", but the client uses ",
+        psi_proto::CipherSuite_Name(cipher_suite)));
+  }
+  return absl::OkStatus();
+}
+
+// Decrypts `encrypted[begin, end)`, which is in `encoding`, with `cipher` in
+// batches of at most `kDecryptChunkSize` elements and calls
+// `consume(offset, chunk)` for each, where `offset` is the index of the
+// chunk's first element in `encrypted`.
+absl::Status DecryptInChunks(
+    const BatchCipher& cipher, EcPointEncoding encoding,
+    const google::protobuf::RepeatedPtrField<std::string>& encrypted,
+    int64_t begin, int64_t end,
+    const std::function<void(int64_t, absl::Span<const std::string>)>&
+        consume) {
+  std::vector<std::string> chunk;
+  for (int64_t offset = begin; offset < end; offset += kDecryptChunkSize) {
+    const int64_t chunk_end = std::min(offset + kDecryptChunkSize, end);
+    chunk.assign(encrypted.begin() + offset, encrypted.begin() + chunk_end);
+    ASSIGN_OR_RETURN(std::vector<std::string> decrypted,
+                     cipher.DecryptBatch(chunk, encoding));
+    consume(offset, absl::MakeConstSpan(decrypted));
+  }
+  return absl::OkStatus();
+}
+
+// Unpacks the first `size` bits of `bitmap`, bit `i % 64` of word `i / 64`
+// being element `i`.
+std::vector<bool> ToBitVector(const std::vector<uint64_t>& bitmap,
+                              int64_t size) {
+  std::vector<bool> bits(size);
+  for (int64_t i = 0; i < size; i++) {
+    bits[i] = (bitmap[i / 64] >> (i % 64)) & 1;
+  }
+  return bits;
+}
+
+}  // namespace
+
 /**
  * @brief Construct a new Psi Client:: Psi Client object
  *
- * @param ec_cipher A unique pointer to a commutative , which is used for
- * encryption and decryption in the Private Set Intersection (PSI) protocol.
+ * @param cipher The batch cipher used for encryption and decryption in the
+ * Private Set Intersection (PSI) protocol, shared by all worker threads.
+ * @param cipher_suite The curve and hash of `cipher`
  * @param reveal_intersection A boolean value indicating whether the
  * intersection of the two sets should be revealed after the PSI protocol is
  * completed.
+ * @param num_threads The number of worker threads
  */
-PsiClient::PsiClient(
-    std::unique_ptr<::private_join_and_compute::ECCommutativeCipher> ec_cipher,
-    bool reveal_intersection)
-    : ec_cipher_(std::move(ec_cipher)),
+PsiClient::PsiClient(std::unique_ptr<BatchCipher> cipher,
+                     psi_proto::CipherSuite cipher_suite,
+                     bool reveal_intersection, int num_threads)
+    : cipher_(std::move(cipher)),
+      cipher_suite_(cipher_suite),
+      num_threads_(num_threads),
       reveal_intersection(reveal_intersection) {}
 
 /**
  * @brief Creates a new instance of the PsiClient class with a new key pair for
- * encryption and decryption using ECCommutativeCipher.
+ * encryption and decryption using the chosen cipher suite.
  *
  * @param reveal_intersection A boolean indicating whether the client wants to
  * learn the intersection values or only its size (cardinality).
+ * @param num_threads The number of worker threads (non-positive for one per
+ * core).
+ * @param cipher_suite The curve and hash to encrypt elements with
  * @return StatusOr<std::unique_ptr<PsiClient>>
  */
 StatusOr<std::unique_ptr<PsiClient>> PsiClient::CreateWithNewKey(
-    bool reveal_intersection) {
-  // Create an EC cipher with curve P-256. This gives 128 bits of security.
-  ASSIGN_OR_RETURN(
-      auto ec_cipher,
-      ::private_join_and_compute::ECCommutativeCipher::CreateWithNewKey(
-          /*NID_X9_62_prime256v1*/NID_sm2,
-          ::private_join_and_compute::ECCommutativeCipher::HashType::SM3/*SHA256*/));
-
-  // Create a new instance of the PsiClient class using the ECCommutativeCipher
-  // object and the reveal_intersection boolean.
-  return absl::WrapUnique(
-      new PsiClient(std::move(ec_cipher), reveal_intersection));
+    bool reveal_intersection, int num_threads,
+    psi_proto::CipherSuite cipher_suite) {
+  ASSIGN_OR_RETURN(auto cipher, CreateBatchCipherWithNewKey(cipher_suite));
+  return absl::WrapUnique(new PsiClient(std::move(cipher), cipher_suite,
+                                        reveal_intersection,
+                                        ResolveNumThreads(num_threads)));
 }
 
 /**
- * @brief Creates a new PsiClient instance using an EC cipher created from the
- * provided key.
+ * @brief Creates a new PsiClient instance using a cipher of the chosen suite
+ * created from the provided key.
  *
  * @param key_bytes The bytes representing the key for the EC cipher.
  * @param reveal_intersection A boolean flag indicating whether the intersection
  * should be revealed.
+ * @param num_threads The number of worker threads (non-positive for one per
+ * core).
+ * @param cipher_suite The curve and hash to encrypt elements with
  * @return StatusOr<std::unique_ptr<PsiClient>>
  */
 StatusOr<std::unique_ptr<PsiClient>> PsiClient::CreateFromKey(
-    const std::string& key_bytes, bool reveal_intersection) {
-  // Create an EC cipher with curve P-256. This gives 128 bits of security.
-  ASSIGN_OR_RETURN(
-      auto ec_cipher,
-      ::private_join_and_compute::ECCommutativeCipher::CreateFromKey(
-          /*NID_X9_62_prime256v1*/NID_sm2, key_bytes,
-          ::private_join_and_compute::ECCommutativeCipher::HashType::SM3/*SHA256*/));
-  return absl::WrapUnique(
-      new PsiClient(std::move(ec_cipher), reveal_intersection));
+    const std::string& key_bytes, bool reveal_intersection, int num_threads,
+    psi_proto::CipherSuite cipher_suite) {
+  ASSIGN_OR_RETURN(auto cipher,
+                   CreateBatchCipherFromKey(cipher_suite, key_bytes));
+  return absl::WrapUnique(new PsiClient(std::move(cipher), cipher_suite,
+                                        reveal_intersection,
+                                        ResolveNumThreads(num_threads)));
 }
 
 /**
  * @brief Creates a request protobuf with encrypted inputs and a reveal flag.
  *
  * @param inputs The inputs to encrypt and add to the request protobuf.
+ * @param point_encoding How to encode the encrypted inputs.
  *
  * @return StatusOr<psi_proto::Request>
  */
 StatusOr<psi_proto::Request> PsiClient::CreateRequest(
-    absl::Span<const std::string> inputs) const {
-  // Encrypt inputs one by one.
-  int64_t input_size = static_cast<int64_t>(inputs.size());
-  std::vector<std::string> encrypted_inputs(input_size);
-  for (int64_t i = 0; i < input_size; i++) {
-    ASSIGN_OR_RETURN(encrypted_inputs[i], ec_cipher_->Encrypt(inputs[i]));
+    absl::Span<const std::string> inputs,
+    psi_proto::PointEncoding point_encoding) const {
+  if (!psi_proto::PointEncoding_IsValid(point_encoding)) {
+    return absl::InvalidArgumentError("Unknown `point_encoding`");
   }
+  const EcPointEncoding encoding = CipherEncoding(point_encoding);
 
   // Create a request protobuf
   psi_proto::Request request;
 
-  // Set the reveal flag
+  // Set the reveal flag, the encoding and the cipher suite
   request.set_reveal_intersection(reveal_intersection);
+  request.set_point_encoding(point_encoding);
+  request.set_cipher_suite(cipher_suite_);
 
-  // Add the encrypted elements
+  // Encrypt the inputs into their slots of the request, one batch per worker
+  // thread.
+  int64_t input_size = static_cast<int64_t>(inputs.size());
+  auto& encrypted_elements = *request.mutable_encrypted_elements();
+  encrypted_elements.Reserve(static_cast<int>(input_size));
   for (int64_t i = 0; i < input_size; i++) {
-    request.add_encrypted_elements(encrypted_inputs[i]);
+    encrypted_elements.Add();
+  }
+  absl::Status status = ParallelFor(
+      num_threads_, input_size,
+      [&](int, int64_t begin, int64_t end) -> absl::Status {
+        ASSIGN_OR_RETURN(
+            std::vector<std::string> batch,
+            cipher_->EncryptBatch(inputs.subspan(begin, end - begin),
+                                  encoding));
+        for (int64_t i = begin; i < end; i++) {
+          *encrypted_elements.Mutable(static_cast<int>(i)) =
+              std::move(batch[i - begin]);
+        }
+        return absl::OkStatus();
+      });
+  if (!status.ok()) {
+    return status;
   }
 
   return request;
@@ -134,10 +246,11 @@ StatusOr<std::vector<int64_t>> PsiClient::GetIntersection(
         "GetIntersection called on PsiClient with reveal_intersection == "
         "false");
   }
-  ASSIGN_OR_RETURN(std::vector<int64_t> intersection,
-                   ProcessResponse(server_setup, server_response));
-  intersection.shrink_to_fit();
-  return intersection;
+  ASSIGN_OR_RETURN(
+      Matches matches,
+      ProcessResponse(server_setup, server_response, ResultMode::kIndices));
+  matches.indices.shrink_to_fit();
+  return std::move(matches.indices);
 }
 
 /**
@@ -151,22 +264,168 @@ StatusOr<std::vector<int64_t>> PsiClient::GetIntersection(
 StatusOr<int64_t> PsiClient::GetIntersectionSize(
     const psi_proto::ServerSetup& server_setup,
     const psi_proto::Response& server_response) const {
-  ASSIGN_OR_RETURN(std::vector<int64_t> intersection,
-                   ProcessResponse(server_setup, server_response));
-  return static_cast<int64_t>(intersection.size());
+  ASSIGN_OR_RETURN(
+      Matches matches,
+      ProcessResponse(server_setup, server_response, ResultMode::kCount));
+  return matches.count;
 }
 
 /**
- * @brief Process the server's response to obtain the intersection
+ * @brief Compute the intersection as a bitmap over the client's elements
  *
  * @param server_setup The original server's setup
  * @param server_response The previous server's response
  *
- * @return StatusOr<std::vector<int64_t>>
+ * @return StatusOr<std::vector<bool>>
  */
-StatusOr<std::vector<int64_t>> PsiClient::ProcessResponse(
+StatusOr<std::vector<bool>> PsiClient::GetIntersectionBitmap(
     const psi_proto::ServerSetup& server_setup,
     const psi_proto::Response& server_response) const {
+  if (!reveal_intersection) {
+    return absl::InvalidArgumentError(
+        "GetIntersectionBitmap called on PsiClient with reveal_intersection "
+        "== false");
+  }
+  ASSIGN_OR_RETURN(
+      Matches matches,
+      ProcessResponse(server_setup, server_response, ResultMode::kBitmap));
+  return ToBitVector(matches.bitmap, server_response.encrypted_elements_size());
+}
+
+/**
+ * @brief Compute the intersection against a prepared setup
+ *
+ * @param prepared_setup The decoded server's setup
+ * @param server_response The previous server's response
+ *
+ * @return StatusOr<std::vector<int64_t>>
+ */
+StatusOr<std::vector<int64_t>> PsiClient::GetIntersection(
+    const PreparedSetup& prepared_setup,
+    const psi_proto::Response& server_response) const {
+  if (!reveal_intersection) {
+    return absl::InvalidArgumentError(
+        "GetIntersection called on PsiClient with reveal_intersection == "
+        "false");
+  }
+  ASSIGN_OR_RETURN(
+      Matches matches,
+      ProcessResponse(prepared_setup, server_response, ResultMode::kIndices));
+  matches.indices.shrink_to_fit();
+  return std::move(matches.indices);
+}
+
+/**
+ * @brief Compute the intersection (cardinality) against a prepared setup
+ *
+ * @param prepared_setup The decoded server's setup
+ * @param server_response The previous server's response
+ *
+ * @return StatusOr<int64_t>
+ */
+StatusOr<int64_t> PsiClient::GetIntersectionSize(
+    const PreparedSetup& prepared_setup,
+    const psi_proto::Response& server_response) const {
+  ASSIGN_OR_RETURN(
+      Matches matches,
+      ProcessResponse(prepared_setup, server_response, ResultMode::kCount));
+  return matches.count;
+}
+
+/**
+ * @brief Compute the intersection as a bitmap against a prepared setup
+ *
+ * @param prepared_setup The decoded server's setup
+ * @param server_response The previous server's response
+ *
+ * @return StatusOr<std::vector<bool>>
+ */
+StatusOr<std::vector<bool>> PsiClient::GetIntersectionBitmap(
+    const PreparedSetup& prepared_setup,
+    const psi_proto::Response& server_response) const {
+  if (!reveal_intersection) {
+    return absl::InvalidArgumentError(
+        "GetIntersectionBitmap called on PsiClient with reveal_intersection "
+        "== false");
+  }
+  ASSIGN_OR_RETURN(
+      Matches matches,
+      ProcessResponse(prepared_setup, server_response, ResultMode::kBitmap));
+  return ToBitVector(matches.bitmap, server_response.encrypted_elements_size());
+}
+
+/**
+ * @brief Adds the matches of a chunk of the decrypted response to the result
+ * of a worker thread. Raw and Bloom filter containers count or set bits
+ * directly, the others go through the indices of the chunk's matches.
+ *
+ * @param container The container to look the chunk up in
+ * @param mode What to collect about the matches
+ * @param offset The index of the chunk's first element in the response,
+ * which is a multiple of 64
+ * @param chunk The decrypted elements
+ * @param thread_matches The indices or count of the thread
+ * @param bitmap The bitmap of the whole response
+ */
+template <typename Container>
+void PsiClient::CollectMatches(const Container& container, ResultMode mode,
+                               int64_t offset,
+                               absl::Span<const std::string> chunk,
+                               Matches* thread_matches,
+                               std::vector<uint64_t>* bitmap) {
+  if constexpr (std::is_same_v<Container, Raw> ||
+                std::is_same_v<Container, BloomFilter>) {
+    if (mode == ResultMode::kCount) {
+      thread_matches->count += container.CountIntersection(chunk);
+      return;
+    }
+    if (mode == ResultMode::kBitmap) {
+      // The words of the chunk belong to this thread alone.
+      const std::vector<uint64_t> words = container.IntersectBitmap(chunk);
+      std::copy(words.begin(), words.end(), bitmap->begin() + offset / 64);
+      return;
+    }
+  }
+  for (int64_t i : container.Intersect(chunk)) {
+    AddMatch(mode, offset + i, thread_matches, bitmap);
+  }
+}
+
+/**
+ * @brief Adds one matching element to a result
+ *
+ * @param mode What to collect about the matches
+ * @param index The index of the element in the response
+ * @param matches The indices or count
+ * @param bitmap The bitmap of the whole response
+ */
+void PsiClient::AddMatch(ResultMode mode, int64_t index, Matches* matches,
+                         std::vector<uint64_t>* bitmap) {
+  switch (mode) {
+    case ResultMode::kIndices:
+      matches->indices.push_back(index);
+      break;
+    case ResultMode::kCount:
+      matches->count++;
+      break;
+    case ResultMode::kBitmap:
+      (*bitmap)[index / 64] |= uint64_t{1} << (index % 64);
+      break;
+  }
+}
+
+/**
+ * @brief Process the server's response to obtain the intersection
+ *
+ * @param server_setup The original server's setup
+ * @param server_response The previous server's response
+ * @param mode What to collect about the matches
+ *
+ * @return StatusOr<Matches>
+ */
+StatusOr<PsiClient::Matches> PsiClient::ProcessResponse(
+    const psi_proto::ServerSetup& server_setup,
+    const psi_proto::Response& server_response, ResultMode mode) const {
   // Ensure both items are valid
   if (!server_setup.IsInitialized()) {
     return absl::InvalidArgumentError("`server_setup` is corrupt!");
@@ -175,40 +434,252 @@ StatusOr<std::vector<int64_t>> PsiClient::ProcessResponse(
   if (!server_response.IsInitialized()) {
     return absl::InvalidArgumentError("`server_response` is corrupt!");
   }
+  absl::Status suite_status =
+      CheckCipherSuite(server_setup.cipher_suite(), cipher_suite_);
+  if (!suite_status.ok()) {
+    return suite_status;
+  }
+  absl::Status encoding_status =
+      CheckPointEncoding(server_setup.point_encoding(), server_response);
+  if (!encoding_status.ok()) {
+    return encoding_status;
+  }
+  const EcPointEncoding encoding =
+      CipherEncoding(server_response.point_encoding());
 
   const auto& response_array = server_response.encrypted_elements();
   const std::int64_t response_size =
       static_cast<std::int64_t>(response_array.size());
-  std::vector<std::string> decrypted;
-  decrypted.reserve(response_size);
+  const int num_threads = num_threads_;
 
-  for (int64_t i = 0; i < response_size; i++) {
-    ASSIGN_OR_RETURN(std::string element,
-                     ec_cipher_->Decrypt(response_array[i]));
-    decrypted.push_back(element);
+  // Matches found by each worker thread, and the bitmap they share.
+  std::vector<Matches> matches(num_threads);
+  Matches result;
+  if (mode == ResultMode::kBitmap) {
+    result.bitmap.resize((response_size + 63) / 64);
   }
 
+  // Decrypts the response in chunks and calls `consume(thread, offset,
+  // chunk)` for each. Every thread takes a range of whole bitmap words, so
+  // that no two threads write to the same word.
+  const auto for_each_chunk =
+      [&](const std::function<void(int, int64_t,
+                                   absl::Span<const std::string>)>& consume) {
+        return ParallelFor(
+            num_threads, (response_size + 63) / 64,
+            [&](int thread, int64_t begin, int64_t end) {
+              return DecryptInChunks(
+                  *cipher_, encoding, response_array, begin * 64,
+                  std::min(end * 64, response_size),
+                  [&](int64_t offset, absl::Span<const std::string> chunk) {
+                    consume(thread, offset, chunk);
+                  });
+            });
+      };
+  // Looks the chunks up in `container`.
+  const auto intersect_chunks = [&](const auto& container) {
+    return for_each_chunk([&](int thread, int64_t offset,
+                              absl::Span<const std::string> chunk) {
+      CollectMatches(container, mode, offset, chunk, &matches[thread],
+                     &result.bitmap);
+    });
+  };
+  // Decrypts the response into the hashes of `container`, which are only
+  // matched against it once all are known.
+  std::vector<std::pair<int64_t, int64_t>> hashes;
+  const auto hash_chunks = [&](const auto& container) {
+    hashes.resize(response_size);
+    return for_each_chunk([&](int, int64_t offset,
+                              absl::Span<const std::string> chunk) {
+      const std::vector<int64_t> chunk_hashes = container.HashElements(chunk);
+      for (size_t i = 0; i < chunk.size(); i++) {
+        hashes[offset + i] = {chunk_hashes[i],
+                              offset + static_cast<int64_t>(i)};
+      }
+    });
+  };
+
+  absl::Status status;
+  // `server_setup` outlives the containers, so those that can read it in place
+  // do, instead of copying it.
   switch (server_setup.data_structure_case()) {
     case psi_proto::ServerSetup::DataStructureCase::kRaw: {
       // Decode Bloom Filter from the server setup.
-      ASSIGN_OR_RETURN(auto container, Raw::CreateFromProtobuf(server_setup));
-      return container->Intersect(absl::MakeConstSpan(decrypted));
+      ASSIGN_OR_RETURN(auto container,
+                       Raw::CreateViewFromProtobuf(server_setup));
+      status = intersect_chunks(*container);
+      break;
     }
     case psi_proto::ServerSetup::DataStructureCase::kGcs: {
       // Decode GCS from the server setup.
-      ASSIGN_OR_RETURN(auto container, GCS::CreateFromProtobuf(server_setup));
-      return container->Intersect(absl::MakeConstSpan(decrypted));
+      ASSIGN_OR_RETURN(auto container,
+                       GCS::CreateViewFromProtobuf(server_setup));
+
+      // Only the hashes of the decrypted elements are kept. Matching them
+      // against the set decodes the blocks of the Golomb-coded stream they
+      // can fall into, spread over the threads.
+      status = hash_chunks(*container);
+      if (!status.ok()) {
+        return status;
+      }
+      switch (mode) {
+        case ResultMode::kIndices:
+          result.indices =
+              container->IntersectHashes(std::move(hashes), num_threads);
+          break;
+        case ResultMode::kCount:
+          result.count = container->CountHashes(std::move(hashes), num_threads);
+          break;
+        case ResultMode::kBitmap:
+          result.bitmap = container->IntersectHashesBitmap(
+              std::move(hashes), response_size, num_threads);
+          break;
+      }
+      return result;
     }
     case psi_proto::ServerSetup::DataStructureCase::kBloomFilter: {
       // Decode Bloom Filter from the server setup.
       ASSIGN_OR_RETURN(auto container,
-                       BloomFilter::CreateFromProtobuf(server_setup));
-      return container->Intersect(absl::MakeConstSpan(decrypted));
+                       BloomFilter::CreateViewFromProtobuf(server_setup));
+      status = intersect_chunks(*container);
+      break;
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kBlockedBloomFilter: {
+      // Decode blocked Bloom Filter from the server setup.
+      ASSIGN_OR_RETURN(auto container,
+                       BlockedBloomFilter::CreateFromProtobuf(server_setup));
+      status = intersect_chunks(*container);
+      break;
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kBinaryFuseFilter: {
+      // Decode binary fuse filter from the server setup.
+      ASSIGN_OR_RETURN(auto container,
+                       BinaryFuseFilter::CreateFromProtobuf(server_setup));
+      status = intersect_chunks(*container);
+      break;
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kEliasFano: {
+      // Decode the Elias-Fano coded set from the server setup. Every element
+      // is looked up on its own, so the work only depends on the number of
+      // client elements.
+      ASSIGN_OR_RETURN(auto container,
+                       EliasFano::CreateFromProtobuf(server_setup));
+      status = intersect_chunks(*container);
+      break;
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kRansSet: {
+      // Decode the rANS coded set from the server setup.
+      ASSIGN_OR_RETURN(auto container,
+                       RansSet::CreateFromProtobuf(server_setup));
+
+      // Only the hashes of the decrypted elements are kept, and matched
+      // against the set in a single pass over it.
+      status = hash_chunks(*container);
+      if (!status.ok()) {
+        return status;
+      }
+      for (int64_t i : container->IntersectHashes(std::move(hashes))) {
+        AddMatch(mode, i, &result, &result.bitmap);
+      }
+      return result;
+    }
+    case psi_proto::ServerSetup::DataStructureCase::kRawFingerprints: {
+      // Decode the fingerprints from the server setup. Every element is looked
+      // up on its own.
+      ASSIGN_OR_RETURN(auto container,
+                       RawFingerprints::CreateFromProtobuf(server_setup));
+      status = intersect_chunks(*container);
+      break;
     }
     default: {
       return absl::InvalidArgumentError("Impossible");
     }
   }
+  if (!status.ok()) {
+    return status;
+  }
+  MergeMatches(&matches, &result);
+  return result;
+}
+
+/**
+ * @brief Process the server's response against a prepared setup
+ *
+ * @param prepared_setup The decoded server's setup
+ * @param server_response The previous server's response
+ * @param mode What to collect about the matches
+ *
+ * @return StatusOr<Matches>
+ */
+StatusOr<PsiClient::Matches> PsiClient::ProcessResponse(
+    const PreparedSetup& prepared_setup,
+    const psi_proto::Response& server_response, ResultMode mode) const {
+  if (!server_response.IsInitialized()) {
+    return absl::InvalidArgumentError("`server_response` is corrupt!");
+  }
+  absl::Status suite_status =
+      CheckCipherSuite(prepared_setup.CipherSuite(), cipher_suite_);
+  if (!suite_status.ok()) {
+    return suite_status;
+  }
+  absl::Status encoding_status =
+      CheckPointEncoding(prepared_setup.PointEncoding(), server_response);
+  if (!encoding_status.ok()) {
+    return encoding_status;
+  }
+  const EcPointEncoding encoding =
+      CipherEncoding(server_response.point_encoding());
+
+  const auto& response_array = server_response.encrypted_elements();
+  const std::int64_t response_size =
+      static_cast<std::int64_t>(response_array.size());
+  const int num_threads = num_threads_;
+
+  // Matches found by each worker thread, and the bitmap they share. Every
+  // thread takes a range of whole bitmap words.
+  std::vector<Matches> matches(num_threads);
+  Matches result;
+  if (mode == ResultMode::kBitmap) {
+    result.bitmap.resize((response_size + 63) / 64);
+  }
+  absl::Status status = ParallelFor(
+      num_threads, (response_size + 63) / 64,
+      [&](int thread, int64_t begin, int64_t end) {
+        return DecryptInChunks(
+            *cipher_, encoding, response_array, begin * 64,
+            std::min(end * 64, response_size),
+            [&](int64_t offset, absl::Span<const std::string> chunk) {
+              CollectMatches(prepared_setup, mode, offset, chunk,
+                             &matches[thread], &result.bitmap);
+            });
+      });
+  if (!status.ok()) {
+    return status;
+  }
+  MergeMatches(&matches, &result);
+  return result;
+}
+
+/**
+ * @brief Adds the indices and counts of the worker threads to the result, the
+ * indices in thread order
+ *
+ * @param thread_matches The matches of every thread
+ * @param result The result
+ */
+void PsiClient::MergeMatches(std::vector<Matches>* thread_matches,
+                             Matches* result) {
+  size_t num_indices = 0;
+  for (const Matches& matches : *thread_matches) {
+    num_indices += matches.indices.size();
+    result->count += matches.count;
+  }
+  result->indices.reserve(num_indices);
+  for (Matches& matches : *thread_matches) {
+    result->indices.insert(result->indices.end(), matches.indices.begin(),
+                           matches.indices.end());
+    matches.indices = std::vector<int64_t>();
+  }
 }
 
 /**
@@ -217,7 +688,7 @@ StatusOr<std::vector<int64_t>> PsiClient::ProcessResponse(
  * @return The private key as a null-terminated binary string
  */
 std::string PsiClient::GetPrivateKeyBytes() const {
-  std::string key = ec_cipher_->GetPrivateKeyBytes();
+  std::string key = cipher_->GetPrivateKeyBytes();
   key.insert(key.begin(), 32 - key.length(), '\0');
   return key;
 }
@@ -17,9 +17,15 @@
 #ifndef PRIVATE_SET_INTERSECTION_CPP_PSI_CLIENT_H_
 #define PRIVATE_SET_INTERSECTION_CPP_PSI_CLIENT_H_
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "absl/status/statusor.h"
 #include "absl/types/span.h"
-#include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
+#include "private_set_intersection/cpp/prepared_setup.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
@@ -98,9 +104,20 @@ class PsiClient {
   // intersection of the two datasets. Otherwise, only the intersection size is
   // learned.
   //
-  // Returns INTERNAL if any OpenSSL crypto operations fail.
+  // `num_threads` sets how many threads encrypt the request in
+  // `CreateRequest` and decrypt and intersect the response in
+  // `GetIntersection` and `GetIntersectionSize`. The threads share one
+  // immutable cipher, and the results do not depend on the thread count. A
+  // non-positive value uses one thread per hardware core.
+  //
+  // `cipher_suite` selects the curve and hash the elements are encrypted with,
+  // which must be those of the server. See `PsiServer::CreateWithNewKey`.
+  //
+  // Returns INVALID_ARGUMENT if `cipher_suite` is unknown, or INTERNAL if any
+  // OpenSSL crypto operations fail.
   static StatusOr<std::unique_ptr<PsiClient>> CreateWithNewKey(
-      bool reveal_intersection);
+      bool reveal_intersection, int num_threads = 1,
+      psi_proto::CipherSuite cipher_suite = psi_proto::CIPHER_SUITE_SM2_SM3);
 
   // Creates and returns a new client instance with the provided private key. If
   // `reveal_intersection` is true, the client learns the elements in the
@@ -112,17 +129,31 @@ class PsiClient {
   // requests can reveal information about the input sets. If in doubt, use
   // `CreateWithNewKey`.
   //
-  // Returns INTERNAL if any OpenSSL crypto operations fail.
+  // See `CreateWithNewKey` for the meaning of `num_threads` and
+  // `cipher_suite`.
+  //
+  // Returns INVALID_ARGUMENT if `cipher_suite` is unknown or `key_bytes` is not
+  // a key of its curve, or INTERNAL if any OpenSSL crypto operations fail.
   static StatusOr<std::unique_ptr<PsiClient>> CreateFromKey(
-      const std::string& key_bytes, bool reveal_intersection);
+      const std::string& key_bytes, bool reveal_intersection,
+      int num_threads = 1,
+      psi_proto::CipherSuite cipher_suite = psi_proto::CIPHER_SUITE_SM2_SM3);
 
   // Creates a request protobuf to be serialized and sent to the server. For
   // each input element x, computes H(x)^c, where c is the secret key of
   // ec_cipher_.
   //
-  // Returns INTERNAL if encryption fails.
+  // The elements are encoded in `point_encoding`, which the server's setup
+  // must use as well (see `PsiServer::CreateSetupMessage`). The server's
+  // response is in the same encoding. The request carries the client's cipher
+  // suite, and the server refuses it unless the suites match.
+  //
+  // Returns INVALID_ARGUMENT if `point_encoding` is unknown, or INTERNAL if
+  // encryption fails.
   StatusOr<psi_proto::Request> CreateRequest(
-      absl::Span<const std::string> inputs) const;
+      absl::Span<const std::string> inputs,
+      psi_proto::PointEncoding point_encoding =
+          psi_proto::POINT_ENCODING_COMPRESSED) const;
 
   // Processes the server's response and returns the intersection of the client
   // and server inputs. Use this function if this instance was created with
@@ -134,8 +165,9 @@ class PsiClient {
   //
   // Note that the intersections are returned in arbitrary order.
   //
-  // Returns INVALID_ARGUMENT if any input messages are malformed, or INTERNAL
-  // if decryption fails.
+  // Returns INVALID_ARGUMENT if any input messages are malformed, the setup
+  // is of another cipher suite than the client or the setup and response use
+  // different point encodings, or INTERNAL if decryption fails.
   StatusOr<std::vector<int64_t>> GetIntersection(
       const psi_proto::ServerSetup& server_setup,
       const psi_proto::Response& server_response) const;
@@ -143,31 +175,118 @@ class PsiClient {
   // As `GetIntersection`, but only reveals the size of the intersection. Use
   // this function if this instance was created with `reveal_intersection =
   // false`.
+  // The matches are only counted, never listed.
   //
-  // Returns INVALID_ARGUMENT if any input messages are malformed, or INTERNAL
-  // if decryption fails.
+  // Returns INVALID_ARGUMENT if any input messages are malformed, the setup
+  // is of another cipher suite than the client or the setup and response use
+  // different point encodings, or INTERNAL if decryption fails.
   StatusOr<int64_t> GetIntersectionSize(
       const psi_proto::ServerSetup& server_setup,
       const psi_proto::Response& server_response) const;
 
+  // As `GetIntersection`, but against a setup decoded once with
+  // `PreparedSetup::Create`, so that a client intersecting many responses
+  // with the same setup only pays for decryption and lookups. The prepared
+  // setup can be shared between clients and threads.
+  //
+  // Returns INVALID_ARGUMENT if the response is malformed or not in the point
+  // encoding of the setup or the setup is of another cipher suite than the
+  // client, or INTERNAL if decryption fails.
+  StatusOr<std::vector<int64_t>> GetIntersection(
+      const PreparedSetup& prepared_setup,
+      const psi_proto::Response& server_response) const;
+
+  // As `GetIntersectionSize`, but against a prepared setup.
+  //
+  // Returns INVALID_ARGUMENT if the response is malformed or not in the point
+  // encoding of the setup or the setup is of another cipher suite than the
+  // client, or INTERNAL if decryption fails.
+  StatusOr<int64_t> GetIntersectionSize(
+      const PreparedSetup& prepared_setup,
+      const psi_proto::Response& server_response) const;
+
+  // As `GetIntersection`, but returns one flag per element of the response,
+  // true for those in the intersection, instead of their indices. For large
+  // inputs this takes a bit per element rather than 8 bytes per match.
+  //
+  // Returns INVALID_ARGUMENT if any input messages are malformed, the setup
+  // is of another cipher suite than the client or the setup and response use
+  // different point encodings, or INTERNAL if decryption fails.
+  StatusOr<std::vector<bool>> GetIntersectionBitmap(
+      const psi_proto::ServerSetup& server_setup,
+      const psi_proto::Response& server_response) const;
+
+  // As `GetIntersectionBitmap`, but against a prepared setup.
+  //
+  // Returns INVALID_ARGUMENT if the response is malformed or not in the point
+  // encoding of the setup or the setup is of another cipher suite than the
+  // client, or INTERNAL if decryption fails.
+  StatusOr<std::vector<bool>> GetIntersectionBitmap(
+      const PreparedSetup& prepared_setup,
+      const psi_proto::Response& server_response) const;
+
   // Returns this instance's private key. This key should only be used to create
   // other client instances. DO NOT SEND THIS KEY TO ANY OTHER PARTY!
   std::string GetPrivateKeyBytes() const;
 
  private:
-  explicit PsiClient(
-      std::unique_ptr<::private_join_and_compute::ECCommutativeCipher>
-          ec_cipher,
-      bool reveal_intersection);
-
-  // Processes the `server_response` and returns the indices that are present in
-  // the bloom filter encoded by `server_setup`. This method is called by
-  // GetIntersection and GetIntersectionSize internally.
-  StatusOr<std::vector<int64_t>> ProcessResponse(
-      const psi_proto::ServerSetup& server_setup,
-      const psi_proto::Response& server_response) const;
+  PsiClient(std::unique_ptr<BatchCipher> cipher,
+            psi_proto::CipherSuite cipher_suite, bool reveal_intersection,
+            int num_threads);
+
+  // What `ProcessResponse` collects about the matching elements.
+  enum class ResultMode { kIndices, kCount, kBitmap };
+
+  // The matches of a response, of which only the field of the `ResultMode` is
+  // filled in. The bitmap holds one bit per element of the response, bit
+  // `i % 64` of word `i / 64` being element `i`.
+  struct Matches {
+    std::vector<int64_t> indices;
+    int64_t count = 0;
+    std::vector<uint64_t> bitmap;
+  };
+
+  // Processes the `server_response` and collects the elements that are present
+  // in the container encoded by `server_setup`. This method is called by
+  // GetIntersection, GetIntersectionSize and GetIntersectionBitmap internally.
+  //
+  // The response is split into one range per worker thread. Each thread
+  // decrypts its range in small chunks and feeds every chunk straight into the
+  // container, so the decrypted response is never held in memory as a whole.
+  // Counts and bitmaps are taken from the containers directly where they
+  // support it, without building the list of indices.
+  StatusOr<Matches> ProcessResponse(const psi_proto::ServerSetup& server_setup,
+                                    const psi_proto::Response& server_response,
+                                    ResultMode mode) const;
+
+  // As above, but looks the decrypted elements up in `prepared_setup`.
+  StatusOr<Matches> ProcessResponse(const PreparedSetup& prepared_setup,
+                                    const psi_proto::Response& server_response,
+                                    ResultMode mode) const;
+
+  // Adds the matches of `chunk`, which starts at element `offset` of the
+  // response, to those of a worker thread, or sets their bits in `bitmap`.
+  // `offset` must be a multiple of 64.
+  template <typename Container>
+  static void CollectMatches(const Container& container, ResultMode mode,
+                             int64_t offset,
+                             absl::Span<const std::string> chunk,
+                             Matches* thread_matches,
+                             std::vector<uint64_t>* bitmap);
+
+  // Adds the element at `index` of the response to `matches`, or sets its bit
+  // in `bitmap`.
+  static void AddMatch(ResultMode mode, int64_t index, Matches* matches,
+                       std::vector<uint64_t>* bitmap);
+
+  // Moves the indices and counts of the worker threads into `result`.
+  static void MergeMatches(std::vector<Matches>* thread_matches,
+                           Matches* result);
 
-  std::unique_ptr<::private_join_and_compute::ECCommutativeCipher> ec_cipher_;
+  // Shared by all worker threads.
+  std::unique_ptr<BatchCipher> cipher_;
+  psi_proto::CipherSuite cipher_suite_;
+  int num_threads_;
   bool reveal_intersection;
 };
 
@@ -18,12 +18,22 @@
 
 #include <math.h>
 
+#include <algorithm>
+
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
 #include "gtest/gtest.h"
 #include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/crypto/sm2_batch_cipher.h"
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
 #include "private_set_intersection/cpp/datastructure/gcs.h"
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
+#include "private_set_intersection/cpp/datastructure/raw.h"
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
 #include "util/status_matchers.h"
 
 namespace private_set_intersection {
@@ -39,20 +49,25 @@ class PsiClientTest : public ::testing::Test {
         ::private_join_and_compute::ECCommutativeCipher::CreateWithNewKey(
             /*NID_X9_62_prime256v1*/NID_sm2,
             ::private_join_and_compute::ECCommutativeCipher::HashType::SM3/*SHA256*/));
+    // Elements are hashed to the curve with SM3-SSWU, which
+    // `ECCommutativeCipher` does not provide.
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto server_key_cipher,
+        ::private_join_and_compute::ECCommutativeCipher::CreateFromKey(
+            NID_sm2, server_ec_cipher_->GetPrivateKeyBytes(),
+            ::private_join_and_compute::ECCommutativeCipher::HashType::SM3));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        server_batch_cipher_,
+        Sm2BatchCipher::Create(std::move(server_key_cipher)));
   }
 
   void CreateDummySetupMessage(absl::Span<const std::string> server_elements,
                                double fpr,
                                psi_proto::ServerSetup* server_setup) {
-    auto num_server_elements = static_cast<int64_t>(server_elements.size());
-    std::vector<std::string> elements;
-    elements.reserve(num_server_elements);
-
-    for (int i = 0; i < num_server_elements; i++) {
-      PSI_ASSERT_OK_AND_ASSIGN(std::string encrypted_element,
-                               server_ec_cipher_->Encrypt(server_elements[i]));
-      elements.push_back(encrypted_element);
-    }
+    PSI_ASSERT_OK_AND_ASSIGN(
+        std::vector<std::string> elements,
+        server_batch_cipher_->EncryptBatch(server_elements,
+                                           EcPointEncoding::kCompressed));
 
     // Insert server elements into GCS.
     PSI_ASSERT_OK_AND_ASSIGN(
@@ -60,6 +75,7 @@ class PsiClientTest : public ::testing::Test {
         GCS::Create(fpr, (int64_t)elements.size(),
                     absl::MakeConstSpan(&elements[0], elements.size())));
     *server_setup = gcs->ToProtobuf();
+    server_setup->set_cipher_suite(psi_proto::CIPHER_SUITE_SM2_SM3);
   }
 
   void CreateDummyResponse(const psi_proto::Request& client_request,
@@ -86,6 +102,7 @@ class PsiClientTest : public ::testing::Test {
   std::unique_ptr<PsiClient> client_;
   std::unique_ptr<private_join_and_compute::ECCommutativeCipher>
       server_ec_cipher_;
+  std::unique_ptr<Sm2BatchCipher> server_batch_cipher_;
 };
 
 TEST_F(PsiClientTest, TestCreatingFromKey) {
@@ -228,6 +245,165 @@ TEST_F(PsiClientTest, TestCorrectnessIntersectionSize) {
             ceil(((double)num_client_elements / 2.0) * 1.1));
 }
 
+TEST_F(PsiClientTest, TestMultiThreadedMatchesSingleThreaded) {
+  SetUp(true);
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto parallel_client,
+      PsiClient::CreateFromKey(client_->GetPrivateKeyBytes(), true, 3));
+  int num_client_elements = 3000, num_server_elements = 1000;
+  double fpr = 1e-9;
+  std::vector<std::string> client_elements(num_client_elements);
+  std::vector<std::string> server_elements(num_server_elements);
+  for (int i = 0; i < num_client_elements; i++) {
+    client_elements[i] = absl::StrCat("Element ", i);
+  }
+  for (int i = 0; i < num_server_elements; i++) {
+    server_elements[i] = absl::StrCat("Element ", 3 * i);
+  }
+
+  // Encrypt the server elements once and wrap them in every container.
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<std::string> encrypted,
+      server_batch_cipher_->EncryptBatch(server_elements,
+                                         EcPointEncoding::kCompressed));
+  std::vector<psi_proto::ServerSetup> server_setups;
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto gcs, GCS::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(gcs->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto bloom_filter,
+      BloomFilter::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(bloom_filter->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto blocked_bloom_filter,
+      BlockedBloomFilter::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(blocked_bloom_filter->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto binary_fuse_filter,
+      BinaryFuseFilter::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(binary_fuse_filter->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto elias_fano, EliasFano::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(elias_fano->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto rans_set, RansSet::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(rans_set->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto raw_fingerprints,
+      RawFingerprints::Create(fpr, num_client_elements, encrypted));
+  server_setups.push_back(raw_fingerprints->ToProtobuf());
+  PSI_ASSERT_OK_AND_ASSIGN(auto raw,
+                           Raw::Create(num_client_elements, encrypted));
+  server_setups.push_back(raw->ToProtobuf());
+  for (auto& server_setup : server_setups) {
+    server_setup.set_cipher_suite(psi_proto::CIPHER_SUITE_SM2_SM3);
+  }
+
+  // The request must not depend on the number of threads.
+  PSI_ASSERT_OK_AND_ASSIGN(psi_proto::Request client_request,
+                           client_->CreateRequest(client_elements));
+  PSI_ASSERT_OK_AND_ASSIGN(psi_proto::Request parallel_client_request,
+                           parallel_client->CreateRequest(client_elements));
+  EXPECT_EQ(client_request.SerializeAsString(),
+            parallel_client_request.SerializeAsString());
+
+  psi_proto::Response server_response;
+  CreateDummyResponse(client_request, &server_response);
+
+  // Neither must the intersection, up to its order.
+  for (const auto& server_setup : server_setups) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        std::vector<int64_t> intersection,
+        client_->GetIntersection(server_setup, server_response));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        std::vector<int64_t> parallel_intersection,
+        parallel_client->GetIntersection(server_setup, server_response));
+    std::sort(intersection.begin(), intersection.end());
+    std::sort(parallel_intersection.begin(), parallel_intersection.end());
+    EXPECT_EQ(intersection, parallel_intersection);
+    EXPECT_EQ(intersection.size(), num_client_elements / 3);
+
+    // The size and the bitmap agree with the intersection.
+    std::vector<bool> expected_bitmap(num_client_elements);
+    for (int64_t i : intersection) {
+      expected_bitmap[i] = true;
+    }
+    for (const PsiClient* client : {client_.get(), parallel_client.get()}) {
+      PSI_ASSERT_OK_AND_ASSIGN(
+          int64_t size, client->GetIntersectionSize(server_setup,
+                                                    server_response));
+      EXPECT_EQ(size, intersection.size());
+      PSI_ASSERT_OK_AND_ASSIGN(
+          std::vector<bool> bitmap,
+          client->GetIntersectionBitmap(server_setup, server_response));
+      EXPECT_EQ(bitmap, expected_bitmap) << server_setup.data_structure_case();
+    }
+
+    // A prepared setup shared by both clients gives the same intersection.
+    PSI_ASSERT_OK_AND_ASSIGN(auto prepared_setup,
+                             PreparedSetup::Create(server_setup));
+    for (const PsiClient* client : {client_.get(), parallel_client.get()}) {
+      PSI_ASSERT_OK_AND_ASSIGN(
+          std::vector<int64_t> prepared_intersection,
+          client->GetIntersection(*prepared_setup, server_response));
+      std::sort(prepared_intersection.begin(), prepared_intersection.end());
+      EXPECT_EQ(prepared_intersection, intersection);
+      PSI_ASSERT_OK_AND_ASSIGN(
+          int64_t prepared_size,
+          client->GetIntersectionSize(*prepared_setup, server_response));
+      EXPECT_EQ(prepared_size, intersection.size());
+      PSI_ASSERT_OK_AND_ASSIGN(
+          std::vector<bool> prepared_bitmap,
+          client->GetIntersectionBitmap(*prepared_setup, server_response));
+      EXPECT_EQ(prepared_bitmap, expected_bitmap);
+    }
+  }
+}
+
+TEST_F(PsiClientTest, TestPointEncodingMismatch) {
+  SetUp(true);
+  psi_proto::ServerSetup server_setup;
+  CreateDummySetupMessage({"a", "b"}, 0.001, &server_setup);
+  PSI_ASSERT_OK_AND_ASSIGN(psi_proto::Request client_request,
+                           client_->CreateRequest(
+                               {"a", "c"}, psi_proto::POINT_ENCODING_X_ONLY));
+  psi_proto::Response server_response;
+  server_response.set_point_encoding(psi_proto::POINT_ENCODING_X_ONLY);
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<std::string> reencrypted,
+      server_batch_cipher_->ReEncryptBatch(
+          std::vector<std::string>(client_request.encrypted_elements().begin(),
+                                   client_request.encrypted_elements().end()),
+          EcPointEncoding::kXOnly));
+  for (const std::string& element : reencrypted) {
+    server_response.add_encrypted_elements(element);
+  }
+
+  // The setup is compressed and the response x-only.
+  EXPECT_EQ(client_->GetIntersection(server_setup, server_response)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  PSI_ASSERT_OK_AND_ASSIGN(auto prepared_setup,
+                           PreparedSetup::Create(server_setup));
+  EXPECT_EQ(prepared_setup->PointEncoding(),
+            psi_proto::POINT_ENCODING_COMPRESSED);
+  EXPECT_EQ(client_->GetIntersection(*prepared_setup, server_response)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  server_setup.set_point_encoding(psi_proto::POINT_ENCODING_X_ONLY);
+  PSI_ASSERT_OK_AND_ASSIGN(prepared_setup, PreparedSetup::Create(server_setup));
+  EXPECT_TRUE(client_->GetIntersection(*prepared_setup, server_response).ok());
+
+  EXPECT_EQ(client_
+                ->CreateRequest({"a"}, static_cast<psi_proto::PointEncoding>(7))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 TEST_F(PsiClientTest, FailIfRevealIntersectionDoesntMatch) {
   SetUp(false);
   psi_proto::ServerSetup server_setup;
@@ -238,6 +414,11 @@ TEST_F(PsiClientTest, FailIfRevealIntersectionDoesntMatch) {
           absl::StatusCode::kInvalidArgument,
           "GetIntersection called on PsiClient with reveal_intersection == "
           "false"));
+  EXPECT_THAT(
+      client_->GetIntersectionBitmap(server_setup, response),
+      StatusIs(absl::StatusCode::kInvalidArgument,
+               "GetIntersectionBitmap called on PsiClient with "
+               "reveal_intersection == false"));
 }
 
 }  // namespace
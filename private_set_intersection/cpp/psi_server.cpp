@@ -16,73 +16,115 @@
 
 #include "private_set_intersection/cpp/psi_server.h"
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
-#include "openssl/obj_mac.h"
+#include "private_join_and_compute/util/status_macros.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
+#include "private_set_intersection/cpp/crypto/cipher_suite.h"
+#include "private_set_intersection/cpp/datastructure/binary_fuse_filter.h"
+#include "private_set_intersection/cpp/datastructure/blocked_bloom_filter.h"
 #include "private_set_intersection/cpp/datastructure/bloom_filter.h"
+#include "private_set_intersection/cpp/datastructure/elias_fano.h"
 #include "private_set_intersection/cpp/datastructure/gcs.h"
+#include "private_set_intersection/cpp/datastructure/rans_set.h"
 #include "private_set_intersection/cpp/datastructure/raw.h"
+#include "private_set_intersection/cpp/datastructure/raw_fingerprints.h"
+#include "private_set_intersection/cpp/util/parallel.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
 namespace private_set_intersection {
 
+namespace {
+
+// Number of request elements a worker re-encrypts as one batch. This bounds
+// the copies of the request held in memory per thread.
+constexpr int64_t kReEncryptChunkSize = 1024;
+
+// Frees the encrypted inputs `container` was built from, then turns it into a
+// protobuf of elements of `cipher_suite` in `point_encoding`. GCS, Bloom
+// filter and Raw containers move their buffers into the protobuf, so the setup
+// is only held once at any point; the others are copied and freed right after.
+template <typename Container>
+psi_proto::ServerSetup ReleaseIntoProtobuf(
+    std::unique_ptr<Container> container, std::vector<std::string>* encrypted,
+    psi_proto::PointEncoding point_encoding,
+    psi_proto::CipherSuite cipher_suite) {
+  *encrypted = std::vector<std::string>();
+  psi_proto::ServerSetup server_setup = std::move(*container).ToProtobuf();
+  container.reset();
+  server_setup.set_point_encoding(point_encoding);
+  server_setup.set_cipher_suite(cipher_suite);
+  return server_setup;
+}
+
+}  // namespace
+
 /**
  * @brief Construct a new Psi Server:: Psi Server object
  *
- * @param ec_cipher A unique pointer to a commutative , which is used for
- * encryption and decryption in the Private Set Intersection (PSI) protocol.
+ * @param cipher The batch cipher used for encryption and decryption in the
+ * Private Set Intersection (PSI) protocol, shared by all worker threads.
+ * @param cipher_suite The curve and hash of `cipher`
  * @param reveal_intersection A boolean value indicating whether the
  * intersection of the two sets should be revealed after the PSI protocol is
  * completed.
+ * @param num_threads The number of worker threads
  */
-PsiServer::PsiServer(
-    std::unique_ptr<::private_join_and_compute::ECCommutativeCipher> ec_cipher,
-    bool reveal_intersection)
-    : ec_cipher_(std::move(ec_cipher)),
+PsiServer::PsiServer(std::unique_ptr<BatchCipher> cipher,
+                     psi_proto::CipherSuite cipher_suite,
+                     bool reveal_intersection, int num_threads)
+    : cipher_(std::move(cipher)),
+      cipher_suite_(cipher_suite),
+      num_threads_(num_threads),
       reveal_intersection(reveal_intersection) {}
 
 /**
  * @brief Creates a new instance of the PsiServer class with a new key pair for
- * encryption and decryption using ECCommutativeCipher.
+ * encryption and decryption using the chosen cipher suite.
  *
  * @param reveal_intersection A boolean indicating whether the client wants to
  * learn the intersection values or only its size (cardinality).
+ * @param num_threads The number of worker threads (non-positive for one per
+ * core).
+ * @param cipher_suite The curve and hash to encrypt elements with
  * @return StatusOr<std::unique_ptr<PsiServer>>
  */
 StatusOr<std::unique_ptr<PsiServer>> PsiServer::CreateWithNewKey(
-    bool reveal_intersection) {
-  // Create an EC cipher with curve P-256. This gives 128 bits of security.
-  ASSIGN_OR_RETURN(
-      auto ec_cipher,
-      ::private_join_and_compute::ECCommutativeCipher::CreateWithNewKey(
-          /*NID_X9_62_prime256v1*/NID_sm2,
-          ::private_join_and_compute::ECCommutativeCipher::HashType::SM3/*SHA256*/));
-  return absl::WrapUnique(
-      new PsiServer(std::move(ec_cipher), reveal_intersection));
+    bool reveal_intersection, int num_threads,
+    psi_proto::CipherSuite cipher_suite) {
+  ASSIGN_OR_RETURN(auto cipher, CreateBatchCipherWithNewKey(cipher_suite));
+  return absl::WrapUnique(new PsiServer(std::move(cipher), cipher_suite,
+                                        reveal_intersection,
+                                        ResolveNumThreads(num_threads)));
 }
 
 /**
- * @brief Creates a new PsiServer instance using an EC cipher created from the
- * provided key.
+ * @brief Creates a new PsiServer instance using a cipher of the chosen suite
+ * created from the provided key.
  *
  * @param key_bytes The bytes representing the key for the EC cipher.
  * @param reveal_intersection A boolean flag indicating whether the intersection
  * should be revealed.
+ * @param num_threads The number of worker threads (non-positive for one per
+ * core).
+ * @param cipher_suite The curve and hash to encrypt elements with
  * @return StatusOr<std::unique_ptr<PsiServer>>
  */
 StatusOr<std::unique_ptr<PsiServer>> PsiServer::CreateFromKey(
-    const std::string& key_bytes, bool reveal_intersection) {
-  // Create an EC cipher with curve P-256. This gives 128 bits of security.
-  ASSIGN_OR_RETURN(
-      auto ec_cipher,
-      ::private_join_and_compute::ECCommutativeCipher::CreateFromKey(
-          /*NID_X9_62_prime256v1*/NID_sm2, key_bytes,
-          ::private_join_and_compute::ECCommutativeCipher::HashType::SM3/*SHA256*/));
-  return absl::WrapUnique(
-      new PsiServer(std::move(ec_cipher), reveal_intersection));
+    const std::string& key_bytes, bool reveal_intersection, int num_threads,
+    psi_proto::CipherSuite cipher_suite) {
+  ASSIGN_OR_RETURN(auto cipher,
+                   CreateBatchCipherFromKey(cipher_suite, key_bytes));
+  return absl::WrapUnique(new PsiServer(std::move(cipher), cipher_suite,
+                                        reveal_intersection,
+                                        ResolveNumThreads(num_threads)));
 }
 
 /**
@@ -95,49 +137,133 @@ StatusOr<std::unique_ptr<PsiServer>> PsiServer::CreateFromKey(
  * @param inputs The server inputs to the PSI protocol
  * @param ds A datastructure enum indicating the type of data structure to use
  * for the PSI protocol
+ * @param point_encoding How to encode the encrypted elements
  * @return StatusOr<psi_proto::ServerSetup>
  */
 StatusOr<psi_proto::ServerSetup> PsiServer::CreateSetupMessage(
     double fpr, int64_t num_client_inputs, absl::Span<const std::string> inputs,
-    DataStructure ds) const {
+    DataStructure ds, psi_proto::PointEncoding point_encoding) const {
+  if (!psi_proto::PointEncoding_IsValid(point_encoding)) {
+    return absl::InvalidArgumentError("Unknown `point_encoding`");
+  }
+  const EcPointEncoding encoding = CipherEncoding(point_encoding);
   auto num_inputs = static_cast<int64_t>(inputs.size());
   // Correct fpr to account for multiple client queries.
   double corrected_fpr = fpr / num_client_inputs;
-  std::vector<std::string> encrypted;
-  encrypted.reserve(num_inputs);
+  std::vector<std::string> encrypted(num_inputs);
 
-  for (int i = 0; i < num_inputs; i++) {
-    ASSIGN_OR_RETURN(std::string encrypted_element,
-                     ec_cipher_->Encrypt(inputs[i]));
-    encrypted.push_back(encrypted_element);
+  // Encrypt the inputs in contiguous ranges, one batch per worker thread.
+  // Every element keeps its input position, so the result is independent of
+  // the number of threads.
+  absl::Status status = ParallelFor(
+      num_threads_, num_inputs,
+      [&](int, int64_t begin, int64_t end) -> absl::Status {
+        ASSIGN_OR_RETURN(
+            std::vector<std::string> batch,
+            cipher_->EncryptBatch(inputs.subspan(begin, end - begin),
+                                  encoding));
+        std::move(batch.begin(), batch.end(), encrypted.begin() + begin);
+        return absl::OkStatus();
+      });
+  if (!status.ok()) {
+    return status;
   }
 
   switch (ds) {
     case DataStructure::Gcs: {
-      // Create a GCS and insert elements into it.
-      ASSIGN_OR_RETURN(auto container,
-                       GCS::Create(corrected_fpr, num_client_inputs,
-                                   absl::MakeConstSpan(encrypted)));
+      // Create a GCS, hashing and sorting the elements on all worker threads.
+      ASSIGN_OR_RETURN(
+          auto container,
+          GCS::Create(corrected_fpr, num_client_inputs,
+                      absl::MakeConstSpan(encrypted),
+                      psi_proto::HASH_VERSION_FAST64,
+                      GCS::kDefaultIndexInterval,
+                      num_threads_));
 
       // Return the GCS as a Protobuf
-      return container->ToProtobuf();
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
     }
     case DataStructure::BloomFilter: {
-      // Create a Bloom Filter and insert elements into it.
-      ASSIGN_OR_RETURN(auto container,
-                       BloomFilter::Create(corrected_fpr, num_client_inputs,
-                                           absl::MakeConstSpan(encrypted)));
+      // Create a Bloom Filter and insert elements into it on all worker
+      // threads.
+      ASSIGN_OR_RETURN(
+          auto container,
+          BloomFilter::Create(corrected_fpr, num_client_inputs,
+                              absl::MakeConstSpan(encrypted),
+                              psi_proto::HASH_VERSION_FAST64,
+                              num_threads_));
 
       // Return the Bloom Filter as a Protobuf
-      return container->ToProtobuf();
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
+    }
+    case DataStructure::BlockedBloomFilter: {
+      // Create a blocked Bloom Filter and insert elements into it.
+      ASSIGN_OR_RETURN(
+          auto container,
+          BlockedBloomFilter::Create(corrected_fpr, num_client_inputs,
+                                     absl::MakeConstSpan(encrypted)));
+
+      // Return the blocked Bloom Filter as a Protobuf
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
+    }
+    case DataStructure::BinaryFuseFilter: {
+      // Create a binary fuse filter, hashing and sorting the elements on all
+      // worker threads.
+      ASSIGN_OR_RETURN(
+          auto container,
+          BinaryFuseFilter::Create(corrected_fpr, num_client_inputs,
+                                   absl::MakeConstSpan(encrypted),
+                                   num_threads_));
+
+      // Return the binary fuse filter as a Protobuf
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
+    }
+    case DataStructure::EliasFano: {
+      // Create an Elias-Fano coded set and insert elements into it.
+      ASSIGN_OR_RETURN(auto container,
+                       EliasFano::Create(corrected_fpr, num_client_inputs,
+                                         absl::MakeConstSpan(encrypted)));
+
+      // Return the Elias-Fano coded set as a Protobuf
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
+    }
+    case DataStructure::RansSet: {
+      // Create an rANS coded set and insert elements into it.
+      ASSIGN_OR_RETURN(auto container,
+                       RansSet::Create(corrected_fpr, num_client_inputs,
+                                       absl::MakeConstSpan(encrypted)));
+
+      // Return the rANS coded set as a Protobuf
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
+    }
+    case DataStructure::RawFingerprints: {
+      // Create the fingerprints, hashing and sorting the elements on all
+      // worker threads.
+      ASSIGN_OR_RETURN(
+          auto container,
+          RawFingerprints::Create(corrected_fpr, num_client_inputs,
+                                  absl::MakeConstSpan(encrypted),
+                                  num_threads_));
+
+      // Return the fingerprints as a Protobuf
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
     }
     case DataStructure::Raw: {
-      // Create a Raw container and insert elements into it.
+      // Create a Raw container, sorting the elements on all worker threads.
       ASSIGN_OR_RETURN(auto container,
-                       Raw::Create(num_client_inputs, std::move(encrypted)));
+                       Raw::Create(num_client_inputs, std::move(encrypted),
+                                   num_threads_));
 
       // Return the Raw container as a Protobuf
-      return container->ToProtobuf();
+      return ReleaseIntoProtobuf(std::move(container), &encrypted,
+                                 point_encoding, cipher_suite_);
     }
     default:
       return absl::InvalidArgumentError("Impossible");
@@ -164,6 +290,29 @@ StatusOr<psi_proto::Response> PsiServer::ProcessRequest(
                      ", but it is actually ", reveal_intersection));
   }
 
+  const psi_proto::PointEncoding point_encoding =
+      client_request.point_encoding();
+  if (!psi_proto::PointEncoding_IsValid(point_encoding)) {
+    return absl::InvalidArgumentError(
+        "`client_request` has an unknown point encoding");
+  }
+  const EcPointEncoding encoding = CipherEncoding(point_encoding);
+
+  if (!psi_proto::CipherSuite_IsValid(client_request.cipher_suite())) {
+    return absl::InvalidArgumentError(
+        "`client_request` has an unknown cipher suite");
+  }
+  if (client_request.cipher_suite() == psi_proto::CIPHER_SUITE_UNSPECIFIED) {
+    return absl::InvalidArgumentError(
+        "`client_request` has no cipher suite, so it is from an older client");
+  }
+  if (client_request.cipher_suite() != cipher_suite_) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Client uses cipher suite ",
+        psi_proto::CipherSuite_Name(client_request.cipher_suite()),
+        ", but the server uses ", psi_proto::CipherSuite_Name(cipher_suite_)));
+  }
+
   // Re-encrypt elements.
   const auto& encrypted_elements = client_request.encrypted_elements();
   const std::int64_t num_client_elements =
@@ -171,20 +320,47 @@ StatusOr<psi_proto::Response> PsiServer::ProcessRequest(
 
   // Create the response
   psi_proto::Response response;
+  response.set_point_encoding(point_encoding);
+  auto& elements = *(response.mutable_encrypted_elements());
+  elements.Reserve(static_cast<int>(num_client_elements));
+  for (int64_t i = 0; i < num_client_elements; i++) {
+    elements.Add();
+  }
 
-  // Re-encrypt the request's elements and add to the response
-  for (int i = 0; i < num_client_elements; i++) {
-    ASSIGN_OR_RETURN(std::string encrypted,
-                     ec_cipher_->ReEncrypt(encrypted_elements[i]));
-    response.add_encrypted_elements(encrypted);
+  // Re-encrypt the request's elements into their slots of the response. Each
+  // worker copies a chunk of its range out of the request, so that the chunk
+  // can be re-encrypted as one batch.
+  const int num_threads = num_threads_;
+  absl::Status status = ParallelFor(
+      num_threads, num_client_elements,
+      [&](int, int64_t begin, int64_t end) -> absl::Status {
+        std::vector<std::string> chunk;
+        for (int64_t offset = begin; offset < end;
+             offset += kReEncryptChunkSize) {
+          const int64_t chunk_end = std::min(offset + kReEncryptChunkSize, end);
+          chunk.assign(encrypted_elements.begin() + offset,
+                       encrypted_elements.begin() + chunk_end);
+          ASSIGN_OR_RETURN(std::vector<std::string> reencrypted,
+                           cipher_->ReEncryptBatch(chunk, encoding));
+          for (int64_t i = offset; i < chunk_end; i++) {
+            *elements.Mutable(static_cast<int>(i)) =
+                std::move(reencrypted[i - offset]);
+          }
+        }
+        return absl::OkStatus();
+      });
+  if (!status.ok()) {
+    return status;
   }
 
   // sort the resulting ciphertexts if we want to hide the intersection from the
   // client.
   if (!reveal_intersection) {
-    // Get mutable reference to encrypted_elements array and sort it.
-    auto& elements = *(response.mutable_encrypted_elements());
-    std::sort(elements.begin(), elements.end());
+    // Sort the string pointers rather than swapping the strings themselves.
+    ParallelSort(elements.pointer_begin(), elements.pointer_end(), num_threads,
+                 [](const std::string* a, const std::string* b) {
+                   return *a < *b;
+                 });
   }
   return response;
 }
@@ -195,7 +371,7 @@ StatusOr<psi_proto::Response> PsiServer::ProcessRequest(
  * @return The private key as a null-terminated binary string
  */
 std::string PsiServer::GetPrivateKeyBytes() const {
-  std::string key = ec_cipher_->GetPrivateKeyBytes();
+  std::string key = cipher_->GetPrivateKeyBytes();
   key.insert(key.begin(), 32 - key.length(), '\0');
   return key;
 }
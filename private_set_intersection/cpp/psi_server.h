@@ -17,9 +17,12 @@
 #ifndef PRIVATE_SET_INTERSECTION_CPP_PSI_SERVER_H_
 #define PRIVATE_SET_INTERSECTION_CPP_PSI_SERVER_H_
 
+#include <memory>
+#include <vector>
+
 #include "absl/status/statusor.h"
 #include "absl/types/span.h"
-#include "private_join_and_compute/crypto/ec_commutative_cipher.h"
+#include "private_set_intersection/cpp/crypto/batch_cipher.h"
 #include "private_set_intersection/cpp/datastructure/datastructure.h"
 #include "private_set_intersection/proto/psi.pb.h"
 
@@ -37,9 +40,22 @@ class PsiServer {
   // `reveal_intersection` indicates whether the client should learn the
   // intersection or only its size.
   //
-  // Returns INTERNAL if any OpenSSL crypto operations fail.
+  // `num_threads` sets how many threads encrypt, re-encrypt and sort elements
+  // in `CreateSetupMessage` and `ProcessRequest`. The threads share one
+  // immutable cipher, and the output does not depend on the thread count. A
+  // non-positive value uses one thread per hardware core.
+  //
+  // `cipher_suite` selects the curve and hash the elements are encrypted with,
+  // which must be those of the client. CIPHER_SUITE_SM2_SM3 is needed for GM/T
+  // compliance. CIPHER_SUITE_P256_SHA256 encrypts each element with
+  // `ECCommutativeCipher` on BoringSSL's P-256 and SHA-256, for clients that
+  // cannot use SM2.
+  //
+  // Returns INVALID_ARGUMENT if `cipher_suite` is unknown, or INTERNAL if any
+  // OpenSSL crypto operations fail.
   static StatusOr<std::unique_ptr<PsiServer>> CreateWithNewKey(
-      bool reveal_intersection);
+      bool reveal_intersection, int num_threads = 1,
+      psi_proto::CipherSuite cipher_suite = psi_proto::CIPHER_SUITE_SM2_SM3);
 
   // Creates and returns a new server instance with the provided private key. If
   // `reveal_intersection` indicates whether the client should learn the
@@ -50,9 +66,15 @@ class PsiServer {
   // requests can reveal information about the input sets. If in doubt, use
   // `CreateWithNewKey`.
   //
-  // Returns INTERNAL if any OpenSSL crypto operations fail.
+  // See `CreateWithNewKey` for the meaning of `num_threads` and
+  // `cipher_suite`.
+  //
+  // Returns INVALID_ARGUMENT if `cipher_suite` is unknown or `key_bytes` is not
+  // a key of its curve, or INTERNAL if any OpenSSL crypto operations fail.
   static StatusOr<std::unique_ptr<PsiServer>> CreateFromKey(
-      const std::string& key_bytes, bool reveal_intersection);
+      const std::string& key_bytes, bool reveal_intersection,
+      int num_threads = 1,
+      psi_proto::CipherSuite cipher_suite = psi_proto::CIPHER_SUITE_SM2_SM3);
 
   // Creates a setup message from the server's dataset to be sent to the client.
   // The setup message is a set containing `H(x)^s` for each element `x` in
@@ -71,7 +93,22 @@ class PsiServer {
   // structure. If the number of client elements is expected to be orders of
   // magnitude lower than the number of server elements, then Bloom Filters may
   // be faster. Otherwise, Golomb Compressed Sets can achieve better
-  // compression, so it is better for network transfer.
+  // compression, so it is better for network transfer. Blocked Bloom Filters
+  // are slightly larger than Bloom Filters for the same `fpr`, but a lookup
+  // reads a single cache line, which is much faster for large filters. Binary
+  // fuse filters are the smallest of the filters and a lookup reads three
+  // fingerprints, but they only support an `fpr` of at least 2^-32 per client
+  // element, that is `fpr / num_client_inputs >= 2^-32`. Elias-Fano coded sets
+  // are about as small as Golomb Compressed Sets, but the client looks up each
+  // of its elements directly instead of decoding the whole set, which is much
+  // faster when the client has far fewer elements than the server. rANS coded
+  // sets are the smallest of all, within a few hundredths of a bit per element
+  // of the entropy of the set, and decode about as fast as a whole GCS. Raw
+  // fingerprints send the sorted fingerprints of the encrypted elements,
+  // truncated to the fewest bytes that keep the `fpr`. They are larger than
+  // the compressed sets but need no decoding, and with a small `fpr` are as
+  // good as exact at a fraction of the size of DataStructure::Raw. They
+  // support an `fpr` of at least 2^-128 per client element.
   //
   // NOTE: If DataStructure::Raw is specified, the protocol will use raw
   // encrypted values and intersection calculations will not have false
@@ -79,24 +116,33 @@ class PsiServer {
   // of larger communication costs. Specifying DataStructure::Raw is useful if
   // you must have correctness.
   //
-  // Returns INTERNAL if encryption fails.
+  // The elements are encrypted into `point_encoding`, which must be the
+  // encoding of the client's requests. POINT_ENCODING_X_ONLY saves a byte per
+  // element of a Raw setup and of every request and response, and the server
+  // and client skip recovering the sign of y when decoding elements.
+  //
+  // Returns INVALID_ARGUMENT if `point_encoding` is unknown, or INTERNAL if
+  // encryption fails.
   StatusOr<psi_proto::ServerSetup> CreateSetupMessage(
       double fpr, int64_t num_client_inputs,
       absl::Span<const std::string> inputs,
-      DataStructure ds = DataStructure::Gcs) const;
+      DataStructure ds = DataStructure::Gcs,
+      psi_proto::PointEncoding point_encoding =
+          psi_proto::POINT_ENCODING_COMPRESSED) const;
 
   // Processes a client query and returns the corresponding server response to
   // be sent to the client. For each encrytped element `H(x)^c` in the decoded
   // `client_request`, computes `(H(x)^c)^s = H(X)^(cs)` and returns these as an
-  // array inside a protobuf.
+  // array inside a protobuf, in the point encoding of the request.
   //
   // If `reveal_intersection` == false, the resulting array is sorted, which
   // prevents the client from matching the individual response elements to the
   // ones in the request, ensuring that they can only learn the intersection
   // size but not individual elements in the intersection.
   //
-  // Returns INVALID_ARGUMENT if the request is malformed or if
-  // reveal_intersection != client_request["reveal_intersection"].
+  // Returns INVALID_ARGUMENT if the request is malformed, if its point
+  // encoding is unknown, if it is of another cipher suite than the server or
+  // if reveal_intersection != client_request["reveal_intersection"].
   StatusOr<psi_proto::Response> ProcessRequest(
       const psi_proto::Request& client_request) const;
 
@@ -105,12 +151,14 @@ class PsiServer {
   std::string GetPrivateKeyBytes() const;
 
  private:
-  explicit PsiServer(
-      std::unique_ptr<::private_join_and_compute::ECCommutativeCipher>
-          ec_cipher,
-      bool reveal_intersection);
+  PsiServer(std::unique_ptr<BatchCipher> cipher,
+            psi_proto::CipherSuite cipher_suite, bool reveal_intersection,
+            int num_threads);
 
-  std::unique_ptr<::private_join_and_compute::ECCommutativeCipher> ec_cipher_;
+  // Shared by all worker threads.
+  std::unique_ptr<BatchCipher> cipher_;
+  psi_proto::CipherSuite cipher_suite_;
+  int num_threads_;
   bool reveal_intersection;
 };
 
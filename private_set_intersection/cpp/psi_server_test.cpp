@@ -66,18 +66,58 @@ TEST_F(PsiServerTest, TestCorrectnessIntersection) {
       auto server_setup2,
       server_->CreateSetupMessage(fpr, num_client_elements, server_elements,
                                   DataStructure::BloomFilter));
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto server_setup3,
+      server_->CreateSetupMessage(fpr, num_client_elements, server_elements,
+                                  DataStructure::BlockedBloomFilter));
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto server_setup4,
+      server_->CreateSetupMessage(fpr, num_client_elements, server_elements,
+                                  DataStructure::BinaryFuseFilter));
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto server_setup5,
+      server_->CreateSetupMessage(fpr, num_client_elements, server_elements,
+                                  DataStructure::EliasFano));
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto server_setup6,
+      server_->CreateSetupMessage(fpr, num_client_elements, server_elements,
+                                  DataStructure::RansSet));
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto server_setup7,
+      server_->CreateSetupMessage(fpr, num_client_elements, server_elements,
+                                  DataStructure::RawFingerprints));
 
   // Create Client request.
   PSI_ASSERT_OK_AND_ASSIGN(auto client_request,
                            client->CreateRequest(client_elements));
   PSI_ASSERT_OK_AND_ASSIGN(auto client_request2,
                            client->CreateRequest(client_elements));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request3,
+                           client->CreateRequest(client_elements));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request4,
+                           client->CreateRequest(client_elements));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request5,
+                           client->CreateRequest(client_elements));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request6,
+                           client->CreateRequest(client_elements));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request7,
+                           client->CreateRequest(client_elements));
 
   // Create Server response.
   PSI_ASSERT_OK_AND_ASSIGN(auto server_response,
                            server_->ProcessRequest(client_request));
   PSI_ASSERT_OK_AND_ASSIGN(auto server_response2,
                            server_->ProcessRequest(client_request2));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response3,
+                           server_->ProcessRequest(client_request3));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response4,
+                           server_->ProcessRequest(client_request4));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response5,
+                           server_->ProcessRequest(client_request5));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response6,
+                           server_->ProcessRequest(client_request6));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response7,
+                           server_->ProcessRequest(client_request7));
 
   // Compute intersection.
   PSI_ASSERT_OK_AND_ASSIGN(
@@ -90,15 +130,50 @@ TEST_F(PsiServerTest, TestCorrectnessIntersection) {
       client->GetIntersection(server_setup2, server_response2));
   absl::flat_hash_set<int64_t> intersection_set2(intersection2.begin(),
                                                  intersection2.end());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<int64_t> intersection3,
+      client->GetIntersection(server_setup3, server_response3));
+  absl::flat_hash_set<int64_t> intersection_set3(intersection3.begin(),
+                                                 intersection3.end());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<int64_t> intersection4,
+      client->GetIntersection(server_setup4, server_response4));
+  absl::flat_hash_set<int64_t> intersection_set4(intersection4.begin(),
+                                                 intersection4.end());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<int64_t> intersection5,
+      client->GetIntersection(server_setup5, server_response5));
+  absl::flat_hash_set<int64_t> intersection_set5(intersection5.begin(),
+                                                 intersection5.end());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<int64_t> intersection6,
+      client->GetIntersection(server_setup6, server_response6));
+  absl::flat_hash_set<int64_t> intersection_set6(intersection6.begin(),
+                                                 intersection6.end());
+  PSI_ASSERT_OK_AND_ASSIGN(
+      std::vector<int64_t> intersection7,
+      client->GetIntersection(server_setup7, server_response7));
+  absl::flat_hash_set<int64_t> intersection_set7(intersection7.begin(),
+                                                 intersection7.end());
 
   // Test if all even elements are present.
   for (int i = 0; i < num_client_elements; i++) {
     if (i % 2) {
       EXPECT_FALSE(intersection_set.contains(i));
       EXPECT_FALSE(intersection_set2.contains(i));
+      EXPECT_FALSE(intersection_set3.contains(i));
+      EXPECT_FALSE(intersection_set4.contains(i));
+      EXPECT_FALSE(intersection_set5.contains(i));
+      EXPECT_FALSE(intersection_set6.contains(i));
+      EXPECT_FALSE(intersection_set7.contains(i));
     } else {
       EXPECT_TRUE(intersection_set.contains(i));
       EXPECT_TRUE(intersection_set2.contains(i));
+      EXPECT_TRUE(intersection_set3.contains(i));
+      EXPECT_TRUE(intersection_set4.contains(i));
+      EXPECT_TRUE(intersection_set5.contains(i));
+      EXPECT_TRUE(intersection_set6.contains(i));
+      EXPECT_TRUE(intersection_set7.contains(i));
     }
   }
 }
@@ -227,6 +302,214 @@ TEST_F(PsiServerTest, TestCreatingFromKey) {
   EXPECT_EQ(server_setup2.gcs().bits(), server_setup3.gcs().bits());
 }
 
+TEST_F(PsiServerTest, TestMultiThreadedMatchesSingleThreaded) {
+  for (bool reveal_intersection : {true, false}) {
+    SetUp(reveal_intersection);
+    const std::string key_bytes = server_->GetPrivateKeyBytes();
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto parallel_server,
+        PsiServer::CreateFromKey(key_bytes, reveal_intersection, 4));
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto client, PsiClient::CreateWithNewKey(reveal_intersection));
+
+    int num_client_elements = 1000, num_server_elements = 1000;
+    double fpr = 0.01;
+    std::vector<std::string> client_elements(num_client_elements);
+    std::vector<std::string> server_elements(num_server_elements);
+    for (int i = 0; i < num_client_elements; i++) {
+      client_elements[i] = absl::StrCat("Element ", i);
+    }
+    for (int i = 0; i < num_server_elements; i++) {
+      server_elements[i] = absl::StrCat("Element ", 2 * i);
+    }
+
+    // The setup must not depend on the number of threads.
+    for (auto ds : {DataStructure::Raw, DataStructure::Gcs,
+                    DataStructure::BloomFilter,
+                    DataStructure::BlockedBloomFilter,
+                    DataStructure::BinaryFuseFilter,
+                    DataStructure::EliasFano, DataStructure::RansSet,
+                    DataStructure::RawFingerprints}) {
+      PSI_ASSERT_OK_AND_ASSIGN(
+          auto server_setup,
+          server_->CreateSetupMessage(fpr, num_client_elements,
+                                      server_elements, ds));
+      PSI_ASSERT_OK_AND_ASSIGN(
+          auto parallel_server_setup,
+          parallel_server->CreateSetupMessage(fpr, num_client_elements,
+                                              server_elements, ds));
+      EXPECT_EQ(server_setup.SerializeAsString(),
+                parallel_server_setup.SerializeAsString());
+    }
+
+    // Neither must the response, both in request order and sorted.
+    PSI_ASSERT_OK_AND_ASSIGN(auto client_request,
+                             client->CreateRequest(client_elements));
+    PSI_ASSERT_OK_AND_ASSIGN(auto server_response,
+                             server_->ProcessRequest(client_request));
+    PSI_ASSERT_OK_AND_ASSIGN(auto parallel_server_response,
+                             parallel_server->ProcessRequest(client_request));
+    EXPECT_EQ(server_response.SerializeAsString(),
+              parallel_server_response.SerializeAsString());
+  }
+}
+
+TEST_F(PsiServerTest, TestXOnlyPointEncoding) {
+  SetUp(true);
+  PSI_ASSERT_OK_AND_ASSIGN(auto client, PsiClient::CreateWithNewKey(true));
+  std::vector<std::string> client_elements;
+  std::vector<std::string> server_elements;
+  for (int i = 0; i < 1000; i++) {
+    client_elements.push_back(absl::StrCat("Element ", i));
+    server_elements.push_back(absl::StrCat("Element ", 2 * i));
+  }
+
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto client_request,
+      client->CreateRequest(client_elements, psi_proto::POINT_ENCODING_X_ONLY));
+  EXPECT_EQ(client_request.point_encoding(), psi_proto::POINT_ENCODING_X_ONLY);
+  for (const std::string& element : client_request.encrypted_elements()) {
+    EXPECT_EQ(element.size(), 32);
+  }
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response,
+                           server_->ProcessRequest(client_request));
+  EXPECT_EQ(server_response.point_encoding(),
+            psi_proto::POINT_ENCODING_X_ONLY);
+
+  for (DataStructure ds : {DataStructure::Raw, DataStructure::Gcs}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto server_setup,
+        server_->CreateSetupMessage(0.0001, 1000, server_elements, ds,
+                                    psi_proto::POINT_ENCODING_X_ONLY));
+    EXPECT_EQ(server_setup.point_encoding(), psi_proto::POINT_ENCODING_X_ONLY);
+    PSI_ASSERT_OK_AND_ASSIGN(
+        std::vector<int64_t> intersection,
+        client->GetIntersection(server_setup, server_response));
+    absl::flat_hash_set<int64_t> intersection_set(intersection.begin(),
+                                                  intersection.end());
+    for (int i = 0; i < 1000; i++) {
+      EXPECT_EQ(intersection_set.contains(i), i % 2 == 0);
+    }
+  }
+
+  // The setup and response must agree on the encoding.
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto compressed_setup,
+      server_->CreateSetupMessage(0.0001, 1000, server_elements,
+                                  DataStructure::Raw));
+  EXPECT_EQ(client->GetIntersection(compressed_setup, server_response)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  client_request.set_point_encoding(static_cast<psi_proto::PointEncoding>(7));
+  EXPECT_EQ(server_->ProcessRequest(client_request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(PsiServerTest, TestP256CipherSuite) {
+  const psi_proto::CipherSuite p256 = psi_proto::CIPHER_SUITE_P256_SHA256;
+  PSI_ASSERT_OK_AND_ASSIGN(auto server,
+                           PsiServer::CreateWithNewKey(true, 1, p256));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client,
+                           PsiClient::CreateWithNewKey(true, 1, p256));
+  std::vector<std::string> client_elements;
+  std::vector<std::string> server_elements;
+  for (int i = 0; i < 1000; i++) {
+    client_elements.push_back(absl::StrCat("Element ", i));
+    server_elements.push_back(absl::StrCat("Element ", 2 * i));
+  }
+
+  for (auto point_encoding : {psi_proto::POINT_ENCODING_COMPRESSED,
+                              psi_proto::POINT_ENCODING_X_ONLY}) {
+    PSI_ASSERT_OK_AND_ASSIGN(
+        auto client_request,
+        client->CreateRequest(client_elements, point_encoding));
+    EXPECT_EQ(client_request.cipher_suite(), p256);
+    PSI_ASSERT_OK_AND_ASSIGN(auto server_response,
+                             server->ProcessRequest(client_request));
+    for (DataStructure ds : {DataStructure::Raw, DataStructure::Gcs}) {
+      PSI_ASSERT_OK_AND_ASSIGN(
+          auto server_setup,
+          server->CreateSetupMessage(0.0001, 1000, server_elements, ds,
+                                     point_encoding));
+      EXPECT_EQ(server_setup.cipher_suite(), p256);
+      PSI_ASSERT_OK_AND_ASSIGN(
+          std::vector<int64_t> intersection,
+          client->GetIntersection(server_setup, server_response));
+      absl::flat_hash_set<int64_t> intersection_set(intersection.begin(),
+                                                    intersection.end());
+      for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(intersection_set.contains(i), i % 2 == 0);
+      }
+    }
+  }
+}
+
+TEST_F(PsiServerTest, FailIfCipherSuiteDoesntMatch) {
+  SetUp(true);
+  PSI_ASSERT_OK_AND_ASSIGN(
+      auto p256_client,
+      PsiClient::CreateWithNewKey(true, 1,
+                                  psi_proto::CIPHER_SUITE_P256_SHA256));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request,
+                           p256_client->CreateRequest({"a", "b"}));
+  EXPECT_THAT(server_->ProcessRequest(client_request),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       "Client uses cipher suite CIPHER_SUITE_P256_SHA256, "
+                       "but the server uses CIPHER_SUITE_SM2_SM3"));
+
+  // The client refuses setups of another suite.
+  PSI_ASSERT_OK_AND_ASSIGN(auto sm2_client, PsiClient::CreateWithNewKey(true));
+  PSI_ASSERT_OK_AND_ASSIGN(client_request,
+                           sm2_client->CreateRequest({"a", "b"}));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response,
+                           server_->ProcessRequest(client_request));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_setup,
+                           server_->CreateSetupMessage(0.001, 2, {"a"}));
+  EXPECT_EQ(server_setup.cipher_suite(), psi_proto::CIPHER_SUITE_SM2_SM3);
+  EXPECT_EQ(p256_client->GetIntersection(server_setup, server_response)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  PSI_ASSERT_OK_AND_ASSIGN(auto prepared_setup,
+                           PreparedSetup::Create(server_setup));
+  EXPECT_EQ(p256_client->GetIntersection(*prepared_setup, server_response)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  client_request.set_cipher_suite(static_cast<psi_proto::CipherSuite>(7));
+  EXPECT_EQ(server_->ProcessRequest(client_request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(PsiServerTest, FailIfCipherSuiteIsMissing) {
+  // Messages without a suite hashed to SM2 differently, and must not be
+  // mistaken for CIPHER_SUITE_SM2_SM3.
+  SetUp(true);
+  PSI_ASSERT_OK_AND_ASSIGN(auto client, PsiClient::CreateWithNewKey(true));
+  PSI_ASSERT_OK_AND_ASSIGN(auto client_request,
+                           client->CreateRequest({"a", "b"}));
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_response,
+                           server_->ProcessRequest(client_request));
+  client_request.clear_cipher_suite();
+  EXPECT_THAT(server_->ProcessRequest(client_request),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       "`client_request` has no cipher suite, so it is from "
+                       "an older client"));
+
+  PSI_ASSERT_OK_AND_ASSIGN(auto server_setup,
+                           server_->CreateSetupMessage(0.001, 2, {"a"}));
+  server_setup.clear_cipher_suite();
+  EXPECT_THAT(client->GetIntersection(server_setup, server_response),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       "`server_setup` has no cipher suite, so it is from an "
+                       "older server"));
+  EXPECT_EQ(PreparedSetup::Create(server_setup).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 TEST_F(PsiServerTest, FailIfRevealIntersectionDoesntMatch) {
   psi_proto::Request client_request;
 
@@ -0,0 +1,261 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef UTIL_PARALLEL_H_
+#define UTIL_PARALLEL_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "absl/status/status.h"
+
+namespace private_set_intersection {
+
+// Returns the number of worker threads to use for a requested `num_threads`.
+// Non-positive values select one thread per hardware core.
+inline int ResolveNumThreads(int num_threads) {
+  if (num_threads > 0) {
+    return num_threads;
+  }
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// Splits [0, `size`) into at most `num_threads` contiguous ranges of roughly
+// equal length and calls `fn(thread_index, begin, end)` once per range, each
+// on its own thread. `thread_index` is dense in [0, num_threads) so callers
+// can keep per-thread state in a vector. With a single range, `fn` runs on the
+// calling thread and no thread is spawned.
+//
+// Returns the first non-OK status in range order, or OK.
+inline absl::Status ParallelFor(
+    int num_threads, int64_t size,
+    const std::function<absl::Status(int, int64_t, int64_t)>& fn) {
+  if (size <= 0) {
+    return absl::OkStatus();
+  }
+  const int64_t num_ranges =
+      std::min<int64_t>(ResolveNumThreads(num_threads), size);
+  if (num_ranges == 1) {
+    return fn(0, 0, size);
+  }
+
+  std::vector<absl::Status> statuses(num_ranges);
+  std::vector<std::thread> threads;
+  threads.reserve(num_ranges - 1);
+  auto run = [&](int64_t t) {
+    statuses[t] = fn(static_cast<int>(t), size * t / num_ranges,
+                     size * (t + 1) / num_ranges);
+  };
+  for (int64_t t = 1; t < num_ranges; t++) {
+    threads.emplace_back(run, t);
+  }
+  run(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (const auto& status : statuses) {
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Sorts [first, last) with `comp` using up to `num_threads` threads: the range
+// is split into sorted runs which are then merged pairwise, one thread per
+// pair. The result is identical to `std::sort(first, last, comp)` for strict
+// weak orderings without equivalent-but-distinguishable elements.
+template <class RandomIt, class Compare>
+void ParallelSort(RandomIt first, RandomIt last, int num_threads,
+                  Compare comp) {
+  const int64_t size = static_cast<int64_t>(last - first);
+  // Below this size the threading overhead outweighs the speedup.
+  constexpr int64_t kMinRunLength = 1 << 12;
+  const int64_t num_runs = std::max<int64_t>(
+      1, std::min<int64_t>(ResolveNumThreads(num_threads),
+                           size / kMinRunLength));
+  if (num_runs == 1) {
+    std::sort(first, last, comp);
+    return;
+  }
+
+  std::vector<int64_t> bounds(num_runs + 1);
+  for (int64_t t = 0; t <= num_runs; t++) {
+    bounds[t] = size * t / num_runs;
+  }
+  // Sorting the runs cannot fail.
+  ParallelFor(static_cast<int>(num_runs), num_runs,
+              [&](int, int64_t begin, int64_t end) {
+                for (int64_t t = begin; t < end; t++) {
+                  std::sort(first + bounds[t], first + bounds[t + 1], comp);
+                }
+                return absl::OkStatus();
+              })
+      .IgnoreError();
+
+  // Merge neighbouring runs until a single run remains.
+  for (int64_t width = 1; width < num_runs; width *= 2) {
+    const int64_t num_merges = (num_runs + 2 * width - 1) / (2 * width);
+    ParallelFor(static_cast<int>(num_merges), num_merges,
+                [&](int, int64_t begin, int64_t end) {
+                  for (int64_t m = begin; m < end; m++) {
+                    const int64_t lo = 2 * width * m;
+                    const int64_t mid = std::min(lo + width, num_runs);
+                    const int64_t hi = std::min(lo + 2 * width, num_runs);
+                    if (mid < hi) {
+                      std::inplace_merge(first + bounds[lo],
+                                         first + bounds[mid],
+                                         first + bounds[hi], comp);
+                    }
+                  }
+                  return absl::OkStatus();
+                })
+        .IgnoreError();
+  }
+}
+
+template <class RandomIt>
+void ParallelSort(RandomIt first, RandomIt last, int num_threads) {
+  ParallelSort(first, last, num_threads, std::less<>());
+}
+
+// Sorts `values` in ascending order with a least-significant-digit radix sort
+// on 8-bit digits, using up to `num_threads` threads. Every pass counts the
+// digits of each thread's range, gives every (digit, thread) pair its slice
+// of the output in that order, and has each thread move its range to its
+// slices, which keeps the sort stable. Digits that all values share are
+// skipped, so values from a small range take few passes. The result is
+// identical to `std::sort`.
+template <class T>
+void ParallelRadixSort(std::vector<T>* values, int num_threads) {
+  static_assert(std::is_integral<T>::value, "Only integers are radix sorted");
+  using Key = std::make_unsigned_t<T>;
+  // Flipping the sign bit orders signed values like unsigned ones.
+  constexpr Key kFlip = std::is_signed<T>::value
+                            ? Key{1} << (8 * sizeof(T) - 1)
+                            : Key{0};
+  const int64_t size = static_cast<int64_t>(values->size());
+  // Below this size the passes cost more than comparisons.
+  constexpr int64_t kMinRadixSortSize = 1 << 10;
+  if (size < kMinRadixSortSize) {
+    std::sort(values->begin(), values->end());
+    return;
+  }
+  // Below this size per thread the threading overhead outweighs the speedup.
+  constexpr int64_t kMinRangeLength = 1 << 14;
+  const int num_ranges = static_cast<int>(std::max<int64_t>(
+      1, std::min<int64_t>(ResolveNumThreads(num_threads),
+                           size / kMinRangeLength)));
+
+  // The bits in which some value differs from the first one.
+  std::vector<Key> differences(num_ranges, 0);
+  const Key first = static_cast<Key>((*values)[0]);
+  // Comparing cannot fail.
+  ParallelFor(num_ranges, size,
+              [&](int thread, int64_t begin, int64_t end) {
+                Key difference = 0;
+                for (int64_t i = begin; i < end; i++) {
+                  difference |= static_cast<Key>((*values)[i]) ^ first;
+                }
+                differences[thread] = difference;
+                return absl::OkStatus();
+              })
+      .IgnoreError();
+  Key difference = 0;
+  for (Key thread_difference : differences) {
+    difference |= thread_difference;
+  }
+
+  std::vector<T> buffer(values->size());
+  T* from = values->data();
+  T* to = buffer.data();
+  std::vector<std::array<int64_t, 256>> offsets(num_ranges);
+  for (int shift = 0; shift < static_cast<int>(8 * sizeof(T)); shift += 8) {
+    if (((difference >> shift) & 0xff) == 0) {
+      continue;
+    }
+    auto digit = [&](T value) {
+      return ((static_cast<Key>(value) ^ kFlip) >> shift) & 0xff;
+    };
+    // Counting cannot fail.
+    ParallelFor(num_ranges, size,
+                [&](int thread, int64_t begin, int64_t end) {
+                  std::array<int64_t, 256>& counts = offsets[thread];
+                  counts.fill(0);
+                  for (int64_t i = begin; i < end; i++) {
+                    counts[digit(from[i])]++;
+                  }
+                  return absl::OkStatus();
+                })
+        .IgnoreError();
+    int64_t offset = 0;
+    for (int d = 0; d < 256; d++) {
+      for (int thread = 0; thread < num_ranges; thread++) {
+        const int64_t count = offsets[thread][d];
+        offsets[thread][d] = offset;
+        offset += count;
+      }
+    }
+    // Scattering cannot fail.
+    ParallelFor(num_ranges, size,
+                [&](int thread, int64_t begin, int64_t end) {
+                  std::array<int64_t, 256>& next = offsets[thread];
+                  for (int64_t i = begin; i < end; i++) {
+                    to[next[digit(from[i])]++] = from[i];
+                  }
+                  return absl::OkStatus();
+                })
+        .IgnoreError();
+    std::swap(from, to);
+  }
+  if (from != values->data()) {
+    values->swap(buffer);
+  }
+}
+
+// ORs `mask` into `*byte` or `*word` atomically, for threads that set bits of
+// a shared array.
+inline void AtomicOr(char* byte, char mask) {
+#if defined(_MSC_VER)
+  _InterlockedOr8(byte, mask);
+#else
+  __atomic_fetch_or(byte, mask, __ATOMIC_RELAXED);
+#endif
+}
+
+inline void AtomicOr(uint64_t* word, uint64_t mask) {
+#if defined(_MSC_VER)
+  _InterlockedOr64(reinterpret_cast<volatile __int64*>(word),
+                   static_cast<__int64>(mask));
+#else
+  __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+#endif
+}
+
+}  // namespace private_set_intersection
+
+#endif  // UTIL_PARALLEL_H_
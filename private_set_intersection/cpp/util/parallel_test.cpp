@@ -0,0 +1,119 @@
+//
+// Copyright 2020 the authors listed in CONTRIBUTORS.md
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "private_set_intersection/cpp/util/parallel.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace private_set_intersection {
+namespace {
+
+TEST(ParallelTest, TestParallelForCoversRange) {
+  for (int num_threads : {1, 2, 3, 8}) {
+    std::vector<int> visited(1000, 0);
+    std::vector<int> owner(1000, -1);
+    auto status = ParallelFor(
+        num_threads, static_cast<int64_t>(visited.size()),
+        [&](int thread, int64_t begin, int64_t end) {
+          for (int64_t i = begin; i < end; i++) {
+            visited[i]++;
+            owner[i] = thread;
+          }
+          return absl::OkStatus();
+        });
+    ASSERT_TRUE(status.ok());
+    for (size_t i = 0; i < visited.size(); i++) {
+      EXPECT_EQ(visited[i], 1);
+      EXPECT_GE(owner[i], 0);
+      EXPECT_LT(owner[i], num_threads);
+    }
+    // Ranges are contiguous and ordered by thread index.
+    EXPECT_TRUE(std::is_sorted(owner.begin(), owner.end()));
+  }
+}
+
+TEST(ParallelTest, TestParallelForReturnsFirstError) {
+  auto status = ParallelFor(4, 100, [](int thread, int64_t, int64_t) {
+    if (thread >= 2) {
+      return absl::InternalError(thread == 2 ? "first" : "second");
+    }
+    return absl::OkStatus();
+  });
+  EXPECT_EQ(status.code(), absl::StatusCode::kInternal);
+  EXPECT_EQ(status.message(), "first");
+}
+
+TEST(ParallelTest, TestParallelForEmptyRange) {
+  bool called = false;
+  auto status = ParallelFor(4, 0, [&](int, int64_t, int64_t) {
+    called = true;
+    return absl::OkStatus();
+  });
+  EXPECT_TRUE(status.ok());
+  EXPECT_FALSE(called);
+}
+
+TEST(ParallelTest, TestParallelSortMatchesSort) {
+  std::mt19937_64 rng(42);
+  for (int num_threads : {1, 2, 3, 7}) {
+    std::vector<std::string> values(100000);
+    for (auto& value : values) {
+      value = std::to_string(rng());
+    }
+    std::vector<std::string> expected = values;
+    std::sort(expected.begin(), expected.end());
+
+    ParallelSort(values.begin(), values.end(), num_threads);
+    EXPECT_EQ(values, expected);
+  }
+}
+
+TEST(ParallelTest, TestParallelRadixSortMatchesSort) {
+  std::mt19937_64 rng(42);
+  for (int num_threads : {1, 2, 3, 7}) {
+    // Full-width values, values sharing their high and low bytes, and values
+    // with every digit equal but the sign.
+    for (uint64_t mask : {~uint64_t{0}, uint64_t{0xffffff00}, uint64_t{0}}) {
+      std::vector<int64_t> values(100000);
+      for (auto& value : values) {
+        value = static_cast<int64_t>((rng() & mask) |
+                                     (rng() & 1 ? uint64_t{1} << 63 : 0));
+      }
+      std::vector<uint64_t> unsigned_values(values.begin(), values.end());
+      std::vector<int64_t> expected = values;
+      std::sort(expected.begin(), expected.end());
+      std::vector<uint64_t> unsigned_expected = unsigned_values;
+      std::sort(unsigned_expected.begin(), unsigned_expected.end());
+
+      ParallelRadixSort(&values, num_threads);
+      EXPECT_EQ(values, expected);
+      ParallelRadixSort(&unsigned_values, num_threads);
+      EXPECT_EQ(unsigned_values, unsigned_expected);
+    }
+  }
+
+  std::vector<int64_t> small = {3, -1, 2};
+  ParallelRadixSort(&small, 4);
+  EXPECT_EQ(small, std::vector<int64_t>({-1, 2, 3}));
+}
+
+}  // namespace
+}  // namespace private_set_intersection
@@ -11,9 +11,14 @@ type DataStructure int
 
 // Golang's way to define enums that are compatible with our C bindings
 const (
-	Raw         DataStructure = C.Raw
-	Gcs                       = C.Gcs
-	BloomFilter               = C.BloomFilter
+	Raw                DataStructure = C.Raw
+	Gcs                              = C.Gcs
+	BloomFilter                      = C.BloomFilter
+	BlockedBloomFilter               = C.BlockedBloomFilter
+	BinaryFuseFilter                 = C.BinaryFuseFilter
+	EliasFano                        = C.EliasFano
+	RansSet                          = C.RansSet
+	RawFingerprints                  = C.RawFingerprints
 )
 
 func (ds DataStructure) String() string {
@@ -24,6 +29,16 @@ func (ds DataStructure) String() string {
 		return "gcs"
 	case BloomFilter:
 		return "bloomfilter"
+	case BlockedBloomFilter:
+		return "blockedbloomfilter"
+	case BinaryFuseFilter:
+		return "binaryfusefilter"
+	case EliasFano:
+		return "eliasfano"
+	case RansSet:
+		return "ransset"
+	case RawFingerprints:
+		return "rawfingerprints"
 	default:
 		panic("impossible")
 	}
@@ -102,9 +102,19 @@ func TestIntegrationIntersection(t *testing.T) {
 		{true, psi_ds.Raw},
 		{true, psi_ds.Gcs},
 		{true, psi_ds.BloomFilter},
+		{true, psi_ds.BlockedBloomFilter},
+		{true, psi_ds.BinaryFuseFilter},
+		{true, psi_ds.EliasFano},
+		{true, psi_ds.RansSet},
+		{true, psi_ds.RawFingerprints},
 		{false, psi_ds.Raw},
 		{false, psi_ds.Gcs},
 		{false, psi_ds.BloomFilter},
+		{false, psi_ds.BlockedBloomFilter},
+		{false, psi_ds.BinaryFuseFilter},
+		{false, psi_ds.EliasFano},
+		{false, psi_ds.RansSet},
+		{false, psi_ds.RawFingerprints},
 	}
 	for _, tc := range testCases {
 		client, err := psi_client.CreateWithNewKey(tc.revealIntersection)
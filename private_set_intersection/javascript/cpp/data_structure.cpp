@@ -6,5 +6,10 @@ EMSCRIPTEN_BINDINGS(PSI_DataStructure) {
   emscripten::enum_<DataStructure>("DataStructure")
       .value("Raw", DataStructure::Raw)
       .value("GCS", DataStructure::Gcs)
-      .value("BloomFilter", DataStructure::BloomFilter);
+      .value("BloomFilter", DataStructure::BloomFilter)
+      .value("BlockedBloomFilter", DataStructure::BlockedBloomFilter)
+      .value("BinaryFuseFilter", DataStructure::BinaryFuseFilter)
+      .value("EliasFano", DataStructure::EliasFano)
+      .value("RansSet", DataStructure::RansSet)
+      .value("RawFingerprints", DataStructure::RawFingerprints);
 }
@@ -67,6 +67,11 @@ declare module 'psi_*' {
     readonly Raw: any
     readonly GCS: any
     readonly BloomFilter: any
+    readonly BlockedBloomFilter: any
+    readonly BinaryFuseFilter: any
+    readonly EliasFano: any
+    readonly RansSet: any
+    readonly RawFingerprints: any
   }
 
   export type Library = {
@@ -55,6 +55,71 @@ const DataStructureConstructor = (library: psi.Library): psi.DataStructure => {
        * @typedef {DataStructure.BloomFilter} DataStructure.BloomFilter
        */
       return DataStructure.BloomFilter
+    },
+    /**
+     * Get the 'BlockedBloomFilter' enum
+     *
+     * @function
+     * @name DataStructure.BlockedBloomFilter
+     * @type {DataStructure.BlockedBloomFilter}
+     */
+    get BlockedBloomFilter(): psi.DataStructure {
+      /**
+       * @typedef {DataStructure.BlockedBloomFilter} DataStructure.BlockedBloomFilter
+       */
+      return DataStructure.BlockedBloomFilter
+    },
+    /**
+     * Get the 'BinaryFuseFilter' enum
+     *
+     * @function
+     * @name DataStructure.BinaryFuseFilter
+     * @type {DataStructure.BinaryFuseFilter}
+     */
+    get BinaryFuseFilter(): psi.DataStructure {
+      /**
+       * @typedef {DataStructure.BinaryFuseFilter} DataStructure.BinaryFuseFilter
+       */
+      return DataStructure.BinaryFuseFilter
+    },
+    /**
+     * Get the 'EliasFano' enum
+     *
+     * @function
+     * @name DataStructure.EliasFano
+     * @type {DataStructure.EliasFano}
+     */
+    get EliasFano(): psi.DataStructure {
+      /**
+       * @typedef {DataStructure.EliasFano} DataStructure.EliasFano
+       */
+      return DataStructure.EliasFano
+    },
+    /**
+     * Get the 'RansSet' enum
+     *
+     * @function
+     * @name DataStructure.RansSet
+     * @type {DataStructure.RansSet}
+     */
+    get RansSet(): psi.DataStructure {
+      /**
+       * @typedef {DataStructure.RansSet} DataStructure.RansSet
+       */
+      return DataStructure.RansSet
+    },
+    /**
+     * Get the 'RawFingerprints' enum
+     *
+     * @function
+     * @name DataStructure.RawFingerprints
+     * @type {DataStructure.RawFingerprints}
+     */
+    get RawFingerprints(): psi.DataStructure {
+      /**
+       * @typedef {DataStructure.RawFingerprints} DataStructure.RawFingerprints
+       */
+      return DataStructure.RawFingerprints
     }
   }
 }
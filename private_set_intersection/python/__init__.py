@@ -18,6 +18,11 @@ class DataStructure(Enum):
     RAW = psi.data_structure.Raw
     GCS = psi.data_structure.GCS
     BLOOM_FILTER = psi.data_structure.BloomFilter
+    BLOCKED_BLOOM_FILTER = psi.data_structure.BlockedBloomFilter
+    BINARY_FUSE_FILTER = psi.data_structure.BinaryFuseFilter
+    ELIAS_FANO = psi.data_structure.EliasFano
+    RANS_SET = psi.data_structure.RansSet
+    RAW_FINGERPRINTS = psi.data_structure.RawFingerprints
 
 
 class client:
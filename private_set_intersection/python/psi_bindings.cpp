@@ -47,7 +47,12 @@ void bind(pybind11::module& m) {
   py::enum_<psi::DataStructure>(m, "data_structure", py::arithmetic())
       .value("Raw", psi::DataStructure::Raw)
       .value("GCS", psi::DataStructure::Gcs)
-      .value("BloomFilter", psi::DataStructure::BloomFilter);
+      .value("BloomFilter", psi::DataStructure::BloomFilter)
+      .value("BlockedBloomFilter", psi::DataStructure::BlockedBloomFilter)
+      .value("BinaryFuseFilter", psi::DataStructure::BinaryFuseFilter)
+      .value("EliasFano", psi::DataStructure::EliasFano)
+      .value("RansSet", psi::DataStructure::RansSet)
+      .value("RawFingerprints", psi::DataStructure::RawFingerprints);
 
   py::class_<psi_proto::ServerSetup>(m, "cpp_proto_server_setup")
       .def(py::init<>())
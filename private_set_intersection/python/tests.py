@@ -30,7 +30,17 @@ def test_static_key():
 
 @pytest.mark.parametrize("reveal_intersection", [False, True])
 @pytest.mark.parametrize(
-    "ds", [psi.DataStructure.RAW, psi.DataStructure.GCS, psi.DataStructure.BLOOM_FILTER]
+    "ds",
+    [
+        psi.DataStructure.RAW,
+        psi.DataStructure.GCS,
+        psi.DataStructure.BLOOM_FILTER,
+        psi.DataStructure.BLOCKED_BLOOM_FILTER,
+        psi.DataStructure.BINARY_FUSE_FILTER,
+        psi.DataStructure.ELIAS_FANO,
+        psi.DataStructure.RANS_SET,
+        psi.DataStructure.RAW_FINGERPRINTS,
+    ],
 )
 def test_integration(ds, reveal_intersection):
     c = psi.client.CreateWithNewKey(reveal_intersection)
@@ -6,4 +6,9 @@ pub enum PsiDataStructure {
     #[default]
     Gcs,
     BloomFilter,
+    BlockedBloomFilter,
+    BinaryFuseFilter,
+    EliasFano,
+    RansSet,
+    RawFingerprints,
 }
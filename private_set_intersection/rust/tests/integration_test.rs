@@ -32,6 +32,11 @@ fn integration_test() {
             datastructure::PsiDataStructure::Raw,
             datastructure::PsiDataStructure::Gcs,
             datastructure::PsiDataStructure::BloomFilter,
+            datastructure::PsiDataStructure::BlockedBloomFilter,
+            datastructure::PsiDataStructure::BinaryFuseFilter,
+            datastructure::PsiDataStructure::EliasFano,
+            datastructure::PsiDataStructure::RansSet,
+            datastructure::PsiDataStructure::RawFingerprints,
         ] {
             let client = client::PsiClient::create_with_new_key(reveal).unwrap();
             let server = server::PsiServer::create_with_new_key(reveal).unwrap();